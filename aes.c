@@ -0,0 +1,849 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "aes.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <CommonCrypto/CommonCryptor.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#include "image.h"
+
+/* The number of blocks in a page. */
+#define kAESPageBlocks (kImagePageSize / kAESBlockSize)
+
+/* The S-box, its inverse and the round tables, computed on first use. */
+static uint8_t sbox[256];
+static uint8_t inverseSbox[256];
+static uint32_t encryptTable[4][256];
+static uint32_t decryptTable[4][256];
+static pthread_once_t tablesOnce = PTHREAD_ONCE_INIT;
+
+/* Multiplies by x in GF(2^8). */
+static inline uint8_t Double(uint8_t value) {
+    return (uint8_t) ((value << 1) ^ (value & 0x80 ? 0x1b : 0));
+}
+
+/* Multiplies two elements of GF(2^8). */
+static uint8_t Multiply(uint8_t a, uint8_t b) {
+    uint8_t product = 0;
+    while (b) {
+        if (b & 1) {
+            product ^= a;
+        }
+        a = Double(a);
+        b >>= 1;
+    }
+    return product;
+}
+
+static inline uint32_t RotateRight(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void AESInitTables(void) {
+    // Walk the multiplicative group with generator 3 and its inverse to
+    // compute the inverse of each element, then apply the affine transform
+    uint8_t p = 1;
+    uint8_t q = 1;
+    do {
+        p = p ^ Double(p);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        uint8_t x = q ^ (uint8_t) ((q << 1) | (q >> 7)) ^
+                    (uint8_t) ((q << 2) | (q >> 6)) ^
+                    (uint8_t) ((q << 3) | (q >> 5)) ^
+                    (uint8_t) ((q << 4) | (q >> 4));
+        sbox[p] = x ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (int i = 0; i < 256; i++) {
+        inverseSbox[sbox[i]] = (uint8_t) i;
+    }
+
+    // Combine SubBytes and MixColumns of one byte into a column
+    for (int i = 0; i < 256; i++) {
+        uint8_t s = sbox[i];
+        uint32_t column = ((uint32_t) Double(s) << 24) | (s << 16) |
+                          (s << 8) | (Double(s) ^ s);
+        uint8_t t = inverseSbox[i];
+        uint32_t inverse = ((uint32_t) Multiply(t, 14) << 24) |
+                           (Multiply(t, 9) << 16) |
+                           (Multiply(t, 13) << 8) |
+                           Multiply(t, 11);
+        for (int j = 0; j < 4; j++) {
+            encryptTable[j][i] = j ? RotateRight(column, 8 * j) : column;
+            decryptTable[j][i] = j ? RotateRight(inverse, 8 * j) : inverse;
+        }
+    }
+}
+
+static inline uint32_t LoadWord(const uint8_t *bytes) {
+    return ((uint32_t) bytes[0] << 24) | (bytes[1] << 16) |
+           (bytes[2] << 8) | bytes[3];
+}
+
+static inline void StoreWord(uint8_t *bytes, uint32_t word) {
+    bytes[0] = (uint8_t) (word >> 24);
+    bytes[1] = (uint8_t) (word >> 16);
+    bytes[2] = (uint8_t) (word >> 8);
+    bytes[3] = (uint8_t) word;
+}
+
+static inline uint32_t SubWord(uint32_t word) {
+    return ((uint32_t) sbox[word >> 24] << 24) |
+           (sbox[(word >> 16) & 0xff] << 16) |
+           (sbox[(word >> 8) & 0xff] << 8) |
+           sbox[word & 0xff];
+}
+
+int AESKeyInit(AESKey *key, const uint8_t *bytes, size_t length) {
+    if (length != 16 && length != 32) {
+        return -1;
+    }
+    pthread_once(&tablesOnce, AESInitTables);
+
+    size_t words = length / 4;
+    key->rounds = (int) words + 6;
+    key->length = length;
+    memcpy(key->bytes, bytes, length);
+
+    // Expand the key
+    uint32_t *w = key->encrypt;
+    size_t total = 4 * (key->rounds + 1);
+    uint8_t rcon = 1;
+    for (size_t i = 0; i < words; i++) {
+        w[i] = LoadWord(bytes + 4 * i);
+    }
+    for (size_t i = words; i < total; i++) {
+        uint32_t temp = w[i - 1];
+        if (i % words == 0) {
+            temp = SubWord((temp << 8) | (temp >> 24)) ^
+                   ((uint32_t) rcon << 24);
+            rcon = Double(rcon);
+        } else if (words > 6 && i % words == 4) {
+            temp = SubWord(temp);
+        }
+        w[i] = w[i - words] ^ temp;
+    }
+
+    // Reverse the round keys and apply InvMixColumns to the inner ones
+    uint32_t *d = key->decrypt;
+    for (int round = 0; round <= key->rounds; round++) {
+        for (int j = 0; j < 4; j++) {
+            uint32_t word = w[4 * (key->rounds - round) + j];
+            if (round > 0 && round < key->rounds) {
+                word = decryptTable[0][sbox[word >> 24]] ^
+                       decryptTable[1][sbox[(word >> 16) & 0xff]] ^
+                       decryptTable[2][sbox[(word >> 8) & 0xff]] ^
+                       decryptTable[3][sbox[word & 0xff]];
+            }
+            d[4 * round + j] = word;
+        }
+    }
+    return 0;
+}
+
+void AESEncryptBlock(const AESKey *key, const uint8_t *in, uint8_t *out) {
+    const uint32_t *rk = key->encrypt;
+    uint32_t s0 = LoadWord(in) ^ rk[0];
+    uint32_t s1 = LoadWord(in + 4) ^ rk[1];
+    uint32_t s2 = LoadWord(in + 8) ^ rk[2];
+    uint32_t s3 = LoadWord(in + 12) ^ rk[3];
+
+    for (int round = 1; round < key->rounds; round++) {
+        rk += 4;
+        uint32_t t0 = encryptTable[0][s0 >> 24] ^
+                      encryptTable[1][(s1 >> 16) & 0xff] ^
+                      encryptTable[2][(s2 >> 8) & 0xff] ^
+                      encryptTable[3][s3 & 0xff] ^ rk[0];
+        uint32_t t1 = encryptTable[0][s1 >> 24] ^
+                      encryptTable[1][(s2 >> 16) & 0xff] ^
+                      encryptTable[2][(s3 >> 8) & 0xff] ^
+                      encryptTable[3][s0 & 0xff] ^ rk[1];
+        uint32_t t2 = encryptTable[0][s2 >> 24] ^
+                      encryptTable[1][(s3 >> 16) & 0xff] ^
+                      encryptTable[2][(s0 >> 8) & 0xff] ^
+                      encryptTable[3][s1 & 0xff] ^ rk[2];
+        uint32_t t3 = encryptTable[0][s3 >> 24] ^
+                      encryptTable[1][(s0 >> 16) & 0xff] ^
+                      encryptTable[2][(s1 >> 8) & 0xff] ^
+                      encryptTable[3][s2 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no MixColumns
+    rk += 4;
+    StoreWord(out, (((uint32_t) sbox[s0 >> 24] << 24) |
+                    (sbox[(s1 >> 16) & 0xff] << 16) |
+                    (sbox[(s2 >> 8) & 0xff] << 8) |
+                    sbox[s3 & 0xff]) ^ rk[0]);
+    StoreWord(out + 4, (((uint32_t) sbox[s1 >> 24] << 24) |
+                        (sbox[(s2 >> 16) & 0xff] << 16) |
+                        (sbox[(s3 >> 8) & 0xff] << 8) |
+                        sbox[s0 & 0xff]) ^ rk[1]);
+    StoreWord(out + 8, (((uint32_t) sbox[s2 >> 24] << 24) |
+                        (sbox[(s3 >> 16) & 0xff] << 16) |
+                        (sbox[(s0 >> 8) & 0xff] << 8) |
+                        sbox[s1 & 0xff]) ^ rk[2]);
+    StoreWord(out + 12, (((uint32_t) sbox[s3 >> 24] << 24) |
+                         (sbox[(s0 >> 16) & 0xff] << 16) |
+                         (sbox[(s1 >> 8) & 0xff] << 8) |
+                         sbox[s2 & 0xff]) ^ rk[3]);
+}
+
+void AESDecryptBlock(const AESKey *key, const uint8_t *in, uint8_t *out) {
+    const uint32_t *rk = key->decrypt;
+    uint32_t s0 = LoadWord(in) ^ rk[0];
+    uint32_t s1 = LoadWord(in + 4) ^ rk[1];
+    uint32_t s2 = LoadWord(in + 8) ^ rk[2];
+    uint32_t s3 = LoadWord(in + 12) ^ rk[3];
+
+    for (int round = 1; round < key->rounds; round++) {
+        rk += 4;
+        uint32_t t0 = decryptTable[0][s0 >> 24] ^
+                      decryptTable[1][(s3 >> 16) & 0xff] ^
+                      decryptTable[2][(s2 >> 8) & 0xff] ^
+                      decryptTable[3][s1 & 0xff] ^ rk[0];
+        uint32_t t1 = decryptTable[0][s1 >> 24] ^
+                      decryptTable[1][(s0 >> 16) & 0xff] ^
+                      decryptTable[2][(s3 >> 8) & 0xff] ^
+                      decryptTable[3][s2 & 0xff] ^ rk[1];
+        uint32_t t2 = decryptTable[0][s2 >> 24] ^
+                      decryptTable[1][(s1 >> 16) & 0xff] ^
+                      decryptTable[2][(s0 >> 8) & 0xff] ^
+                      decryptTable[3][s3 & 0xff] ^ rk[2];
+        uint32_t t3 = decryptTable[0][s3 >> 24] ^
+                      decryptTable[1][(s2 >> 16) & 0xff] ^
+                      decryptTable[2][(s1 >> 8) & 0xff] ^
+                      decryptTable[3][s0 & 0xff] ^ rk[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+    }
+
+    // The last round has no InvMixColumns
+    rk += 4;
+    StoreWord(out, (((uint32_t) inverseSbox[s0 >> 24] << 24) |
+                    (inverseSbox[(s3 >> 16) & 0xff] << 16) |
+                    (inverseSbox[(s2 >> 8) & 0xff] << 8) |
+                    inverseSbox[s1 & 0xff]) ^ rk[0]);
+    StoreWord(out + 4, (((uint32_t) inverseSbox[s1 >> 24] << 24) |
+                        (inverseSbox[(s0 >> 16) & 0xff] << 16) |
+                        (inverseSbox[(s3 >> 8) & 0xff] << 8) |
+                        inverseSbox[s2 & 0xff]) ^ rk[1]);
+    StoreWord(out + 8, (((uint32_t) inverseSbox[s2 >> 24] << 24) |
+                        (inverseSbox[(s1 >> 16) & 0xff] << 16) |
+                        (inverseSbox[(s0 >> 8) & 0xff] << 8) |
+                        inverseSbox[s3 & 0xff]) ^ rk[2]);
+    StoreWord(out + 12, (((uint32_t) inverseSbox[s3 >> 24] << 24) |
+                         (inverseSbox[(s2 >> 16) & 0xff] << 16) |
+                         (inverseSbox[(s1 >> 8) & 0xff] << 8) |
+                         inverseSbox[s0 & 0xff]) ^ rk[3]);
+}
+
+/* Stores a page index as a little endian XTS tweak. */
+static void StoreTweak(uint8_t *tweak, uint64_t page) {
+    memset(tweak, 0, kAESBlockSize);
+    for (int i = 0; i < 8; i++) {
+        tweak[i] = (uint8_t) (page >> (8 * i));
+    }
+}
+
+/* Multiplies the XTS tweak by x in GF(2^128). */
+static void NextTweak(uint8_t *tweak) {
+    uint8_t carry = tweak[15] >> 7;
+    for (int i = 15; i > 0; i--) {
+        tweak[i] = (uint8_t) ((tweak[i] << 1) | (tweak[i - 1] >> 7));
+    }
+    tweak[0] = (uint8_t) ((tweak[0] << 1) ^ (carry ? 0x87 : 0));
+}
+
+static int PagesSoftware(const AESPageKeys *keys,
+                         int mode,
+                         int encrypt,
+                         uint8_t *iv,
+                         uint64_t firstPage,
+                         const uint8_t *in,
+                         uint8_t *out,
+                         size_t count) {
+    uint8_t block[kAESBlockSize];
+    uint8_t tweak[kAESBlockSize];
+
+    for (size_t page = 0; page < count; page++) {
+        if (mode == kAESModeXTS) {
+            StoreTweak(block, firstPage + page);
+            AESEncryptBlock(&keys->tweak, block, tweak);
+        }
+        for (size_t i = 0; i < kAESPageBlocks; i++) {
+            const uint8_t *source = in + i * kAESBlockSize;
+            uint8_t *destination = out + i * kAESBlockSize;
+
+            if (mode == kAESModeCBC && encrypt) {
+                for (int j = 0; j < kAESBlockSize; j++) {
+                    block[j] = source[j] ^ iv[j];
+                }
+                AESEncryptBlock(&keys->data, block, destination);
+                memcpy(iv, destination, kAESBlockSize);
+            } else if (mode == kAESModeCBC) {
+                uint8_t chain[kAESBlockSize];
+                memcpy(chain, source, kAESBlockSize);
+                AESDecryptBlock(&keys->data, source, block);
+                for (int j = 0; j < kAESBlockSize; j++) {
+                    destination[j] = block[j] ^ iv[j];
+                }
+                memcpy(iv, chain, kAESBlockSize);
+            } else {
+                for (int j = 0; j < kAESBlockSize; j++) {
+                    block[j] = source[j] ^ tweak[j];
+                }
+                if (encrypt) {
+                    AESEncryptBlock(&keys->data, block, block);
+                } else {
+                    AESDecryptBlock(&keys->data, block, block);
+                }
+                for (int j = 0; j < kAESBlockSize; j++) {
+                    destination[j] = block[j] ^ tweak[j];
+                }
+                NextTweak(tweak);
+            }
+        }
+        in += kImagePageSize;
+        out += kImagePageSize;
+    }
+    return 0;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* The round keys loaded into vector registers. */
+typedef struct {
+    __m128i encrypt[kAESRoundsMax + 1];
+    __m128i decrypt[kAESRoundsMax + 1];
+    int rounds;
+} AESNISchedule;
+
+/* Converts the round keys to the byte order used by the AES instructions. */
+static void AESNILoad(const AESKey *key, AESNISchedule *schedule) {
+    uint8_t bytes[kAESBlockSize];
+
+    schedule->rounds = key->rounds;
+    for (int round = 0; round <= key->rounds; round++) {
+        for (int j = 0; j < 4; j++) {
+            StoreWord(bytes + 4 * j, key->encrypt[4 * round + j]);
+        }
+        schedule->encrypt[round] = _mm_loadu_si128((const __m128i *) bytes);
+        for (int j = 0; j < 4; j++) {
+            StoreWord(bytes + 4 * j, key->decrypt[4 * round + j]);
+        }
+        schedule->decrypt[round] = _mm_loadu_si128((const __m128i *) bytes);
+    }
+}
+
+/* Encrypts 4 independent blocks, so that the rounds overlap. */
+__attribute__((target("aes")))
+static inline void AESNIEncrypt4(const AESNISchedule *schedule, __m128i *b) {
+    __m128i key = schedule->encrypt[0];
+    __m128i b0 = _mm_xor_si128(b[0], key);
+    __m128i b1 = _mm_xor_si128(b[1], key);
+    __m128i b2 = _mm_xor_si128(b[2], key);
+    __m128i b3 = _mm_xor_si128(b[3], key);
+    for (int round = 1; round < schedule->rounds; round++) {
+        key = schedule->encrypt[round];
+        b0 = _mm_aesenc_si128(b0, key);
+        b1 = _mm_aesenc_si128(b1, key);
+        b2 = _mm_aesenc_si128(b2, key);
+        b3 = _mm_aesenc_si128(b3, key);
+    }
+    key = schedule->encrypt[schedule->rounds];
+    b[0] = _mm_aesenclast_si128(b0, key);
+    b[1] = _mm_aesenclast_si128(b1, key);
+    b[2] = _mm_aesenclast_si128(b2, key);
+    b[3] = _mm_aesenclast_si128(b3, key);
+}
+
+/* Decrypts 4 independent blocks, so that the rounds overlap. */
+__attribute__((target("aes")))
+static inline void AESNIDecrypt4(const AESNISchedule *schedule, __m128i *b) {
+    __m128i key = schedule->decrypt[0];
+    __m128i b0 = _mm_xor_si128(b[0], key);
+    __m128i b1 = _mm_xor_si128(b[1], key);
+    __m128i b2 = _mm_xor_si128(b[2], key);
+    __m128i b3 = _mm_xor_si128(b[3], key);
+    for (int round = 1; round < schedule->rounds; round++) {
+        key = schedule->decrypt[round];
+        b0 = _mm_aesdec_si128(b0, key);
+        b1 = _mm_aesdec_si128(b1, key);
+        b2 = _mm_aesdec_si128(b2, key);
+        b3 = _mm_aesdec_si128(b3, key);
+    }
+    key = schedule->decrypt[schedule->rounds];
+    b[0] = _mm_aesdeclast_si128(b0, key);
+    b[1] = _mm_aesdeclast_si128(b1, key);
+    b[2] = _mm_aesdeclast_si128(b2, key);
+    b[3] = _mm_aesdeclast_si128(b3, key);
+}
+
+__attribute__((target("aes")))
+static inline __m128i AESNIEncrypt1(const AESNISchedule *schedule,
+                                    __m128i block) {
+    block = _mm_xor_si128(block, schedule->encrypt[0]);
+    for (int round = 1; round < schedule->rounds; round++) {
+        block = _mm_aesenc_si128(block, schedule->encrypt[round]);
+    }
+    return _mm_aesenclast_si128(block, schedule->encrypt[schedule->rounds]);
+}
+
+/* Multiplies the XTS tweak by x in GF(2^128). */
+static inline __m128i AESNINextTweak(__m128i tweak) {
+    // Move the carry of each 32 bit lane to the next lane, the carry of the
+    // top lane is reduced by the polynomial
+    __m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(tweak, 31), 0x93);
+    carry = _mm_and_si128(carry, _mm_set_epi32(1, 1, 1, 0x87));
+    return _mm_xor_si128(_mm_slli_epi32(tweak, 1), carry);
+}
+
+__attribute__((target("aes")))
+static int PagesAESNI(const AESPageKeys *keys,
+                      int mode,
+                      int encrypt,
+                      uint8_t *iv,
+                      uint64_t firstPage,
+                      const uint8_t *in,
+                      uint8_t *out,
+                      size_t count) {
+    AESNISchedule data;
+    AESNISchedule tweakSchedule;
+    const __m128i *source = (const __m128i *) in;
+    __m128i *destination = (__m128i *) out;
+    __m128i b[4];
+
+    AESNILoad(&keys->data, &data);
+    if (mode == kAESModeXTS) {
+        AESNILoad(&keys->tweak, &tweakSchedule);
+    }
+    __m128i chain = _mm_loadu_si128((const __m128i *) iv);
+
+    for (size_t page = 0; page < count; page++) {
+        if (mode == kAESModeCBC && encrypt) {
+            // Each block depends on the previous one
+            for (size_t i = 0; i < kAESPageBlocks; i++) {
+                chain = AESNIEncrypt1(&data,
+                                      _mm_xor_si128(
+                                              _mm_loadu_si128(source + i),
+                                              chain));
+                _mm_storeu_si128(destination + i, chain);
+            }
+        } else if (mode == kAESModeCBC) {
+            // Decrypting does not depend on the previous block
+            for (size_t i = 0; i < kAESPageBlocks; i += 4) {
+                __m128i c0 = b[0] = _mm_loadu_si128(source + i);
+                __m128i c1 = b[1] = _mm_loadu_si128(source + i + 1);
+                __m128i c2 = b[2] = _mm_loadu_si128(source + i + 2);
+                __m128i c3 = b[3] = _mm_loadu_si128(source + i + 3);
+                AESNIDecrypt4(&data, b);
+                _mm_storeu_si128(destination + i, _mm_xor_si128(b[0], chain));
+                _mm_storeu_si128(destination + i + 1, _mm_xor_si128(b[1], c0));
+                _mm_storeu_si128(destination + i + 2, _mm_xor_si128(b[2], c1));
+                _mm_storeu_si128(destination + i + 3, _mm_xor_si128(b[3], c2));
+                chain = c3;
+            }
+        } else {
+            uint8_t index[kAESBlockSize];
+            StoreTweak(index, firstPage + page);
+            __m128i tweak = AESNIEncrypt1(
+                    &tweakSchedule,
+                    _mm_loadu_si128((const __m128i *) index));
+            for (size_t i = 0; i < kAESPageBlocks; i += 4) {
+                __m128i t[4];
+                for (int j = 0; j < 4; j++) {
+                    t[j] = tweak;
+                    b[j] = _mm_xor_si128(_mm_loadu_si128(source + i + j),
+                                         tweak);
+                    tweak = AESNINextTweak(tweak);
+                }
+                if (encrypt) {
+                    AESNIEncrypt4(&data, b);
+                } else {
+                    AESNIDecrypt4(&data, b);
+                }
+                for (int j = 0; j < 4; j++) {
+                    _mm_storeu_si128(destination + i + j,
+                                     _mm_xor_si128(b[j], t[j]));
+                }
+            }
+        }
+        source += kAESPageBlocks;
+        destination += kAESPageBlocks;
+    }
+
+    _mm_storeu_si128((__m128i *) iv, chain);
+    return 0;
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+static int PagesCommonCrypto(const AESPageKeys *keys,
+                             int mode,
+                             int encrypt,
+                             uint8_t *iv,
+                             uint64_t firstPage,
+                             const uint8_t *in,
+                             uint8_t *out,
+                             size_t count) {
+    CCCryptorRef cryptor;
+    CCOperation operation = encrypt ? kCCEncrypt : kCCDecrypt;
+    CCCryptorStatus status;
+    size_t size = count * kImagePageSize;
+    size_t moved;
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (mode == kAESModeCBC) {
+        // Continue the chain with the last cipher block
+        uint8_t chain[kAESBlockSize];
+        memcpy(chain,
+               (encrypt ? out : in) + size - kAESBlockSize,
+               kAESBlockSize);
+        status = CCCryptorCreate(operation,
+                                 kCCAlgorithmAES,
+                                 0,
+                                 keys->data.bytes,
+                                 keys->data.length,
+                                 iv,
+                                 &cryptor);
+        if (status != kCCSuccess) {
+            return -1;
+        }
+        status = CCCryptorUpdate(cryptor, in, size, out, size, &moved);
+        CCCryptorRelease(cryptor);
+        if (status != kCCSuccess || moved != size) {
+            return -1;
+        }
+        memcpy(iv,
+               encrypt ? out + size - kAESBlockSize : chain,
+               kAESBlockSize);
+        return 0;
+    }
+
+    status = CCCryptorCreateWithMode(operation,
+                                     kCCModeXTS,
+                                     kCCAlgorithmAES,
+                                     ccNoPadding,
+                                     NULL,
+                                     keys->data.bytes,
+                                     keys->data.length,
+                                     keys->tweak.bytes,
+                                     keys->tweak.length,
+                                     0,
+                                     0,
+                                     &cryptor);
+    if (status != kCCSuccess) {
+        return -1;
+    }
+    for (size_t page = 0; page < count && status == kCCSuccess; page++) {
+        uint8_t tweak[kAESBlockSize];
+        StoreTweak(tweak, firstPage + page);
+        status = CCCryptorReset(cryptor, tweak);
+        if (status == kCCSuccess) {
+            status = CCCryptorUpdate(cryptor,
+                                     in + page * kImagePageSize,
+                                     kImagePageSize,
+                                     out + page * kImagePageSize,
+                                     kImagePageSize,
+                                     &moved);
+        }
+    }
+    CCCryptorRelease(cryptor);
+    return status == kCCSuccess ? 0 : -1;
+}
+
+const char *AESEngineName(int engine) {
+    static const char *names[kAESEngineCount] = {
+        "software", "aes-ni", "commoncrypto"
+    };
+    if (engine < 0 || engine >= kAESEngineCount) {
+        return "unknown";
+    }
+    return names[engine];
+}
+
+AESPagesFunction AESEngineGet(int engine) {
+    switch (engine) {
+        case kAESEngineSoftware:
+            return PagesSoftware;
+#if defined(__x86_64__) || defined(__i386__)
+        case kAESEngineAESNI:
+            return __builtin_cpu_supports("aes") ? PagesAESNI : NULL;
+#endif
+        case kAESEngineCommonCrypto:
+            return PagesCommonCrypto;
+    }
+    return NULL;
+}
+
+/* The minimum time in seconds each measurement runs. */
+#define kAESBenchmarkSeconds 0.5
+
+/* Returns the monotonic time in seconds. */
+static double BenchmarkTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * Runs the implementation repeatedly for at least kAESBenchmarkSeconds and
+ * returns the throughput in bytes per second, or 0 if it failed.
+ */
+static double MeasureThroughput(AESPagesFunction function,
+                                const AESPageKeys *keys,
+                                int mode,
+                                int encrypt,
+                                const uint8_t *in,
+                                uint8_t *out,
+                                size_t pages) {
+    uint8_t iv[kAESBlockSize] = { 0 };
+    double start = BenchmarkTime();
+    double elapsed;
+    size_t rounds = 0;
+
+    do {
+        if (function(keys, mode, encrypt, iv, 0, in, out, pages) != 0) {
+            return 0;
+        }
+        rounds++;
+        elapsed = BenchmarkTime() - start;
+    } while (elapsed < kAESBenchmarkSeconds);
+
+    return (double) rounds * pages * kImagePageSize / elapsed;
+}
+
+/* Checks the portable implementation against the FIPS-197 test vectors. */
+static int CheckTestVectors(void) {
+    static const uint8_t plaintext[kAESBlockSize] = {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+    static const uint8_t expected[2][kAESBlockSize] = {
+        { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+          0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+        { 0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+          0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89 }
+    };
+    uint8_t bytes[32];
+    uint8_t block[kAESBlockSize];
+    AESKey key;
+
+    for (int i = 0; i < 32; i++) {
+        bytes[i] = (uint8_t) i;
+    }
+    for (int i = 0; i < 2; i++) {
+        AESKeyInit(&key, bytes, i ? 32 : 16);
+        AESEncryptBlock(&key, plaintext, block);
+        if (memcmp(block, expected[i], kAESBlockSize) != 0) {
+            return -1;
+        }
+        AESDecryptBlock(&key, block, block);
+        if (memcmp(block, plaintext, kAESBlockSize) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Checks the XTS mode of the portable implementation against the vectors 1 and
+ * 2 of IEEE 1619-2007. Their data units are 32 bytes, which are the first two
+ * blocks of a page with the sequence number as its index.
+ */
+static int CheckXTSTestVectors(void) {
+    static const struct {
+        uint8_t dataKey;
+        uint8_t tweakKey;
+        uint64_t sequence;
+        uint8_t plaintext;
+        uint8_t ciphertext[32];
+    } vectors[2] = {
+        { 0x00, 0x00, 0, 0x00,
+          { 0x91, 0x7c, 0xf6, 0x9e, 0xbd, 0x68, 0xb2, 0xec,
+            0x9b, 0x9f, 0xe9, 0xa3, 0xea, 0xdd, 0xa6, 0x92,
+            0xcd, 0x43, 0xd2, 0xf5, 0x95, 0x98, 0xed, 0x85,
+            0x8c, 0x02, 0xc2, 0x65, 0x2f, 0xbf, 0x92, 0x2e } },
+        { 0x11, 0x22, 0x3333333333ULL, 0x44,
+          { 0xc4, 0x54, 0x18, 0x5e, 0x6a, 0x16, 0x93, 0x6e,
+            0x39, 0x33, 0x40, 0x38, 0xac, 0xef, 0x83, 0x8b,
+            0xfb, 0x18, 0x6f, 0xff, 0x74, 0x80, 0xad, 0xc4,
+            0x28, 0x93, 0x82, 0xec, 0xd6, 0xd3, 0x94, 0xf0 } }
+    };
+    uint8_t in[kImagePageSize];
+    uint8_t out[kImagePageSize];
+    uint8_t bytes[16];
+    AESPageKeys keys;
+
+    for (int i = 0; i < 2; i++) {
+        memset(bytes, vectors[i].dataKey, sizeof(bytes));
+        AESKeyInit(&keys.data, bytes, sizeof(bytes));
+        memset(bytes, vectors[i].tweakKey, sizeof(bytes));
+        AESKeyInit(&keys.tweak, bytes, sizeof(bytes));
+        memset(in, vectors[i].plaintext, sizeof(in));
+
+        PagesSoftware(&keys, kAESModeXTS, 1, NULL, vectors[i].sequence,
+                      in, out, 1);
+        if (memcmp(out, vectors[i].ciphertext, 32) != 0) {
+            return -1;
+        }
+        PagesSoftware(&keys, kAESModeXTS, 0, NULL, vectors[i].sequence,
+                      out, out, 1);
+        if (memcmp(out, in, sizeof(in)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int AESBenchmark(size_t pages, uint64_t projectedPages, FILE *stream) {
+    static const char *modeNames[2] = { "cbc", "xts" };
+    uint8_t bytes[32];
+    AESPageKeys keys;
+    int rc = kAESBenchmarkSuccess;
+
+    if (CheckTestVectors() != 0 || CheckXTSTestVectors() != 0) {
+        return kAESBenchmarkErrorMismatch;
+    }
+
+    // The kernel uses 128 bit keys
+    for (int i = 0; i < 32; i++) {
+        bytes[i] = (uint8_t) (i * 37 + 11);
+    }
+    AESKeyInit(&keys.data, bytes, 16);
+    AESKeyInit(&keys.tweak, bytes + 16, 16);
+
+    size_t size = pages * kImagePageSize;
+    uint8_t *plaintext = (uint8_t *) malloc(size);
+    uint8_t *reference = (uint8_t *) malloc(size);
+    uint8_t *ciphertext = (uint8_t *) malloc(size);
+    uint8_t *decrypted = (uint8_t *) malloc(size);
+    if (pages == 0 || !plaintext || !reference || !ciphertext || !decrypted) {
+        free(plaintext);
+        free(reference);
+        free(ciphertext);
+        free(decrypted);
+        return kAESBenchmarkErrorResources;
+    }
+    uint32_t seed = 1;
+    for (size_t i = 0; i < size; i++) {
+        seed = seed * 1103515245 + 12345;
+        plaintext[i] = (uint8_t) (seed >> 16);
+    }
+
+    fprintf(stream,
+            "%-4s %-13s %12s %12s %10s %10s\n",
+            "mode",
+            "engine",
+            "encrypt MB/s",
+            "decrypt MB/s",
+            "sleep +s",
+            "wake +s");
+    for (int mode = kAESModeCBC; mode <= kAESModeXTS; mode++) {
+        uint8_t iv[kAESBlockSize] = { 0 };
+        PagesSoftware(&keys, mode, 1, iv, 0, plaintext, reference, pages);
+
+        for (int engine = 0; engine < kAESEngineCount; engine++) {
+            AESPagesFunction function = AESEngineGet(engine);
+            if (!function) {
+                continue;
+            }
+
+            // Validate against the portable implementation
+            uint8_t encryptIV[kAESBlockSize] = { 0 };
+            uint8_t decryptIV[kAESBlockSize] = { 0 };
+            if (function(&keys, mode, 1, encryptIV, 0,
+                         plaintext, ciphertext, pages) != 0 ||
+                function(&keys, mode, 0, decryptIV, 0,
+                         reference, decrypted, pages) != 0) {
+                fprintf(stream,
+                        "%-4s %-13s failed\n",
+                        modeNames[mode],
+                        AESEngineName(engine));
+                rc = kAESBenchmarkErrorResources;
+                continue;
+            }
+            int match = memcmp(ciphertext, reference, size) == 0 &&
+                        memcmp(decrypted, plaintext, size) == 0;
+            if (!match) {
+                rc = kAESBenchmarkErrorMismatch;
+            }
+
+            double encryptRate = MeasureThroughput(function, &keys, mode, 1,
+                                                   plaintext, ciphertext,
+                                                   pages);
+            double decryptRate = MeasureThroughput(function, &keys, mode, 0,
+                                                   reference, decrypted,
+                                                   pages);
+            fprintf(stream,
+                    "%-4s %-13s %12.1f %12.1f",
+                    modeNames[mode],
+                    AESEngineName(engine),
+                    encryptRate / 1e6,
+                    decryptRate / 1e6);
+            if (projectedPages && encryptRate > 0 && decryptRate > 0) {
+                double projectedSize = (double) projectedPages *
+                                       kImagePageSize;
+                fprintf(stream,
+                        " %10.2f %10.2f",
+                        projectedSize / encryptRate,
+                        projectedSize / decryptRate);
+            } else {
+                fprintf(stream, " %10s %10s", "-", "-");
+            }
+            fprintf(stream, "%s\n", match ? "" : " MISMATCH");
+        }
+    }
+
+    free(plaintext);
+    free(reference);
+    free(ciphertext);
+    free(decrypted);
+    return rc;
+}
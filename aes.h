@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_AES_H
+#define HIBERNATE_AES_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* The size of an AES block in bytes. */
+#define kAESBlockSize 16
+/* The number of rounds for 256 bit keys, the largest supported key size. */
+#define kAESRoundsMax 14
+
+/* An expanded AES key. */
+typedef struct {
+    /* The round keys as big endian words. */
+    uint32_t encrypt[4 * (kAESRoundsMax + 1)];
+    /* The round keys of the equivalent inverse cipher. */
+    uint32_t decrypt[4 * (kAESRoundsMax + 1)];
+    int rounds;
+    /* The key itself, for implementations that expand it on their own. */
+    uint8_t bytes[32];
+    size_t length;
+} AESKey;
+
+/*
+ * Expands a 128 or 256 bit key. Returns 0 on success and -1 if the key length
+ * is not supported.
+ */
+int AESKeyInit(AESKey *key, const uint8_t *bytes, size_t length);
+
+/* Encrypts a single block using the portable table based implementation. */
+void AESEncryptBlock(const AESKey *key, const uint8_t *in, uint8_t *out);
+
+/* Decrypts a single block using the portable table based implementation. */
+void AESDecryptBlock(const AESKey *key, const uint8_t *in, uint8_t *out);
+
+/*
+ * Cipher block chaining over the whole image like the kernel encrypts it with
+ * the IV of hibernate_cryptvars_t. The last cipher block of each page is the
+ * IV of the next page.
+ */
+#define kAESModeCBC 0
+/* XTS with the index of each page as its tweak, as used by disk encryption. */
+#define kAESModeXTS 1
+
+/* The keys used to encrypt pages. The tweak key is only used by XTS. */
+typedef struct {
+    AESKey data;
+    AESKey tweak;
+} AESPageKeys;
+
+/*
+ * Encrypts or decrypts count pages of kImagePageSize bytes. For CBC the IV is
+ * updated, so that consecutive calls continue the chain. For XTS the tweak of
+ * page i is firstPage + i. Returns 0 on success and -1 otherwise.
+ */
+typedef int (*AESPagesFunction)(const AESPageKeys *keys,
+                                int mode,
+                                int encrypt,
+                                uint8_t *iv,
+                                uint64_t firstPage,
+                                const uint8_t *in,
+                                uint8_t *out,
+                                size_t count);
+
+/* The portable table based implementation. */
+#define kAESEngineSoftware 0
+/* The AES instructions of x86 processors. */
+#define kAESEngineAESNI 1
+/* CommonCrypto, which uses the fastest implementation of the system. */
+#define kAESEngineCommonCrypto 2
+/* The number of implementations. */
+#define kAESEngineCount 3
+
+/* Returns the name of the implementation. */
+const char *AESEngineName(int engine);
+
+/*
+ * Returns the implementation or NULL if it has not been compiled in or is not
+ * supported by the processor.
+ */
+AESPagesFunction AESEngineGet(int engine);
+
+/* The benchmark has completed and all implementations match. */
+#define kAESBenchmarkSuccess 0
+/*
+ * The portable implementation failed the FIPS-197 or IEEE 1619 test vectors or
+ * another implementation produced different results.
+ */
+#define kAESBenchmarkErrorMismatch 1
+/* The buffers could not be allocated or an implementation failed. */
+#define kAESBenchmarkErrorResources 2
+
+/*
+ * Measures the encryption and decryption throughput of every supported
+ * implementation in both modes over a buffer of the specified number of
+ * pages. If projectedPages is not zero, the seconds that encrypting and
+ * decrypting an image of projectedPages pages would add to sleep and wake are
+ * printed as well.
+ */
+int AESBenchmark(size_t pages, uint64_t projectedPages, FILE *stream);
+
+#endif /* HIBERNATE_AES_H */
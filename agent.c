@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "agent.h"
+
+#include <stdio.h>
+#include <string.h>
+
+uint8_t AgentHandleCommand(const ControlCommand *command,
+                           uint8_t *reply,
+                           uint16_t *replyLength,
+                           void *context) {
+    Agent *agent = context;
+
+    agent->commands++;
+    switch (command->opcode) {
+        case kControlSetProfile: {
+            char name[kProfileNameLength];
+            if (command->length == 0 || command->length >= sizeof(name)) {
+                return kControlStatusInvalidArgument;
+            }
+            memcpy(name, command->data, command->length);
+            name[command->length] = '\0';
+
+            const HibernateProfile *found =
+                    ProfileTableFind(agent->profiles, name);
+            if (!found) {
+                return kControlStatusUnknownProfile;
+            }
+            agent->profile = *found;
+            return kControlStatusSuccess;
+        }
+        case kControlHibernateAt: {
+            int64_t date;
+            if (ControlDecodeInt64(command, &date) != 0 || date < 0) {
+                return kControlStatusInvalidArgument;
+            }
+            if (agent->timer) {
+                EventWatcherCancel(agent->timer);
+                agent->timer = NULL;
+            }
+            agent->pendingDate = 0;
+            if (date == 0) {
+                return kControlStatusSuccess;
+            }
+            if (agent->loop) {
+                agent->timer = EventLoopAddTimer(agent->loop,
+                                                 (double) date,
+                                                 kEventTimerAbsolute,
+                                                 agent->hibernate,
+                                                 agent);
+                if (!agent->timer) {
+                    return kControlStatusError;
+                }
+            }
+            agent->pendingDate = date;
+            return kControlStatusSuccess;
+        }
+        case kControlQueryStats: {
+            ControlStats stats;
+            stats.hibernations = agent->hibernations;
+            stats.failures = agent->failures;
+            stats.pendingDate = agent->pendingDate;
+            stats.commands = agent->commands;
+            snprintf(stats.profile,
+                     sizeof(stats.profile),
+                     "%s",
+                     agent->profile.name);
+            *replyLength = ControlStatsEncode(&stats, reply);
+            return kControlStatusSuccess;
+        }
+    }
+    return kControlStatusUnknownCommand;
+}
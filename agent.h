@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_AGENT_H
+#define HIBERNATE_AGENT_H
+
+#include <stdint.h>
+
+#include "control.h"
+#include "eventloop.h"
+#include "profile.h"
+
+/* A resident hibernate process that executes control requests. */
+typedef struct {
+    const ProfileTable *profiles;
+    HibernateProfile profile;
+    /*
+     * The loop the pending hibernation is scheduled on. Simulated agents have
+     * none and only record the date.
+     */
+    EventLoop *loop;
+    /* Hibernates once the requested date has come, called with the agent. */
+    EventCallback hibernate;
+    EventWatcher *timer;
+    /* The date of the pending hibernation in seconds since 1970 or 0. */
+    int64_t pendingDate;
+    uint32_t hibernations;
+    uint32_t failures;
+    uint64_t commands;
+} Agent;
+
+/* Executes a control command for an agent. Returns a kControlStatus code. */
+uint8_t AgentHandleCommand(const ControlCommand *command,
+                           uint8_t *reply,
+                           uint16_t *replyLength,
+                           void *context);
+
+#endif /* HIBERNATE_AGENT_H */
@@ -0,0 +1,217 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "assertions.h"
+
+#include <limits.h>
+#include <string.h>
+
+#include <libproc.h>
+
+#include <CoreFoundation/CFArray.h>
+#include <CoreFoundation/CFDictionary.h>
+#include <CoreFoundation/CFNumber.h>
+#include <CoreFoundation/CFString.h>
+
+#include <IOKit/IOReturn.h>
+#include <IOKit/pwr_mgt/IOPMLib.h>
+
+#include "IOPMLibPrivate.h"
+
+/* The names of the assertion activity actions indexed by action. */
+static const char *kAssertionActionNames[] = {
+    "Unknown",
+    "Create",
+    "Retain",
+    "Release",
+    "ClientDeath",
+    "Timeout",
+    "TurnOff",
+    "TurnOn"
+};
+
+/*
+ * Copies the string to the buffer. Strings that do not fit into the buffer are
+ * truncated.
+ */
+static void CopyCString(CFTypeRef string, char *buffer, CFIndex size) {
+    CFIndex used = 0;
+
+    if (string && CFGetTypeID(string) == CFStringGetTypeID()) {
+        CFStringGetBytes((CFStringRef) string,
+                         CFRangeMake(0, CFStringGetLength((CFStringRef) string)),
+                         kCFStringEncodingUTF8,
+                         '?',
+                         false,
+                         (UInt8 *) buffer,
+                         size - 1,
+                         &used);
+    }
+    buffer[used] = '\0';
+}
+
+/* Returns the action matching the action name reported by powerd. */
+static uint32_t GetAction(CFTypeRef name) {
+    char buffer[16];
+
+    CopyCString(name, buffer, sizeof(buffer));
+    for (uint32_t action = kAssertionActionCreate;
+         action <= kAssertionActionTurnOn;
+         action++) {
+        if (strcasecmp(buffer, kAssertionActionNames[action]) == 0) {
+            return action;
+        }
+    }
+    return kAssertionActionUnknown;
+}
+
+/* Appends an activity entry reported by powerd to the ring buffer. */
+static void AppendEntry(AssertionLog *log, CFDictionaryRef activity) {
+    AssertionLogEntry *entry;
+    CFTypeRef value;
+
+    if (log->count == kAssertionLogCapacity) {
+        // Overwrite the oldest entry
+        entry = &log->entries[log->first];
+        log->first = (log->first + 1) % kAssertionLogCapacity;
+        log->dropped++;
+    } else {
+        entry = &log->entries[(log->first + log->count) %
+                              kAssertionLogCapacity];
+        log->count++;
+    }
+    log->received++;
+
+    value = CFDictionaryGetValue(activity, kIOPMAssertionActivityTime);
+    if (value && CFGetTypeID(value) == CFDateGetTypeID()) {
+        entry->time = CFDateGetAbsoluteTime((CFDateRef) value);
+    } else {
+        entry->time = CFAbsoluteTimeGetCurrent();
+    }
+
+    int pid = 0;
+    value = CFDictionaryGetValue(activity, kIOPMAssertionPIDKey);
+    if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef) value, kCFNumberIntType, &pid);
+    }
+    entry->pid = pid;
+
+    entry->action = GetAction(CFDictionaryGetValue(activity,
+                                                   kIOPMAssertionActivityAction));
+    CopyCString(CFDictionaryGetValue(activity, kIOPMAssertionTypeKey),
+                entry->type,
+                sizeof(entry->type));
+    CopyCString(CFDictionaryGetValue(activity, kIOPMAssertionNameKey),
+                entry->name,
+                sizeof(entry->name));
+}
+
+int AssertionLogStart(AssertionLog *log) {
+    CFArrayRef updates = NULL;
+    bool overflow = false;
+
+    memset(log, 0, sizeof(*log));
+
+    // Activity logging is global to powerd and might be used by others, which
+    // is why it is left enabled
+    if (IOPMSetAssertionActivityLog(true) != kIOReturnSuccess) {
+        return kAssertionLogStartErrorEnable;
+    }
+
+    // Skip the activity that happened before streaming has been started
+    log->refCount = UINT_MAX;
+    if (IOPMCopyAssertionActivityUpdate(&updates,
+                                        &overflow,
+                                        &log->refCount) != kIOReturnSuccess) {
+        return kAssertionLogStartErrorUpdate;
+    }
+    if (updates) {
+        CFRelease(updates);
+    }
+
+    return kAssertionLogStartSuccess;
+}
+
+int AssertionLogUpdate(AssertionLog *log) {
+    CFArrayRef updates = NULL;
+    bool overflow = false;
+
+    if (IOPMCopyAssertionActivityUpdate(&updates,
+                                        &overflow,
+                                        &log->refCount) != kIOReturnSuccess) {
+        return kAssertionLogUpdateError;
+    }
+    if (overflow) {
+        log->overflows++;
+    }
+    if (!updates) {
+        return kAssertionLogUpdateSuccess;
+    }
+
+    CFIndex count = CFArrayGetCount(updates);
+    for (CFIndex i = 0; i < count; i++) {
+        CFTypeRef activity = CFArrayGetValueAtIndex(updates, i);
+        if (activity && CFGetTypeID(activity) == CFDictionaryGetTypeID()) {
+            AppendEntry(log, (CFDictionaryRef) activity);
+        }
+    }
+    CFRelease(updates);
+
+    return kAssertionLogUpdateSuccess;
+}
+
+void AssertionLogReport(const AssertionLog *log,
+                        CFAbsoluteTime start,
+                        CFAbsoluteTime end,
+                        FILE *stream) {
+    fprintf(stream,
+            "hibernate: assertion activity: %llu entries, %u dropped, "
+            "%u overflows\n",
+            (unsigned long long) log->received,
+            log->dropped,
+            log->overflows);
+
+    for (uint32_t i = 0; i < log->count; i++) {
+        const AssertionLogEntry *entry =
+                &log->entries[(log->first + i) % kAssertionLogCapacity];
+        if (entry->time < start || entry->time > end) {
+            continue;
+        }
+
+        char process[2 * MAXCOMLEN];
+        if (proc_name(entry->pid, process, sizeof(process)) <= 0) {
+            strlcpy(process, "?", sizeof(process));
+        }
+
+        fprintf(stream,
+                "hibernate:   +%.3fs %d (%s) %s %s \"%s\"\n",
+                entry->time - start,
+                entry->pid,
+                process,
+                kAssertionActionNames[entry->action],
+                entry->type,
+                entry->name);
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_ASSERTIONS_H
+#define HIBERNATE_ASSERTIONS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <sys/types.h>
+
+#include <CoreFoundation/CFBase.h>
+#include <CoreFoundation/CFDate.h>
+
+/* The number of assertion activity entries kept in the ring buffer. */
+#define kAssertionLogCapacity 256
+/* The maximum length of an assertion type stored in the ring buffer. */
+#define kAssertionLogTypeLength 32
+/* The maximum length of an assertion name stored in the ring buffer. */
+#define kAssertionLogNameLength 64
+
+/* The assertion activity actions reported by powerd. */
+#define kAssertionActionUnknown 0
+#define kAssertionActionCreate 1
+#define kAssertionActionRetain 2
+#define kAssertionActionRelease 3
+#define kAssertionActionClientDeath 4
+#define kAssertionActionTimeout 5
+#define kAssertionActionTurnOff 6
+#define kAssertionActionTurnOn 7
+
+/* A single assertion activity entry copied out of the powerd activity log. */
+typedef struct {
+    CFAbsoluteTime time;
+    pid_t pid;
+    uint32_t action;
+    char type[kAssertionLogTypeLength];
+    char name[kAssertionLogNameLength];
+} AssertionLogEntry;
+
+/*
+ * Bounded ring buffer of assertion activity. Only the entries added since the
+ * previous update are copied from powerd, the oldest entries are overwritten
+ * once the buffer is full.
+ */
+typedef struct {
+    AssertionLogEntry entries[kAssertionLogCapacity];
+    /* The index of the oldest entry. */
+    uint32_t first;
+    /* The number of valid entries. */
+    uint32_t count;
+    /* The reference index of the last entry returned by powerd. */
+    uint32_t refCount;
+    /* The number of updates for which powerd reported lost entries. */
+    uint32_t overflows;
+    /* The number of entries overwritten in the ring buffer. */
+    uint32_t dropped;
+    /* The number of entries received since streaming has been started. */
+    uint64_t received;
+} AssertionLog;
+
+/* Assertion activity streaming has been started. */
+#define kAssertionLogStartSuccess 0
+/* Enabling the powerd assertion activity log failed. */
+#define kAssertionLogStartErrorEnable 1
+/* Copying the initial assertion activity log failed. */
+#define kAssertionLogStartErrorUpdate 2
+
+/*
+ * Enables the powerd assertion activity log and skips all activity that
+ * happened before streaming has been started.
+ */
+int AssertionLogStart(AssertionLog *log);
+
+/* The ring buffer has been updated successfully. */
+#define kAssertionLogUpdateSuccess 0
+/* Copying the assertion activity since the last update failed. */
+#define kAssertionLogUpdateError 1
+
+/*
+ * Appends the assertion activity that happened since the last update to the
+ * ring buffer.
+ */
+int AssertionLogUpdate(AssertionLog *log);
+
+/*
+ * Prints the streaming metrics and the per-process assertion activity between
+ * the given points in time to the specified stream.
+ */
+void AssertionLogReport(const AssertionLog *log,
+                        CFAbsoluteTime start,
+                        CFAbsoluteTime end,
+                        FILE *stream);
+
+#endif /* HIBERNATE_ASSERTIONS_H */
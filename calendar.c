@@ -0,0 +1,235 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "calendar.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__APPLE__)
+#include "IOPMLibPrivate.h"
+#endif
+
+/* Converts a calendar time to a CFAbsoluteTime. */
+static CFAbsoluteTime AbsoluteTimeFromTime(time_t time) {
+    return (CFAbsoluteTime) time - kCFAbsoluteTimeIntervalSince1970;
+}
+
+/* Converts a CFAbsoluteTime to a calendar time. */
+static time_t TimeFromAbsoluteTime(CFAbsoluteTime date) {
+    return (time_t) (date + kCFAbsoluteTimeIntervalSince1970);
+}
+
+int ParseWakeDate(const char *string, CFAbsoluteTime *date) {
+    time_t now = time(NULL);
+    struct tm tm;
+    const char *end;
+
+    localtime_r(&now, &tm);
+    tm.tm_sec = 0;
+
+    // Parse date and time of day or time of day only
+    end = strptime(string, "%Y-%m-%d %H:%M", &tm);
+    if (end) {
+        if (*end == ':') {
+            end = strptime(end, ":%S", &tm);
+        }
+    } else {
+        localtime_r(&now, &tm);
+        tm.tm_sec = 0;
+
+        end = strptime(string, "%H:%M", &tm);
+        if (end && *end == ':') {
+            end = strptime(end, ":%S", &tm);
+        }
+        if (end && *end == '\0') {
+            // Use the next occurrence of the time of day
+            time_t today;
+
+            tm.tm_isdst = -1;
+            today = mktime(&tm);
+            if (today != -1 && today <= now) {
+                tm.tm_mday++;
+            }
+        }
+    }
+    if (!end || *end != '\0') {
+        return kParseWakeErrorFormat;
+    }
+
+    tm.tm_isdst = -1;
+    time_t wake = mktime(&tm);
+    if (wake == -1) {
+        return kParseWakeErrorFormat;
+    }
+    if (wake <= now) {
+        return kParseWakeErrorPast;
+    }
+
+    *date = AbsoluteTimeFromTime(wake);
+    return kParseWakeSuccess;
+}
+
+int ParseWakeInterval(const char *string, CFTimeInterval *interval) {
+    char *end;
+    double value = strtod(string, &end);
+
+    // Reject nan, inf and values that overflow like 1e400
+    if (end == string || !isfinite(value) || value <= 0) {
+        return kParseWakeErrorFormat;
+    }
+    if (strcmp(end, "h") == 0) {
+        value *= 3600;
+    } else if (strcmp(end, "m") == 0) {
+        value *= 60;
+    } else if (*end != '\0' && strcmp(end, "s") != 0) {
+        return kParseWakeErrorFormat;
+    }
+    if (!isfinite(value)) {
+        return kParseWakeErrorFormat;
+    }
+
+    *interval = value;
+    return kParseWakeSuccess;
+}
+
+/* Parses the days of a schedule and returns the days bitfield or 0. */
+static int ParseDays(const char *string) {
+    static const char kDayLetters[] = "MTWRFSU";
+    int days = 0;
+
+    if (strcmp(string, "daily") == 0) {
+        return kAllDays;
+    }
+    if (strcmp(string, "weekdays") == 0) {
+        return kIOPMMonday | kIOPMTuesday | kIOPMWednesday | kIOPMThursday |
+               kIOPMFriday;
+    }
+    if (strcmp(string, "weekends") == 0) {
+        return kIOPMSaturday | kIOPMSunday;
+    }
+    for (const char *c = string; *c; c++) {
+        const char *letter = strchr(kDayLetters, *c);
+        if (!letter) {
+            return 0;
+        }
+        days |= 1 << (letter - kDayLetters);
+    }
+    return days;
+}
+
+int WeeklyScheduleParse(const char *string, WeeklySchedule *schedule) {
+    char days[16];
+    int sleepHour, sleepMinute, wakeHour, wakeMinute;
+    char trailing;
+
+    if (sscanf(string,
+               "%15s %d:%d %d:%d %c",
+               days,
+               &sleepHour,
+               &sleepMinute,
+               &wakeHour,
+               &wakeMinute,
+               &trailing) != 5) {
+        return kWeeklyScheduleErrorFormat;
+    }
+    if (sleepHour < 0 || sleepHour > 23 || sleepMinute < 0 ||
+        sleepMinute > 59 || wakeHour < 0 || wakeHour > 23 ||
+        wakeMinute < 0 || wakeMinute > 59) {
+        return kWeeklyScheduleErrorFormat;
+    }
+
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->sleepDays = ParseDays(days);
+    schedule->sleepMinute = sleepHour * 60 + sleepMinute;
+    schedule->wakeMinute = wakeHour * 60 + wakeMinute;
+    if (!schedule->sleepDays ||
+        schedule->sleepMinute == schedule->wakeMinute) {
+        return kWeeklyScheduleErrorFormat;
+    }
+
+    WeeklyScheduleCompile(schedule);
+    return kWeeklyScheduleSuccess;
+}
+
+void WeeklyScheduleCompile(WeeklySchedule *schedule) {
+    int days = schedule->sleepDays & kAllDays;
+
+    // Windows that span midnight end on the following day
+    if (schedule->wakeMinute > schedule->sleepMinute) {
+        schedule->wakeDays = days;
+    } else {
+        schedule->wakeDays = ((days << 1) | (days >> 6)) & kAllDays;
+    }
+
+    for (int day = 0; day < 7; day++) {
+        int offset = 1;
+        while (offset < 7 && !(days & (1 << ((day + offset) % 7)))) {
+            offset++;
+        }
+        schedule->daysToNextSleep[day] = offset;
+    }
+}
+
+CFAbsoluteTime WeeklyScheduleNextSleep(const WeeklySchedule *schedule,
+                                       CFAbsoluteTime date) {
+    time_t now = TimeFromAbsoluteTime(date);
+    struct tm tm;
+
+    localtime_r(&now, &tm);
+
+    // Use today's window if it has not started yet
+    int day = (tm.tm_wday + 6) % 7;
+    int second = (tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec;
+    if (!(schedule->sleepDays & (1 << day)) ||
+        second >= schedule->sleepMinute * 60) {
+        tm.tm_mday += schedule->daysToNextSleep[day];
+    }
+
+    tm.tm_hour = schedule->sleepMinute / 60;
+    tm.tm_min = schedule->sleepMinute % 60;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return AbsoluteTimeFromTime(mktime(&tm));
+}
+
+CFAbsoluteTime WeeklyScheduleWake(const WeeklySchedule *schedule,
+                                  CFAbsoluteTime sleepDate) {
+    time_t sleep = TimeFromAbsoluteTime(sleepDate);
+    struct tm tm;
+
+    localtime_r(&sleep, &tm);
+    if (schedule->wakeMinute <= schedule->sleepMinute) {
+        tm.tm_mday++;
+    }
+    tm.tm_hour = schedule->wakeMinute / 60;
+    tm.tm_min = schedule->wakeMinute % 60;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    return AbsoluteTimeFromTime(mktime(&tm));
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_CALENDAR_H
+#define HIBERNATE_CALENDAR_H
+
+#if defined(__APPLE__)
+#include <CoreFoundation/CFDate.h>
+#else
+/* The time types of CoreFoundation, which is only available on macOS. */
+typedef double CFTimeInterval;
+typedef CFTimeInterval CFAbsoluteTime;
+
+/* The number of seconds from 1970 to the CFAbsoluteTime reference date. */
+#define kCFAbsoluteTimeIntervalSince1970 978307200.0
+
+/* The days of the week as defined by IOPMLibPrivate.h. */
+#define kIOPMMonday (1 << 0)
+#define kIOPMTuesday (1 << 1)
+#define kIOPMWednesday (1 << 2)
+#define kIOPMThursday (1 << 3)
+#define kIOPMFriday (1 << 4)
+#define kIOPMSaturday (1 << 5)
+#define kIOPMSunday (1 << 6)
+#endif
+
+/* All days of the week. */
+#define kAllDays (kIOPMMonday | kIOPMTuesday | kIOPMWednesday | \
+                  kIOPMThursday | kIOPMFriday | kIOPMSaturday | kIOPMSunday)
+/* The number of minutes per day. */
+#define kMinutesPerDay (24 * 60)
+
+/* The string has been parsed successfully. */
+#define kParseWakeSuccess 0
+/* The string is not a valid date or interval. */
+#define kParseWakeErrorFormat 1
+/* The date is not in the future. */
+#define kParseWakeErrorPast 2
+
+/*
+ * Parses a local date of the form "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]". The
+ * latter refers to the next occurrence of that time of day.
+ */
+int ParseWakeDate(const char *string, CFAbsoluteTime *date);
+
+/*
+ * Parses a positive, finite interval in seconds. The suffixes "s", "m" and "h"
+ * can be used to specify seconds, minutes and hours. Nothing else may follow
+ * the number.
+ */
+int ParseWakeInterval(const char *string, CFTimeInterval *interval);
+
+/*
+ * A weekly hibernation window. The system hibernates at sleepMinute on each of
+ * the sleepDays and wakes at the next wakeMinute. Days use the kIOPMMonday to
+ * kIOPMSunday bitfield of IOPMScheduleRepeatingPowerEvent, minutes are counted
+ * from local midnight.
+ */
+typedef struct {
+    int sleepDays;
+    int sleepMinute;
+    int wakeMinute;
+    /* The days on which the windows end. Set by WeeklyScheduleCompile. */
+    int wakeDays;
+    /*
+     * The number of days from each weekday (Monday is 0) to the next sleep
+     * day after it. Set by WeeklyScheduleCompile.
+     */
+    int daysToNextSleep[7];
+} WeeklySchedule;
+
+/* The schedule has been parsed successfully. */
+#define kWeeklyScheduleSuccess 0
+/* The schedule is not of the form "days HH:MM HH:MM". */
+#define kWeeklyScheduleErrorFormat 1
+/* The system has no repeating sleep and wake event to adopt. */
+#define kWeeklyScheduleErrorSystem 2
+
+/*
+ * Parses a schedule of the form "days HH:MM HH:MM" where the first time is the
+ * time to hibernate and the second time is the time to wake. The days are
+ * "daily", "weekdays", "weekends" or any combination of the letters MTWRFSU.
+ */
+int WeeklyScheduleParse(const char *string, WeeklySchedule *schedule);
+
+/*
+ * Computes the lookup tables used to evaluate the schedule. Must be called
+ * after the schedule has been modified.
+ */
+void WeeklyScheduleCompile(WeeklySchedule *schedule);
+
+/*
+ * Returns the start of the first window after the specified date. Runs in
+ * constant time using the tables computed by WeeklyScheduleCompile.
+ */
+CFAbsoluteTime WeeklyScheduleNextSleep(const WeeklySchedule *schedule,
+                                       CFAbsoluteTime date);
+
+/* Returns the end of the window starting at the specified date. */
+CFAbsoluteTime WeeklyScheduleWake(const WeeklySchedule *schedule,
+                                  CFAbsoluteTime sleepDate);
+
+#endif /* HIBERNATE_CALENDAR_H */
@@ -0,0 +1,1430 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#if defined(__APPLE__)
+#include <sys/sysctl.h>
+#endif
+
+#include "IOHibernatePrivate.h"
+
+#include "agent.h"
+#include "commands.h"
+#include "control.h"
+#include "dedup.h"
+#include "delta.h"
+#include "diff.h"
+#include "entropy.h"
+#include "fuzz.h"
+#include "generate.h"
+#include "image.h"
+#include "polled.h"
+#include "prefetch.h"
+#include "preview.h"
+#include "progress.h"
+#include "tuner.h"
+
+/* The default number of iterations of the progress indicator benchmark. */
+#define kProgressBenchmarkIterations 100
+
+/*
+ * Benchmarks the blend implementations of the progress indicator renderer.
+ * Returns one of the kMain codes.
+ */
+int RunProgressBenchmark(int argc, const char *argv[]) {
+    unsigned iterations = kProgressBenchmarkIterations;
+
+    if (argc > 2 || (argc == 2 && sscanf(argv[1], "%u", &iterations) != 1)) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    switch (ProgressBenchmark(iterations, stdout)) {
+        case kProgressBenchmarkSuccess:
+            return kMainSuccess;
+        case kProgressBenchmarkErrorMismatch:
+            fprintf(stderr, "hibernate: blend results differ from the "
+                            "scalar reference\n");
+            break;
+        case kProgressBenchmarkErrorMemory:
+            perror("hibernate: allocating framebuffers failed\n");
+            break;
+    }
+    return kMainErrorBenchmark;
+}
+
+/* The names of the preview images used in the PNG file names. */
+static const char *kPreviewImageNames[kIOPreviewImageCount] = {
+    "desktop", "lockscreen"
+};
+
+/* The long command line options of the preview command. */
+static const struct option kPreviewOptions[] = {
+    { "width", required_argument, NULL, 'w' },
+    { "filter", required_argument, NULL, 'f' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Writes the preview images of a hibernation image to PNG files, downscaled to
+ * the specified width if any. Returns one of the kMain codes.
+ */
+int RunPreview(int argc, const char *argv[]) {
+    uint32_t width = 0;
+    int filter = kPreviewFilterBox;
+    const char *prefix = "preview";
+    int rc;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kPreviewOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'w':
+                if (sscanf(optarg, "%u", &width) != 1 || width == 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "box") == 0) {
+                    filter = kPreviewFilterBox;
+                } else if (strcmp(optarg, "lanczos") == 0) {
+                    filter = kPreviewFilterLanczos;
+                } else {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'o':
+                prefix = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 1) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Map the image and locate the preview
+    HibernateImage image;
+    rc = ImageOpen(&image, argv[optind]);
+    if (rc != kImageOpenSuccess) {
+        switch (rc) {
+            case kImageOpenErrorFile:
+                perror("hibernate: opening image failed\n");
+                break;
+            case kImageOpenErrorFormat:
+                fprintf(stderr, "hibernate: not a hibernation image\n");
+                break;
+        }
+        return kMainErrorImage;
+    }
+    const hibernate_preview_t *preview;
+    const uint8_t *pixels;
+    rc = ImageGetPreview(&image, &preview, &pixels);
+    if (rc != kImagePreviewSuccess) {
+        switch (rc) {
+            case kImagePreviewErrorMissing:
+                fprintf(stderr, "hibernate: image contains no preview\n");
+                break;
+            case kImagePreviewErrorFormat:
+                fprintf(stderr, "hibernate: invalid preview\n");
+                break;
+        }
+        ImageClose(&image);
+        return kMainErrorImage;
+    }
+
+    // Resize in parallel stripes, one per processor
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned threads = processors > 0 ? (unsigned) processors : 1;
+    size_t imageSize = (size_t) preview->width * preview->height *
+                       (preview->depth / 8);
+
+    rc = kMainSuccess;
+    for (uint32_t i = 0; i < preview->imageCount && rc == kMainSuccess; i++) {
+        PreviewBitmap bitmap = {
+            pixels + i * imageSize,
+            preview->width * (preview->depth / 8),
+            preview->width,
+            preview->height,
+            preview->depth
+        };
+        uint32_t outWidth = width ? width : preview->width;
+        uint32_t outHeight = preview->height;
+        if (width) {
+            outHeight = (uint32_t) (((uint64_t) preview->height * width +
+                                     preview->width / 2) / preview->width);
+            if (outHeight == 0) {
+                outHeight = 1;
+            }
+        }
+
+        uint32_t *resized;
+        if (PreviewResize(&bitmap,
+                          outWidth,
+                          outHeight,
+                          filter,
+                          threads,
+                          &resized) != kPreviewResizeSuccess) {
+            fprintf(stderr, "hibernate: resizing preview failed\n");
+            rc = kMainErrorImage;
+            break;
+        }
+
+        char path[1024];
+        snprintf(path,
+                 sizeof(path),
+                 "%s-%s.png",
+                 prefix,
+                 kPreviewImageNames[i]);
+        if (PreviewWritePNG(path, resized, outWidth, outHeight) != 0) {
+            perror("hibernate: writing PNG file failed\n");
+            rc = kMainErrorImage;
+        } else {
+            printf("%s %ux%u\n", path, outWidth, outHeight);
+        }
+        free(resized);
+    }
+
+    ImageClose(&image);
+    return rc;
+}
+
+/* The long command line options of the write-benchmark command. */
+static const struct option kWriteBenchmarkOptions[] = {
+    { "size", required_argument, NULL, 's' },
+    { "queue-depth", required_argument, NULL, 'q' },
+    { "block-size", required_argument, NULL, 'b' },
+    { "alignment", required_argument, NULL, 'a' },
+    { "extents", required_argument, NULL, 'e' },
+    { "all", no_argument, NULL, 'A' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Parses a comma separated list of numbers and multiplies them by scale.
+ * Returns 0 on success and -1 otherwise.
+ */
+static int ParseList(const char *string,
+                     uint32_t scale,
+                     uint32_t *values,
+                     unsigned *count) {
+    *count = 0;
+    for (;;) {
+        char *end;
+        unsigned long value = strtoul(string, &end, 10);
+        if (end == string || value > UINT32_MAX / scale ||
+            *count == kPolledMaxValues) {
+            return -1;
+        }
+        values[(*count)++] = (uint32_t) value * scale;
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        string = end + 1;
+    }
+}
+
+/*
+ * Measures the throughput of the polled writes of the image to a drive over a
+ * sweep of their parameters. Returns one of the kMain codes.
+ */
+int RunWriteBenchmark(int argc, const char *argv[]) {
+    PolledOptions options;
+    unsigned long long size;
+
+    PolledOptionsInit(&options);
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kWriteBenchmarkOptions,
+                                 NULL)) != -1) {
+        int rc = 0;
+        switch (option) {
+            case 's':
+                rc = sscanf(optarg, "%llu", &size) == 1 && size > 0 ? 0 : -1;
+                options.size = (uint64_t) size << 20;
+                break;
+            case 'q':
+                rc = ParseList(optarg,
+                               1,
+                               options.queueDepths,
+                               &options.queueDepthCount);
+                break;
+            case 'b':
+                rc = ParseList(optarg,
+                               1024,
+                               options.blockSizes,
+                               &options.blockSizeCount);
+                break;
+            case 'a':
+                rc = ParseList(optarg,
+                               1,
+                               options.alignments,
+                               &options.alignmentCount);
+                break;
+            case 'e':
+                rc = ParseList(optarg,
+                               1,
+                               options.extentCounts,
+                               &options.extentCountCount);
+                break;
+            case 'A':
+                options.all = 1;
+                break;
+            default:
+                rc = -1;
+                break;
+        }
+        if (rc != 0) {
+            PrintUsage(stderr);
+            return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 1) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Project the write time of the last hibernation image
+    uint64_t projectedBytes = 0;
+#if defined(__APPLE__)
+    hibernate_statistics_t statistics;
+    size_t length = sizeof(statistics);
+    if (sysctlbyname(kIOSysctlHibernateStatistics,
+                     &statistics,
+                     &length,
+                     NULL,
+                     0) == 0 && length == sizeof(statistics)) {
+        projectedBytes = statistics.imageSize;
+    }
+#endif
+
+    switch (PolledBenchmark(argv[optind], &options, projectedBytes, stdout)) {
+        case kPolledBenchmarkSuccess:
+            return kMainSuccess;
+        case kPolledBenchmarkErrorFile:
+            perror("hibernate: preparing benchmark file failed\n");
+            break;
+        case kPolledBenchmarkErrorOptions:
+            fprintf(stderr, "hibernate: invalid write parameters\n");
+            return kMainErrorUsage;
+        case kPolledBenchmarkErrorResources:
+            fprintf(stderr, "hibernate: write benchmark failed\n");
+            break;
+    }
+    return kMainErrorBenchmark;
+}
+
+/* The long command line options of the verify-encryption command. */
+static const struct option kVerifyEncryptionOptions[] = {
+    { "threshold", required_argument, NULL, 't' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Prints a region found by EntropyVerify. */
+static void PrintEntropyRegion(const EntropyRegion *region, void *context) {
+    (void) context;
+    static const char *const kKindNames[] = {
+        "uncovered",
+        "plaintext",
+        "cipher-outside"
+    };
+
+    printf("%-15s pages %llu-%llu (%llu pages",
+           kKindNames[region->kind],
+           (unsigned long long) region->firstPage,
+           (unsigned long long) (region->firstPage + region->pageCount - 1),
+           (unsigned long long) region->pageCount);
+    if (region->kind != kEntropyRegionUncovered) {
+        printf(", entropy %.2f-%.2f", region->minEntropy, region->maxEntropy);
+    }
+    printf(")\n");
+}
+
+/*
+ * Verifies that the encrypted range of a hibernation image matches the entropy
+ * of its pages. Returns one of the kMain codes.
+ */
+int RunVerifyEncryption(int argc, const char *argv[]) {
+    double threshold = kEntropyThresholdDefault;
+    EntropySummary summary;
+    struct timespec start, end;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kVerifyEncryptionOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 't':
+                if (sscanf(optarg, "%lf", &threshold) != 1 ||
+                    threshold <= 0 || threshold > 8) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 1) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = EntropyVerify(argv[optind],
+                           threshold,
+                           processors > 0 ? (unsigned) processors : 1,
+                           PrintEntropyRegion,
+                           NULL,
+                           &summary);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    switch (rc) {
+        case kEntropyVerifySuccess:
+            break;
+        case kEntropyVerifyErrorFile:
+            perror("hibernate: reading image failed\n");
+            return kMainErrorImage;
+        case kEntropyVerifyErrorFormat:
+            fprintf(stderr, "hibernate: not a hibernation image\n");
+            return kMainErrorImage;
+        case kEntropyVerifyErrorNotEncrypted:
+            fprintf(stderr, "hibernate: image has no encrypted range\n");
+            return kMainErrorVerify;
+        case kEntropyVerifyErrorResources:
+            fprintf(stderr, "hibernate: verifying image failed\n");
+            return kMainErrorImage;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("encrypted range 0x%llx-0x%llx, plaintext up to 0x%llx\n"
+           "%llu pages in %.2f s (%.0f MB/s): %llu encrypted, "
+           "%llu uncovered, %llu plaintext, %llu cipher-outside\n",
+           (unsigned long long) summary.encryptStart,
+           (unsigned long long) summary.encryptEnd,
+           (unsigned long long) summary.plaintextEnd,
+           (unsigned long long) summary.pages,
+           seconds,
+           seconds > 0 ? summary.pages * (double) kImagePageSize /
+                         seconds / 1e6 : 0,
+           (unsigned long long) summary.encryptedPages,
+           (unsigned long long) summary.uncoveredPages,
+           (unsigned long long) summary.plaintextPages,
+           (unsigned long long) summary.cipherOutsidePages);
+
+    if (summary.uncoveredPages > 0 ||
+        summary.plaintextPages > 0 ||
+        summary.cipherOutsidePages > 0) {
+        return kMainErrorVerify;
+    }
+    return kMainSuccess;
+}
+
+/* The long command line options of the prefetch command. */
+static const struct option kPrefetchOptions[] = {
+    { "read-rate", required_argument, NULL, 'r' },
+    { "budget", required_argument, NULL, 'b' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Simulates the page accesses of a trace on wake from an image and recommends
+ * the pages of image2 to move into image1. Returns one of the kMain codes.
+ */
+int RunPrefetch(int argc, const char *argv[]) {
+    double readRate = 0;
+    double budget = kPrefetchDefaultBudget / 1048576.0;
+    const char *outputPath = NULL;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kPrefetchOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'r':
+                if (sscanf(optarg, "%lf", &readRate) != 1 || readRate <= 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                readRate *= 1e6;
+                break;
+            case 'b':
+                if (sscanf(optarg, "%lf", &budget) != 1 || budget < 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 2) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Read at the speed the kernel has read image2 on the last wake
+    if (readRate == 0) {
+        readRate = kPrefetchDefaultReadRate;
+#if defined(__APPLE__)
+        hibernate_statistics_t statistics;
+        size_t length = sizeof(statistics);
+        if (sysctlbyname(kIOSysctlHibernateStatistics,
+                         &statistics,
+                         &length,
+                         NULL,
+                         0) == 0 && length == sizeof(statistics) &&
+            statistics.kernelImageReadDuration > 0 &&
+            statistics.imageSize > statistics.image1Size) {
+            readRate = (statistics.imageSize - statistics.image1Size) /
+                       (statistics.kernelImageReadDuration / 1e3);
+        }
+#endif
+    }
+
+    HibernateImage image;
+    int rc = ImageOpen(&image, argv[optind]);
+    if (rc != kImageOpenSuccess) {
+        switch (rc) {
+            case kImageOpenErrorFile:
+                perror("hibernate: opening image failed\n");
+                break;
+            case kImageOpenErrorFormat:
+                fprintf(stderr, "hibernate: not a hibernation image\n");
+                break;
+        }
+        return kMainErrorImage;
+    }
+    FILE *output = NULL;
+    if (outputPath && !(output = fopen(outputPath, "w"))) {
+        perror("hibernate: creating recommendation failed\n");
+        ImageClose(&image);
+        return kMainErrorImage;
+    }
+
+    PrefetchReport report;
+    rc = PrefetchAnalyze(&image,
+                         argv[optind + 1],
+                         readRate,
+                         (uint64_t) (budget * 1048576),
+                         output,
+                         &report);
+    ImageClose(&image);
+    if (output && fclose(output) != 0 && rc == kPrefetchAnalyzeSuccess) {
+        perror("hibernate: writing recommendation failed\n");
+        return kMainErrorImage;
+    }
+    switch (rc) {
+        case kPrefetchAnalyzeSuccess:
+            PrefetchPrint(&report, stdout);
+            return kMainSuccess;
+        case kPrefetchAnalyzeErrorTrace:
+            fprintf(stderr, "hibernate: reading access trace failed\n");
+            break;
+        case kPrefetchAnalyzeErrorFormat:
+            fprintf(stderr, "hibernate: invalid page list or page runs\n");
+            break;
+        case kPrefetchAnalyzeErrorResources:
+            fprintf(stderr, "hibernate: analyzing image failed\n");
+            break;
+    }
+    return kMainErrorImage;
+}
+
+/* The long command line options of the diff command. */
+static const struct option kDiffOptions[] = {
+    { "region", required_argument, NULL, 'r' },
+    { "top", required_argument, NULL, 't' },
+    { "content", no_argument, NULL, 'c' },
+    { "threads", required_argument, NULL, 'j' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Opens an image and reports errors. Returns 0 on success. */
+static int OpenImage(HibernateImage *image, const char *path) {
+    switch (ImageOpen(image, path)) {
+        case kImageOpenSuccess:
+            return 0;
+        case kImageOpenErrorFile:
+            perror("hibernate: opening image failed\n");
+            break;
+        case kImageOpenErrorFormat:
+            fprintf(stderr, "hibernate: %s is not a hibernation image\n", path);
+            break;
+    }
+    return -1;
+}
+
+/*
+ * Compares the page lists and optionally the pages of the images of two sleep
+ * cycles. Returns one of the kMain codes.
+ */
+int RunDiff(int argc, const char *argv[]) {
+    unsigned region = kDiffDefaultRegionPages / (1048576 / kImagePageSize);
+    unsigned top = 10;
+    int compareContent = 0;
+    unsigned threads = 0;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kDiffOptions,
+                                 NULL)) != -1) {
+        int rc = 0;
+        switch (option) {
+            case 'r':
+                rc = sscanf(optarg, "%u", &region) == 1 && region > 0 &&
+                     region <= 1048576 ? 0 : -1;
+                break;
+            case 't':
+                rc = sscanf(optarg, "%u", &top) == 1 ? 0 : -1;
+                break;
+            case 'c':
+                compareContent = 1;
+                break;
+            case 'j':
+                rc = sscanf(optarg, "%u", &threads) == 1 ? 0 : -1;
+                break;
+            default:
+                rc = -1;
+                break;
+        }
+        if (rc != 0) {
+            PrintUsage(stderr);
+            return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 2) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+    if (threads == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = processors > 0 ? (unsigned) processors : 1;
+    }
+
+    HibernateImage first, second;
+    if (OpenImage(&first, argv[optind]) != 0) {
+        return kMainErrorImage;
+    }
+    if (OpenImage(&second, argv[optind + 1]) != 0) {
+        ImageClose(&first);
+        return kMainErrorImage;
+    }
+
+    DiffResult result;
+    int rc = DiffImages(&first,
+                        &second,
+                        region * (1048576 / kImagePageSize),
+                        compareContent,
+                        threads,
+                        &result);
+    ImageClose(&second);
+    ImageClose(&first);
+    switch (rc) {
+        case kDiffImagesSuccess:
+            DiffPrint(&result, top, stdout);
+            DiffFree(&result);
+            return kMainSuccess;
+        case kDiffImagesErrorFormat:
+            fprintf(stderr, "hibernate: invalid page list or page runs\n");
+            break;
+        case kDiffImagesErrorResources:
+            fprintf(stderr, "hibernate: comparing images failed\n");
+            break;
+    }
+    return kMainErrorImage;
+}
+
+/* The long command line options of the dedup command. */
+static const struct option kDedupOptions[] = {
+    { "memory", required_argument, NULL, 'm' },
+    { "threads", required_argument, NULL, 'j' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Counts the zero and duplicate pages of an image and the bytes writing each
+ * distinct page once would save. Returns one of the kMain codes.
+ */
+int RunDedup(int argc, const char *argv[]) {
+    unsigned memory = kDedupDefaultMemory >> 20;
+    unsigned threads = 0;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kDedupOptions,
+                                 NULL)) != -1) {
+        int rc = 0;
+        switch (option) {
+            case 'm':
+                rc = sscanf(optarg, "%u", &memory) == 1 && memory > 0 ? 0 : -1;
+                break;
+            case 'j':
+                rc = sscanf(optarg, "%u", &threads) == 1 ? 0 : -1;
+                break;
+            default:
+                rc = -1;
+                break;
+        }
+        if (rc != 0) {
+            PrintUsage(stderr);
+            return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 1) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+    if (threads == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = processors > 0 ? (unsigned) processors : 1;
+    }
+
+    HibernateImage image;
+    if (OpenImage(&image, argv[optind]) != 0) {
+        return kMainErrorImage;
+    }
+    DedupReport report;
+    int rc = DedupAnalyze(&image, (uint64_t) memory << 20, threads, &report);
+    ImageClose(&image);
+    switch (rc) {
+        case kDedupAnalyzeSuccess:
+            DedupPrint(&report, stdout);
+            return kMainSuccess;
+        case kDedupAnalyzeErrorFormat:
+            fprintf(stderr, "hibernate: invalid page runs\n");
+            break;
+        case kDedupAnalyzeErrorResources:
+            fprintf(stderr, "hibernate: allocating the hash table failed\n");
+            break;
+    }
+    return kMainErrorImage;
+}
+
+/* The long command line options of the delta command. */
+static const struct option kDeltaOptions[] = {
+    { "block-size", required_argument, NULL, 'b' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Prints the bytes written and the time of an image written to the device. */
+static void PrintDeltaResult(const char *name, const DeltaResult *result) {
+    printf("%-13s %llu of %llu pages written, %llu map entries\n"
+           "%-13s %.1f MB in %llu writes in %.3f s (%.0f MB/s)\n",
+           name,
+           (unsigned long long) result->changedPages,
+           (unsigned long long) result->pages,
+           (unsigned long long) result->entries,
+           "",
+           result->bytesWritten / 1048576.0,
+           (unsigned long long) result->writes,
+           result->seconds,
+           result->seconds > 0 ? result->bytesWritten / result->seconds / 1e6
+                               : 0);
+}
+
+/*
+ * Writes an image to a file standing in for the device in full and as the
+ * changes to the previous image, and compares both. Returns one of the kMain
+ * codes.
+ */
+int RunDelta(int argc, const char *argv[]) {
+    unsigned blockSize = kDeltaDefaultBlockSize;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kDeltaOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'b':
+                if (sscanf(optarg, "%u", &blockSize) != 1) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 3) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    HibernateImage previous, next;
+    DeltaDevice device;
+    if (OpenImage(&previous, argv[optind]) != 0) {
+        return kMainErrorImage;
+    }
+    if (OpenImage(&next, argv[optind + 1]) != 0) {
+        ImageClose(&previous);
+        return kMainErrorImage;
+    }
+    if (DeltaDeviceOpen(&device, argv[optind + 2], blockSize) != 0) {
+        perror("hibernate: opening device failed\n");
+        ImageClose(&next);
+        ImageClose(&previous);
+        return kMainErrorImage;
+    }
+
+    // The previous image must be on the device before the delta is written
+    DeltaResult full, delta, setup;
+    int rc = DeltaWriteFull(&device, &next, &full);
+    if (rc == kDeltaSuccess) {
+        rc = DeltaWriteFull(&device, &previous, &setup);
+    }
+    if (rc == kDeltaSuccess) {
+        rc = DeltaWrite(&device, &previous, &next, &delta);
+    }
+    if (rc == kDeltaSuccess) {
+        rc = DeltaVerify(&device, &previous, &next);
+    }
+    DeltaDeviceClose(&device);
+    ImageClose(&next);
+    ImageClose(&previous);
+    switch (rc) {
+        case kDeltaSuccess:
+            break;
+        case kDeltaErrorDevice:
+            perror("hibernate: writing device failed\n");
+            return kMainErrorImage;
+        case kDeltaErrorFormat:
+            fprintf(stderr, "hibernate: invalid page runs\n");
+            return kMainErrorImage;
+        case kDeltaErrorResources:
+            fprintf(stderr, "hibernate: writing delta failed\n");
+            return kMainErrorImage;
+        case kDeltaErrorMismatch:
+            fprintf(stderr, "hibernate: delta does not restore the image\n");
+            return kMainErrorImage;
+    }
+
+    PrintDeltaResult("full rewrite:", &full);
+    PrintDeltaResult("delta:", &delta);
+    printf("the delta writes %.1f %% of the bytes in %.1f %% of the time and "
+           "restores the image\n",
+           full.bytesWritten > 0 ? 100.0 * delta.bytesWritten /
+                                   full.bytesWritten : 0,
+           full.seconds > 0 ? 100 * delta.seconds / full.seconds : 0);
+    return kMainSuccess;
+}
+
+/* The long command line options of the generate command. */
+static const struct option kGenerateOptions[] = {
+    { "size", required_argument, NULL, 's' },
+    { "file-size", required_argument, NULL, 'f' },
+    { "zero", required_argument, NULL, 'z' },
+    { "duplicate", required_argument, NULL, 'd' },
+    { "text", required_argument, NULL, 'x' },
+    { "seed", required_argument, NULL, 'r' },
+    { "threads", required_argument, NULL, 'j' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Parses gigabytes into bytes. Returns 0 on success and -1 otherwise. */
+static int ParseGigabytes(const char *string, uint64_t *bytes) {
+    double number;
+    char end;
+
+    if (sscanf(string, "%lf%c", &number, &end) != 1 || number < 0) {
+        return -1;
+    }
+    *bytes = (uint64_t) (number * 1e9);
+    return 0;
+}
+
+/* Parses a percentage into a ratio. Returns 0 on success and -1 otherwise. */
+static int ParsePercent(const char *string, double *ratio) {
+    double number;
+    char end;
+
+    if (sscanf(string, "%lf%c", &number, &end) != 1 ||
+        number < 0 || number > 100) {
+        return -1;
+    }
+    *ratio = number / 100;
+    return 0;
+}
+
+/*
+ * Writes a synthetic hibernation image for testing and benchmarking the
+ * offline tools. Returns one of the kMain codes.
+ */
+int RunGenerate(int argc, const char *argv[]) {
+    GenerateOptions options;
+    GenerateResult result;
+    struct timespec start, end;
+    unsigned long long number;
+
+    GenerateOptionsInit(&options);
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kGenerateOptions,
+                                 NULL)) != -1) {
+        int rc = 0;
+        switch (option) {
+            case 's':
+                rc = ParseGigabytes(optarg, &options.size);
+                break;
+            case 'f':
+                rc = ParseGigabytes(optarg, &options.fileSize);
+                break;
+            case 'z':
+                rc = ParsePercent(optarg, &options.zeroRatio);
+                break;
+            case 'd':
+                rc = ParsePercent(optarg, &options.duplicateRatio);
+                break;
+            case 'x':
+                rc = ParsePercent(optarg, &options.textRatio);
+                break;
+            case 'r':
+                rc = sscanf(optarg, "%llu", &number) == 1 ? 0 : -1;
+                options.seed = number;
+                break;
+            case 'j':
+                rc = sscanf(optarg, "%u", &options.threads) == 1 ? 0 : -1;
+                break;
+            default:
+                rc = -1;
+                break;
+        }
+        if (rc != 0) {
+            PrintUsage(stderr);
+            return kMainErrorUsage;
+        }
+    }
+    if (optind != argc - 1) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int rc = GenerateImage(argv[optind], &options, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    switch (rc) {
+        case kGenerateImageSuccess:
+            break;
+        case kGenerateImageErrorFile:
+            perror("hibernate: writing image failed\n");
+            return kMainErrorImage;
+        case kGenerateImageErrorOptions:
+            fprintf(stderr, "hibernate: invalid image size or shares\n");
+            return kMainErrorUsage;
+        case kGenerateImageErrorResources:
+            fprintf(stderr, "hibernate: generating image failed\n");
+            return kMainErrorImage;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) +
+                     (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%llu pages of memory, %u pages in image1 (%.1f MB), %u pages in "
+           "image2\n"
+           "%.2f GB written in %.2f s (%.0f MB/s)\n",
+           (unsigned long long) result.memoryPages,
+           result.image1Pages,
+           result.image1Size / 1e6,
+           result.image2Pages,
+           result.imageSize / 1e9,
+           seconds,
+           seconds > 0 ? result.imageSize / seconds / 1e6 : 0);
+    return kMainSuccess;
+}
+
+
+/* The default number of executions of the fuzz command per target. */
+#define kFuzzExecutions 1000000
+/* The size of the synthetic image the fuzz command mutates. */
+#define kFuzzSeedSize (1 << 20)
+
+/* The long command line options of the fuzz command. */
+static const struct option kFuzzOptions[] = {
+    { "target", required_argument, NULL, 't' },
+    { "executions", required_argument, NULL, 'n' },
+    { "seed", required_argument, NULL, 'r' },
+    { "save", required_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Fuzzes the image parsers with mutations of a small synthetic image and
+ * prints the executions per second. Returns one of the kMain codes.
+ */
+int RunFuzz(int argc, const char *argv[]) {
+    int first = 0;
+    int last = kFuzzTargetCount - 1;
+    unsigned long long executions = kFuzzExecutions;
+    unsigned long long seed = 1;
+    const char *savePath = NULL;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kFuzzOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 't':
+                first = 0;
+                while (first < kFuzzTargetCount &&
+                       strcmp(optarg, kFuzzTargetNames[first]) != 0) {
+                    first++;
+                }
+                if (first == kFuzzTargetCount) {
+                    fprintf(stderr,
+                            "hibernate: unknown fuzz target: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                last = first;
+                break;
+            case 'n':
+                if (sscanf(optarg, "%llu", &executions) != 1) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'r':
+                if (sscanf(optarg, "%llu", &seed) != 1) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 's':
+                savePath = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Generate a small image with all structures as the seed
+    char temporaryPath[] = "/tmp/hibernate-fuzz.XXXXXX";
+    const char *path = savePath;
+    if (!path) {
+        int fd = mkstemp(temporaryPath);
+        if (fd == -1) {
+            perror("hibernate: creating seed image failed\n");
+            return kMainErrorImage;
+        }
+        close(fd);
+        path = temporaryPath;
+    }
+    GenerateOptions options;
+    GenerateResult result;
+    GenerateOptionsInit(&options);
+    options.size = kFuzzSeedSize;
+    options.previewWidth = 32;
+    options.previewHeight = 20;
+    options.seed = seed;
+    options.threads = 1;
+    HibernateImage image;
+    int rc = GenerateImage(path, &options, &result);
+    if (rc == kGenerateImageSuccess) {
+        rc = ImageOpen(&image, path);
+    }
+    if (!savePath) {
+        unlink(path);
+    }
+    if (rc != kImageOpenSuccess) {
+        fprintf(stderr, "hibernate: generating seed image failed\n");
+        return kMainErrorImage;
+    }
+
+    for (int target = first; target <= last; target++) {
+        FuzzStatistics statistics;
+        if (FuzzRun(target,
+                    image.base,
+                    image.size,
+                    executions,
+                    seed + target,
+                    stdout,
+                    &statistics) != kFuzzRunSuccess) {
+            fprintf(stderr, "hibernate: fuzzing failed\n");
+            ImageClose(&image);
+            return kMainErrorImage;
+        }
+        printf("%s: %llu executions in %.1f s (%.0f/s), %llu accepted\n",
+               kFuzzTargetNames[target],
+               (unsigned long long) statistics.executions,
+               statistics.seconds,
+               statistics.seconds > 0
+                       ? statistics.executions / statistics.seconds
+                       : 0,
+               (unsigned long long) statistics.accepted);
+    }
+    ImageClose(&image);
+    return kMainSuccess;
+}
+
+/* The default number of simulated agents of the control benchmark. */
+#define kControlBenchmarkAgents 1000
+/* The default number of requests sent to each simulated agent. */
+#define kControlBenchmarkRequests 100
+/* The default number of requests in flight. */
+#define kControlBenchmarkConcurrency 8
+
+/* The long command line options of the control-benchmark command. */
+static const struct option kControlBenchmarkOptions[] = {
+    { "agents", required_argument, NULL, 'a' },
+    { "requests", required_argument, NULL, 'r' },
+    { "concurrency", required_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Measures the round trip latency of control requests to many simulated
+ * agents, which execute commands like a resident agent but never hibernate.
+ * Returns one of the kMain codes.
+ */
+int RunControlBenchmark(int argc, const char *argv[]) {
+    unsigned agentCount = kControlBenchmarkAgents;
+    unsigned requests = kControlBenchmarkRequests;
+    unsigned concurrency = kControlBenchmarkConcurrency;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kControlBenchmarkOptions,
+                                 NULL)) != -1) {
+        unsigned *value = NULL;
+        switch (option) {
+            case 'a':
+                value = &agentCount;
+                break;
+            case 'r':
+                value = &requests;
+                break;
+            case 'c':
+                value = &concurrency;
+                break;
+        }
+        if (!value || sscanf(optarg, "%u", value) != 1 || *value == 0) {
+            PrintUsage(stderr);
+            return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // The built-in profiles are enough for set-profile
+    ProfileTable profiles;
+    ProfileTableInit(&profiles);
+    Agent *agents = calloc(agentCount, sizeof(*agents));
+    if (!agents) {
+        fprintf(stderr, "hibernate: control benchmark failed\n");
+        return kMainErrorBenchmark;
+    }
+    for (unsigned i = 0; i < agentCount; i++) {
+        agents[i].profiles = &profiles;
+        agents[i].profile = profiles.profiles[0];
+    }
+
+    // A typical batch of a coordinator
+    uint8_t bytes[256];
+    uint8_t date[sizeof(int64_t)];
+    ControlFrame request;
+    ControlFrameInit(&request, bytes, sizeof(bytes), 0);
+    ControlFrameAdd(&request,
+                    kControlSetProfile,
+                    0,
+                    kProfileDefaultName,
+                    strlen(kProfileDefaultName));
+    ControlEncodeInt64(date, time(NULL) + 3600);
+    ControlFrameAdd(&request, kControlHibernateAt, 0, date, sizeof(date));
+    ControlFrameAdd(&request, kControlQueryStats, 0, NULL, 0);
+    ControlFrameFinish(&request);
+
+    int rc = ControlBenchmark(agentCount,
+                              requests,
+                              concurrency,
+                              &request,
+                              AgentHandleCommand,
+                              agents,
+                              sizeof(*agents),
+                              stdout);
+    free(agents);
+    switch (rc) {
+        case kControlBenchmarkSuccess:
+            return kMainSuccess;
+        case kControlBenchmarkErrorResources:
+            fprintf(stderr, "hibernate: not enough file descriptors or "
+                            "memory for %u agents\n", agentCount);
+            break;
+        case kControlBenchmarkErrorReplies:
+            fprintf(stderr, "hibernate: control replies were missing or "
+                            "invalid\n");
+            break;
+    }
+    return kMainErrorBenchmark;
+}
+
+/* The long command line options of the tune command. */
+static const struct option kTuneOptions[] = {
+    { "replay", required_argument, NULL, 'r' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Prints the observations of the tuner and the setting it chooses next.
+ * Returns one of the kMain codes.
+ */
+int RunTune(int argc, const char *argv[]) {
+    const char *path = kTunerDefaultPath;
+    FILE *replay = NULL;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kTuneOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'r':
+                path = optarg;
+                replay = stdout;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    Tuner tuner;
+    int line;
+    TunerInit(&tuner);
+    int rc = TunerLoad(&tuner, path, replay, &line);
+    switch (rc) {
+        case kTunerLoadErrorOpen:
+            // Nothing has been recorded yet unless a trace is replayed
+            if (replay) {
+                perror("hibernate: opening tuning trace failed\n");
+                return kMainErrorHistory;
+            }
+            break;
+        case kTunerLoadErrorSyntax:
+            fprintf(stderr,
+                    "hibernate: invalid tuning observation in line %d\n",
+                    line);
+            return kMainErrorHistory;
+    }
+
+    TunerPrint(&tuner, stdout);
+    const TunerArm *next = &kTunerArms[TunerChoose(&tuner)];
+    printf("next: free ratio %d%%, free time %d ms\n",
+           next->freeRatio,
+           next->freeTime);
+    return kMainSuccess;
+}
+
+/* The commands selected by the first argument. */
+static const Command kCommands[] = {
+    { "progress-benchmark", RunProgressBenchmark },
+    { "preview", RunPreview },
+    { "write-benchmark", RunWriteBenchmark },
+    { "verify-encryption", RunVerifyEncryption },
+    { "generate", RunGenerate },
+    { "fuzz", RunFuzz },
+    { "prefetch", RunPrefetch },
+    { "diff", RunDiff },
+    { "dedup", RunDedup },
+    { "delta", RunDelta },
+    { "control-benchmark", RunControlBenchmark },
+    { "tune", RunTune }
+};
+#define kCommandCount (sizeof(kCommands) / sizeof(kCommands[0]))
+
+const Command *CommandFind(const char *name) {
+    for (size_t i = 0; i < kCommandCount; i++) {
+        if (strcmp(name, kCommands[i].name) == 0) {
+            return &kCommands[i];
+        }
+    }
+    return NULL;
+}
+
+void PrintCommandSynopsis(FILE *stream) {
+    fprintf(stream,
+            "       hibernate progress-benchmark [iterations]\n"
+            "       hibernate preview [--width pixels] [--filter name]\n"
+            "                 [--output prefix] image\n"
+            "       hibernate write-benchmark [--size MB]\n"
+            "                 [--queue-depth list] [--block-size list]\n"
+            "                 [--alignment list] [--extents list] [--all]\n"
+            "                 file\n"
+            "       hibernate verify-encryption [--threshold bits] image\n"
+            "       hibernate generate [--size GB] [--file-size GB]\n"
+            "                 [--zero percent] [--duplicate percent]\n"
+            "                 [--text percent] [--seed number]\n"
+            "                 [--threads count] image\n"
+            "       hibernate fuzz [--target name] [--executions count]\n"
+            "                 [--seed number] [--save path]\n"
+            "       hibernate prefetch [--read-rate MB/s] [--budget MB]\n"
+            "                 [--output path] image trace\n"
+            "       hibernate diff [--region MB] [--top count] [--content]\n"
+            "                 [--threads count] image image\n"
+            "       hibernate dedup [--memory MB] [--threads count] image\n"
+            "       hibernate delta [--block-size bytes] previous image\n"
+            "                 device\n"
+            "       hibernate control-benchmark [--agents count]\n"
+            "                 [--requests count] [--concurrency count]\n"
+            "       hibernate tune [--replay path]\n");
+}
+
+void PrintCommandDescriptions(FILE *stream) {
+    fprintf(stream,
+            "  progress-benchmark [iterations]\n"
+            "      draw the progress indicator on 5K and 6K framebuffers\n"
+            "      with every blend implementation and print the time per\n"
+            "      frame (default: 100 iterations)\n"
+            "  preview image\n"
+            "      write the desktop and lock screen previews of a\n"
+            "      hibernation image to prefix-desktop.png and\n"
+            "      prefix-lockscreen.png (default prefix: preview),\n"
+            "      downscaled to --width with the box or lanczos filter\n"
+            "  write-benchmark file\n"
+            "      write --size MB (default: 1024) to a file on the drive\n"
+            "      like the kernel writes the image, bypassing the cache,\n"
+            "      and print the throughput for each comma separated\n"
+            "      --queue-depth (default: 2,1,4,8,16,32), --block-size in\n"
+            "      KB (128,16,64,256,1024), deviceBase --alignment in bytes\n"
+            "      (0,512,2048) and number of --extents (1,16,256,4096);\n"
+            "      the first of each is the baseline the others vary from,\n"
+            "      --all runs every combination\n"
+            "  verify-encryption image\n"
+            "      check that encryptStart and encryptEnd cover all pages\n"
+            "      after the restore code and preview, and report pages\n"
+            "      whose entropy is below --threshold bits per byte inside\n"
+            "      or above it outside that range (default: 7.5)\n"
+            "  generate image\n"
+            "      write a synthetic image of about --size GB (default: 1)\n"
+            "      in a file of --file-size GB with --zero (default: 20),\n"
+            "      --duplicate (10) and --text (30) percent of the pages,\n"
+            "      the rest random, on --threads threads (default: one per\n"
+            "      processor); the same --seed gives the same image\n"
+            "  fuzz\n"
+            "      mutate a synthetic image, saved to --save, and run the\n"
+            "      image parsers of --target (header, preview, page-list,\n"
+            "      pages, handoff or all; default: each) on --executions\n"
+            "      mutations (default: 1000000) and print the executions\n"
+            "      per second\n"
+            "  prefetch image trace\n"
+            "      replay the physical pages of an access trace on wake at\n"
+            "      --read-rate (default: the image2 read of the last wake)\n"
+            "      and recommend the pages of image2 to move into image1,\n"
+            "      up to --budget (default: 64 MB), written to --output\n"
+            "  diff image image\n"
+            "      compare the page lists of the images of two cycles and\n"
+            "      print the pages added and removed per bank and the\n"
+            "      --top (default: 10) physical regions of --region MB\n"
+            "      (default: 1024) that grew most; --content also counts\n"
+            "      the pages saved in both whose content changed on\n"
+            "      --threads threads (default: one per processor)\n"
+            "  dedup image\n"
+            "      hash the pages of an image on --threads threads (default:\n"
+            "      one per processor) and print the share of zero pages and\n"
+            "      of pages that duplicate an earlier one, counted in\n"
+            "      --memory MB (default: 256)\n"
+            "  delta previous image device\n"
+            "      write the image to a file standing in for the device\n"
+            "      in full, then write it as the changes to the previous\n"
+            "      image in blocks of --block-size bytes (default: 4096)\n"
+            "      and compare the bytes written and the time\n"
+            "  control-benchmark\n"
+            "      serve --agents simulated agents (default: 1000) on the\n"
+            "      loopback interface, send --requests requests to each\n"
+            "      (default: 100) with --concurrency requests in flight\n"
+            "      (default: 8) and print the round trip latency\n"
+            "  tune\n"
+            "      print the mean sleep entry time of each setting of the\n"
+            "      tuner and the setting of the next hibernation; --replay\n"
+            "      prints the setting chosen after each recorded cycle\n");
+}
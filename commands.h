@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_COMMANDS_H
+#define HIBERNATE_COMMANDS_H
+
+#include <stdio.h>
+
+/* The system hibernation has been initiated successfuly. */
+#define kMainSuccess 0
+/* The operating system release could not be determined or is unsupported. */
+#define kMainErrorOSRelease 1
+/* Connection to the IOPMrootDomain failed. */
+#define kMainErrorIOPMrootDomain 2
+/*
+ * The power management preferences could not be adapted to enable hibernation.
+ */
+#define kMainErrorPMAlterPreferences 3
+/* The power manamgment preferences could not be restored after hibernation. */
+#define kMainErrorPMRestorePreferences 4
+/* The command line options are invalid. */
+#define kMainErrorUsage 5
+/* The wake from hibernation could not be scheduled. */
+#define kMainErrorScheduleWake 6
+/* Initiating system sleep failed. */
+#define kMainErrorSleepSystem 7
+/* The weekly hibernation schedule could not be set up. */
+#define kMainErrorSchedule 8
+/* The configuration file could not be loaded or the profile is unknown. */
+#define kMainErrorConfig 9
+/* A benchmark failed or produced wrong results. */
+#define kMainErrorBenchmark 10
+/* The hibernation image could not be read or its contents converted. */
+#define kMainErrorImage 11
+/* The encrypted range of the image does not match the contents. */
+#define kMainErrorVerify 12
+/* The power history or the tuning observations could not be loaded. */
+#define kMainErrorHistory 13
+/* The control socket could not be set up or a control request failed. */
+#define kMainErrorControl 14
+
+/* A command that runs instead of hibernating the system. */
+typedef struct {
+    const char *name;
+    int (*run)(int argc, const char *argv[]);
+} Command;
+
+/*
+ * Returns the command of the specified name that does not depend on the power
+ * management of the system, or NULL if there is none. These commands work on
+ * image files and simulations and build on any system.
+ */
+const Command *CommandFind(const char *name);
+
+/* Prints the synopsis of each command, one usage line each, to the stream. */
+void PrintCommandSynopsis(FILE *stream);
+
+/* Prints the description of each command to the stream. */
+void PrintCommandDescriptions(FILE *stream);
+
+/*
+ * Prints the command line usage to the specified stream. Is defined by the
+ * program the commands are linked into.
+ */
+void PrintUsage(FILE *stream);
+
+#endif /* HIBERNATE_COMMANDS_H */
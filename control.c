@@ -0,0 +1,983 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "control.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "sketch.h"
+
+/* The initial size of the input buffer of a client. */
+#define kControlInputSize 512
+/*
+ * The amount of pending replies after which the requests of a client are no
+ * longer executed until the replies have been written.
+ */
+#define kControlOutputLimit 65536
+/* The seconds the benchmark waits for all connections and for all replies. */
+#define kControlBenchmarkTimeout 60
+/* The seconds the loop runs between counting the accepted connections. */
+#define kControlBenchmarkAcceptInterval 0.01
+
+#if defined(MSG_NOSIGNAL)
+#define kControlSendFlags MSG_NOSIGNAL
+#else
+#define kControlSendFlags 0
+#endif
+
+/* Reads a big-endian uint16_t. */
+static uint16_t GetUInt16(const uint8_t *bytes) {
+    return (uint16_t) (bytes[0] << 8 | bytes[1]);
+}
+
+/* Reads a big-endian uint32_t. */
+static uint32_t GetUInt32(const uint8_t *bytes) {
+    return (uint32_t) bytes[0] << 24 | (uint32_t) bytes[1] << 16 |
+           (uint32_t) bytes[2] << 8 | bytes[3];
+}
+
+/* Reads a big-endian uint64_t. */
+static uint64_t GetUInt64(const uint8_t *bytes) {
+    return (uint64_t) GetUInt32(bytes) << 32 | GetUInt32(bytes + 4);
+}
+
+/* Stores a big-endian uint16_t. */
+static void PutUInt16(uint8_t *bytes, uint16_t value) {
+    bytes[0] = (uint8_t) (value >> 8);
+    bytes[1] = (uint8_t) value;
+}
+
+/* Stores a big-endian uint32_t. */
+static void PutUInt32(uint8_t *bytes, uint32_t value) {
+    bytes[0] = (uint8_t) (value >> 24);
+    bytes[1] = (uint8_t) (value >> 16);
+    bytes[2] = (uint8_t) (value >> 8);
+    bytes[3] = (uint8_t) value;
+}
+
+/* Stores a big-endian uint64_t. */
+static void PutUInt64(uint8_t *bytes, uint64_t value) {
+    PutUInt32(bytes, (uint32_t) (value >> 32));
+    PutUInt32(bytes + 4, (uint32_t) value);
+}
+
+size_t ControlReplyLength(uint16_t count) {
+    return kControlHeaderSize +
+           (size_t) count * (kControlCommandHeaderSize + kControlReplyCapacity);
+}
+
+void ControlFrameInit(ControlFrame *frame,
+                      uint8_t *bytes,
+                      size_t capacity,
+                      uint32_t sequence) {
+    frame->bytes = bytes;
+    frame->capacity = capacity;
+    frame->length = kControlHeaderSize;
+    frame->count = 0;
+    PutUInt32(bytes + 4, sequence);
+}
+
+int ControlFrameAdd(ControlFrame *frame,
+                    uint8_t opcode,
+                    uint8_t status,
+                    const void *data,
+                    uint16_t length) {
+    size_t size = kControlCommandHeaderSize + length;
+    if (frame->count == kControlBatchCapacity ||
+        frame->length + size > frame->capacity) {
+        return -1;
+    }
+
+    uint8_t *command = frame->bytes + frame->length;
+    command[0] = opcode;
+    command[1] = status;
+    PutUInt16(command + 2, length);
+    if (length > 0) {
+        memcpy(command + kControlCommandHeaderSize, data, length);
+    }
+    frame->length += size;
+    frame->count++;
+    return 0;
+}
+
+void ControlFrameFinish(ControlFrame *frame) {
+    PutUInt32(frame->bytes, (uint32_t) frame->length);
+    PutUInt16(frame->bytes + 8, frame->count);
+}
+
+int ControlReaderInit(ControlReader *reader,
+                      const uint8_t *bytes,
+                      size_t length) {
+    if (length < kControlHeaderSize || GetUInt32(bytes) != length) {
+        return -1;
+    }
+    uint16_t count = GetUInt16(bytes + 8);
+    if (count > kControlBatchCapacity) {
+        return -1;
+    }
+
+    // Check that every command lies within the frame
+    size_t offset = kControlHeaderSize;
+    for (uint16_t i = 0; i < count; i++) {
+        if (length - offset < kControlCommandHeaderSize) {
+            return -1;
+        }
+        size_t size = kControlCommandHeaderSize +
+                      GetUInt16(bytes + offset + 2);
+        if (length - offset < size) {
+            return -1;
+        }
+        offset += size;
+    }
+    if (offset != length) {
+        return -1;
+    }
+
+    reader->next = bytes + kControlHeaderSize;
+    reader->sequence = GetUInt32(bytes + 4);
+    reader->count = count;
+    reader->remaining = count;
+    return 0;
+}
+
+int ControlReaderNext(ControlReader *reader, ControlCommand *command) {
+    if (reader->remaining == 0) {
+        return 0;
+    }
+    command->opcode = reader->next[0];
+    command->status = reader->next[1];
+    command->length = GetUInt16(reader->next + 2);
+    command->data = reader->next + kControlCommandHeaderSize;
+    reader->next += kControlCommandHeaderSize + command->length;
+    reader->remaining--;
+    return 1;
+}
+
+void ControlEncodeInt64(uint8_t *bytes, int64_t value) {
+    PutUInt64(bytes, (uint64_t) value);
+}
+
+int ControlDecodeInt64(const ControlCommand *command, int64_t *value) {
+    if (command->length != sizeof(uint64_t)) {
+        return -1;
+    }
+    *value = (int64_t) GetUInt64(command->data);
+    return 0;
+}
+
+/* The length of the statistics without the profile name. */
+#define kControlStatsSize 24
+
+uint16_t ControlStatsEncode(const ControlStats *stats, uint8_t *bytes) {
+    size_t nameLength = strnlen(stats->profile, sizeof(stats->profile) - 1);
+
+    PutUInt32(bytes, stats->hibernations);
+    PutUInt32(bytes + 4, stats->failures);
+    PutUInt64(bytes + 8, (uint64_t) stats->pendingDate);
+    PutUInt64(bytes + 16, stats->commands);
+    memcpy(bytes + kControlStatsSize, stats->profile, nameLength);
+    return (uint16_t) (kControlStatsSize + nameLength);
+}
+
+int ControlStatsDecode(const ControlCommand *result, ControlStats *stats) {
+    if (result->length < kControlStatsSize) {
+        return -1;
+    }
+    size_t nameLength = (size_t) result->length - kControlStatsSize;
+    if (nameLength >= sizeof(stats->profile)) {
+        return -1;
+    }
+
+    stats->hibernations = GetUInt32(result->data);
+    stats->failures = GetUInt32(result->data + 4);
+    stats->pendingDate = (int64_t) GetUInt64(result->data + 8);
+    stats->commands = GetUInt64(result->data + 16);
+    memcpy(stats->profile, result->data + kControlStatsSize, nameLength);
+    stats->profile[nameLength] = '\0';
+    return 0;
+}
+
+/*
+ * Converts an address to a socket address: a port number on the loopback
+ * interface or the path of a Unix domain socket. Returns 0 on success.
+ */
+static int ParseAddress(const char *address,
+                        struct sockaddr_storage *storage,
+                        socklen_t *length) {
+    memset(storage, 0, sizeof(*storage));
+
+    char *end;
+    unsigned long port = strtoul(address, &end, 10);
+    if (*address != '\0' && *end == '\0') {
+        if (port > UINT16_MAX) {
+            return -1;
+        }
+        struct sockaddr_in *inet = (struct sockaddr_in *) storage;
+        inet->sin_family = AF_INET;
+        inet->sin_port = htons((uint16_t) port);
+        inet->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        *length = sizeof(*inet);
+        return 0;
+    }
+
+    struct sockaddr_un *local = (struct sockaddr_un *) storage;
+    if (strlen(address) >= sizeof(local->sun_path)) {
+        return -1;
+    }
+    local->sun_family = AF_UNIX;
+    strcpy(local->sun_path, address);
+    *length = sizeof(*local);
+    return 0;
+}
+
+/*
+ * Prepares a connected socket: close on exec, no SIGPIPE on writes to a closed
+ * connection and no delay of small TCP segments. Returns 0 on success.
+ */
+static int ConfigureSocket(int fd, int nonblocking) {
+    int on = 1;
+
+    if (fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (nonblocking &&
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+        return -1;
+    }
+#if defined(SO_NOSIGPIPE)
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    // Fails for Unix domain sockets, which do not delay writes
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return 0;
+}
+
+/* Closes the connection of a client and frees it. */
+static void CloseClient(ControlClient *client) {
+    ControlServer *server = client->server;
+
+    if (client->previous) {
+        client->previous->next = client->next;
+    } else {
+        server->clients = client->next;
+    }
+    if (client->next) {
+        client->next->previous = client->previous;
+    }
+    server->clientCount--;
+
+    EventWatcherCancel(client->watcher);
+    close(client->fd);
+    free(client->input);
+    free(client->output);
+    free(client);
+}
+
+/* Grows a buffer to hold at least the required bytes. Returns 0 on success. */
+static int Reserve(uint8_t **bytes, size_t *capacity, size_t required) {
+    if (required <= *capacity) {
+        return 0;
+    }
+    size_t size = *capacity ? *capacity : kControlInputSize;
+    while (size < required) {
+        size *= 2;
+    }
+    uint8_t *grown = realloc(*bytes, size);
+    if (!grown) {
+        return -1;
+    }
+    *bytes = grown;
+    *capacity = size;
+    return 0;
+}
+
+/*
+ * Executes a request and appends the reply to the output of the client.
+ * Returns 0 on success and -1 if the request is invalid.
+ */
+static int ExecuteRequest(ControlClient *client,
+                          const uint8_t *bytes,
+                          size_t length) {
+    ControlServer *server = client->server;
+    ControlReader reader;
+
+    if (ControlReaderInit(&reader, bytes, length) != 0) {
+        return -1;
+    }
+
+    // Build the reply in place, it is at most ControlReplyLength bytes
+    size_t end = client->outputOffset + client->outputLength;
+    size_t capacity = ControlReplyLength(reader.count);
+    if (Reserve(&client->output,
+                &client->outputCapacity,
+                end + capacity) != 0) {
+        return -1;
+    }
+    ControlFrame reply;
+    ControlFrameInit(&reply, client->output + end, capacity, reader.sequence);
+
+    ControlCommand command;
+    uint8_t data[kControlReplyCapacity];
+    while (ControlReaderNext(&reader, &command)) {
+        uint16_t dataLength = 0;
+        uint8_t status = server->handler(&command,
+                                         data,
+                                         &dataLength,
+                                         server->context);
+        if (dataLength > kControlReplyCapacity) {
+            dataLength = 0;
+            status = kControlStatusError;
+        }
+        ControlFrameAdd(&reply, command.opcode, status, data, dataLength);
+    }
+    ControlFrameFinish(&reply);
+
+    client->outputLength += reply.length;
+    server->requests++;
+    server->commands += reader.count;
+    return 0;
+}
+
+/*
+ * Executes the complete requests in the input of a client until the pending
+ * replies reach kControlOutputLimit. Returns 0 on success and -1 if a request
+ * is invalid.
+ */
+static int ExecuteInput(ControlClient *client) {
+    size_t offset = 0;
+    int rc = 0;
+
+    while (client->outputLength < kControlOutputLimit) {
+        size_t available = client->inputLength - offset;
+        if (available < kControlHeaderSize) {
+            break;
+        }
+        uint32_t length = GetUInt32(client->input + offset);
+        if (length < kControlHeaderSize || length > kControlFrameCapacity) {
+            rc = -1;
+            break;
+        }
+        if (available < length) {
+            // Make room for the rest of the request
+            if (Reserve(&client->input,
+                        &client->inputCapacity,
+                        length) != 0) {
+                rc = -1;
+            }
+            break;
+        }
+        if (ExecuteRequest(client, client->input + offset, length) != 0) {
+            rc = -1;
+            break;
+        }
+        offset += length;
+    }
+
+    if (offset > 0) {
+        memmove(client->input,
+                client->input + offset,
+                client->inputLength - offset);
+        client->inputLength -= offset;
+    }
+    return rc;
+}
+
+/* Writes pending replies. Returns 0 on success and -1 on error. */
+static int WriteOutput(ControlClient *client) {
+    while (client->outputLength > 0) {
+        ssize_t written = send(client->fd,
+                               client->output + client->outputOffset,
+                               client->outputLength,
+                               kControlSendFlags);
+        if (written == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        client->outputOffset += (size_t) written;
+        client->outputLength -= (size_t) written;
+    }
+    client->outputOffset = 0;
+    return 0;
+}
+
+/* Serves a client whenever it has sent requests or can receive replies. */
+static void ClientCallback(EventWatcher *watcher, int events, void *context) {
+    ControlClient *client = context;
+    int closed = 0;
+
+    if (events & kEventRead) {
+        if (Reserve(&client->input,
+                    &client->inputCapacity,
+                    client->inputLength + 1) != 0) {
+            CloseClient(client);
+            return;
+        }
+        ssize_t count = recv(client->fd,
+                             client->input + client->inputLength,
+                             client->inputCapacity - client->inputLength,
+                             0);
+        if (count > 0) {
+            client->inputLength += (size_t) count;
+        } else if (count == 0 ||
+                   (errno != EAGAIN && errno != EWOULDBLOCK &&
+                    errno != EINTR)) {
+            closed = 1;
+        }
+    } else if (events & kEventHangup) {
+        closed = 1;
+    }
+
+    // Replies of requests received before the client closed its end are
+    // still written if possible
+    if (ExecuteInput(client) != 0 || WriteOutput(client) != 0 || closed) {
+        CloseClient(client);
+        return;
+    }
+
+    // Stop reading requests while replies are pending
+    if (client->outputLength > 0) {
+        EventWatcherSetEvents(watcher, kEventWrite);
+    } else if (client->inputLength >= kControlHeaderSize &&
+               client->inputLength >= GetUInt32(client->input)) {
+        // Requests left behind by the output limit are executed next
+        EventWatcherSetEvents(watcher, kEventWrite);
+    } else {
+        EventWatcherSetEvents(watcher, kEventRead);
+    }
+}
+
+/* Accepts all pending connections. */
+static void ListenerCallback(EventWatcher *watcher, int events, void *context) {
+    ControlServer *server = context;
+    (void) watcher;
+    (void) events;
+
+    for (;;) {
+        int fd = accept(server->fd, NULL, NULL);
+        if (fd == -1) {
+            return;
+        }
+
+        ControlClient *client = calloc(1, sizeof(*client));
+        if (!client || ConfigureSocket(fd, 1) != 0) {
+            free(client);
+            close(fd);
+            continue;
+        }
+        client->server = server;
+        client->fd = fd;
+        client->watcher = EventLoopAddFD(server->loop,
+                                         fd,
+                                         kEventRead,
+                                         ClientCallback,
+                                         client);
+        if (!client->watcher) {
+            free(client);
+            close(fd);
+            continue;
+        }
+
+        client->next = server->clients;
+        if (server->clients) {
+            server->clients->previous = client;
+        }
+        server->clients = client;
+        server->clientCount++;
+    }
+}
+
+int ControlServerInit(ControlServer *server,
+                      EventLoop *loop,
+                      const char *address,
+                      ControlHandler handler,
+                      void *context) {
+    struct sockaddr_storage storage;
+    socklen_t length;
+
+    memset(server, 0, sizeof(*server));
+    server->loop = loop;
+    server->handler = handler;
+    server->context = context;
+    server->fd = -1;
+
+    if (ParseAddress(address, &storage, &length) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    server->fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (server->fd == -1) {
+        return -1;
+    }
+
+    int on = 1;
+    if (storage.ss_family == AF_UNIX) {
+        // Replace the socket of an agent that has not been shut down
+        const char *path = ((struct sockaddr_un *) &storage)->sun_path;
+        if (strlen(path) >= sizeof(server->path)) {
+            ControlServerFree(server);
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        unlink(path);
+        strcpy(server->path, path);
+    } else {
+        setsockopt(server->fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    if (bind(server->fd, (struct sockaddr *) &storage, length) != 0 ||
+        (server->path[0] && chmod(server->path, S_IRUSR | S_IWUSR) != 0) ||
+        listen(server->fd, SOMAXCONN) != 0 ||
+        ConfigureSocket(server->fd, 1) != 0) {
+        ControlServerFree(server);
+        return -1;
+    }
+
+    if (storage.ss_family == AF_INET) {
+        length = sizeof(storage);
+        getsockname(server->fd, (struct sockaddr *) &storage, &length);
+        server->port = ntohs(((struct sockaddr_in *) &storage)->sin_port);
+    }
+
+    server->listener = EventLoopAddFD(loop,
+                                      server->fd,
+                                      kEventRead,
+                                      ListenerCallback,
+                                      server);
+    if (!server->listener) {
+        ControlServerFree(server);
+        return -1;
+    }
+    return 0;
+}
+
+void ControlServerFree(ControlServer *server) {
+    while (server->clients) {
+        CloseClient(server->clients);
+    }
+    if (server->listener) {
+        EventWatcherCancel(server->listener);
+        server->listener = NULL;
+    }
+    if (server->fd != -1) {
+        close(server->fd);
+        server->fd = -1;
+    }
+    if (server->path[0]) {
+        unlink(server->path);
+        server->path[0] = '\0';
+    }
+}
+
+int ControlConnect(const char *address) {
+    struct sockaddr_storage storage;
+    socklen_t length;
+
+    if (ParseAddress(address, &storage, &length) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *) &storage, length) != 0 ||
+        ConfigureSocket(fd, 0) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int ControlWriteFrame(int fd, const ControlFrame *frame) {
+    size_t offset = 0;
+    while (offset < frame->length) {
+        ssize_t written = send(fd,
+                               frame->bytes + offset,
+                               frame->length - offset,
+                               kControlSendFlags);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        offset += (size_t) written;
+    }
+    return 0;
+}
+
+/* Reads exactly length bytes from a blocking socket. Returns 0 on success. */
+static int ReadFully(int fd, uint8_t *bytes, size_t length) {
+    size_t offset = 0;
+    while (offset < length) {
+        ssize_t count = recv(fd, bytes + offset, length - offset, 0);
+        if (count == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (count == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        offset += (size_t) count;
+    }
+    return 0;
+}
+
+int ControlReadFrame(int fd, uint8_t *bytes, size_t *length) {
+    if (ReadFully(fd, bytes, kControlHeaderSize) != 0) {
+        return -1;
+    }
+    uint32_t frameLength = GetUInt32(bytes);
+    if (frameLength < kControlHeaderSize ||
+        frameLength > kControlFrameCapacity) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (ReadFully(fd,
+                  bytes + kControlHeaderSize,
+                  frameLength - kControlHeaderSize) != 0) {
+        return -1;
+    }
+    *length = frameLength;
+    return 0;
+}
+
+/* Returns the time of the monotonic clock in seconds. */
+static double Now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+typedef struct CoordinatorConnection CoordinatorConnection;
+
+/* The state shared by the coordinator connections of the benchmark. */
+typedef struct {
+    EventLoop *loop;
+    /* The request, its sequence is replaced before each write. */
+    uint8_t *request;
+    size_t requestLength;
+    uint16_t commands;
+    /* The number of requests each connection sends. */
+    unsigned requests;
+    CoordinatorConnection *connections;
+    unsigned agents;
+    /*
+     * A ring of the connections without a request in flight, in the order they
+     * became idle, so that requests rotate over all agents.
+     */
+    unsigned *idle;
+    unsigned idleHead;
+    unsigned idleCount;
+    unsigned inFlight;
+    unsigned failed;
+    Sketch latency;
+} Coordinator;
+
+/* A coordinator connection to one agent. */
+struct CoordinatorConnection {
+    Coordinator *coordinator;
+    unsigned index;
+    int fd;
+    EventWatcher *watcher;
+    uint8_t *reply;
+    size_t replyLength;
+    size_t replyCapacity;
+    unsigned sent;
+    unsigned answered;
+    double sendTime;
+};
+
+/* Sends a request on a connection. Returns 0 on success. */
+static int SendRequest(CoordinatorConnection *connection) {
+    Coordinator *coordinator = connection->coordinator;
+
+    PutUInt32(coordinator->request + 4, connection->sent);
+    connection->sendTime = Now();
+    ssize_t written = send(connection->fd,
+                           coordinator->request,
+                           coordinator->requestLength,
+                           kControlSendFlags);
+    if (written != (ssize_t) coordinator->requestLength) {
+        return -1;
+    }
+    connection->sent++;
+    return 0;
+}
+
+/*
+ * Sends the next request on the connection that has been idle the longest.
+ * Stops the loop once all requests have been answered.
+ */
+static void SendNextRequest(Coordinator *coordinator) {
+    while (coordinator->idleCount > 0) {
+        unsigned index = coordinator->idle[coordinator->idleHead];
+        coordinator->idleHead = (coordinator->idleHead + 1) %
+                                coordinator->agents;
+        coordinator->idleCount--;
+
+        CoordinatorConnection *connection = &coordinator->connections[index];
+        if (SendRequest(connection) == 0) {
+            coordinator->inFlight++;
+            return;
+        }
+        EventWatcherCancel(connection->watcher);
+        connection->watcher = NULL;
+        coordinator->failed++;
+    }
+    if (coordinator->inFlight == 0) {
+        EventLoopStop(coordinator->loop);
+    }
+}
+
+/* Reads a reply, records its latency and sends the next request. */
+static void CoordinatorCallback(EventWatcher *watcher,
+                                int events,
+                                void *context) {
+    CoordinatorConnection *connection = context;
+    Coordinator *coordinator = connection->coordinator;
+    int valid = 0;
+    (void) events;
+
+    ssize_t count = recv(connection->fd,
+                         connection->reply + connection->replyLength,
+                         connection->replyCapacity - connection->replyLength,
+                         0);
+    if (count == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (count > 0) {
+        connection->replyLength += (size_t) count;
+        if (connection->replyLength < kControlHeaderSize ||
+            connection->replyLength < GetUInt32(connection->reply)) {
+            return;
+        }
+        SketchAdd(&coordinator->latency, Now() - connection->sendTime);
+
+        // Every command of the request must have succeeded
+        ControlReader reader;
+        ControlCommand result;
+        valid = ControlReaderInit(&reader,
+                                  connection->reply,
+                                  connection->replyLength) == 0 &&
+                reader.sequence == connection->sent - 1 &&
+                reader.count == coordinator->commands;
+        while (valid && ControlReaderNext(&reader, &result)) {
+            valid = result.status == kControlStatusSuccess;
+        }
+        connection->replyLength = 0;
+    }
+    if (connection->answered < connection->sent) {
+        connection->answered++;
+        coordinator->inFlight--;
+    }
+
+    if (!valid) {
+        EventWatcherCancel(watcher);
+        connection->watcher = NULL;
+        coordinator->failed++;
+    } else if (connection->sent < coordinator->requests) {
+        unsigned tail = (coordinator->idleHead + coordinator->idleCount) %
+                        coordinator->agents;
+        coordinator->idle[tail] = connection->index;
+        coordinator->idleCount++;
+    }
+    SendNextRequest(coordinator);
+}
+
+int ControlBenchmark(unsigned agents,
+                     unsigned requests,
+                     unsigned concurrency,
+                     const ControlFrame *request,
+                     ControlHandler handler,
+                     void *contexts,
+                     size_t contextSize,
+                     FILE *stream) {
+    int rc = kControlBenchmarkSuccess;
+
+    // Each agent needs a listening, an accepted and a connecting socket
+    struct rlimit limit;
+    rlim_t required = (rlim_t) agents * 3 + 16;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < required) {
+        limit.rlim_cur = limit.rlim_max < required ? limit.rlim_max : required;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < required) {
+        return kControlBenchmarkErrorResources;
+    }
+    if (concurrency > agents) {
+        concurrency = agents;
+    }
+
+    EventLoop loop;
+    if (EventLoopInit(&loop) != 0) {
+        return kControlBenchmarkErrorResources;
+    }
+    ControlServer *servers = calloc(agents, sizeof(*servers));
+    Coordinator coordinator;
+    memset(&coordinator, 0, sizeof(coordinator));
+    coordinator.loop = &loop;
+    coordinator.request = malloc(request->length);
+    coordinator.requestLength = request->length;
+    coordinator.commands = request->count;
+    coordinator.requests = requests;
+    coordinator.connections = calloc(agents, sizeof(CoordinatorConnection));
+    coordinator.idle = calloc(agents, sizeof(unsigned));
+    SketchInit(&coordinator.latency);
+
+    unsigned started = 0;
+    unsigned connected = 0;
+    if (!servers || !coordinator.connections || !coordinator.idle ||
+        !coordinator.request) {
+        rc = kControlBenchmarkErrorResources;
+        goto out;
+    }
+    memcpy(coordinator.request, request->bytes, request->length);
+
+    // Start the agents and connect the coordinator to each of them
+    for (; started < agents; started++) {
+        char port[8];
+        void *context = (uint8_t *) contexts + started * contextSize;
+        if (ControlServerInit(&servers[started],
+                              &loop,
+                              "0",
+                              handler,
+                              context) != 0) {
+            rc = kControlBenchmarkErrorResources;
+            goto out;
+        }
+        snprintf(port, sizeof(port), "%u", servers[started].port);
+
+        CoordinatorConnection *connection =
+                &coordinator.connections[connected];
+        connection->coordinator = &coordinator;
+        connection->index = connected;
+        connection->replyCapacity = ControlReplyLength(request->count);
+        connection->reply = malloc(connection->replyCapacity);
+        connection->fd = ControlConnect(port);
+        if (!connection->reply || connection->fd == -1) {
+            free(connection->reply);
+            rc = kControlBenchmarkErrorResources;
+            goto out;
+        }
+        connected++;
+        connection->watcher = EventLoopAddFD(&loop,
+                                             connection->fd,
+                                             kEventRead,
+                                             CoordinatorCallback,
+                                             connection);
+        if (ConfigureSocket(connection->fd, 1) != 0 || !connection->watcher) {
+            rc = kControlBenchmarkErrorResources;
+            goto out;
+        }
+        coordinator.idle[coordinator.idleCount++] = connection->index;
+    }
+    coordinator.agents = agents;
+
+    // Accept all connections before the clock starts. A run of the loop
+    // handles at most one batch of events, which may not reach every agent
+    double deadline = Now() + kControlBenchmarkTimeout;
+    for (;;) {
+        unsigned accepted = 0;
+        for (unsigned i = 0; i < agents; i++) {
+            accepted += servers[i].clientCount;
+        }
+        if (accepted == agents) {
+            break;
+        }
+        if (Now() >= deadline ||
+            EventLoopRun(&loop, kControlBenchmarkAcceptInterval) ==
+                    kEventLoopError) {
+            rc = kControlBenchmarkErrorResources;
+            goto out;
+        }
+    }
+
+    double start = Now();
+    for (unsigned i = 0; i < concurrency; i++) {
+        SendNextRequest(&coordinator);
+    }
+    if (EventLoopRun(&loop, kControlBenchmarkTimeout) != kEventLoopStopped ||
+        coordinator.failed > 0) {
+        rc = kControlBenchmarkErrorReplies;
+    }
+    double seconds = Now() - start;
+
+    uint64_t roundTrips = coordinator.latency.total;
+    fprintf(stream,
+            "%u agents, %u requests in flight: %llu round trips of %u "
+            "commands in %.3f s (%.0f/s)\n",
+            agents,
+            concurrency,
+            (unsigned long long) roundTrips,
+            request->count,
+            seconds,
+            roundTrips / seconds);
+    fprintf(stream,
+            "latency p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+            SketchQuantile(&coordinator.latency, 0.5) * 1e3,
+            SketchQuantile(&coordinator.latency, 0.99) * 1e3,
+            coordinator.latency.max * 1e3);
+
+out:
+    for (unsigned i = 0; i < connected; i++) {
+        CoordinatorConnection *connection = &coordinator.connections[i];
+        if (connection->watcher) {
+            EventWatcherCancel(connection->watcher);
+        }
+        close(connection->fd);
+        free(connection->reply);
+    }
+    for (unsigned i = 0; i < started; i++) {
+        ControlServerFree(&servers[i]);
+    }
+    free(coordinator.request);
+    free(coordinator.connections);
+    free(coordinator.idle);
+    free(servers);
+    EventLoopFree(&loop);
+    return rc;
+}
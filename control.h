@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_CONTROL_H
+#define HIBERNATE_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "eventloop.h"
+#include "profile.h"
+
+/*
+ * The control protocol lets a coordinator send batches of commands to a
+ * resident hibernate agent over a stream socket. All integers are big-endian.
+ *
+ * A frame starts with a header of kControlHeaderSize bytes:
+ *
+ *     uint32_t length      the length of the frame including the header
+ *     uint32_t sequence    chosen by the sender, echoed in the reply
+ *     uint16_t count       the number of commands in the frame
+ *
+ * followed by count commands of kControlCommandHeaderSize bytes plus data:
+ *
+ *     uint8_t opcode
+ *     uint8_t status       0 in requests, a kControlStatus code in replies
+ *     uint16_t length      the length of the data
+ *     uint8_t data[length]
+ *
+ * The reply to a request has the same sequence and one result per command, in
+ * the order of the commands.
+ */
+
+/* The default address of the agent. */
+#define kControlDefaultSocket "/var/run/hibernate.sock"
+
+/* The size of a frame header. */
+#define kControlHeaderSize 10
+/* The size of the header of a command in a frame. */
+#define kControlCommandHeaderSize 4
+/* The maximum length of a frame. */
+#define kControlFrameCapacity 65536
+/* The maximum number of commands in a frame. */
+#define kControlBatchCapacity 128
+/* The maximum length of the data of a result. */
+#define kControlReplyCapacity 256
+
+/* Selects the profile of the following hibernations by name. */
+#define kControlSetProfile 1
+/*
+ * Hibernates at the date in the data, an int64_t in seconds since 1970. A date
+ * of 0 cancels the pending hibernation. Replaces the pending hibernation.
+ */
+#define kControlHibernateAt 2
+/* Replies with the statistics of the agent, see ControlStats. */
+#define kControlQueryStats 3
+
+/* The command has been executed. */
+#define kControlStatusSuccess 0
+/* The opcode is unknown. */
+#define kControlStatusUnknownCommand 1
+/* The data of the command is invalid. */
+#define kControlStatusInvalidArgument 2
+/* The profile is unknown. */
+#define kControlStatusUnknownProfile 3
+/* The command failed. */
+#define kControlStatusError 4
+
+/* A command of a request or a result of a reply. */
+typedef struct {
+    uint8_t opcode;
+    uint8_t status;
+    uint16_t length;
+    /* Points into the frame. */
+    const uint8_t *data;
+} ControlCommand;
+
+/* Writes a frame into a caller provided buffer. */
+typedef struct {
+    uint8_t *bytes;
+    size_t capacity;
+    size_t length;
+    uint16_t count;
+} ControlFrame;
+
+/* Reads the commands of a validated frame. */
+typedef struct {
+    const uint8_t *next;
+    uint32_t sequence;
+    uint16_t count;
+    uint16_t remaining;
+} ControlReader;
+
+/* The statistics returned by kControlQueryStats. */
+typedef struct {
+    uint32_t hibernations;
+    uint32_t failures;
+    /* The date of the pending hibernation in seconds since 1970 or 0. */
+    int64_t pendingDate;
+    /* The number of commands the agent has executed. */
+    uint64_t commands;
+    char profile[kProfileNameLength];
+} ControlStats;
+
+/*
+ * Returns the length of a reply frame to a request with count commands, the
+ * space a reply has to be built in.
+ */
+size_t ControlReplyLength(uint16_t count);
+
+/* Starts a frame in the buffer. */
+void ControlFrameInit(ControlFrame *frame,
+                      uint8_t *bytes,
+                      size_t capacity,
+                      uint32_t sequence);
+
+/*
+ * Appends a command to the frame. Returns 0 on success and -1 if the frame is
+ * full.
+ */
+int ControlFrameAdd(ControlFrame *frame,
+                    uint8_t opcode,
+                    uint8_t status,
+                    const void *data,
+                    uint16_t length);
+
+/* Stores the length and the count in the header once all commands are added. */
+void ControlFrameFinish(ControlFrame *frame);
+
+/*
+ * Validates the frame. Returns 0 if the lengths of the header and of all
+ * commands add up to the length of the frame, so that the commands can be read
+ * without further checks, and -1 otherwise.
+ */
+int ControlReaderInit(ControlReader *reader,
+                      const uint8_t *bytes,
+                      size_t length);
+
+/* Reads the next command. Returns 1 on success and 0 at the end. */
+int ControlReaderNext(ControlReader *reader, ControlCommand *command);
+
+/* Stores an int64_t in big-endian order. */
+void ControlEncodeInt64(uint8_t *bytes, int64_t value);
+
+/*
+ * Reads the int64_t data of a command. Returns 0 on success and -1 if the data
+ * has a different length.
+ */
+int ControlDecodeInt64(const ControlCommand *command, int64_t *value);
+
+/*
+ * Stores the statistics in a buffer of kControlReplyCapacity bytes. Returns the
+ * length.
+ */
+uint16_t ControlStatsEncode(const ControlStats *stats, uint8_t *bytes);
+
+/* Reads the statistics of a result. Returns 0 on success and -1 otherwise. */
+int ControlStatsDecode(const ControlCommand *result, ControlStats *stats);
+
+/*
+ * Executes a command and returns one of the kControlStatus codes. Data for the
+ * result can be stored in reply, which has room for kControlReplyCapacity
+ * bytes.
+ */
+typedef uint8_t (*ControlHandler)(const ControlCommand *command,
+                                  uint8_t *reply,
+                                  uint16_t *replyLength,
+                                  void *context);
+
+/* A connection accepted by a control server. */
+typedef struct ControlClient {
+    struct ControlServer *server;
+    int fd;
+    EventWatcher *watcher;
+    /* Received bytes of incomplete or not yet executed requests. */
+    uint8_t *input;
+    size_t inputLength;
+    size_t inputCapacity;
+    /* Replies that have not been written yet, starting at outputOffset. */
+    uint8_t *output;
+    size_t outputOffset;
+    size_t outputLength;
+    size_t outputCapacity;
+    struct ControlClient *previous;
+    struct ControlClient *next;
+} ControlClient;
+
+/*
+ * Accepts connections on a socket and executes the requests of all clients on
+ * an event loop. Requests of a client are executed in order. While replies to
+ * a client are pending, its requests are not read, so a client that does not
+ * read its replies cannot make the server buffer without limit.
+ */
+typedef struct ControlServer {
+    EventLoop *loop;
+    int fd;
+    EventWatcher *listener;
+    /* The path of a Unix domain socket, which is removed when freed. */
+    char path[104];
+    /* The port of a TCP socket. */
+    uint16_t port;
+    ControlHandler handler;
+    void *context;
+    ControlClient *clients;
+    unsigned clientCount;
+    uint64_t requests;
+    uint64_t commands;
+} ControlServer;
+
+/*
+ * Listens on the address and serves clients on the loop. The address is the
+ * path of a Unix domain socket, which only root can connect to, or a port
+ * number on the loopback interface for testing. Port 0 selects a free port,
+ * which is stored in port. Returns 0 on success and -1 otherwise.
+ */
+int ControlServerInit(ControlServer *server,
+                      EventLoop *loop,
+                      const char *address,
+                      ControlHandler handler,
+                      void *context);
+
+/* Closes all connections and stops listening. */
+void ControlServerFree(ControlServer *server);
+
+/* Connects to an agent. Returns the socket or -1. */
+int ControlConnect(const char *address);
+
+/* Writes a finished frame to a blocking socket. Returns 0 on success. */
+int ControlWriteFrame(int fd, const ControlFrame *frame);
+
+/*
+ * Reads a frame of at most kControlFrameCapacity bytes from a blocking socket
+ * into the buffer. Returns 0 on success.
+ */
+int ControlReadFrame(int fd, uint8_t *bytes, size_t *length);
+
+/* The benchmark has completed successfully. */
+#define kControlBenchmarkSuccess 0
+/* Not enough file descriptors or memory for the agents. */
+#define kControlBenchmarkErrorResources 1
+/* A reply was invalid or did not arrive. */
+#define kControlBenchmarkErrorReplies 2
+
+/*
+ * Starts agents control servers on the loopback interface and connects a
+ * coordinator to each of them. The coordinator keeps concurrency requests in
+ * flight and sends each one on the connection that has been idle the longest,
+ * until every connection has sent requests copies of the request. Agent i
+ * executes commands with the handler and the context at index i of the
+ * contexts array, whose elements have contextSize bytes. Prints the
+ * throughput and the round trip latency to the stream.
+ */
+int ControlBenchmark(unsigned agents,
+                     unsigned requests,
+                     unsigned concurrency,
+                     const ControlFrame *request,
+                     ControlHandler handler,
+                     void *contexts,
+                     size_t contextSize,
+                     FILE *stream);
+
+#endif /* HIBERNATE_CONTROL_H */
@@ -0,0 +1,310 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "dedup.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hash.h"
+
+/* The number of pages hashed by the threads at a time. */
+#define kDedupBatchPages 65536
+/* The maximum number of threads hashing a batch. */
+#define kDedupThreadsMax 16
+/* The percentage of the slots of the hash table in use when it is full. */
+#define kDedupTableLoad 75
+/* The number of rows of the count-min sketch. */
+#define kDedupSketchDepth 4
+
+/*
+ * The set of hashes seen so far, shared by the threads without locks. Slots
+ * are claimed with compare and swap, zero marks a free slot.
+ */
+typedef struct {
+    uint64_t *slots;
+    uint64_t mask;
+    uint64_t limit;
+    uint64_t count;
+    /* The rows of the sketch, width counters each. */
+    uint32_t *sketch;
+    uint64_t width;
+    uint64_t sketchCount;
+} DedupTable;
+
+/* Returns the largest power of two not above value and at least 1024. */
+static uint64_t PowerOfTwo(uint64_t value) {
+    uint64_t power = 1024;
+    while (power * 2 <= value) {
+        power *= 2;
+    }
+    return power;
+}
+
+/*
+ * Counts a hash in the sketch. Returns 1 if every counter of the hash had been
+ * counted before, i.e. the page is probably a duplicate, and 0 otherwise.
+ */
+static int SketchAdd(DedupTable *table, uint64_t hash) {
+    uint32_t low = (uint32_t) hash;
+    uint32_t high = (uint32_t) (hash >> 32) | 1;
+    uint32_t minimum = UINT32_MAX;
+
+    for (uint32_t i = 0; i < kDedupSketchDepth; i++) {
+        uint32_t *counter = &table->sketch[i * table->width +
+                                           ((low + i * high) &
+                                            (table->width - 1))];
+        uint32_t count = __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+        if (count < minimum) {
+            minimum = count;
+        }
+    }
+    __atomic_fetch_add(&table->sketchCount, 1, __ATOMIC_RELAXED);
+    return minimum > 0;
+}
+
+/* Adds a hash. Returns 1 if it has been added before and 0 otherwise. */
+static int TableAdd(DedupTable *table, uint64_t hash) {
+    if (hash == 0) {
+        hash = 1;
+    }
+
+    uint64_t slot = hash & table->mask;
+    for (;;) {
+        uint64_t value = __atomic_load_n(&table->slots[slot], __ATOMIC_RELAXED);
+        if (value == hash) {
+            return 1;
+        }
+        if (value != 0) {
+            slot = (slot + 1) & table->mask;
+            continue;
+        }
+
+        // A free slot ends the probe, the hash is new to the table
+        if (__atomic_load_n(&table->count, __ATOMIC_RELAXED) >= table->limit) {
+            return SketchAdd(table, hash);
+        }
+        if (__atomic_compare_exchange_n(&table->slots[slot],
+                                        &value,
+                                        hash,
+                                        0,
+                                        __ATOMIC_RELAXED,
+                                        __ATOMIC_RELAXED)) {
+            __atomic_fetch_add(&table->count, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        // Another thread has claimed the slot, check what it has stored
+    }
+}
+
+/* A slice of a batch hashed by one thread, and its counts. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    DedupTable *table;
+    const uint8_t *base;
+    const ImagePage *pages;
+    size_t count;
+    DedupReport counts;
+} DedupSlice;
+
+static void *DedupSliceRun(void *argument) {
+    static const uint8_t kZeroPage[kImagePageSize];
+    DedupSlice *slice = argument;
+    DedupReport *counts = &slice->counts;
+
+    for (size_t i = 0; i < slice->count; i++) {
+        const uint8_t *data = slice->base + slice->pages[i].offset;
+        uint32_t length = slice->pages[i].length;
+
+        counts->pages++;
+        counts->bytes += length;
+        if (memcmp(data, kZeroPage, length) == 0) {
+            counts->zeroPages++;
+            counts->zeroBytes += length;
+        }
+        if (TableAdd(slice->table, HashXXH3(data, length))) {
+            counts->duplicatePages++;
+            counts->duplicateBytes += length;
+        }
+    }
+    return NULL;
+}
+
+/* Hashes a batch of pages on the threads and adds up their counts. */
+static void DedupBatch(DedupSlice *slices,
+                       unsigned threads,
+                       const ImagePage *pages,
+                       size_t count,
+                       DedupReport *report) {
+    for (unsigned i = 0; i < threads; i++) {
+        size_t first = count * i / threads;
+        size_t last = count * (i + 1) / threads;
+        slices[i].pages = pages + first;
+        slices[i].count = last - first;
+        memset(&slices[i].counts, 0, sizeof(slices[i].counts));
+        slices[i].started = pthread_create(&slices[i].thread,
+                                           NULL,
+                                           DedupSliceRun,
+                                           &slices[i]) == 0;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        if (slices[i].started) {
+            pthread_join(slices[i].thread, NULL);
+        } else {
+            DedupSliceRun(&slices[i]);
+        }
+        const DedupReport *counts = &slices[i].counts;
+        report->pages += counts->pages;
+        report->bytes += counts->bytes;
+        report->zeroPages += counts->zeroPages;
+        report->zeroBytes += counts->zeroBytes;
+        report->duplicatePages += counts->duplicatePages;
+        report->duplicateBytes += counts->duplicateBytes;
+    }
+}
+
+int DedupAnalyze(const HibernateImage *image,
+                 uint64_t memory,
+                 unsigned threads,
+                 DedupReport *report) {
+    DedupTable table;
+    ImagePageIterator iterator;
+    struct timespec start, end;
+    int rc = kDedupAnalyzeSuccess;
+
+    memset(report, 0, sizeof(*report));
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > kDedupThreadsMax) {
+        threads = kDedupThreadsMax;
+    }
+
+    // Three quarters of the memory for the table, the rest for the sketch
+    memset(&table, 0, sizeof(table));
+    uint64_t capacity = PowerOfTwo(memory / 4 * 3 / sizeof(uint64_t));
+    uint64_t sketchSize = memory > capacity * sizeof(uint64_t) ?
+                          memory - capacity * sizeof(uint64_t) : 0;
+    table.width = PowerOfTwo(sketchSize / kDedupSketchDepth /
+                             sizeof(uint32_t));
+    table.mask = capacity - 1;
+    table.limit = capacity / 100 * kDedupTableLoad;
+    table.slots = calloc(capacity, sizeof(uint64_t));
+    table.sketch = calloc(table.width * kDedupSketchDepth, sizeof(uint32_t));
+    ImagePage *pages = malloc(kDedupBatchPages * sizeof(*pages));
+    if (!table.slots || !table.sketch || !pages) {
+        rc = kDedupAnalyzeErrorResources;
+        goto out;
+    }
+    if (ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        rc = kDedupAnalyzeErrorFormat;
+        goto out;
+    }
+
+    DedupSlice slices[kDedupThreadsMax];
+    for (unsigned i = 0; i < threads; i++) {
+        slices[i].table = &table;
+        slices[i].base = image->base;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int next;
+    do {
+        size_t count = 0;
+        while (count < kDedupBatchPages &&
+               (next = ImagePagesNext(&iterator, &pages[count])) ==
+               kImagePagesSuccess) {
+            count++;
+        }
+        DedupBatch(slices, threads, pages, count, report);
+    } while (next == kImagePagesSuccess);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (next != kImagePagesEnd) {
+        rc = kDedupAnalyzeErrorFormat;
+        goto out;
+    }
+
+    // A new hash is taken for a duplicate if all its counters have been hit,
+    // which is at most as likely as for the last page counted
+    report->tableEntries = table.count;
+    report->tableCapacity = capacity;
+    report->sketchPages = table.sketchCount;
+    double hit = 1 - exp(-(double) table.sketchCount / table.width);
+    report->sketchErrorPages = (uint64_t) (table.sketchCount *
+                                           pow(hit, kDedupSketchDepth));
+    report->seconds = (end.tv_sec - start.tv_sec) +
+                      (end.tv_nsec - start.tv_nsec) / 1e9;
+
+out:
+    free(pages);
+    free(table.sketch);
+    free(table.slots);
+    return rc;
+}
+
+/* Returns the percentage of part in total. */
+static double Percent(uint64_t part, uint64_t total) {
+    return total > 0 ? 100.0 * part / total : 0;
+}
+
+void DedupPrint(const DedupReport *report, FILE *stream) {
+    uint64_t references = report->duplicatePages * kDedupReferenceSize;
+    uint64_t saved = report->duplicateBytes > references ?
+                     report->duplicateBytes - references : 0;
+
+    fprintf(stream,
+            "%llu pages, %.1f MB stored in the image\n"
+            "zero pages:      %llu (%.1f %%), %.1f MB\n"
+            "duplicate pages: %llu (%.1f %%), %.1f MB\n"
+            "distinct pages:  %llu in the hash table of %llu slots\n"
+            "writing each distinct page once would save %.1f MB (%.1f %%)\n",
+            (unsigned long long) report->pages,
+            report->bytes / 1048576.0,
+            (unsigned long long) report->zeroPages,
+            Percent(report->zeroPages, report->pages),
+            report->zeroBytes / 1048576.0,
+            (unsigned long long) report->duplicatePages,
+            Percent(report->duplicatePages, report->pages),
+            report->duplicateBytes / 1048576.0,
+            (unsigned long long) report->tableEntries,
+            (unsigned long long) report->tableCapacity,
+            saved / 1048576.0,
+            Percent(saved, report->bytes));
+    if (report->sketchPages > 0) {
+        fprintf(stream,
+                "the hash table was full, %llu pages were counted in the "
+                "sketch and up to\n"
+                "about %llu of them taken for duplicates by mistake\n",
+                (unsigned long long) report->sketchPages,
+                (unsigned long long) report->sketchErrorPages);
+    }
+    fprintf(stream,
+            "hashed in %.2f s (%.0f MB/s)\n",
+            report->seconds,
+            report->seconds > 0 ? report->bytes / report->seconds / 1e6 : 0);
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_DEDUP_H
+#define HIBERNATE_DEDUP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+
+/* The default memory for the hash table and the sketch, 256 MB. */
+#define kDedupDefaultMemory (256ULL << 20)
+/* The bytes a page that duplicates an earlier one would take as reference. */
+#define kDedupReferenceSize 8
+
+/* The duplicate pages of an image. */
+typedef struct {
+    /* The pages stored in the image and the bytes they take. */
+    uint64_t pages;
+    uint64_t bytes;
+    /* The pages whose stored bytes are all zero. */
+    uint64_t zeroPages;
+    uint64_t zeroBytes;
+    /* The pages whose stored bytes equal those of an earlier page. */
+    uint64_t duplicatePages;
+    uint64_t duplicateBytes;
+    /*
+     * The pages checked against the count-min sketch after the hash table
+     * had filled up, and the upper bound of the pages of them that may have
+     * been counted as duplicates although they are not.
+     */
+    uint64_t sketchPages;
+    uint64_t sketchErrorPages;
+    /* The distinct contents in the hash table and its capacity. */
+    uint64_t tableEntries;
+    uint64_t tableCapacity;
+    double seconds;
+} DedupReport;
+
+/* The image has been analyzed successfully. */
+#define kDedupAnalyzeSuccess 0
+/* The page runs of the image are invalid. */
+#define kDedupAnalyzeErrorFormat 1
+/* Memory could not be allocated. */
+#define kDedupAnalyzeErrorResources 2
+
+/*
+ * Hashes the pages stored in an image with XXH3 on the specified number of
+ * threads and counts the zero pages and the pages that equal an earlier one.
+ * Pages are compared as they are stored, so compressed pages are duplicates if
+ * their uncompressed contents are. The distinct hashes are kept in a hash
+ * table shared by the threads, in at most three quarters of memory bytes.
+ * Once it is full, the pages that are not in the table are counted in a
+ * count-min sketch in the rest, which may count a few pages as duplicates that
+ * are not.
+ */
+int DedupAnalyze(const HibernateImage *image,
+                 uint64_t memory,
+                 unsigned threads,
+                 DedupReport *report);
+
+/* Prints the ratios and the bytes deduplication would save. */
+void DedupPrint(const DedupReport *report, FILE *stream);
+
+#endif /* HIBERNATE_DEDUP_H */
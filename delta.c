@@ -0,0 +1,628 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "delta.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+/*
+ * The size of the buffers the device is written and read through. Holds at
+ * least one block, since a partial block is padded to a whole one in place.
+ */
+#define kDeltaBufferSize kDeltaMaxBlockSize
+
+/* Rounds a value up to a multiple of a power of two. */
+static uint64_t RoundUp(uint64_t value, uint64_t size) {
+    return (value + size - 1) & ~(size - 1);
+}
+
+/* Returns the seconds since start. */
+static double SecondsSince(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int DeltaDeviceOpen(DeltaDevice *device, const char *path, uint32_t blockSize) {
+    struct stat status;
+
+    if (blockSize < 512 ||
+        blockSize > kDeltaMaxBlockSize ||
+        (blockSize & (blockSize - 1)) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Never truncate a real device
+    if (fstat(fd, &status) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(status.st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (ftruncate(fd, 0) == -1) {
+        close(fd);
+        return -1;
+    }
+
+    device->fd = fd;
+    device->blockSize = blockSize;
+    device->bytesWritten = 0;
+    device->writes = 0;
+    return 0;
+}
+
+void DeltaDeviceClose(DeltaDevice *device) {
+    close(device->fd);
+    device->fd = -1;
+}
+
+/* Writes whole blocks at a block boundary. Returns 0 on success. */
+static int DeviceWrite(DeltaDevice *device,
+                       uint64_t offset,
+                       const uint8_t *data,
+                       size_t length) {
+    if (offset % device->blockSize != 0 || length % device->blockSize != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(device->fd,
+                           data + done,
+                           length - done,
+                           (off_t) (offset + done));
+        if (n == -1) {
+            return -1;
+        }
+        done += n;
+    }
+    device->bytesWritten += length;
+    device->writes++;
+    return 0;
+}
+
+/* Reads up to length bytes. Returns the number of bytes read or -1. */
+static ssize_t DeviceRead(DeltaDevice *device,
+                          uint64_t offset,
+                          uint8_t *data,
+                          size_t length) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pread(device->fd,
+                          data + done,
+                          length - done,
+                          (off_t) (offset + done));
+        if (n == -1) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+/* Appends sections to the device through a buffer of whole blocks. */
+typedef struct {
+    DeltaDevice *device;
+    uint8_t *buffer;
+    /* The device offset of the start of the buffer. */
+    uint64_t offset;
+    size_t used;
+} DeltaWriter;
+
+static int WriterInit(DeltaWriter *writer,
+                      DeltaDevice *device,
+                      uint64_t offset) {
+    void *buffer;
+
+    if (posix_memalign(&buffer, device->blockSize, kDeltaBufferSize) != 0) {
+        return -1;
+    }
+    writer->device = device;
+    writer->buffer = buffer;
+    writer->offset = offset;
+    writer->used = 0;
+    return 0;
+}
+
+/* Returns the device offset of the next byte appended. */
+static uint64_t WriterPosition(const DeltaWriter *writer) {
+    return writer->offset + writer->used;
+}
+
+/*
+ * Writes the buffer padded with zeros to the next block boundary, where the
+ * next section starts. Returns 0 on success.
+ */
+static int WriterFlush(DeltaWriter *writer) {
+    size_t size = RoundUp(writer->used, writer->device->blockSize);
+
+    if (size == 0) {
+        return 0;
+    }
+    memset(writer->buffer + writer->used, 0, size - writer->used);
+    if (DeviceWrite(writer->device, writer->offset, writer->buffer, size)) {
+        return -1;
+    }
+    writer->offset += size;
+    writer->used = 0;
+    return 0;
+}
+
+static int WriterAppend(DeltaWriter *writer, const void *data, size_t length) {
+    const uint8_t *bytes = data;
+
+    while (length > 0) {
+        size_t n = kDeltaBufferSize - writer->used;
+        if (n > length) {
+            n = length;
+        }
+        memcpy(writer->buffer + writer->used, bytes, n);
+        writer->used += n;
+        bytes += n;
+        length -= n;
+        if (writer->used == kDeltaBufferSize && WriterFlush(writer) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Counts the pages of an image. Returns 0 if its page runs are valid. */
+static int CountPages(const HibernateImage *image, uint64_t *pages) {
+    ImagePageIterator iterator;
+    ImagePage page;
+    int rc;
+
+    *pages = 0;
+    if (ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        return -1;
+    }
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        (*pages)++;
+    }
+    return rc == kImagePagesEnd ? 0 : -1;
+}
+
+int DeltaWriteFull(DeltaDevice *device,
+                   const HibernateImage *image,
+                   DeltaResult *result) {
+    DeltaWriter writer;
+    struct timespec start;
+
+    memset(result, 0, sizeof(*result));
+    if (CountPages(image, &result->pages) != 0) {
+        return kDeltaErrorFormat;
+    }
+    result->changedPages = result->pages;
+    if (WriterInit(&writer, device, 0) != 0) {
+        return kDeltaErrorResources;
+    }
+
+    uint64_t bytesWritten = device->bytesWritten;
+    uint64_t writes = device->writes;
+    int rc = kDeltaSuccess;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t size = ImageGetHeader(image)->imageSize;
+    if (WriterAppend(&writer, image->base, size) != 0 ||
+        WriterFlush(&writer) != 0 ||
+        fsync(device->fd) != 0) {
+        rc = kDeltaErrorDevice;
+    }
+    result->seconds = SecondsSince(&start);
+    result->bytesWritten = device->bytesWritten - bytesWritten;
+    result->writes = device->writes - writes;
+    free(writer.buffer);
+    return rc;
+}
+
+/* A page of the previous image. */
+typedef struct {
+    uint32_t number;
+    uint32_t length;
+    uint64_t offset;
+} DeltaPage;
+
+static int ComparePages(const void *a, const void *b) {
+    const DeltaPage *left = a;
+    const DeltaPage *right = b;
+
+    return left->number < right->number ? -1 : left->number > right->number;
+}
+
+/*
+ * Collects the pages of an image sorted by number. Returns 0 on success or one
+ * of the kDelta codes.
+ */
+static int CollectPages(const HibernateImage *image,
+                        DeltaPage **pages,
+                        size_t *count) {
+    ImagePageIterator iterator;
+    ImagePage page;
+    uint64_t total;
+    int rc;
+
+    *pages = NULL;
+    *count = 0;
+    if (CountPages(image, &total) != 0 ||
+        ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        return kDeltaErrorFormat;
+    }
+    *pages = malloc((total > 0 ? total : 1) * sizeof(**pages));
+    if (!*pages) {
+        return kDeltaErrorResources;
+    }
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        DeltaPage *entry = &(*pages)[(*count)++];
+        entry->number = page.number;
+        entry->length = page.length;
+        entry->offset = page.offset;
+    }
+    qsort(*pages, *count, sizeof(**pages), ComparePages);
+    return kDeltaSuccess;
+}
+
+/* Returns the page with a number or NULL. */
+static const DeltaPage *FindPage(const DeltaPage *pages,
+                                 size_t count,
+                                 uint32_t number) {
+    size_t low = 0;
+    size_t high = count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (pages[middle].number < number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < count && pages[low].number == number ? &pages[low] : NULL;
+}
+
+/* The map of a delta, grown as the pages of the new image are written. */
+typedef struct {
+    DeltaEntry *entries;
+    size_t count;
+    size_t capacity;
+    /* The device offset after the tagged page of the last entry. */
+    uint64_t end;
+} DeltaMap;
+
+/*
+ * Adds a tagged page at a device offset to the map. It extends the last entry
+ * if it follows its last page in number and on the device, unless split is
+ * set. Returns 0 on success.
+ */
+static int MapAdd(DeltaMap *map,
+                  uint32_t number,
+                  uint32_t length,
+                  uint64_t offset,
+                  int split) {
+    DeltaEntry *last = map->count > 0 ? &map->entries[map->count - 1] : NULL;
+
+    if (!split && last && offset == map->end &&
+        number == last->firstPage + last->pageCount) {
+        last->pageCount++;
+    } else {
+        if (map->count == map->capacity) {
+            size_t capacity = map->capacity ? map->capacity * 2 : 1024;
+            DeltaEntry *grown = realloc(map->entries,
+                                        capacity * sizeof(*grown));
+            if (!grown) {
+                return -1;
+            }
+            map->entries = grown;
+            map->capacity = capacity;
+        }
+        DeltaEntry *entry = &map->entries[map->count++];
+        entry->firstPage = number;
+        entry->pageCount = 1;
+        entry->offset = offset;
+    }
+    map->end = offset + sizeof(uint32_t) + RoundUp(length, 4);
+    return 0;
+}
+
+int DeltaWrite(DeltaDevice *device,
+               const HibernateImage *previous,
+               const HibernateImage *next,
+               DeltaResult *result) {
+    const IOHibernateImageHeader *previousHeader = ImageGetHeader(previous);
+    const IOHibernateImageHeader *header = ImageGetHeader(next);
+    static const uint8_t kPadding[4];
+    DeltaPage *previousPages = NULL;
+    size_t previousCount;
+    DeltaMap map = { NULL, 0, 0, 0 };
+    DeltaWriter writer = { .buffer = NULL };
+    ImagePageIterator iterator;
+    ImagePage page;
+    DeltaHeader delta;
+    struct timespec start;
+
+    memset(result, 0, sizeof(*result));
+    int rc = CollectPages(previous, &previousPages, &previousCount);
+    if (rc != kDeltaSuccess) {
+        goto out;
+    }
+    if (ImagePagesInit(&iterator, next) != kImagePagesSuccess) {
+        rc = kDeltaErrorFormat;
+        goto out;
+    }
+    uint64_t base = RoundUp(previousHeader->imageSize, device->blockSize);
+    if (WriterInit(&writer, device, base + device->blockSize) != 0) {
+        rc = kDeltaErrorResources;
+        goto out;
+    }
+
+    uint64_t bytesWritten = device->bytesWritten;
+    uint64_t writes = device->writes;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // The header, restore code, preview and page list of the new image
+    memset(&delta, 0, sizeof(delta));
+    delta.signature = kDeltaSignature;
+    delta.previousSum = previousHeader->image2Sum;
+    delta.previousSize = previousHeader->imageSize;
+    delta.imageSize = header->imageSize;
+    delta.prefixOffset = WriterPosition(&writer);
+    delta.prefixSize = iterator.offset;
+    if (WriterAppend(&writer, next->base, iterator.offset) != 0 ||
+        WriterFlush(&writer) != 0) {
+        rc = kDeltaErrorDevice;
+        goto out;
+    }
+
+    // Reference the unchanged pages and write the others
+    int image2 = 0;
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        const uint8_t *data = next->base + page.offset;
+        const DeltaPage *old = FindPage(previousPages,
+                                        previousCount,
+                                        page.number);
+        uint64_t offset;
+        if (old && old->length == page.length &&
+            memcmp(previous->base + old->offset, data, page.length) == 0) {
+            offset = old->offset - sizeof(uint32_t);
+        } else {
+            uint32_t tag = kImageTagSignature | page.length;
+            offset = WriterPosition(&writer);
+            if (WriterAppend(&writer, &tag, sizeof(tag)) != 0 ||
+                WriterAppend(&writer, data, page.length) != 0 ||
+                WriterAppend(&writer,
+                             kPadding,
+                             RoundUp(page.length, 4) - page.length) != 0) {
+                rc = kDeltaErrorDevice;
+                goto out;
+            }
+            result->changedPages++;
+        }
+
+        int split = page.image2 && !image2;
+        if (split) {
+            delta.image1Entries = map.count;
+            image2 = 1;
+        }
+        if (MapAdd(&map, page.number, page.length, offset, split) != 0) {
+            rc = kDeltaErrorResources;
+            goto out;
+        }
+        result->pages++;
+    }
+    if (rc != kImagePagesEnd) {
+        rc = kDeltaErrorFormat;
+        goto out;
+    }
+    if (!image2) {
+        delta.image1Entries = map.count;
+    }
+
+    // The map, then the header once everything else is on the device
+    if (WriterFlush(&writer) != 0) {
+        rc = kDeltaErrorDevice;
+        goto out;
+    }
+    delta.mapOffset = WriterPosition(&writer);
+    delta.entryCount = map.count;
+    if (WriterAppend(&writer,
+                     map.entries,
+                     map.count * sizeof(*map.entries)) != 0 ||
+        WriterFlush(&writer) != 0 ||
+        fsync(device->fd) != 0) {
+        rc = kDeltaErrorDevice;
+        goto out;
+    }
+    writer.offset = base;
+    if (WriterAppend(&writer, &delta, sizeof(delta)) != 0 ||
+        WriterFlush(&writer) != 0 ||
+        fsync(device->fd) != 0) {
+        rc = kDeltaErrorDevice;
+        goto out;
+    }
+    result->seconds = SecondsSince(&start);
+    result->entries = map.count;
+    result->bytesWritten = device->bytesWritten - bytesWritten;
+    result->writes = device->writes - writes;
+    rc = kDeltaSuccess;
+
+out:
+    free(writer.buffer);
+    free(map.entries);
+    free(previousPages);
+    return rc;
+}
+
+/* Reads the device through a window of kDeltaBufferSize bytes. */
+typedef struct {
+    DeltaDevice *device;
+    uint8_t *buffer;
+    uint64_t offset;
+    size_t size;
+} DeltaReader;
+
+/*
+ * Returns the bytes at a device offset, at most kDeltaBufferSize, or NULL if
+ * they could not be read. Sets errno to 0 if the device ends before them.
+ */
+static const uint8_t *ReaderGet(DeltaReader *reader,
+                                uint64_t offset,
+                                size_t length) {
+    if (offset < reader->offset ||
+        offset + length > reader->offset + reader->size) {
+        ssize_t n = DeviceRead(reader->device,
+                               offset,
+                               reader->buffer,
+                               kDeltaBufferSize);
+        reader->offset = offset;
+        reader->size = n > 0 ? n : 0;
+        if (n == -1) {
+            return NULL;
+        }
+        if (length > reader->size) {
+            errno = 0;
+            return NULL;
+        }
+    }
+    return reader->buffer + (offset - reader->offset);
+}
+
+/* Returns kDeltaErrorDevice for a read error and kDeltaErrorMismatch else. */
+static int ReaderError(void) {
+    return errno != 0 ? kDeltaErrorDevice : kDeltaErrorMismatch;
+}
+
+int DeltaVerify(DeltaDevice *device,
+                const HibernateImage *previous,
+                const HibernateImage *next) {
+    const IOHibernateImageHeader *previousHeader = ImageGetHeader(previous);
+    const IOHibernateImageHeader *header = ImageGetHeader(next);
+    DeltaReader reader = { device, NULL, 0, 0 };
+    ImagePageIterator iterator;
+    ImagePage page;
+    DeltaHeader delta;
+    const uint8_t *bytes;
+    int rc = kDeltaErrorMismatch;
+
+    if (ImagePagesInit(&iterator, next) != kImagePagesSuccess) {
+        return kDeltaErrorFormat;
+    }
+    reader.buffer = malloc(kDeltaBufferSize);
+    if (!reader.buffer) {
+        return kDeltaErrorResources;
+    }
+
+    // The header must belong to the previous and the next image
+    uint64_t base = RoundUp(previousHeader->imageSize, device->blockSize);
+    if (!(bytes = ReaderGet(&reader, base, sizeof(delta)))) {
+        rc = ReaderError();
+        goto out;
+    }
+    memcpy(&delta, bytes, sizeof(delta));
+    if (delta.signature != kDeltaSignature ||
+        delta.previousSum != previousHeader->image2Sum ||
+        delta.previousSize != previousHeader->imageSize ||
+        delta.imageSize != header->imageSize ||
+        delta.prefixSize != iterator.offset ||
+        delta.image1Entries > delta.entryCount) {
+        goto out;
+    }
+    for (uint64_t done = 0; done < delta.prefixSize; ) {
+        size_t n = delta.prefixSize - done < kDeltaBufferSize ?
+                   delta.prefixSize - done : kDeltaBufferSize;
+        if (!(bytes = ReaderGet(&reader, delta.prefixOffset + done, n))) {
+            rc = ReaderError();
+            goto out;
+        }
+        if (memcmp(bytes, next->base + done, n) != 0) {
+            goto out;
+        }
+        done += n;
+    }
+
+    // Restore the pages entry by entry
+    for (uint64_t i = 0; i < delta.entryCount; i++) {
+        DeltaEntry entry;
+        if (!(bytes = ReaderGet(&reader,
+                                delta.mapOffset + i * sizeof(entry),
+                                sizeof(entry)))) {
+            rc = ReaderError();
+            goto out;
+        }
+        memcpy(&entry, bytes, sizeof(entry));
+
+        uint64_t offset = entry.offset;
+        for (uint32_t j = 0; j < entry.pageCount; j++) {
+            uint32_t tag;
+            if (!(bytes = ReaderGet(&reader, offset, sizeof(tag)))) {
+                rc = ReaderError();
+                goto out;
+            }
+            memcpy(&tag, bytes, sizeof(tag));
+            uint32_t length = tag & kImageTagLengthMask;
+            if ((tag & ~kImageTagLengthMask) != kImageTagSignature ||
+                length == 0 || length > kImagePageSize ||
+                ImagePagesNext(&iterator, &page) != kImagePagesSuccess ||
+                page.number != entry.firstPage + j ||
+                page.length != length ||
+                page.image2 != (i >= delta.image1Entries)) {
+                goto out;
+            }
+            if (!(bytes = ReaderGet(&reader, offset + sizeof(tag), length))) {
+                rc = ReaderError();
+                goto out;
+            }
+            if (memcmp(bytes, next->base + page.offset, length) != 0) {
+                goto out;
+            }
+            offset += sizeof(tag) + RoundUp(length, 4);
+        }
+    }
+    if (ImagePagesNext(&iterator, &page) == kImagePagesEnd) {
+        rc = kDeltaSuccess;
+    }
+
+out:
+    free(reader.buffer);
+    return rc;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_DELTA_H
+#define HIBERNATE_DELTA_H
+
+#include <stdint.h>
+
+#include "image.h"
+
+/*
+ * A delta stores an image as the changes to the previous image on the same
+ * device. The device keeps the previous image at offset 0, and the delta
+ * starts at the next block after it:
+ *
+ * - A DeltaHeader in a block of its own, written last.
+ * - The bytes of the new image before its page runs: the header, the restore
+ *   code, the preview and the page list.
+ * - The pages that are not in the previous image or whose stored data
+ *   differs, as tagged pages like in the page runs of image.h.
+ * - The map, a DeltaEntry for each run of pages of the new image stored as
+ *   consecutive tagged pages either in the previous image or in the delta,
+ *   in the order of the new image. The first image1Entries entries hold the
+ *   pages of image1.
+ *
+ * All sections start at a block boundary and are written in whole blocks.
+ */
+
+/* The signature of a DeltaHeader. */
+#define kDeltaSignature 0x44544c44
+/* The default block size of the device. */
+#define kDeltaDefaultBlockSize 4096
+/* The largest block size of the device, the size of the buffers of a delta. */
+#define kDeltaMaxBlockSize (1 << 20)
+
+typedef struct {
+    uint32_t signature;
+    /* The image2Sum of the previous image, which must be on the device. */
+    uint32_t previousSum;
+    uint64_t previousSize;
+    /* The imageSize of the new image. */
+    uint64_t imageSize;
+    /* The device offset and size of the bytes before the page runs. */
+    uint64_t prefixOffset;
+    uint64_t prefixSize;
+    /* The device offset and number of the entries of the map. */
+    uint64_t mapOffset;
+    uint64_t entryCount;
+    uint64_t image1Entries;
+} DeltaHeader;
+
+typedef struct {
+    uint32_t firstPage;
+    uint32_t pageCount;
+    /* The device offset of the tag of the first page. */
+    uint64_t offset;
+} DeltaEntry;
+
+/*
+ * A regular file that stands in for the block device of the polled file. It
+ * only accepts writes of whole, aligned blocks and counts them.
+ */
+typedef struct {
+    int fd;
+    uint32_t blockSize;
+    uint64_t bytesWritten;
+    uint64_t writes;
+} DeltaDevice;
+
+/* The pages and bytes of an image written to the device. */
+typedef struct {
+    uint64_t pages;
+    /* The pages written, the rest are referenced in the previous image. */
+    uint64_t changedPages;
+    uint64_t entries;
+    uint64_t bytesWritten;
+    uint64_t writes;
+    /* The time from the first write to the end of the last flush. */
+    double seconds;
+} DeltaResult;
+
+/* The image has been written or verified successfully. */
+#define kDeltaSuccess 0
+/* Reading or writing the device failed, errno is set. */
+#define kDeltaErrorDevice 1
+/* The page runs of an image are invalid. */
+#define kDeltaErrorFormat 2
+/* Memory could not be allocated. */
+#define kDeltaErrorResources 3
+/* The delta on the device does not restore the new image. */
+#define kDeltaErrorMismatch 4
+
+/*
+ * Creates or truncates a regular file as device with a block size that is a
+ * power of two from 512 bytes to kDeltaMaxBlockSize. Returns 0 on success and
+ * -1 otherwise.
+ */
+int DeltaDeviceOpen(DeltaDevice *device, const char *path, uint32_t blockSize);
+
+void DeltaDeviceClose(DeltaDevice *device);
+
+/* Writes a whole image to the device at offset 0, like a full rewrite. */
+int DeltaWriteFull(DeltaDevice *device,
+                   const HibernateImage *image,
+                   DeltaResult *result);
+
+/*
+ * Writes the delta of the next image to the previous one, which must have been
+ * written to the device by DeltaWriteFull. A page is referenced if the
+ * previous image stores the same page number with the same data.
+ */
+int DeltaWrite(DeltaDevice *device,
+               const HibernateImage *previous,
+               const HibernateImage *next,
+               DeltaResult *result);
+
+/*
+ * Reads the delta back from the device and checks that it restores the pages
+ * of the next image in order.
+ */
+int DeltaVerify(DeltaDevice *device,
+                const HibernateImage *previous,
+                const HibernateImage *next);
+
+#endif /* HIBERNATE_DELTA_H */
@@ -0,0 +1,649 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "diff.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* The maximum number of threads comparing the contents of pages. */
+#define kDiffThreadsMax 16
+
+/* Returns the seconds since start. */
+static double SecondsSince(const struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Returns the bank after a bank of a page list. */
+static const hibernate_bitmap_t *NextBank(const hibernate_bitmap_t *bank) {
+    return (const hibernate_bitmap_t *) &bank->bitmap[bank->bitmapwords];
+}
+
+/* Returns the bank of a list with the same pages or NULL. */
+static const hibernate_bitmap_t *FindBank(const hibernate_page_list_t *list,
+                                          uint32_t firstPage,
+                                          uint32_t lastPage) {
+    const hibernate_bitmap_t *bank = list->bank_bitmap;
+
+    for (uint32_t i = 0; i < list->bank_count; i++) {
+        if (bank->first_page == firstPage && bank->last_page == lastPage) {
+            return bank;
+        }
+        bank = NextBank(bank);
+    }
+    return NULL;
+}
+
+/* Returns 1 if a page is in a bank of the list and saved. */
+static int IsSaved(const hibernate_page_list_t *list, uint32_t page) {
+    const hibernate_bitmap_t *bank = list->bank_bitmap;
+
+    for (uint32_t i = 0; i < list->bank_count; i++) {
+        if (page >= bank->first_page && page <= bank->last_page) {
+            return !ImagePageListTest(list, page);
+        }
+        bank = NextBank(bank);
+    }
+    return 0;
+}
+
+/* Returns the mask of the bits from index to the end of its word. */
+static uint32_t HeadMask(uint64_t index) {
+    return 0xffffffff >> (index & 31);
+}
+
+/*
+ * Counts the bits in [start, end) that are set in first and clear in second as
+ * added, and the other way around as removed. Set bits mark pages that are not
+ * saved. Whole words are processed 64 bits at a time.
+ */
+static void CountBits(const uint32_t *first,
+                      const uint32_t *second,
+                      uint64_t start,
+                      uint64_t end,
+                      uint64_t *added,
+                      uint64_t *removed) {
+    uint64_t word = start >> 5;
+    uint64_t endWord = end >> 5;
+
+    // The bits of the first word up to the end of the range
+    if (start & 31) {
+        uint32_t mask = HeadMask(start);
+        if (word == endWord) {
+            mask &= ~HeadMask(end);
+        }
+        *added += __builtin_popcount(first[word] & ~second[word] & mask);
+        *removed += __builtin_popcount(~first[word] & second[word] & mask);
+        if (word == endWord) {
+            return;
+        }
+        word++;
+    }
+
+    uint64_t sumAdded = 0;
+    uint64_t sumRemoved = 0;
+    for (; word + 2 <= endWord; word += 2) {
+        uint64_t a, b;
+        memcpy(&a, &first[word], sizeof(a));
+        memcpy(&b, &second[word], sizeof(b));
+        sumAdded += __builtin_popcountll(a & ~b);
+        sumRemoved += __builtin_popcountll(~a & b);
+    }
+    if (word < endWord) {
+        sumAdded += __builtin_popcount(first[word] & ~second[word]);
+        sumRemoved += __builtin_popcount(~first[word] & second[word]);
+        word++;
+    }
+
+    // The bits of the last word before the end
+    if (end & 31) {
+        uint32_t mask = ~HeadMask(end);
+        sumAdded += __builtin_popcount(first[word] & ~second[word] & mask);
+        sumRemoved += __builtin_popcount(~first[word] & second[word] & mask);
+    }
+    *added += sumAdded;
+    *removed += sumRemoved;
+}
+
+/* Returns the saved pages of a page list. */
+static uint64_t CountSaved(const hibernate_page_list_t *list) {
+    const hibernate_bitmap_t *bank = list->bank_bitmap;
+    uint64_t saved = 0;
+
+    for (uint32_t i = 0; i < list->bank_count; i++) {
+        uint64_t pages = (uint64_t) bank->last_page - bank->first_page + 1;
+        uint64_t set = 0;
+        uint64_t clear = 0;
+
+        // Comparing against a clear bitmap counts the set bits as added
+        static const uint32_t kZero[1024];
+        for (uint64_t start = 0; start < pages; start += 1024 * 32) {
+            uint64_t end = start + 1024 * 32 < pages ? start + 1024 * 32
+                                                     : pages;
+            CountBits(bank->bitmap + start / 32,
+                      kZero,
+                      0,
+                      end - start,
+                      &set,
+                      &clear);
+        }
+        saved += pages - set;
+        bank = NextBank(bank);
+    }
+    return saved;
+}
+
+/* Adds a bank to the result. Returns NULL if there are too many. */
+static DiffBank *AddBank(DiffResult *result,
+                         uint32_t firstPage,
+                         uint32_t lastPage) {
+    if (result->bankCount == kDiffMaxBanks) {
+        return NULL;
+    }
+    DiffBank *bank = &result->banks[result->bankCount++];
+    memset(bank, 0, sizeof(*bank));
+    bank->firstPage = firstPage;
+    bank->lastPage = lastPage;
+    return bank;
+}
+
+/* Counts a page that is saved in only one of the images. */
+static void CountPage(DiffResult *result,
+                      DiffBank *bank,
+                      uint32_t page,
+                      int savedFirst,
+                      int savedSecond) {
+    DiffRegion *region = &result->regions[page / result->regionPages];
+
+    if (savedSecond && !savedFirst) {
+        region->added++;
+        if (bank) {
+            bank->added++;
+        }
+    } else if (savedFirst && !savedSecond) {
+        region->removed++;
+        if (bank) {
+            bank->removed++;
+        }
+    }
+}
+
+/* Compares the page lists. Returns 0 on success and -1 otherwise. */
+static int DiffPageLists(const hibernate_page_list_t *first,
+                         const hibernate_page_list_t *second,
+                         DiffResult *result) {
+    uint32_t regionPages = result->regionPages;
+
+    // Size the regions to cover the banks of both lists
+    uint64_t lastPage = 0;
+    const hibernate_page_list_t *lists[2] = { first, second };
+    for (int i = 0; i < 2; i++) {
+        const hibernate_bitmap_t *bank = lists[i]->bank_bitmap;
+        for (uint32_t j = 0; j < lists[i]->bank_count; j++) {
+            if (bank->last_page > lastPage) {
+                lastPage = bank->last_page;
+            }
+            bank = NextBank(bank);
+        }
+    }
+    result->regionCount = lastPage / regionPages + 1;
+    result->regions = calloc(result->regionCount, sizeof(*result->regions));
+    if (!result->regions) {
+        return -1;
+    }
+
+    const hibernate_bitmap_t *bank = first->bank_bitmap;
+    for (uint32_t i = 0; i < first->bank_count; i++) {
+        DiffBank *diffBank = AddBank(result, bank->first_page, bank->last_page);
+        const hibernate_bitmap_t *twin =
+                FindBank(second, bank->first_page, bank->last_page);
+        if (diffBank) {
+            diffBank->inFirst = 1;
+            diffBank->inSecond = twin != NULL;
+        }
+
+        if (twin) {
+            // Compare the bitmaps a region at a time
+            uint64_t page = bank->first_page;
+            while (page <= bank->last_page) {
+                uint64_t end = (page / regionPages + 1) * regionPages;
+                if (end > (uint64_t) bank->last_page + 1) {
+                    end = (uint64_t) bank->last_page + 1;
+                }
+                DiffRegion *region = &result->regions[page / regionPages];
+                uint64_t added = 0;
+                uint64_t removed = 0;
+                CountBits(bank->bitmap,
+                          twin->bitmap,
+                          page - bank->first_page,
+                          end - bank->first_page,
+                          &added,
+                          &removed);
+                region->added += added;
+                region->removed += removed;
+                if (diffBank) {
+                    diffBank->added += added;
+                    diffBank->removed += removed;
+                }
+                page = end;
+            }
+        } else {
+            // The banks differ, compare page by page
+            for (uint64_t page = bank->first_page;
+                 page <= bank->last_page;
+                 page++) {
+                CountPage(result,
+                          diffBank,
+                          (uint32_t) page,
+                          !ImagePageListTest(first, (uint32_t) page),
+                          IsSaved(second, (uint32_t) page));
+            }
+        }
+        bank = NextBank(bank);
+    }
+
+    // Pages of the second list outside of all banks of the first are added
+    bank = second->bank_bitmap;
+    for (uint32_t i = 0; i < second->bank_count; i++) {
+        if (!FindBank(first, bank->first_page, bank->last_page)) {
+            DiffBank *diffBank = AddBank(result,
+                                         bank->first_page,
+                                         bank->last_page);
+            if (diffBank) {
+                diffBank->inSecond = 1;
+            }
+            for (uint64_t page = bank->first_page;
+                 page <= bank->last_page;
+                 page++) {
+                int inFirst = 0;
+                const hibernate_bitmap_t *other = first->bank_bitmap;
+                for (uint32_t j = 0; j < first->bank_count && !inFirst; j++) {
+                    inFirst = page >= other->first_page &&
+                              page <= other->last_page;
+                    other = NextBank(other);
+                }
+                if (!inFirst) {
+                    CountPage(result,
+                              diffBank,
+                              (uint32_t) page,
+                              0,
+                              !ImagePageListTest(second, (uint32_t) page));
+                }
+            }
+        }
+        bank = NextBank(bank);
+    }
+
+    for (size_t i = 0; i < result->regionCount; i++) {
+        result->added += result->regions[i].added;
+        result->removed += result->regions[i].removed;
+    }
+    return 0;
+}
+
+/* A page stored in an image. */
+typedef struct {
+    uint32_t number;
+    uint32_t length;
+    uint64_t offset;
+} DiffPage;
+
+static int ComparePages(const void *a, const void *b) {
+    const DiffPage *left = a;
+    const DiffPage *right = b;
+
+    return left->number < right->number ? -1 : left->number > right->number;
+}
+
+/*
+ * Collects the pages of an image sorted by number. Returns 0 on success, -1 if
+ * memory could not be allocated and -2 if the page runs are invalid.
+ */
+static int CollectPages(const HibernateImage *image,
+                        DiffPage **pages,
+                        size_t *count) {
+    ImagePageIterator iterator;
+    ImagePage page;
+    size_t capacity = 0;
+    int sorted = 1;
+    int rc;
+
+    *pages = NULL;
+    *count = 0;
+    if (ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        return -2;
+    }
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        if (*count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            DiffPage *grown = realloc(*pages, capacity * sizeof(**pages));
+            if (!grown) {
+                return -1;
+            }
+            *pages = grown;
+        }
+        if (*count > 0 && (*pages)[*count - 1].number > page.number) {
+            sorted = 0;
+        }
+        DiffPage *entry = &(*pages)[(*count)++];
+        entry->number = page.number;
+        entry->length = page.length;
+        entry->offset = page.offset;
+    }
+    if (rc != kImagePagesEnd) {
+        return -2;
+    }
+
+    // Each part is written in page order, so usually only image1 and image2
+    // have to be merged
+    if (!sorted) {
+        qsort(*pages, *count, sizeof(**pages), ComparePages);
+    }
+    return 0;
+}
+
+/* A slice of the pages of the first image compared by one thread. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    const HibernateImage *first;
+    const HibernateImage *second;
+    const DiffPage *pages;
+    size_t count;
+    const DiffPage *secondPages;
+    size_t secondCount;
+    uint32_t regionPages;
+    size_t regionCount;
+    uint64_t *changed;
+    uint64_t compared;
+} DiffSlice;
+
+static void *DiffSliceRun(void *argument) {
+    DiffSlice *slice = argument;
+
+    if (slice->count == 0) {
+        return NULL;
+    }
+
+    // Find the first page of the slice in the second image
+    size_t low = 0;
+    size_t high = slice->secondCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (slice->secondPages[middle].number < slice->pages[0].number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    size_t j = low;
+    for (size_t i = 0; i < slice->count; i++) {
+        const DiffPage *page = &slice->pages[i];
+        while (j < slice->secondCount &&
+               slice->secondPages[j].number < page->number) {
+            j++;
+        }
+        if (j == slice->secondCount) {
+            break;
+        }
+        const DiffPage *other = &slice->secondPages[j];
+        if (other->number != page->number) {
+            continue;
+        }
+        slice->compared++;
+        if (page->length != other->length ||
+            memcmp(slice->first->base + page->offset,
+                   slice->second->base + other->offset,
+                   page->length) != 0) {
+            size_t region = page->number / slice->regionPages;
+            if (region < slice->regionCount) {
+                slice->changed[region]++;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Compares the pages saved in both images. Returns 0 on success. */
+static int DiffContent(const HibernateImage *first,
+                       const HibernateImage *second,
+                       unsigned threads,
+                       DiffResult *result) {
+    DiffPage *firstPages = NULL;
+    DiffPage *secondPages = NULL;
+    DiffSlice *slices = NULL;
+    size_t firstCount, secondCount;
+    int rc = kDiffImagesErrorResources;
+
+    int collected = CollectPages(first, &firstPages, &firstCount);
+    if (collected == 0) {
+        collected = CollectPages(second, &secondPages, &secondCount);
+    }
+    if (collected != 0) {
+        rc = collected == -2 ? kDiffImagesErrorFormat
+                             : kDiffImagesErrorResources;
+        goto out;
+    }
+
+    slices = calloc(threads, sizeof(*slices));
+    if (!slices) {
+        goto out;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        size_t start = firstCount * i / threads;
+        size_t end = firstCount * (i + 1) / threads;
+        slices[i].first = first;
+        slices[i].second = second;
+        slices[i].pages = firstPages + start;
+        slices[i].count = end - start;
+        slices[i].secondPages = secondPages;
+        slices[i].secondCount = secondCount;
+        slices[i].regionPages = result->regionPages;
+        slices[i].regionCount = result->regionCount;
+        slices[i].changed = calloc(result->regionCount, sizeof(uint64_t));
+        if (!slices[i].changed) {
+            goto out;
+        }
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        slices[i].started = pthread_create(&slices[i].thread,
+                                           NULL,
+                                           DiffSliceRun,
+                                           &slices[i]) == 0;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        if (slices[i].started) {
+            pthread_join(slices[i].thread, NULL);
+        } else {
+            DiffSliceRun(&slices[i]);
+        }
+        result->compared += slices[i].compared;
+        for (size_t j = 0; j < result->regionCount; j++) {
+            result->regions[j].changed += slices[i].changed[j];
+            result->changed += slices[i].changed[j];
+        }
+    }
+    result->contentCompared = 1;
+    rc = kDiffImagesSuccess;
+
+out:
+    if (slices) {
+        for (unsigned i = 0; i < threads; i++) {
+            free(slices[i].changed);
+        }
+    }
+    free(slices);
+    free(firstPages);
+    free(secondPages);
+    return rc;
+}
+
+int DiffImages(const HibernateImage *first,
+               const HibernateImage *second,
+               uint32_t regionPages,
+               int compareContent,
+               unsigned threads,
+               DiffResult *result) {
+    const hibernate_page_list_t *firstList;
+    const hibernate_page_list_t *secondList;
+    struct timespec start;
+
+    memset(result, 0, sizeof(*result));
+    result->regionPages = regionPages > 0 ? regionPages
+                                          : kDiffDefaultRegionPages;
+    result->firstSize = ImageGetHeader(first)->imageSize;
+    result->secondSize = ImageGetHeader(second)->imageSize;
+    if (ImageGetPageList(first, &firstList) != kImagePageListSuccess ||
+        ImageGetPageList(second, &secondList) != kImagePageListSuccess) {
+        return kDiffImagesErrorFormat;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result->firstSaved = CountSaved(firstList);
+    result->secondSaved = CountSaved(secondList);
+    if (DiffPageLists(firstList, secondList, result) != 0) {
+        return kDiffImagesErrorResources;
+    }
+    result->bitmapSeconds = SecondsSince(&start);
+
+    if (compareContent) {
+        if (threads < 1) {
+            threads = 1;
+        } else if (threads > kDiffThreadsMax) {
+            threads = kDiffThreadsMax;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int rc = DiffContent(first, second, threads, result);
+        if (rc != kDiffImagesSuccess) {
+            DiffFree(result);
+            return rc;
+        }
+        result->contentSeconds = SecondsSince(&start);
+    }
+    return kDiffImagesSuccess;
+}
+
+void DiffFree(DiffResult *result) {
+    free(result->regions);
+    result->regions = NULL;
+    result->regionCount = 0;
+}
+
+/* Returns the megabytes of a number of pages. */
+static double Megabytes(uint64_t pages) {
+    return pages * (double) kImagePageSize / 1048576;
+}
+
+/* Compares regions by growth, the largest first. */
+static int CompareGrowth(const void *a, const void *b) {
+    const DiffRegion *left = *(const DiffRegion * const *) a;
+    const DiffRegion *right = *(const DiffRegion * const *) b;
+    int64_t leftGrowth = (int64_t) left->added - (int64_t) left->removed;
+    int64_t rightGrowth = (int64_t) right->added - (int64_t) right->removed;
+
+    if (leftGrowth != rightGrowth) {
+        return leftGrowth > rightGrowth ? -1 : 1;
+    }
+    return left < right ? -1 : left > right;
+}
+
+void DiffPrint(const DiffResult *result, unsigned top, FILE *stream) {
+    fprintf(stream,
+            "first:  %.1f MB image, %llu pages saved\n"
+            "second: %.1f MB image, %llu pages saved\n"
+            "%.1f MB added, %.1f MB removed (page lists compared in "
+            "%.3f s)\n",
+            result->firstSize / 1048576.0,
+            (unsigned long long) result->firstSaved,
+            result->secondSize / 1048576.0,
+            (unsigned long long) result->secondSaved,
+            Megabytes(result->added),
+            Megabytes(result->removed),
+            result->bitmapSeconds);
+    if (result->contentCompared) {
+        fprintf(stream,
+                "%llu of %llu pages saved in both changed (compared in "
+                "%.3f s)\n",
+                (unsigned long long) result->changed,
+                (unsigned long long) result->compared,
+                result->contentSeconds);
+    }
+
+    fprintf(stream, "\nbanks:\n");
+    for (uint32_t i = 0; i < result->bankCount; i++) {
+        const DiffBank *bank = &result->banks[i];
+        fprintf(stream,
+                "  0x%08x-0x%08x %-7s +%.1f MB -%.1f MB\n",
+                bank->firstPage,
+                bank->lastPage,
+                bank->inFirst && bank->inSecond ? "" :
+                        bank->inFirst ? "(first)" : "(second)",
+                Megabytes(bank->added),
+                Megabytes(bank->removed));
+    }
+
+    // Rank the regions that changed by growth
+    const DiffRegion **ranked = malloc(result->regionCount * sizeof(*ranked));
+    if (!ranked) {
+        return;
+    }
+    size_t count = 0;
+    for (size_t i = 0; i < result->regionCount; i++) {
+        const DiffRegion *region = &result->regions[i];
+        if (region->added || region->removed || region->changed) {
+            ranked[count++] = region;
+        }
+    }
+    qsort(ranked, count, sizeof(*ranked), CompareGrowth);
+
+    fprintf(stream,
+            "\nregions of %.0f MB that grew most:\n",
+            Megabytes(result->regionPages));
+    for (size_t i = 0; i < count && i < top; i++) {
+        const DiffRegion *region = ranked[i];
+        uint64_t first = (uint64_t) (region - result->regions) *
+                         result->regionPages * kImagePageSize;
+        uint64_t last = first +
+                        (uint64_t) result->regionPages * kImagePageSize - 1;
+        fprintf(stream,
+                "  0x%012llx-0x%012llx %+9.1f MB (+%.1f -%.1f)",
+                (unsigned long long) first,
+                (unsigned long long) last,
+                Megabytes(region->added) - Megabytes(region->removed),
+                Megabytes(region->added),
+                Megabytes(region->removed));
+        if (result->contentCompared) {
+            fprintf(stream, ", %.1f MB changed", Megabytes(region->changed));
+        }
+        fprintf(stream, "\n");
+    }
+    free(ranked);
+}
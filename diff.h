@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_DIFF_H
+#define HIBERNATE_DIFF_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+
+/* The default size of the regions pages are counted in, 1 GB. */
+#define kDiffDefaultRegionPages 262144
+/* The maximum number of banks of a page list that are reported. */
+#define kDiffMaxBanks 64
+
+/* A bank of physical memory in either image. */
+typedef struct {
+    uint32_t firstPage;
+    uint32_t lastPage;
+    /* The bank is in the page list of the first and of the second image. */
+    int inFirst;
+    int inSecond;
+    /* The pages saved in the second image but not in the first and back. */
+    uint64_t added;
+    uint64_t removed;
+} DiffBank;
+
+/* A region of physical memory of the same size. */
+typedef struct {
+    uint64_t added;
+    uint64_t removed;
+    /* The pages saved in both images whose content differs. */
+    uint64_t changed;
+} DiffRegion;
+
+/* The differences between the images of two cycles. */
+typedef struct {
+    uint64_t firstSize;
+    uint64_t secondSize;
+    uint64_t firstSaved;
+    uint64_t secondSaved;
+    DiffBank banks[kDiffMaxBanks];
+    uint32_t bankCount;
+    /* The regions of regionPages pages, starting at page 0. */
+    DiffRegion *regions;
+    size_t regionCount;
+    uint32_t regionPages;
+    uint64_t added;
+    uint64_t removed;
+    /* The contents have been compared. */
+    int contentCompared;
+    uint64_t compared;
+    uint64_t changed;
+    double bitmapSeconds;
+    double contentSeconds;
+} DiffResult;
+
+/* The images have been compared successfully. */
+#define kDiffImagesSuccess 0
+/* The page list or the page runs of an image are invalid. */
+#define kDiffImagesErrorFormat 1
+/* Memory could not be allocated. */
+#define kDiffImagesErrorResources 2
+
+/*
+ * Compares the page lists of two images bank by bank and counts the pages
+ * added and removed per bank and per region. Banks with the same pages in
+ * both lists are compared a word at a time. If compareContent is set, the
+ * pages saved in both images are compared on the specified number of threads.
+ */
+int DiffImages(const HibernateImage *first,
+               const HibernateImage *second,
+               uint32_t regionPages,
+               int compareContent,
+               unsigned threads,
+               DiffResult *result);
+
+/* Frees the regions of a result. */
+void DiffFree(DiffResult *result);
+
+/*
+ * Prints the totals, the banks and the top regions with the largest growth
+ * from the first to the second image.
+ */
+void DiffPrint(const DiffResult *result, unsigned top, FILE *stream);
+
+#endif /* HIBERNATE_DIFF_H */
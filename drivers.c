@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "drivers.h"
+
+#include <stdlib.h>
+
+#include "sketch.h"
+
+/* The transitions of a driver to a lower power state. */
+#define kDriverPhaseSleep 0
+/* The transitions of a driver to a higher power state. */
+#define kDriverPhaseWake 1
+/* The number of phases. */
+#define kDriverPhaseCount 2
+
+/* The names of the phases indexed by phase. */
+static const char *const kDriverPhaseNames[] = { "sleep", "wake" };
+
+/* The latencies of a driver in one phase. */
+typedef struct {
+    /* The summed latency in microseconds of each cycle. */
+    Sketch sketch;
+    /* The summed latency of the current cycle. */
+    uint64_t cycleSum;
+    double p99;
+    uint32_t symbol;
+} DriverPhase;
+
+static int CompareP99(const void *a, const void *b) {
+    double x = (*(DriverPhase * const *) a)->p99;
+    double y = (*(DriverPhase * const *) b)->p99;
+    return (x < y) - (x > y);
+}
+
+/* Prints the top drivers of a phase, ranked by p99. */
+static void PrintPhase(const HistoryStore *store,
+                       const char *name,
+                       DriverPhase *phases,
+                       Sketch *totals,
+                       uint32_t top,
+                       DriverPhase **ranked,
+                       FILE *stream) {
+    uint32_t ranks = 0;
+    for (uint32_t i = 0; i < store->symbolCount; i++) {
+        if (phases[i].sketch.total > 0) {
+            phases[i].p99 = SketchQuantile(&phases[i].sketch, 0.99);
+            ranked[ranks++] = &phases[i];
+        }
+    }
+    qsort(ranked, ranks, sizeof(DriverPhase *), CompareP99);
+
+    fprintf(stream,
+            "%s: %llu cycles, p50 %.3f ms, p99 %.3f ms\n"
+            "%10s %10s %10s %6s %6s  %s\n",
+            name,
+            (unsigned long long) totals->total,
+            SketchQuantile(totals, 0.5) / 1e3,
+            SketchQuantile(totals, 0.99) / 1e3,
+            "p99 ms", "p50 ms", "max ms", "share", "cycles", "driver");
+    for (uint32_t i = 0; i < ranks && i < top; i++) {
+        DriverPhase *phase = ranked[i];
+        fprintf(stream,
+                "%10.3f %10.3f %10.3f %5.1f%% %6llu  %s\n",
+                phase->p99 / 1e3,
+                SketchQuantile(&phase->sketch, 0.5) / 1e3,
+                phase->sketch.max / 1e3,
+                totals->sum > 0 ? 100 * phase->sketch.sum / totals->sum : 0,
+                (unsigned long long) phase->sketch.total,
+                HistorySymbolName(store, phase->symbol));
+    }
+}
+
+int DriversReport(const HistoryStore *store,
+                  uint32_t cycles,
+                  uint32_t top,
+                  FILE *stream) {
+    Sketch totals[kDriverPhaseCount];
+    uint32_t symbols = store->symbolCount;
+
+    // One sketch per driver and phase, and the drivers of the current cycle
+    DriverPhase *phases = calloc((size_t) symbols * kDriverPhaseCount,
+                                 sizeof(DriverPhase));
+    uint32_t *touched = malloc((size_t) symbols * kDriverPhaseCount *
+                               sizeof(uint32_t));
+    DriverPhase **ranked = malloc((size_t) symbols * sizeof(DriverPhase *));
+    if (symbols > 0 && (!phases || !touched || !ranked)) {
+        free(ranked);
+        free(touched);
+        free(phases);
+        return kDriversReportErrorResources;
+    }
+    for (uint32_t phase = 0; phase < kDriverPhaseCount; phase++) {
+        SketchInit(&totals[phase]);
+        for (uint32_t i = 0; i < symbols; i++) {
+            SketchInit(&phases[phase * symbols + i].sketch);
+            phases[phase * symbols + i].symbol = i;
+        }
+    }
+
+    uint32_t first = 0;
+    if (store->cycleCount > cycles) {
+        first = store->cycleCount - cycles;
+    }
+    for (uint32_t c = first; c < store->cycleCount; c++) {
+        const HistoryCycle *cycle = &store->cycles[c];
+        uint64_t cycleTotals[kDriverPhaseCount] = { 0, 0 };
+        uint32_t touchedCount = 0;
+
+        // Sum the latencies of each driver within the cycle
+        for (uint32_t e = cycle->firstEvent;
+             e < cycle->firstEvent + cycle->eventCount;
+             e++) {
+            uint32_t phase;
+            if (store->newState[e] < store->oldState[e]) {
+                phase = kDriverPhaseSleep;
+            } else if (store->newState[e] > store->oldState[e]) {
+                phase = kDriverPhaseWake;
+            } else {
+                continue;
+            }
+            // The interested driver takes the time to acknowledge the
+            // transition of the device it watches
+            uint32_t driver = store->interested[e];
+            if (driver == kHistorySymbolNone) {
+                driver = store->device[e];
+            }
+            uint32_t index = phase * symbols + driver;
+            if (phases[index].cycleSum == 0) {
+                touched[touchedCount++] = index;
+            }
+            // Zero latencies are counted as one microsecond to mark the
+            // driver as touched
+            uint32_t elapsed = store->elapsedUS[e] ? store->elapsedUS[e] : 1;
+            phases[index].cycleSum += elapsed;
+            cycleTotals[phase] += elapsed;
+        }
+
+        for (uint32_t i = 0; i < touchedCount; i++) {
+            DriverPhase *phase = &phases[touched[i]];
+            SketchAdd(&phase->sketch, (double) phase->cycleSum);
+            phase->cycleSum = 0;
+        }
+        for (uint32_t phase = 0; phase < kDriverPhaseCount; phase++) {
+            if (cycleTotals[phase] > 0) {
+                SketchAdd(&totals[phase], (double) cycleTotals[phase]);
+            }
+        }
+    }
+
+    for (uint32_t phase = 0; phase < kDriverPhaseCount; phase++) {
+        if (phase > 0) {
+            fprintf(stream, "\n");
+        }
+        PrintPhase(store,
+                   kDriverPhaseNames[phase],
+                   &phases[phase * symbols],
+                   &totals[phase],
+                   top,
+                   ranked,
+                   stream);
+    }
+
+    free(ranked);
+    free(touched);
+    free(phases);
+    return kDriversReportSuccess;
+}
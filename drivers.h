@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_DRIVERS_H
+#define HIBERNATE_DRIVERS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "history.h"
+
+/* The report has been printed. */
+#define kDriversReportSuccess 0
+/* The sketches could not be allocated. */
+#define kDriversReportErrorResources 1
+
+/*
+ * Prints the drivers that contribute most to sleep and to wake over the last
+ * cycles of the power history. Transitions to a lower power state count
+ * towards sleep, transitions to a higher one towards wake. A transition is
+ * charged to its interested driver, which took the time to acknowledge it, or
+ * to the device itself if there is none. The latencies of a driver are summed
+ * per cycle and added to a sketch, so that memory depends on the number of
+ * drivers only. Cycles in which a driver does not transition are not added.
+ * Drivers are ranked by the p99 of their sums, the share is their part of the
+ * sums of all drivers.
+ */
+int DriversReport(const HistoryStore *store,
+                  uint32_t cycles,
+                  uint32_t top,
+                  FILE *stream);
+
+#endif /* HIBERNATE_DRIVERS_H */
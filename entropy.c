@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "entropy.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "image.h"
+
+/* The number of pages read at once. Two batches are in memory at a time. */
+#define kEntropyBatchPages 4096
+/* The maximum number of threads computing the entropy of a batch. */
+#define kEntropyThreadsMax 16
+
+/* The values of c * log2(c) for every possible byte count of a page. */
+static double gCountLog[kImagePageSize + 1];
+static pthread_once_t gCountLogOnce = PTHREAD_ONCE_INIT;
+
+static void CountLogInit(void) {
+    for (int c = 1; c <= kImagePageSize; c++) {
+        gCountLog[c] = c * log2(c);
+    }
+}
+
+/* Returns the Shannon entropy of the bytes of a page in bits per byte. */
+static float PageEntropy(const uint8_t *page) {
+    // Four histograms avoid stalls on runs of the same byte
+    uint32_t histogram[4][256];
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < kImagePageSize; i += 4) {
+        histogram[0][page[i]]++;
+        histogram[1][page[i + 1]]++;
+        histogram[2][page[i + 2]]++;
+        histogram[3][page[i + 3]]++;
+    }
+
+    double sum = 0;
+    for (int b = 0; b < 256; b++) {
+        sum += gCountLog[histogram[0][b] + histogram[1][b] +
+                         histogram[2][b] + histogram[3][b]];
+    }
+    return (float) (log2(kImagePageSize) - sum / kImagePageSize);
+}
+
+/* A slice of a batch whose entropy is computed by one thread. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    const uint8_t *pages;
+    size_t count;
+    float *entropy;
+} EntropySlice;
+
+static void *EntropySliceRun(void *argument) {
+    EntropySlice *slice = argument;
+
+    for (size_t i = 0; i < slice->count; i++) {
+        slice->entropy[i] = PageEntropy(slice->pages + i * kImagePageSize);
+    }
+    return NULL;
+}
+
+/* Starts the threads of a batch. Slices without a thread run on join. */
+static void EntropyStart(EntropySlice *slices,
+                         unsigned count,
+                         const uint8_t *pages,
+                         size_t pageCount,
+                         float *entropy) {
+    for (unsigned i = 0; i < count; i++) {
+        size_t first = pageCount * i / count;
+        size_t last = pageCount * (i + 1) / count;
+        slices[i].pages = pages + first * kImagePageSize;
+        slices[i].count = last - first;
+        slices[i].entropy = entropy + first;
+        slices[i].started = pthread_create(&slices[i].thread,
+                                           NULL,
+                                           EntropySliceRun,
+                                           &slices[i]) == 0;
+    }
+}
+
+static void EntropyJoin(EntropySlice *slices, unsigned count) {
+    for (unsigned i = 0; i < count; i++) {
+        if (slices[i].started) {
+            pthread_join(slices[i].thread, NULL);
+        } else {
+            EntropySliceRun(&slices[i]);
+        }
+    }
+}
+
+/* The region that is extended while the pages are classified in order. */
+typedef struct {
+    EntropyRegion region;
+    int open;
+    EntropyRegionCallback callback;
+    void *context;
+} RegionTracker;
+
+static void RegionClose(RegionTracker *tracker) {
+    if (tracker->open) {
+        tracker->callback(&tracker->region, tracker->context);
+        tracker->open = 0;
+    }
+}
+
+static void RegionAdd(RegionTracker *tracker,
+                      int kind,
+                      uint64_t page,
+                      float entropy) {
+    EntropyRegion *region = &tracker->region;
+
+    if (tracker->open && region->kind == kind &&
+        region->firstPage + region->pageCount == page) {
+        region->pageCount++;
+        region->minEntropy = fminf(region->minEntropy, entropy);
+        region->maxEntropy = fmaxf(region->maxEntropy, entropy);
+        return;
+    }
+    RegionClose(tracker);
+    region->kind = kind;
+    region->firstPage = page;
+    region->pageCount = 1;
+    region->minEntropy = entropy;
+    region->maxEntropy = entropy;
+    tracker->open = 1;
+}
+
+/* Reports the pages in [first, last) as uncovered, if there are any. */
+static void RegionUncovered(RegionTracker *tracker,
+                            uint64_t first,
+                            uint64_t last,
+                            EntropySummary *summary) {
+    if (first >= last) {
+        return;
+    }
+    EntropyRegion region = { kEntropyRegionUncovered, first, last - first,
+                             0, 0 };
+    tracker->callback(&region, tracker->context);
+    summary->uncoveredPages += last - first;
+}
+
+/* Reads as many whole pages as possible. Returns the number of pages read. */
+static ssize_t ReadPages(int fd, uint8_t *buffer, size_t count, off_t offset) {
+    size_t size = count * kImagePageSize;
+    size_t done = 0;
+
+    while (done < size) {
+        ssize_t n = pread(fd, buffer + done, size - done, offset + done);
+        if (n == -1) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += n;
+    }
+    return done / kImagePageSize;
+}
+
+int EntropyVerify(const char *path,
+                  double threshold,
+                  unsigned threads,
+                  EntropyRegionCallback callback,
+                  void *context,
+                  EntropySummary *summary) {
+    uint8_t headerPage[kImagePageSize];
+    HibernateImage image;
+    struct stat status;
+    int rc = kEntropyVerifySuccess;
+
+    memset(summary, 0, sizeof(*summary));
+    pthread_once(&gCountLogOnce, CountLogInit);
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return kEntropyVerifyErrorFile;
+    }
+    if (fstat(fd, &status) == -1 ||
+        ReadPages(fd, headerPage, 1, 0) == -1) {
+        close(fd);
+        return kEntropyVerifyErrorFile;
+    }
+    if (status.st_size < kImagePageSize ||
+        ImageInit(&image, headerPage, kImagePageSize) != kImageOpenSuccess) {
+        close(fd);
+        return kEntropyVerifyErrorFormat;
+    }
+
+    // The sleep image file is usually larger than the image it contains
+    const IOHibernateImageHeader *header = ImageGetHeader(&image);
+    uint64_t size = status.st_size;
+    if (header->imageSize > 0 && header->imageSize < size) {
+        size = header->imageSize;
+    }
+    uint64_t pages = size / kImagePageSize;
+
+    summary->encryptStart = header->encryptStart;
+    summary->encryptEnd = header->encryptEnd;
+    summary->plaintextEnd = (uint64_t) kImagePageSize *
+                            (1 + header->restore1PageCount) +
+                            header->previewSize;
+    if (summary->encryptStart >= summary->encryptEnd) {
+        close(fd);
+        return kEntropyVerifyErrorNotEncrypted;
+    }
+
+    // Pages are classified only if they are entirely inside or outside
+    uint64_t firstPlaintext = summary->plaintextEnd / kImagePageSize;
+    uint64_t firstInside = (summary->encryptStart + kImagePageSize - 1) /
+                           kImagePageSize;
+    uint64_t lastInside = summary->encryptEnd / kImagePageSize;
+    uint64_t firstOutside = (summary->encryptEnd + kImagePageSize - 1) /
+                            kImagePageSize;
+    uint64_t lastOutside = summary->encryptStart / kImagePageSize;
+
+    RegionTracker tracker = { .callback = callback, .context = context };
+    RegionUncovered(&tracker,
+                    (summary->plaintextEnd + kImagePageSize - 1) /
+                    kImagePageSize,
+                    lastOutside < pages ? lastOutside : pages,
+                    summary);
+    if (firstOutside > firstPlaintext && firstOutside < pages) {
+        RegionUncovered(&tracker, firstOutside, pages, summary);
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    } else if (threads > kEntropyThreadsMax) {
+        threads = kEntropyThreadsMax;
+    }
+
+    uint8_t *buffers[2];
+    float *entropy = calloc(kEntropyBatchPages, sizeof(float));
+    buffers[0] = malloc((size_t) kEntropyBatchPages * kImagePageSize);
+    buffers[1] = malloc((size_t) kEntropyBatchPages * kImagePageSize);
+    if (!entropy || !buffers[0] || !buffers[1]) {
+        rc = kEntropyVerifyErrorResources;
+        goto out;
+    }
+
+    // Read the next batch while the threads work on the current one
+    EntropySlice slices[kEntropyThreadsMax];
+    uint64_t page = 0;
+    ssize_t count = ReadPages(fd, buffers[0], kEntropyBatchPages, 0);
+    int current = 0;
+    while (count > 0 && page < pages) {
+        if ((uint64_t) count > pages - page) {
+            count = pages - page;
+        }
+        EntropyStart(slices, threads, buffers[current], count, entropy);
+
+        uint64_t next = page + count;
+        ssize_t nextCount = 0;
+        if (next < pages) {
+            nextCount = ReadPages(fd,
+                                  buffers[!current],
+                                  kEntropyBatchPages,
+                                  (off_t) next * kImagePageSize);
+        }
+        EntropyJoin(slices, threads);
+
+        for (ssize_t i = 0; i < count; i++, page++) {
+            int encrypted = entropy[i] >= threshold;
+            if (page >= firstInside && page < lastInside) {
+                if (encrypted) {
+                    summary->encryptedPages++;
+                } else {
+                    summary->plaintextPages++;
+                    RegionAdd(&tracker, kEntropyRegionPlaintext, page,
+                              entropy[i]);
+                }
+            } else if ((page < lastOutside || page >= firstOutside) &&
+                       encrypted) {
+                summary->cipherOutsidePages++;
+                RegionAdd(&tracker, kEntropyRegionCipherOutside, page,
+                          entropy[i]);
+            }
+        }
+        summary->pages = page;
+
+        if (nextCount == -1) {
+            rc = kEntropyVerifyErrorFile;
+            break;
+        }
+        count = nextCount;
+        current = !current;
+    }
+    if (count == -1) {
+        rc = kEntropyVerifyErrorFile;
+    }
+    RegionClose(&tracker);
+
+out:
+    free(buffers[1]);
+    free(buffers[0]);
+    free(entropy);
+    close(fd);
+    return rc;
+}
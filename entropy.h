@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_ENTROPY_H
+#define HIBERNATE_ENTROPY_H
+
+#include <stdint.h>
+
+/*
+ * The entropy in bits per byte above which a page is considered encrypted by
+ * default. Encrypted pages are close to 8, code and data rarely exceed 7.
+ */
+#define kEntropyThresholdDefault 7.5
+
+/*
+ * Pages after the restore code and the preview that are not within the
+ * encrypted range of the header.
+ */
+#define kEntropyRegionUncovered 0
+/* Pages within the encrypted range whose entropy is below the threshold. */
+#define kEntropyRegionPlaintext 1
+/* Pages outside the encrypted range whose entropy is above the threshold. */
+#define kEntropyRegionCipherOutside 2
+
+/* A run of consecutive pages with the same finding. */
+typedef struct {
+    int kind;
+    uint64_t firstPage;
+    uint64_t pageCount;
+    /* The entropy range of the pages, both 0 for uncovered regions. */
+    float minEntropy;
+    float maxEntropy;
+} EntropyRegion;
+
+/*
+ * Receives the uncovered regions first and then the regions found by the scan
+ * in the order of the image.
+ */
+typedef void (*EntropyRegionCallback)(const EntropyRegion *region,
+                                      void *context);
+
+/* The result of a verification. */
+typedef struct {
+    /* The byte range encrypted according to the header. */
+    uint64_t encryptStart;
+    uint64_t encryptEnd;
+    /* The end of the restore code and the preview, which stay plaintext. */
+    uint64_t plaintextEnd;
+    /* The number of pages scanned. */
+    uint64_t pages;
+    /* The number of pages within the encrypted range above the threshold. */
+    uint64_t encryptedPages;
+    uint64_t uncoveredPages;
+    uint64_t plaintextPages;
+    uint64_t cipherOutsidePages;
+} EntropySummary;
+
+/* The image has been scanned, the summary contains the findings. */
+#define kEntropyVerifySuccess 0
+/* The image file could not be opened or read. */
+#define kEntropyVerifyErrorFile 1
+/* The file is not a hibernation image. */
+#define kEntropyVerifyErrorFormat 2
+/* The header does not specify an encrypted range. */
+#define kEntropyVerifyErrorNotEncrypted 3
+/* The buffers could not be allocated. */
+#define kEntropyVerifyErrorResources 4
+
+/*
+ * Checks that the encrypted range of the header covers all pages after the
+ * restore code and the preview, and that the entropy of each page matches
+ * whether it is inside the range. The image is streamed in batches: while
+ * threads compute the entropy of one batch, the next one is read, so that
+ * memory stays bounded by two batches.
+ */
+int EntropyVerify(const char *path,
+                  double threshold,
+                  unsigned threads,
+                  EntropyRegionCallback callback,
+                  void *context,
+                  EntropySummary *summary);
+
+#endif /* HIBERNATE_ENTROPY_H */
@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "eventloop.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <sys/event.h>
+#else
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#endif
+
+/* The maximum number of events fetched from the kernel at once. */
+#define kEventBatch 64
+
+#if defined(__APPLE__)
+/* The size of the buffer notification messages are received into. */
+#define kNotificationMessageSize 4096
+#endif
+
+/* Returns the time of the monotonic clock in seconds. */
+static double MonotonicNow(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int EventLoopInit(EventLoop *loop) {
+    memset(loop, 0, sizeof(*loop));
+#if defined(__APPLE__)
+    loop->queue = kqueue();
+#else
+    loop->queue = epoll_create1(EPOLL_CLOEXEC);
+#endif
+    return loop->queue == -1 ? -1 : 0;
+}
+
+void EventLoopFree(EventLoop *loop) {
+    for (EventWatcher *watcher = loop->watchers;
+         watcher;
+         watcher = watcher->next) {
+        EventWatcherCancel(watcher);
+    }
+    while (loop->watchers) {
+        EventWatcher *next = loop->watchers->next;
+        free(loop->watchers);
+        loop->watchers = next;
+    }
+    if (loop->queue != -1) {
+        close(loop->queue);
+        loop->queue = -1;
+    }
+}
+
+/* Allocates a watcher. It is linked into the loop by AddWatcher. */
+static EventWatcher *NewWatcher(EventLoop *loop,
+                                int type,
+                                EventCallback callback,
+                                void *context) {
+    EventWatcher *watcher = calloc(1, sizeof(*watcher));
+    if (!watcher) {
+        return NULL;
+    }
+    watcher->loop = loop;
+    watcher->type = type;
+    watcher->fd = -1;
+    watcher->callback = callback;
+    watcher->context = context;
+    return watcher;
+}
+
+/* Links a watcher, which has been registered with the kernel, into the loop. */
+static EventWatcher *AddWatcher(EventLoop *loop, EventWatcher *watcher) {
+    watcher->next = loop->watchers;
+    loop->watchers = watcher;
+    loop->active++;
+    return watcher;
+}
+
+#if defined(__APPLE__)
+
+/* Applies a change to the kqueue. Returns 0 on success and -1 otherwise. */
+static int KQueueChange(EventLoop *loop,
+                        uintptr_t ident,
+                        int16_t filter,
+                        uint16_t flags,
+                        uint32_t fflags,
+                        intptr_t data,
+                        void *udata) {
+    struct kevent change;
+    EV_SET(&change, ident, filter, flags, fflags, data, udata);
+    return kevent(loop->queue, &change, 1, NULL, 0, NULL) == -1 ? -1 : 0;
+}
+
+/* Enables or disables the read and write filters of a watcher. */
+static int KQueueSetEvents(EventWatcher *watcher, uint16_t flags, int events) {
+    struct kevent changes[2];
+    EV_SET(&changes[0],
+           watcher->fd,
+           EVFILT_READ,
+           flags | (events & kEventRead ? EV_ENABLE : EV_DISABLE),
+           0,
+           0,
+           watcher);
+    EV_SET(&changes[1],
+           watcher->fd,
+           EVFILT_WRITE,
+           flags | (events & kEventWrite ? EV_ENABLE : EV_DISABLE),
+           0,
+           0,
+           watcher);
+    return kevent(watcher->loop->queue, changes, 2, NULL, 0, NULL) == -1 ?
+            -1 : 0;
+}
+
+#else
+
+/* Returns the epoll events for the kEvent flags. */
+static uint32_t EpollEvents(int events) {
+    uint32_t mask = EPOLLRDHUP;
+    if (events & kEventRead) {
+        mask |= EPOLLIN;
+    }
+    if (events & kEventWrite) {
+        mask |= EPOLLOUT;
+    }
+    return mask;
+}
+
+/* Adds or modifies the epoll registration of a watcher. */
+static int EpollControl(EventWatcher *watcher, int operation, uint32_t mask) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = mask;
+    event.data.ptr = watcher;
+    return epoll_ctl(watcher->loop->queue, operation, watcher->fd, &event);
+}
+
+#endif
+
+EventWatcher *EventLoopAddFD(EventLoop *loop,
+                             int fd,
+                             int events,
+                             EventCallback callback,
+                             void *context) {
+    EventWatcher *watcher =
+            NewWatcher(loop, kEventWatcherFD, callback, context);
+    if (!watcher) {
+        return NULL;
+    }
+    watcher->fd = fd;
+    watcher->events = events;
+
+#if defined(__APPLE__)
+    int rc = KQueueSetEvents(watcher, EV_ADD, events);
+#else
+    int rc = EpollControl(watcher, EPOLL_CTL_ADD, EpollEvents(events));
+#endif
+    if (rc != 0) {
+        free(watcher);
+        return NULL;
+    }
+    return AddWatcher(loop, watcher);
+}
+
+int EventWatcherSetEvents(EventWatcher *watcher, int events) {
+    if (watcher->type != kEventWatcherFD || watcher->cancelled) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (events == watcher->events) {
+        return 0;
+    }
+
+#if defined(__APPLE__)
+    int rc = KQueueSetEvents(watcher, 0, events);
+#else
+    int rc = EpollControl(watcher, EPOLL_CTL_MOD, EpollEvents(events));
+#endif
+    if (rc == 0) {
+        watcher->events = events;
+    }
+    return rc;
+}
+
+EventWatcher *EventLoopAddTimer(EventLoop *loop,
+                                double seconds,
+                                int flags,
+                                EventCallback callback,
+                                void *context) {
+    if ((flags & kEventTimerAbsolute) && (flags & kEventTimerRepeat)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    EventWatcher *watcher =
+            NewWatcher(loop, kEventWatcherTimer, callback, context);
+    if (!watcher) {
+        return NULL;
+    }
+    watcher->timerFlags = flags;
+    if (seconds < 0) {
+        seconds = 0;
+    }
+
+#if defined(__APPLE__)
+    // NOTE_ABSOLUTE takes the date in seconds since 1970 as the deadline
+    uint32_t fflags = NOTE_USECONDS;
+    if (flags & kEventTimerAbsolute) {
+        fflags |= NOTE_ABSOLUTE;
+    }
+    int rc = KQueueChange(loop,
+                          (uintptr_t) watcher,
+                          EVFILT_TIMER,
+                          EV_ADD | (flags & kEventTimerRepeat ? 0 : EV_ONESHOT),
+                          fflags,
+                          (intptr_t) llround(seconds * 1e6),
+                          watcher);
+    if (rc != 0) {
+        free(watcher);
+        return NULL;
+    }
+#else
+    // CLOCK_REALTIME counts the time the system was suspended, unlike
+    // CLOCK_MONOTONIC (see clock_gettime(2))
+    int clock = flags & kEventTimerAbsolute ? CLOCK_REALTIME : CLOCK_MONOTONIC;
+    watcher->fd = timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (watcher->fd == -1) {
+        free(watcher);
+        return NULL;
+    }
+
+    // A zero expiration would disarm the timer
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t) seconds;
+    spec.it_value.tv_nsec = (long) ((seconds - floor(seconds)) * 1e9);
+    if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0) {
+        spec.it_value.tv_nsec = 1;
+    }
+    if (flags & kEventTimerRepeat) {
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(watcher->fd,
+                        flags & kEventTimerAbsolute ? TFD_TIMER_ABSTIME : 0,
+                        &spec,
+                        NULL) != 0 ||
+        EpollControl(watcher, EPOLL_CTL_ADD, EPOLLIN) != 0) {
+        close(watcher->fd);
+        free(watcher);
+        return NULL;
+    }
+#endif
+    return AddWatcher(loop, watcher);
+}
+
+EventWatcher *EventLoopAddSignal(EventLoop *loop,
+                                 int signal,
+                                 EventCallback callback,
+                                 void *context) {
+    EventWatcher *watcher =
+            NewWatcher(loop, kEventWatcherSignal, callback, context);
+    if (!watcher) {
+        return NULL;
+    }
+    watcher->signal = signal;
+
+#if defined(__APPLE__)
+    // kqueue records signals even if they are ignored
+    struct sigaction ignore;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    if (sigaction(signal, &ignore, &watcher->previousAction) != 0) {
+        free(watcher);
+        return NULL;
+    }
+    if (KQueueChange(loop, signal, EVFILT_SIGNAL, EV_ADD, 0, 0, watcher) != 0) {
+        sigaction(signal, &watcher->previousAction, NULL);
+        free(watcher);
+        return NULL;
+    }
+#else
+    // signalfd only receives signals that are blocked
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, signal);
+    if (sigprocmask(SIG_BLOCK, &mask, &watcher->previousMask) != 0) {
+        free(watcher);
+        return NULL;
+    }
+    watcher->fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (watcher->fd == -1 ||
+        EpollControl(watcher, EPOLL_CTL_ADD, EPOLLIN) != 0) {
+        if (watcher->fd != -1) {
+            close(watcher->fd);
+        }
+        sigprocmask(SIG_SETMASK, &watcher->previousMask, NULL);
+        free(watcher);
+        return NULL;
+    }
+#endif
+    return AddWatcher(loop, watcher);
+}
+
+#if defined(__APPLE__)
+
+EventWatcher *EventLoopAddNotificationPort(EventLoop *loop,
+                                           IONotificationPortRef port,
+                                           EventCallback callback,
+                                           void *context) {
+    EventWatcher *watcher =
+            NewWatcher(loop, kEventWatcherNotificationPort, callback, context);
+    if (!watcher) {
+        return NULL;
+    }
+    watcher->port = port;
+
+    if (KQueueChange(loop,
+                     IONotificationPortGetMachPort(port),
+                     EVFILT_MACHPORT,
+                     EV_ADD,
+                     0,
+                     0,
+                     watcher) != 0) {
+        free(watcher);
+        return NULL;
+    }
+    return AddWatcher(loop, watcher);
+}
+
+/*
+ * Receives the pending messages of a notification port and passes them to
+ * IOKit, which invokes the registered notification callbacks.
+ */
+static void DispatchNotifications(EventWatcher *watcher) {
+    union {
+        mach_msg_header_t header;
+        uint8_t bytes[kNotificationMessageSize];
+    } message;
+    mach_port_t port = IONotificationPortGetMachPort(watcher->port);
+
+    while (!watcher->cancelled) {
+        kern_return_t result = mach_msg(&message.header,
+                                        MACH_RCV_MSG | MACH_RCV_TIMEOUT,
+                                        0,
+                                        sizeof(message),
+                                        port,
+                                        0,
+                                        MACH_PORT_NULL);
+        if (result != KERN_SUCCESS) {
+            break;
+        }
+        IODispatchCalloutFromMessage(NULL, &message.header, watcher->port);
+    }
+}
+
+#endif
+
+void EventWatcherCancel(EventWatcher *watcher) {
+    EventLoop *loop = watcher->loop;
+
+    if (watcher->cancelled) {
+        return;
+    }
+
+    // Errors are ignored, e.g. for one-shot timers that have already been
+    // removed by the kernel
+    switch (watcher->type) {
+        case kEventWatcherFD:
+#if defined(__APPLE__)
+            KQueueChange(loop, watcher->fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
+            KQueueChange(loop, watcher->fd, EVFILT_WRITE, EV_DELETE, 0, 0, 0);
+#else
+            epoll_ctl(loop->queue, EPOLL_CTL_DEL, watcher->fd, NULL);
+#endif
+            break;
+        case kEventWatcherTimer:
+#if defined(__APPLE__)
+            KQueueChange(loop,
+                         (uintptr_t) watcher,
+                         EVFILT_TIMER,
+                         EV_DELETE,
+                         0,
+                         0,
+                         0);
+#else
+            close(watcher->fd);
+#endif
+            break;
+        case kEventWatcherSignal:
+#if defined(__APPLE__)
+            KQueueChange(loop,
+                         watcher->signal,
+                         EVFILT_SIGNAL,
+                         EV_DELETE,
+                         0,
+                         0,
+                         0);
+            sigaction(watcher->signal, &watcher->previousAction, NULL);
+#else
+            close(watcher->fd);
+            if (!sigismember(&watcher->previousMask, watcher->signal)) {
+                sigset_t mask;
+                sigemptyset(&mask);
+                sigaddset(&mask, watcher->signal);
+                sigprocmask(SIG_UNBLOCK, &mask, NULL);
+            }
+#endif
+            break;
+#if defined(__APPLE__)
+        case kEventWatcherNotificationPort:
+            KQueueChange(loop,
+                         IONotificationPortGetMachPort(watcher->port),
+                         EVFILT_MACHPORT,
+                         EV_DELETE,
+                         0,
+                         0,
+                         0);
+            break;
+#endif
+    }
+
+    // The watcher is freed after the batch, which may still refer to it
+    watcher->cancelled = 1;
+    if (!watcher->expired) {
+        loop->active--;
+    }
+    loop->cancelled++;
+}
+
+/* Frees the watchers that have been cancelled. */
+static void SweepWatchers(EventLoop *loop) {
+    EventWatcher **link = &loop->watchers;
+    while (*link) {
+        EventWatcher *watcher = *link;
+        if (watcher->cancelled) {
+            *link = watcher->next;
+            free(watcher);
+        } else {
+            link = &watcher->next;
+        }
+    }
+    loop->cancelled = 0;
+}
+
+/* Marks a one-shot timer as expired, it no longer keeps the loop active. */
+static void ExpireTimer(EventWatcher *watcher) {
+    if (!(watcher->timerFlags & kEventTimerRepeat)) {
+        watcher->expired = 1;
+        watcher->loop->active--;
+    }
+}
+
+#if defined(__APPLE__)
+
+/*
+ * Waits for events for at most timeout seconds, or without limit if timeout
+ * is negative, and dispatches them. Returns the number of events or -1.
+ */
+static int WaitAndDispatch(EventLoop *loop, double timeout) {
+    struct kevent events[kEventBatch];
+    struct timespec wait;
+    if (timeout >= 0) {
+        wait.tv_sec = (time_t) timeout;
+        wait.tv_nsec = (long) ((timeout - floor(timeout)) * 1e9);
+    }
+
+    int count = kevent(loop->queue,
+                       NULL,
+                       0,
+                       events,
+                       kEventBatch,
+                       timeout >= 0 ? &wait : NULL);
+    for (int i = 0; i < count; i++) {
+        EventWatcher *watcher = events[i].udata;
+        if (!watcher || watcher->cancelled) {
+            continue;
+        }
+
+        int pending = 0;
+        switch (events[i].filter) {
+            case EVFILT_READ:
+                pending = kEventRead;
+                break;
+            case EVFILT_WRITE:
+                pending = kEventWrite;
+                break;
+            case EVFILT_TIMER:
+                pending = kEventTimer;
+                ExpireTimer(watcher);
+                break;
+            case EVFILT_SIGNAL:
+                pending = kEventSignal;
+                break;
+            case EVFILT_MACHPORT:
+                pending = kEventNotification;
+                DispatchNotifications(watcher);
+                break;
+        }
+        if (events[i].flags & (EV_EOF | EV_ERROR)) {
+            pending |= kEventHangup;
+        }
+
+        if (!watcher->cancelled && watcher->callback) {
+            watcher->callback(watcher, pending, watcher->context);
+        }
+    }
+    return count;
+}
+
+#else
+
+/*
+ * Waits for events for at most timeout seconds, or without limit if timeout
+ * is negative, and dispatches them. Returns the number of events or -1.
+ */
+static int WaitAndDispatch(EventLoop *loop, double timeout) {
+    struct epoll_event events[kEventBatch];
+
+    int count = epoll_wait(loop->queue,
+                           events,
+                           kEventBatch,
+                           timeout >= 0 ? (int) ceil(timeout * 1e3) : -1);
+    for (int i = 0; i < count; i++) {
+        EventWatcher *watcher = events[i].data.ptr;
+        if (watcher->cancelled) {
+            continue;
+        }
+
+        int pending = 0;
+        uint32_t mask = events[i].events;
+        switch (watcher->type) {
+            case kEventWatcherFD:
+                if (mask & EPOLLIN) {
+                    pending |= kEventRead;
+                }
+                if (mask & EPOLLOUT) {
+                    pending |= kEventWrite;
+                }
+                if (mask & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+                    pending |= kEventHangup;
+                }
+                break;
+            case kEventWatcherTimer: {
+                uint64_t expirations;
+                if (read(watcher->fd,
+                         &expirations,
+                         sizeof(expirations)) != sizeof(expirations)) {
+                    continue;
+                }
+                pending = kEventTimer;
+                ExpireTimer(watcher);
+                break;
+            }
+            case kEventWatcherSignal: {
+                struct signalfd_siginfo info;
+                while (read(watcher->fd, &info, sizeof(info)) ==
+                       sizeof(info)) {
+                }
+                pending = kEventSignal;
+                break;
+            }
+        }
+
+        if (watcher->callback) {
+            watcher->callback(watcher, pending, watcher->context);
+        }
+    }
+    return count;
+}
+
+#endif
+
+int EventLoopRun(EventLoop *loop, double timeout) {
+    double deadline = MonotonicNow() + timeout;
+
+    loop->stopped = 0;
+    while (!loop->stopped) {
+        if (loop->active == 0) {
+            return kEventLoopIdle;
+        }
+
+        double wait = -1;
+        if (timeout >= 0) {
+            wait = fmax(deadline - MonotonicNow(), 0);
+        }
+        int count = WaitAndDispatch(loop, wait);
+        if (count == -1 && errno != EINTR) {
+            return kEventLoopError;
+        }
+        if (loop->cancelled) {
+            SweepWatchers(loop);
+        }
+
+        if (!loop->stopped && timeout >= 0 && MonotonicNow() >= deadline) {
+            return kEventLoopTimedOut;
+        }
+    }
+    return kEventLoopStopped;
+}
+
+void EventLoopStop(EventLoop *loop) {
+    loop->stopped = 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_EVENTLOOP_H
+#define HIBERNATE_EVENTLOOP_H
+
+#include <signal.h>
+
+#if defined(__APPLE__)
+#include <IOKit/IOKitLib.h>
+#endif
+
+/* The file descriptor is readable. */
+#define kEventRead 0x1
+/* The file descriptor is writable. */
+#define kEventWrite 0x2
+/* The peer has closed the connection or an error is pending. */
+#define kEventHangup 0x4
+/* The timer has expired. */
+#define kEventTimer 0x8
+/* The signal has been received. */
+#define kEventSignal 0x10
+/* Notifications have been dispatched from the notification port. */
+#define kEventNotification 0x20
+
+/* The watcher waits for a file descriptor. */
+#define kEventWatcherFD 0
+/* The watcher waits for a timer. */
+#define kEventWatcherTimer 1
+/* The watcher waits for a signal. */
+#define kEventWatcherSignal 2
+/* The watcher dispatches the messages of an IONotificationPort. */
+#define kEventWatcherNotificationPort 3
+
+/* The timer expires at a date in seconds since 1970 instead of an interval. */
+#define kEventTimerAbsolute 0x1
+/* The timer expires again after each interval until it is cancelled. */
+#define kEventTimerRepeat 0x2
+
+/* The loop has been stopped with EventLoopStop. */
+#define kEventLoopStopped 0
+/* The timeout passed to EventLoopRun has expired. */
+#define kEventLoopTimedOut 1
+/* The loop has no active watchers left. */
+#define kEventLoopIdle 2
+/* Waiting for events failed. */
+#define kEventLoopError 3
+
+typedef struct EventLoop EventLoop;
+typedef struct EventWatcher EventWatcher;
+
+/*
+ * Is invoked on the thread running the loop with the kEvent flags that are
+ * pending for the watcher. Callbacks may add and cancel any watcher, including
+ * their own, and stop the loop.
+ */
+typedef void (*EventCallback)(EventWatcher *watcher, int events, void *context);
+
+/*
+ * A file descriptor, timer, signal or notification port watched by a loop.
+ * Watchers are allocated by the loop and freed once they have been cancelled
+ * and no event of the current batch can refer to them anymore.
+ */
+struct EventWatcher {
+    EventLoop *loop;
+    int type;
+    /*
+     * The watched file descriptor. On Linux timers and signals are watched
+     * through a timerfd and a signalfd, which is stored here.
+     */
+    int fd;
+    /* The kEventRead and kEventWrite events of interest. */
+    int events;
+    int signal;
+    int timerFlags;
+    /* The one-shot timer has expired and is no longer active. */
+    int expired;
+    int cancelled;
+    EventCallback callback;
+    void *context;
+#if defined(__APPLE__)
+    IONotificationPortRef port;
+    /* The action of the signal before it was watched. */
+    struct sigaction previousAction;
+#else
+    /* The signal mask of the process before the signal was watched. */
+    sigset_t previousMask;
+#endif
+    struct EventWatcher *next;
+};
+
+/*
+ * A single-threaded event loop on kqueue on macOS and on epoll on Linux. All
+ * watchers share one kernel queue, so any number of clients, timers, signals
+ * and power notifications are served by one thread.
+ */
+struct EventLoop {
+    /* The kqueue or epoll descriptor. */
+    int queue;
+    int stopped;
+    /* The number of watchers that can still produce events. */
+    unsigned active;
+    /* The number of watchers cancelled since the last batch. */
+    unsigned cancelled;
+    EventWatcher *watchers;
+};
+
+/* Initializes the loop. Returns 0 on success and -1 otherwise. */
+int EventLoopInit(EventLoop *loop);
+
+/* Cancels all watchers and closes the kernel queue. */
+void EventLoopFree(EventLoop *loop);
+
+/*
+ * Watches the file descriptor for the kEventRead and kEventWrite events. A
+ * hangup is reported with kEventHangup whatever the events of interest are.
+ * Returns NULL on failure.
+ */
+EventWatcher *EventLoopAddFD(EventLoop *loop,
+                             int fd,
+                             int events,
+                             EventCallback callback,
+                             void *context);
+
+/*
+ * Changes the events of interest of a file descriptor watcher, e.g. to wait
+ * for kEventWrite only while output is queued. Returns 0 on success and -1
+ * otherwise.
+ */
+int EventWatcherSetEvents(EventWatcher *watcher, int events);
+
+/*
+ * Adds a timer that expires after the specified seconds or, with
+ * kEventTimerAbsolute, at the specified wall clock date in seconds since 1970.
+ * On Linux absolute timers also expire at the date if the system was
+ * suspended in between. kqueue does not document this for NOTE_ABSOLUTE, so
+ * callers compare the date with the clock once the timer has expired. A timer
+ * that does not repeat stays allocated after it has expired until it is
+ * cancelled. Returns NULL on failure.
+ */
+EventWatcher *EventLoopAddTimer(EventLoop *loop,
+                                double seconds,
+                                int flags,
+                                EventCallback callback,
+                                void *context);
+
+/*
+ * Watches the signal instead of delivering it to a handler. Only one watcher
+ * per signal is supported. The previous disposition of the signal is
+ * restored when the watcher is cancelled. Returns NULL on failure.
+ */
+EventWatcher *EventLoopAddSignal(EventLoop *loop,
+                                 int signal,
+                                 EventCallback callback,
+                                 void *context);
+
+#if defined(__APPLE__)
+/*
+ * Dispatches the messages of the notification port to the callbacks
+ * registered with IOKit, e.g. IORegisterForSystemPower, and then invokes the
+ * callback, which may be NULL. Returns NULL on failure.
+ */
+EventWatcher *EventLoopAddNotificationPort(EventLoop *loop,
+                                           IONotificationPortRef port,
+                                           EventCallback callback,
+                                           void *context);
+#endif
+
+/*
+ * Removes the watcher from the loop. No callback is invoked for it afterwards,
+ * even if events are pending in the current batch.
+ */
+void EventWatcherCancel(EventWatcher *watcher);
+
+/*
+ * Dispatches events until the loop is stopped, no active watchers are left or
+ * the timeout in seconds has expired. A negative timeout waits without limit,
+ * a timeout of 0 dispatches pending events without waiting. Returns one of
+ * the kEventLoop codes.
+ */
+int EventLoopRun(EventLoop *loop, double timeout);
+
+/* Makes EventLoopRun return once the current callback has returned. */
+void EventLoopStop(EventLoop *loop);
+
+#endif /* HIBERNATE_EVENTLOOP_H */
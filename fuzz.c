@@ -0,0 +1,394 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "fuzz.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "image.h"
+
+/* The bytes a fuzzed input may grow by. */
+#define kFuzzGrowth 65536
+/* The number of mutations stacked before starting over from the seed. */
+#define kFuzzStack 8
+
+const char *const kFuzzTargetNames[kFuzzTargetCount] = {
+    "header", "preview", "page-list", "pages", "handoff", "all"
+};
+
+/* Aborts if a parser returned memory outside of the input. */
+static void CheckRange(const HibernateImage *image,
+                       const void *pointer,
+                       uint64_t length) {
+    const uint8_t *bytes = pointer;
+
+    if (bytes < image->base ||
+        (uint64_t) (bytes - image->base) > image->size ||
+        length > image->size - (uint64_t) (bytes - image->base)) {
+        abort();
+    }
+}
+
+/* Reads the first and last byte of a range, so a sanitizer can check it. */
+static uint8_t Touch(const HibernateImage *image,
+                     const void *pointer,
+                     uint64_t length) {
+    const uint8_t *bytes = pointer;
+
+    CheckRange(image, pointer, length);
+    return length > 0 ? bytes[0] ^ bytes[length - 1] : 0;
+}
+
+static int FuzzPreview(const HibernateImage *image, volatile uint8_t *sink) {
+    const hibernate_preview_t *preview;
+    const uint8_t *pixels;
+
+    if (ImageGetPreview(image, &preview, &pixels) != kImagePreviewSuccess) {
+        return 0;
+    }
+    uint64_t length = (uint64_t) preview->imageCount * preview->width *
+                      preview->height * (preview->depth / 8);
+    *sink ^= Touch(image, preview, sizeof(*preview));
+    *sink ^= Touch(image, pixels, length);
+    return 1;
+}
+
+static int FuzzPageList(const HibernateImage *image, volatile uint8_t *sink) {
+    const IOHibernateImageHeader *header = ImageGetHeader(image);
+    const hibernate_page_list_t *list;
+
+    if (ImageGetPageList(image, &list) != kImagePageListSuccess) {
+        return 0;
+    }
+    *sink ^= Touch(image, list, list->list_size);
+
+    // Test the pages at the ends of each bank and the handoff pages
+    const hibernate_bitmap_t *bank = list->bank_bitmap;
+    for (uint32_t i = 0; i < list->bank_count; i++) {
+        *sink ^= ImagePageListTest(list, bank->first_page);
+        *sink ^= ImagePageListTest(list, bank->last_page);
+        bank = (const hibernate_bitmap_t *) &bank->bitmap[bank->bitmapwords];
+    }
+    *sink ^= ImagePageListTest(list, header->handoffPages);
+    return 1;
+}
+
+static int FuzzPages(const HibernateImage *image, volatile uint8_t *sink) {
+    ImagePageIterator iterator;
+    ImagePage page;
+    uint32_t sum = 0;
+    int rc;
+
+    if (ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        return 0;
+    }
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        const uint8_t *data = image->base + page.offset;
+        *sink ^= Touch(image, data, page.length);
+        if (page.length == kImagePageSize) {
+            sum += ImageSumPage(data, page.number);
+        }
+    }
+    *sink ^= (uint8_t) sum;
+    return rc == kImagePagesEnd;
+}
+
+static int FuzzHandoff(const HibernateImage *image, volatile uint8_t *sink) {
+    ImageHandoffIterator iterator;
+    ImageHandoffEntry entry;
+    uint8_t buffer[64];
+    int rc;
+
+    if (ImageHandoffInit(&iterator, image) != kImageHandoffSuccess) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < iterator.pageCount; i++) {
+        *sink ^= Touch(image,
+                       image->base + iterator.pageOffsets[i],
+                       kImagePageSize);
+    }
+    while ((rc = ImageHandoffNext(&iterator, &entry)) ==
+           kImageHandoffSuccess) {
+        size_t length = entry.bytecount < sizeof(buffer)
+                        ? entry.bytecount
+                        : sizeof(buffer);
+        if (ImageHandoffRead(&iterator,
+                             entry.position,
+                             buffer,
+                             length) != 0) {
+            abort();
+        }
+        *sink ^= length > 0 ? buffer[length - 1] : 0;
+    }
+    return rc == kImageHandoffEnd;
+}
+
+int FuzzImage(int target, const uint8_t *data, size_t size) {
+    HibernateImage image;
+    volatile uint8_t sink = 0;
+
+    if (ImageInit(&image, data, size) != kImageOpenSuccess) {
+        return 0;
+    }
+    sink ^= Touch(&image, ImageGetHeader(&image), kImagePageSize);
+
+    switch (target) {
+        case kFuzzTargetHeader: {
+            ImagePageIterator iterator;
+            return ImagePagesInit(&iterator, &image) == kImagePagesSuccess;
+        }
+        case kFuzzTargetPreview:
+            return FuzzPreview(&image, &sink);
+        case kFuzzTargetPageList:
+            return FuzzPageList(&image, &sink);
+        case kFuzzTargetPages:
+            return FuzzPages(&image, &sink);
+        case kFuzzTargetHandoff:
+            return FuzzHandoff(&image, &sink);
+        default: {
+            int accepted = FuzzPreview(&image, &sink);
+            accepted &= FuzzPageList(&image, &sink);
+            accepted &= FuzzPages(&image, &sink);
+            accepted &= FuzzHandoff(&image, &sink);
+            return accepted;
+        }
+    }
+}
+
+/* Returns the next random number of a xorshift64* generator. */
+static uint64_t Next(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* Returns a value at a boundary of the checks of the parsers. */
+static uint64_t BoundaryValue(uint64_t *state, size_t size) {
+    uint64_t number = Next(state);
+
+    switch (number % 12) {
+        case 0: return 0;
+        case 1: return 1;
+        case 2: return 0x7fffffff;
+        case 3: return 0x80000000;
+        case 4: return 0xffffffff;
+        case 5: return UINT64_MAX;
+        case 6: return size;
+        case 7: return size - 1;
+        case 8: return size + 1;
+        case 9: return size / kImagePageSize;
+        case 10: return (number >> 8) % (size + 1);
+        default: return number >> 32;
+    }
+}
+
+/* Writes a value of 4 or 8 bytes if it fits into the input. */
+static void Store(uint8_t *data,
+                  size_t size,
+                  uint64_t offset,
+                  uint64_t value,
+                  size_t width) {
+    if (offset <= size && width <= size - offset) {
+        if (width == sizeof(uint32_t)) {
+            uint32_t word = (uint32_t) value;
+            memcpy(data + offset, &word, sizeof(word));
+        } else {
+            memcpy(data + offset, &value, sizeof(value));
+        }
+    }
+}
+
+/* A size or count of the header and its width. */
+typedef struct {
+    size_t offset;
+    size_t width;
+} FuzzField;
+
+#define FUZZ_FIELD(name) \
+    { offsetof(IOHibernateImageHeader, name), \
+      sizeof(((IOHibernateImageHeader *) NULL)->name) }
+
+static const FuzzField kHeaderFields[] = {
+    FUZZ_FIELD(imageSize),
+    FUZZ_FIELD(image1Size),
+    FUZZ_FIELD(restore1PageCount),
+    FUZZ_FIELD(pageCount),
+    FUZZ_FIELD(bitmapSize),
+    FUZZ_FIELD(previewSize),
+    FUZZ_FIELD(previewPageListSize),
+    FUZZ_FIELD(handoffPages),
+    FUZZ_FIELD(handoffPageCount)
+};
+
+#undef FUZZ_FIELD
+
+size_t FuzzMutate(uint8_t *data,
+                  size_t size,
+                  size_t capacity,
+                  uint64_t *state) {
+    HibernateImage image;
+    uint64_t number = Next(state);
+
+    // Inputs that are not images only get bytes flipped or resized
+    int valid = ImageInit(&image, data, size) == kImageOpenSuccess;
+    unsigned operation = valid ? number % 8 : 6 + number % 2;
+    uint64_t value = BoundaryValue(state, size);
+    uint64_t offset = 0;
+    if (valid) {
+        const IOHibernateImageHeader *header = ImageGetHeader(&image);
+        uint64_t listOffset = (uint64_t) kImagePageSize *
+                              (1 + (uint64_t) header->restore1PageCount) +
+                              header->previewSize;
+        uint64_t position = Next(state);
+        switch (operation) {
+            case 0:
+            case 1: {
+                const FuzzField *field =
+                        &kHeaderFields[position % (sizeof(kHeaderFields) /
+                                                   sizeof(*kHeaderFields))];
+                Store(data, size, field->offset, value, field->width);
+                return size;
+            }
+            case 2:
+                // The list header and the fields of the first banks
+                offset = listOffset + (position % 16) * sizeof(uint32_t);
+                break;
+            case 3:
+                // The first runs and tags or any word behind the page list
+                offset = listOffset + header->bitmapSize;
+                offset += position & 1
+                          ? (position >> 1) % 64 * sizeof(uint32_t)
+                          : (position >> 1) % (size + 1) & ~3ULL;
+                break;
+            case 4: {
+                ImageHandoffIterator iterator;
+                if (ImageHandoffInit(&iterator, &image) !=
+                    kImageHandoffSuccess) {
+                    return size;
+                }
+                offset = iterator.pageOffsets[0] +
+                         (position % 8) * sizeof(uint32_t);
+                break;
+            }
+            case 5:
+                offset = (uint64_t) kImagePageSize *
+                         (1 + (uint64_t) header->restore1PageCount) +
+                         header->previewPageListSize +
+                         (position % 4) * sizeof(uint32_t);
+                break;
+        }
+        if (operation < 6) {
+            Store(data, size, offset, value, sizeof(uint32_t));
+            return size;
+        }
+    }
+
+    if (operation == 6) {
+        // Flip a byte
+        if (size > 0) {
+            data[Next(state) % size] ^= (uint8_t) (1 << (Next(state) % 8));
+        }
+        return size;
+    }
+
+    // Truncate or extend with zeros
+    size_t newSize = Next(state) % (capacity + 1);
+    if (newSize > size) {
+        memset(data + size, 0, newSize - size);
+    }
+    return newSize;
+}
+
+int FuzzRun(int target,
+            const uint8_t *seed,
+            size_t size,
+            uint64_t executions,
+            uint64_t randomSeed,
+            FILE *stream,
+            FuzzStatistics *statistics) {
+    struct timespec start, now;
+    uint64_t state = randomSeed | 1;
+    size_t capacity = size + kFuzzGrowth;
+
+    memset(statistics, 0, sizeof(*statistics));
+    uint8_t *data = malloc(capacity);
+    if (!data) {
+        return kFuzzRunErrorResources;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double report = 1;
+    size_t length = 0;
+    for (uint64_t i = 0; i < executions; i++) {
+        if (i % kFuzzStack == 0) {
+            memcpy(data, seed, size);
+            length = size;
+        }
+        length = FuzzMutate(data, length, capacity, &state);
+        statistics->accepted += FuzzImage(target, data, length);
+        statistics->executions++;
+
+        // Checking the time costs a system call on some systems
+        if (i % 1024 == 0) {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            statistics->seconds = (now.tv_sec - start.tv_sec) +
+                                  (now.tv_nsec - start.tv_nsec) / 1e9;
+            if (stream && statistics->seconds >= report) {
+                fprintf(stream,
+                        "%s: %llu executions, %.0f/s, %llu accepted\n",
+                        kFuzzTargetNames[target],
+                        (unsigned long long) statistics->executions,
+                        statistics->executions / statistics->seconds,
+                        (unsigned long long) statistics->accepted);
+                report += 1;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    statistics->seconds = (now.tv_sec - start.tv_sec) +
+                          (now.tv_nsec - start.tv_nsec) / 1e9;
+    free(data);
+    return kFuzzRunSuccess;
+}
+
+#if HIBERNATE_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    FuzzImage(HIBERNATE_FUZZ_TARGET, data, size);
+    return 0;
+}
+
+size_t LLVMFuzzerCustomMutator(uint8_t *data,
+                               size_t size,
+                               size_t maxSize,
+                               unsigned int seed) {
+    uint64_t state = seed | 1;
+    return FuzzMutate(data, size, maxSize, &state);
+}
+
+#endif /* HIBERNATE_LIBFUZZER */
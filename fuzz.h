@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_FUZZ_H
+#define HIBERNATE_FUZZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * If HIBERNATE_LIBFUZZER is enabled, fuzz.c defines the entry points of
+ * libFuzzer for HIBERNATE_FUZZ_TARGET, e.g. compiled together with image.c
+ * with -fsanitize=fuzzer,address -DHIBERNATE_LIBFUZZER=1.
+ */
+#ifndef HIBERNATE_LIBFUZZER
+#define HIBERNATE_LIBFUZZER 0
+#endif
+#ifndef HIBERNATE_FUZZ_TARGET
+#define HIBERNATE_FUZZ_TARGET kFuzzTargetAll
+#endif
+
+/* The parsers of image.c that are fuzzed, alone or all together. */
+#define kFuzzTargetHeader 0
+#define kFuzzTargetPreview 1
+#define kFuzzTargetPageList 2
+#define kFuzzTargetPages 3
+#define kFuzzTargetHandoff 4
+#define kFuzzTargetAll 5
+#define kFuzzTargetCount 6
+
+/* The names of the targets, indexed by target. */
+extern const char *const kFuzzTargetNames[kFuzzTargetCount];
+
+/*
+ * Runs the parsers of a target on an input and touches everything they return.
+ * Aborts if a parser returns memory outside of the input, so that the fuzzer
+ * reports it even without a sanitizer. Returns 1 if the parsers accepted the
+ * input and 0 otherwise.
+ */
+int FuzzImage(int target, const uint8_t *data, size_t size);
+
+/*
+ * Applies a mutation to an input that is aware of the layout of image.h: it
+ * sets sizes and counts of the header, the page list, the page runs, the
+ * handoff chain and the preview to boundary values, flips bytes, or truncates
+ * or extends the input up to capacity. Returns the new size.
+ */
+size_t FuzzMutate(uint8_t *data, size_t size, size_t capacity, uint64_t *state);
+
+/* The result of a fuzzing run. */
+typedef struct {
+    uint64_t executions;
+    uint64_t accepted;
+    double seconds;
+} FuzzStatistics;
+
+/* The run has completed without a parser misbehaving. */
+#define kFuzzRunSuccess 0
+/* Memory could not be allocated. */
+#define kFuzzRunErrorResources 1
+
+/*
+ * Mutates the seed image and runs the parsers of the target on each mutation,
+ * stacking up to 8 mutations before starting over from the seed. Prints the
+ * executions per second to stream every second.
+ */
+int FuzzRun(int target,
+            const uint8_t *seed,
+            size_t size,
+            uint64_t executions,
+            uint64_t randomSeed,
+            FILE *stream,
+            FuzzStatistics *statistics);
+
+#endif /* HIBERNATE_FUZZ_H */
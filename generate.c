@@ -0,0 +1,635 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "generate.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "image.h"
+
+/* The pages between the two banks of physical memory. */
+#define kGenerateBankHole 0x40000
+/* Saved pages come in clusters of 1 << kGenerateClusterShift pages. */
+#define kGenerateClusterShift 4
+/* The physical page of the restore code. */
+#define kGenerateRestorePage 0x100
+/* The size of the buffer each thread writes through. */
+#define kGenerateBufferSize (4 << 20)
+/* The bytes a page takes in the image, including its tag. */
+#define kGeneratePageBytes (sizeof(uint32_t) + kImagePageSize)
+
+void GenerateOptionsInit(GenerateOptions *options) {
+    options->size = 1ULL << 30;
+    options->fileSize = 0;
+    options->savedRatio = 0.6;
+    options->image1Ratio = 0.05;
+    options->zeroRatio = 0.2;
+    options->duplicateRatio = 0.1;
+    options->textRatio = 0.3;
+    options->previewWidth = 1280;
+    options->previewHeight = 800;
+    options->seed = 1;
+    options->threads = 0;
+}
+
+/* Scrambles a value, the finalizer of SplitMix64. */
+static uint64_t Mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+/* Returns a hash of a page for one purpose as a number in [0, 1). */
+static double Uniform(const GenerateOptions *options,
+                      uint64_t purpose,
+                      uint64_t value) {
+    uint64_t hash = Mix(options->seed ^ Mix(purpose << 40 ^ value));
+    return (hash >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Returns 1 if the handoff chain is stored in the page. */
+static int IsHandoffPage(uint32_t page) {
+    return page == kGenerateHandoffPage;
+}
+
+/* Returns 1 if the page is saved. */
+static int IsSaved(const GenerateOptions *options, uint32_t page) {
+    return IsHandoffPage(page) ||
+           Uniform(options, 1, page >> kGenerateClusterShift) <
+                   options->savedRatio;
+}
+
+/* Returns 1 if a saved page is part of image1. */
+static int IsImage1(const GenerateOptions *options, uint32_t page) {
+    return IsHandoffPage(page) || Uniform(options, 2, page) <
+                                  options->image1Ratio;
+}
+
+/* Fills a page with random bytes. */
+static void FillRandom(uint8_t *page, uint64_t state) {
+    state |= 1;
+    for (size_t i = 0; i < kImagePageSize; i += sizeof(state)) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        uint64_t value = state * 0x2545f4914f6cdd1dULL;
+        memcpy(page + i, &value, sizeof(value));
+    }
+}
+
+/* Fills a page with words separated by spaces and new lines. */
+static void FillText(uint8_t *page, uint64_t state) {
+    static const char *const kWords[] = {
+        "the", "kernel", "writes", "pages", "of", "memory", "to", "disk",
+        "before", "sleep", "and", "reads", "them", "back", "on", "wake",
+        "void", "return", "struct", "uint32_t", "const", "if", "for", "NULL",
+        "com.apple", "Library", "Caches", "plist", "string", "key", "0", "1"
+    };
+    size_t i = 0;
+
+    while (i < kImagePageSize) {
+        state = Mix(state);
+        const char *word = kWords[state % (sizeof(kWords) / sizeof(*kWords))];
+        size_t length = strlen(word);
+        if (length > kImagePageSize - i) {
+            length = kImagePageSize - i;
+        }
+        memcpy(page + i, word, length);
+        i += length;
+        if (i < kImagePageSize) {
+            page[i++] = (state >> 32) % 8 == 0 ? '\n' : ' ';
+        }
+    }
+}
+
+/* Writes the handoff chain of the booter into a page. */
+static void FillHandoff(uint8_t *page, const GenerateOptions *options) {
+    IOHibernateHandoff handoff;
+    hibernate_graphics_t graphics;
+
+    memset(page, 0, kImagePageSize);
+    memset(&graphics, 0, sizeof(graphics));
+    graphics.physicalAddress = 0x80000000;
+    graphics.rowBytes = options->previewWidth * 4;
+    graphics.width = options->previewWidth;
+    graphics.height = options->previewHeight;
+    graphics.depth = 32;
+
+    handoff.type = kIOHibernateHandoffTypeGraphicsInfo;
+    handoff.bytecount = sizeof(graphics);
+    memcpy(page, &handoff, sizeof(handoff));
+    memcpy(page + sizeof(handoff), &graphics, sizeof(graphics));
+    handoff.type = kIOHibernateHandoffTypeEnd;
+    handoff.bytecount = 0;
+    memcpy(page + sizeof(handoff) + sizeof(graphics),
+           &handoff,
+           sizeof(handoff));
+}
+
+/* Writes the content of a saved page. */
+static void FillPage(uint8_t *page,
+                     const GenerateOptions *options,
+                     uint32_t number) {
+    if (IsHandoffPage(number)) {
+        FillHandoff(page, options);
+        return;
+    }
+
+    double kind = Uniform(options, 3, number);
+    uint64_t state = Mix(options->seed ^ Mix((uint64_t) number << 8 | 4));
+    if (kind < options->zeroRatio) {
+        memset(page, 0, kImagePageSize);
+    } else if ((kind -= options->zeroRatio) < options->duplicateRatio) {
+        FillRandom(page, Mix(options->seed ^ (state % kGenerateDuplicatePool)));
+    } else if (kind - options->duplicateRatio < options->textRatio) {
+        FillText(page, state);
+    } else {
+        FillRandom(page, state);
+    }
+}
+
+/* The physical pages of one task and their share of image1 and image2. */
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+    /* The words of the page list the chunk marks pages in. */
+    uint32_t *bitmap;
+    uint32_t pages[2];
+    uint32_t runs[2];
+    /* The offset of the runs of the chunk in image1 and image2. */
+    uint64_t offset[2];
+} GenerateChunk;
+
+/* The chunks shared by the threads of the pool. */
+typedef struct {
+    const GenerateOptions *options;
+    GenerateChunk *chunks;
+    size_t chunkCount;
+    /* The chunks are written into the file in the second pass. */
+    int writing;
+    int fd;
+    pthread_mutex_t lock;
+    size_t next;
+} GeneratePool;
+
+/* A thread of the pool. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    GeneratePool *pool;
+    uint8_t *buffer;
+    uint32_t sums[2];
+    int failed;
+} GenerateWorker;
+
+/* Counts the pages and runs of a chunk and marks the pages not saved. */
+static void CountChunk(const GenerateOptions *options, GenerateChunk *chunk) {
+    int previous = -1;
+
+    for (uint32_t i = 0; i < chunk->count; i++) {
+        uint32_t page = chunk->first + i;
+        if (!IsSaved(options, page)) {
+            chunk->bitmap[i >> 5] |= 0x80000000 >> (i & 31);
+            previous = -1;
+            continue;
+        }
+        int image = IsImage1(options, page) ? 0 : 1;
+        chunk->pages[image]++;
+        if (image != previous) {
+            chunk->runs[image]++;
+        }
+        previous = image;
+    }
+}
+
+/* Writes the buffered bytes at the offset. Returns 0 on success. */
+static int Flush(GenerateWorker *worker, size_t *length, uint64_t *offset) {
+    size_t done = 0;
+
+    while (done < *length) {
+        ssize_t written = pwrite(worker->pool->fd,
+                                 worker->buffer + done,
+                                 *length - done,
+                                 (off_t) (*offset + done));
+        if (written <= 0) {
+            return -1;
+        }
+        done += written;
+    }
+    *offset += *length;
+    *length = 0;
+    return 0;
+}
+
+/* Writes the runs of a chunk in image1 and image2. Returns 0 on success. */
+static int WriteChunk(GenerateWorker *worker, const GenerateChunk *chunk) {
+    const GenerateOptions *options = worker->pool->options;
+
+    for (int image = 0; image < 2; image++) {
+        uint64_t offset = chunk->offset[image];
+        size_t length = 0;
+        uint32_t i = 0;
+
+        while (i < chunk->count) {
+            // Find the next run of saved pages of this part
+            uint32_t page = chunk->first + i;
+            if (!IsSaved(options, page) ||
+                IsImage1(options, page) != (image == 0)) {
+                i++;
+                continue;
+            }
+            uint32_t count = 1;
+            while (i + count < chunk->count &&
+                   IsSaved(options, page + count) &&
+                   IsImage1(options, page + count) == (image == 0)) {
+                count++;
+            }
+
+            if (length + 2 * sizeof(uint32_t) > kGenerateBufferSize &&
+                Flush(worker, &length, &offset) != 0) {
+                return -1;
+            }
+            uint32_t run[2] = { page, count };
+            memcpy(worker->buffer + length, run, sizeof(run));
+            length += sizeof(run);
+
+            for (uint32_t j = 0; j < count; j++) {
+                if (length + kGeneratePageBytes > kGenerateBufferSize &&
+                    Flush(worker, &length, &offset) != 0) {
+                    return -1;
+                }
+                uint32_t tag = kImageTagSignature | kImagePageSize;
+                memcpy(worker->buffer + length, &tag, sizeof(tag));
+                uint8_t *data = worker->buffer + length + sizeof(tag);
+                FillPage(data, options, page + j);
+                worker->sums[image] += ImageSumPage(data, page + j);
+                length += kGeneratePageBytes;
+            }
+            i += count;
+        }
+        if (Flush(worker, &length, &offset) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *GenerateWorkerRun(void *argument) {
+    GenerateWorker *worker = argument;
+    GeneratePool *pool = worker->pool;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        size_t index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (index >= pool->chunkCount) {
+            return NULL;
+        }
+
+        GenerateChunk *chunk = &pool->chunks[index];
+        if (!pool->writing) {
+            CountChunk(pool->options, chunk);
+        } else if (WriteChunk(worker, chunk) != 0) {
+            worker->failed = 1;
+            return NULL;
+        }
+    }
+}
+
+/*
+ * Runs one pass over all chunks on the threads. Threads that could not be
+ * started run on join. Returns 0 on success and -1 if a write failed.
+ */
+static int RunPool(GeneratePool *pool,
+                   GenerateWorker *workers,
+                   unsigned count,
+                   uint32_t sums[2]) {
+    int rc = 0;
+
+    pool->next = 0;
+    for (unsigned i = 0; i < count; i++) {
+        workers[i].started = pthread_create(&workers[i].thread,
+                                            NULL,
+                                            GenerateWorkerRun,
+                                            &workers[i]) == 0;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        } else {
+            GenerateWorkerRun(&workers[i]);
+        }
+        if (workers[i].failed) {
+            rc = -1;
+        }
+        sums[0] += workers[i].sums[0];
+        sums[1] += workers[i].sums[1];
+    }
+    return rc;
+}
+
+/* Writes all bytes at the offset. Returns 0 on success and -1 otherwise. */
+static int WriteAt(int fd, const void *bytes, size_t length, uint64_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t written = pwrite(fd,
+                                 (const uint8_t *) bytes + done,
+                                 length - done,
+                                 (off_t) (offset + done));
+        if (written <= 0) {
+            return -1;
+        }
+        done += written;
+    }
+    return 0;
+}
+
+/*
+ * Builds the preview page list and buffer with a gradient desktop and a darker
+ * lock screen. Returns NULL if memory could not be allocated.
+ */
+static uint8_t *BuildPreview(const GenerateOptions *options,
+                             uint32_t *size,
+                             uint32_t *pageListSize) {
+    uint32_t width = options->previewWidth;
+    uint32_t height = options->previewHeight;
+    uint64_t bufferSize = sizeof(hibernate_preview_t) +
+                          2ULL * width * height * 4;
+    uint64_t bufferPages = (bufferSize + kImagePageSize - 1) / kImagePageSize;
+
+    *pageListSize = (uint32_t) (bufferPages * sizeof(uint32_t));
+    *size = (uint32_t) (*pageListSize + bufferPages * kImagePageSize);
+    uint8_t *preview = calloc(1, *size);
+    if (!preview) {
+        return NULL;
+    }
+
+    // The buffer is placed behind the restore code in physical memory
+    uint32_t *pageList = (uint32_t *) preview;
+    for (uint64_t i = 0; i < bufferPages; i++) {
+        pageList[i] = kGenerateRestorePage + kGenerateRestorePages + i;
+    }
+
+    hibernate_preview_t *header =
+            (hibernate_preview_t *) (preview + *pageListSize);
+    header->imageCount = 2;
+    header->width = width;
+    header->height = height;
+    header->depth = 32;
+    uint8_t *pixels = (uint8_t *) (header + 1);
+    for (uint32_t image = 0; image < 2; image++) {
+        for (uint32_t y = 0; y < height; y++) {
+            for (uint32_t x = 0; x < width; x++) {
+                uint32_t red = x * 255 / width >> image;
+                uint32_t green = y * 255 / height >> image;
+                uint32_t pixel = red << 16 | green << 8 | (0x80 >> image);
+                memcpy(pixels, &pixel, sizeof(pixel));
+                pixels += sizeof(pixel);
+            }
+        }
+    }
+    return preview;
+}
+
+int GenerateImage(const char *path,
+                  const GenerateOptions *options,
+                  GenerateResult *result) {
+    GenerateChunk *chunks = NULL;
+    GenerateWorker *workers = NULL;
+    uint8_t *pageList = NULL;
+    uint8_t *preview = NULL;
+    uint8_t *page = NULL;
+    unsigned threadCount = options->threads;
+    int fd = -1;
+    int rc;
+
+    memset(result, 0, sizeof(*result));
+    if (options->size < kImagePageSize ||
+        options->savedRatio <= 0 || options->savedRatio > 1 ||
+        options->image1Ratio < 0 || options->image1Ratio > 1 ||
+        options->zeroRatio < 0 || options->duplicateRatio < 0 ||
+        options->textRatio < 0 ||
+        options->zeroRatio + options->duplicateRatio +
+                options->textRatio > 1 ||
+        options->previewWidth == 0 || options->previewHeight == 0 ||
+        options->previewWidth > 16384 || options->previewHeight > 16384) {
+        return kGenerateImageErrorOptions;
+    }
+
+    // Split memory into two banks, page numbers must fit into 32 bits
+    uint64_t memoryPages = (uint64_t) (options->size / kImagePageSize /
+                                       options->savedRatio) + 1;
+    if (memoryPages < 2 * (kGenerateHandoffPage + 1)) {
+        memoryPages = 2 * (kGenerateHandoffPage + 1);
+    }
+    uint64_t bankFirst[2] = { 0, memoryPages / 2 + kGenerateBankHole };
+    uint64_t bankCount[2] = { memoryPages / 2, memoryPages - memoryPages / 2 };
+    if (bankFirst[1] + bankCount[1] > UINT32_MAX) {
+        return kGenerateImageErrorOptions;
+    }
+    result->memoryPages = memoryPages;
+
+    // Allocate the page list and one chunk per kGenerateChunkPages of a bank
+    uint64_t listSize = sizeof(hibernate_page_list_t);
+    size_t chunkCount = 0;
+    for (int bank = 0; bank < 2; bank++) {
+        listSize += sizeof(hibernate_bitmap_t) +
+                    (bankCount[bank] + 31) / 32 * sizeof(uint32_t);
+        chunkCount += (bankCount[bank] + kGenerateChunkPages - 1) /
+                      kGenerateChunkPages;
+    }
+    pageList = calloc(1, listSize);
+    chunks = calloc(chunkCount, sizeof(*chunks));
+    page = calloc(1, kImagePageSize);
+    if (!pageList || !chunks || !page) {
+        rc = kGenerateImageErrorResources;
+        goto out;
+    }
+    hibernate_page_list_t *list = (hibernate_page_list_t *) pageList;
+    list->list_size = (uint32_t) listSize;
+    list->page_count = (uint32_t) memoryPages;
+    list->bank_count = 2;
+    hibernate_bitmap_t *bank = list->bank_bitmap;
+    GenerateChunk *chunk = chunks;
+    for (int i = 0; i < 2; i++) {
+        bank->first_page = (uint32_t) bankFirst[i];
+        bank->last_page = (uint32_t) (bankFirst[i] + bankCount[i] - 1);
+        bank->bitmapwords = (uint32_t) ((bankCount[i] + 31) / 32);
+        for (uint64_t first = 0;
+             first < bankCount[i];
+             first += kGenerateChunkPages) {
+            chunk->first = (uint32_t) (bankFirst[i] + first);
+            chunk->count = (uint32_t) (bankCount[i] - first <
+                                               kGenerateChunkPages
+                                       ? bankCount[i] - first
+                                       : kGenerateChunkPages);
+            chunk->bitmap = &bank->bitmap[first / 32];
+            chunk++;
+        }
+        bank = (hibernate_bitmap_t *) &bank->bitmap[bank->bitmapwords];
+    }
+
+    // Start the thread pool
+    if (threadCount == 0) {
+        long processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threadCount = processors > 0 ? (unsigned) processors : 1;
+    }
+    workers = calloc(threadCount, sizeof(*workers));
+    if (!workers) {
+        rc = kGenerateImageErrorResources;
+        goto out;
+    }
+    GeneratePool pool = {
+        options, chunks, chunkCount, 0, -1, PTHREAD_MUTEX_INITIALIZER, 0
+    };
+    for (unsigned i = 0; i < threadCount; i++) {
+        workers[i].pool = &pool;
+        workers[i].buffer = malloc(kGenerateBufferSize);
+        if (!workers[i].buffer) {
+            rc = kGenerateImageErrorResources;
+            goto out;
+        }
+    }
+
+    // Count the pages of each chunk to place its runs in the file
+    uint32_t sums[2] = { 0, 0 };
+    RunPool(&pool, workers, threadCount, sums);
+    uint32_t previewSize;
+    uint32_t previewPageListSize;
+    preview = BuildPreview(options, &previewSize, &previewPageListSize);
+    if (!preview) {
+        rc = kGenerateImageErrorResources;
+        goto out;
+    }
+    uint64_t previewOffset = (uint64_t) kImagePageSize *
+                             (1 + kGenerateRestorePages);
+    uint64_t listOffset = previewOffset + previewSize;
+    uint64_t offset = listOffset + listSize;
+    uint64_t pages[2] = { 0, 0 };
+    for (int image = 0; image < 2; image++) {
+        for (size_t i = 0; i < chunkCount; i++) {
+            chunks[i].offset[image] = offset;
+            offset += chunks[i].runs[image] * 2 * sizeof(uint32_t) +
+                      (uint64_t) chunks[i].pages[image] * kGeneratePageBytes;
+            pages[image] += chunks[i].pages[image];
+        }
+        if (image == 0) {
+            result->image1Size = offset;
+        }
+    }
+    result->imageSize = offset;
+    if (pages[0] + pages[1] > UINT32_MAX) {
+        rc = kGenerateImageErrorOptions;
+        goto out;
+    }
+    result->image1Pages = (uint32_t) pages[0];
+    result->image2Pages = (uint32_t) pages[1];
+
+    // Extend the file first, the threads write their runs in place
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    uint64_t fileSize = options->fileSize > result->imageSize
+                        ? options->fileSize
+                        : result->imageSize;
+    if (fd == -1 || ftruncate(fd, (off_t) fileSize) == -1) {
+        rc = kGenerateImageErrorFile;
+        goto out;
+    }
+    pool.fd = fd;
+    pool.writing = 1;
+    if (RunPool(&pool, workers, threadCount, sums) != 0) {
+        rc = kGenerateImageErrorFile;
+        goto out;
+    }
+
+    // Write the restore code, the preview and the page list
+    IOHibernateImageHeader *header = (IOHibernateImageHeader *) page;
+    uint32_t restore1Sum = 0;
+    for (uint32_t i = 0; i < kGenerateRestorePages; i++) {
+        uint8_t code[kImagePageSize];
+        FillRandom(code, Mix(options->seed ^ Mix(5 + i)));
+        restore1Sum += ImageSumPage(code, kGenerateRestorePage + i);
+        if (WriteAt(fd,
+                    code,
+                    kImagePageSize,
+                    (uint64_t) kImagePageSize * (1 + i)) != 0) {
+            rc = kGenerateImageErrorFile;
+            goto out;
+        }
+    }
+    if (WriteAt(fd, preview, previewSize, previewOffset) != 0 ||
+        WriteAt(fd, pageList, listSize, listOffset) != 0) {
+        rc = kGenerateImageErrorFile;
+        goto out;
+    }
+
+    // Write the header last, like the kernel does
+    header->imageSize = result->imageSize;
+    header->image1Size = result->image1Size;
+    header->restore1CodePhysPage = kGenerateRestorePage;
+    header->restore1CodeVirt = 0xffffff8000000000ULL +
+                               (uint64_t) kGenerateRestorePage * kImagePageSize;
+    header->restore1PageCount = kGenerateRestorePages;
+    header->restore1StackOffset = kGenerateRestorePages * kImagePageSize - 16;
+    header->pageCount = result->image1Pages + result->image2Pages;
+    header->bitmapSize = (uint32_t) listSize;
+    header->restore1Sum = restore1Sum;
+    header->image1Sum = sums[0];
+    header->image2Sum = sums[1];
+    header->actualUncompressedPages = header->pageCount;
+    header->signature = kIOHibernateHeaderSignature;
+    header->previewSize = previewSize;
+    header->previewPageListSize = previewPageListSize;
+    header->handoffPages = kGenerateHandoffPage;
+    header->handoffPageCount = 1;
+    header->fileExtentMapSize = sizeof(header->fileExtentMap);
+    header->fileExtentMap[0].start = 0;
+    header->fileExtentMap[0].length = fileSize;
+    if (WriteAt(fd, page, kImagePageSize, 0) != 0) {
+        rc = kGenerateImageErrorFile;
+        goto out;
+    }
+    rc = kGenerateImageSuccess;
+
+out:
+    if (fd != -1 && close(fd) == -1 && rc == kGenerateImageSuccess) {
+        rc = kGenerateImageErrorFile;
+    }
+    if (workers) {
+        for (unsigned i = 0; i < threadCount; i++) {
+            free(workers[i].buffer);
+        }
+    }
+    free(workers);
+    free(chunks);
+    free(pageList);
+    free(preview);
+    free(page);
+    return rc;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_GENERATE_H
+#define HIBERNATE_GENERATE_H
+
+#include <stdint.h>
+
+/* The physical pages of memory handled by one task of the thread pool. */
+#define kGenerateChunkPages 65536
+/* The pages of distinct content duplicate pages are copied from. */
+#define kGenerateDuplicatePool 4096
+/* The physical page of the handoff chain of the booter. */
+#define kGenerateHandoffPage 0x10
+/* The number of pages of restore code. */
+#define kGenerateRestorePages 4
+
+/* The settings of a synthetic image. */
+typedef struct {
+    /* The approximate size of the image in bytes. */
+    uint64_t size;
+    /* The size of the file, if larger than the image the rest is a hole. */
+    uint64_t fileSize;
+    /* The share of physical pages that are saved. */
+    double savedRatio;
+    /* The share of saved pages that are in image1. */
+    double image1Ratio;
+    /*
+     * The shares of pages that are zero, copies of a pool of
+     * kGenerateDuplicatePool pages and text. The other pages are random.
+     */
+    double zeroRatio;
+    double duplicateRatio;
+    double textRatio;
+    /* The size of the desktop and lock screen previews in pixels. */
+    uint32_t previewWidth;
+    uint32_t previewHeight;
+    /* The same seed and settings produce the same image. */
+    uint64_t seed;
+    /* The number of threads, 0 for one per processor. */
+    unsigned threads;
+} GenerateOptions;
+
+/* Sets the options to the defaults of a 1 GB image. */
+void GenerateOptionsInit(GenerateOptions *options);
+
+/* The pages and sizes of a generated image. */
+typedef struct {
+    uint64_t memoryPages;
+    uint32_t image1Pages;
+    uint32_t image2Pages;
+    uint64_t image1Size;
+    uint64_t imageSize;
+} GenerateResult;
+
+/* The image has been written successfully. */
+#define kGenerateImageSuccess 0
+/* The file could not be created or written. */
+#define kGenerateImageErrorFile 1
+/* The options are invalid or too large for 32 bit page numbers. */
+#define kGenerateImageErrorOptions 2
+/* Memory could not be allocated. */
+#define kGenerateImageErrorResources 3
+
+/*
+ * Writes a synthetic uncompressed and unencrypted image in the layout of
+ * image.h. Physical memory consists of two banks with a hole in between.
+ * Saved pages come in clusters, the rest are marked as not saved in the page
+ * list. The page runs are written by a pool of threads into the file that is
+ * extended to its final size first, so each thread writes its part in place.
+ */
+int GenerateImage(const char *path,
+                  const GenerateOptions *options,
+                  GenerateResult *result);
+
+#endif /* HIBERNATE_GENERATE_H */
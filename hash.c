@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hash.h"
+
+#include <string.h>
+
+/* The primes of xxHash. */
+#define kPrime32_1 0x9e3779b1U
+#define kPrime32_2 0x85ebca77U
+#define kPrime32_3 0xc2b2ae3dU
+#define kPrime64_1 0x9e3779b185ebca87ULL
+#define kPrime64_2 0xc2b2ae3d27d4eb4fULL
+#define kPrime64_3 0x165667b19e3779f9ULL
+#define kPrime64_4 0x85ebca77c2b2ae63ULL
+#define kPrime64_5 0x27d4eb2f165667c5ULL
+#define kPrimeMx1 0x165667919e3779f9ULL
+#define kPrimeMx2 0x9fb21c651e98df25ULL
+
+/* The bytes of a stripe, accumulated into eight lanes. */
+#define kStripeSize 64
+/* The stripes of a block, after which the accumulators are scrambled. */
+#define kBlockStripes ((sizeof(kSecret) - kStripeSize) / 8)
+
+/* The default secret. */
+static const uint8_t kSecret[192] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c,
+    0xf7, 0x21, 0xad, 0x1c, 0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb,
+    0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f, 0xcb, 0x79, 0xe6, 0x4e,
+    0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6,
+    0x81, 0x3a, 0x26, 0x4c, 0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb,
+    0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3, 0x71, 0x64, 0x48, 0x97,
+    0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7,
+    0xc7, 0x0b, 0x4f, 0x1d, 0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31,
+    0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64, 0xea, 0xc5, 0xac, 0x83,
+    0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26,
+    0x29, 0xd4, 0x68, 0x9e, 0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc,
+    0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce, 0x45, 0xcb, 0x3a, 0x8f,
+    0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e
+};
+
+static inline uint32_t Read32(const uint8_t *bytes) {
+    uint32_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static inline uint64_t Read64(const uint8_t *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+static inline uint64_t Rotate(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/* Multiplies to 128 bits and folds the halves. */
+static inline uint64_t MultiplyFold(uint64_t a, uint64_t b) {
+    unsigned __int128 product = (unsigned __int128) a * b;
+    return (uint64_t) product ^ (uint64_t) (product >> 64);
+}
+
+static uint64_t Avalanche(uint64_t hash) {
+    hash ^= hash >> 37;
+    hash *= kPrimeMx1;
+    return hash ^ (hash >> 32);
+}
+
+/* The final mix of XXH64. */
+static uint64_t Avalanche64(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= kPrime64_2;
+    hash ^= hash >> 29;
+    hash *= kPrime64_3;
+    return hash ^ (hash >> 32);
+}
+
+static uint64_t Mix16(const uint8_t *bytes, const uint8_t *secret) {
+    return MultiplyFold(Read64(bytes) ^ Read64(secret),
+                        Read64(bytes + 8) ^ Read64(secret + 8));
+}
+
+/* Hashes up to 16 bytes. */
+static uint64_t HashShort(const uint8_t *bytes, size_t length) {
+    if (length > 8) {
+        uint64_t low = Read64(bytes) ^
+                       (Read64(kSecret + 24) ^ Read64(kSecret + 32));
+        uint64_t high = Read64(bytes + length - 8) ^
+                        (Read64(kSecret + 40) ^ Read64(kSecret + 48));
+        return Avalanche(length + __builtin_bswap64(low) + high +
+                         MultiplyFold(low, high));
+    }
+    if (length >= 4) {
+        uint64_t input = Read32(bytes + length - 4) +
+                         ((uint64_t) Read32(bytes) << 32);
+        uint64_t hash = input ^ (Read64(kSecret + 8) ^ Read64(kSecret + 16));
+        hash ^= Rotate(hash, 49) ^ Rotate(hash, 24);
+        hash *= kPrimeMx2;
+        hash ^= (hash >> 35) + length;
+        hash *= kPrimeMx2;
+        return hash ^ (hash >> 28);
+    }
+    if (length > 0) {
+        uint32_t combined = ((uint32_t) bytes[0] << 16) |
+                            ((uint32_t) bytes[length >> 1] << 24) |
+                            bytes[length - 1] |
+                            ((uint32_t) length << 8);
+        return Avalanche64(combined ^
+                           (Read32(kSecret) ^ Read32(kSecret + 4)));
+    }
+    return Avalanche64(Read64(kSecret + 56) ^ Read64(kSecret + 64));
+}
+
+/* Hashes 17 to 240 bytes. */
+static uint64_t HashMedium(const uint8_t *bytes, size_t length) {
+    uint64_t hash = length * kPrime64_1;
+
+    if (length <= 128) {
+        if (length > 32) {
+            if (length > 64) {
+                if (length > 96) {
+                    hash += Mix16(bytes + 48, kSecret + 96);
+                    hash += Mix16(bytes + length - 64, kSecret + 112);
+                }
+                hash += Mix16(bytes + 32, kSecret + 64);
+                hash += Mix16(bytes + length - 48, kSecret + 80);
+            }
+            hash += Mix16(bytes + 16, kSecret + 32);
+            hash += Mix16(bytes + length - 32, kSecret + 48);
+        }
+        hash += Mix16(bytes, kSecret);
+        hash += Mix16(bytes + length - 16, kSecret + 16);
+        return Avalanche(hash);
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+        hash += Mix16(bytes + 16 * i, kSecret + 16 * i);
+    }
+    hash = Avalanche(hash);
+    for (size_t i = 8; i < length / 16; i++) {
+        hash += Mix16(bytes + 16 * i, kSecret + 16 * (i - 8) + 3);
+    }
+    hash += Mix16(bytes + length - 16, kSecret + 136 - 17);
+    return Avalanche(hash);
+}
+
+/* Accumulates a stripe into the eight lanes. */
+static inline void Accumulate(uint64_t *lanes,
+                              const uint8_t *bytes,
+                              const uint8_t *secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t value = Read64(bytes + 8 * i);
+        uint64_t key = value ^ Read64(secret + 8 * i);
+        lanes[i ^ 1] += value;
+        lanes[i] += (uint32_t) key * (key >> 32);
+    }
+}
+
+static void Scramble(uint64_t *lanes, const uint8_t *secret) {
+    for (int i = 0; i < 8; i++) {
+        uint64_t lane = lanes[i];
+        lane ^= lane >> 47;
+        lane ^= Read64(secret + 8 * i);
+        lanes[i] = lane * kPrime32_1;
+    }
+}
+
+/* Hashes more than 240 bytes in blocks of stripes. */
+static uint64_t HashLong(const uint8_t *bytes, size_t length) {
+    uint64_t lanes[8] = { kPrime32_3, kPrime64_1, kPrime64_2, kPrime64_3,
+                          kPrime64_4, kPrime32_2, kPrime64_5, kPrime32_1 };
+    size_t blockSize = kStripeSize * kBlockStripes;
+    size_t blocks = (length - 1) / blockSize;
+
+    for (size_t block = 0; block < blocks; block++) {
+        const uint8_t *start = bytes + block * blockSize;
+        for (size_t i = 0; i < kBlockStripes; i++) {
+            Accumulate(lanes, start + i * kStripeSize, kSecret + i * 8);
+        }
+        Scramble(lanes, kSecret + sizeof(kSecret) - kStripeSize);
+    }
+
+    // The stripes of the last block and the last stripe of the input
+    size_t stripes = (length - 1 - blockSize * blocks) / kStripeSize;
+    const uint8_t *start = bytes + blocks * blockSize;
+    for (size_t i = 0; i < stripes; i++) {
+        Accumulate(lanes, start + i * kStripeSize, kSecret + i * 8);
+    }
+    Accumulate(lanes,
+               bytes + length - kStripeSize,
+               kSecret + sizeof(kSecret) - kStripeSize - 7);
+
+    uint64_t hash = length * kPrime64_1;
+    for (int i = 0; i < 4; i++) {
+        hash += MultiplyFold(lanes[2 * i] ^ Read64(kSecret + 11 + 16 * i),
+                             lanes[2 * i + 1] ^
+                             Read64(kSecret + 11 + 16 * i + 8));
+    }
+    return Avalanche(hash);
+}
+
+uint64_t HashXXH3(const void *data, size_t length) {
+    if (length <= 16) {
+        return HashShort(data, length);
+    }
+    if (length <= 240) {
+        return HashMedium(data, length);
+    }
+    return HashLong(data, length);
+}
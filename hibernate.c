@@ -23,17 +23,21 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <getopt.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/types.h>
 #include <sys/sysctl.h>
+#include <sys/time.h>
 
 #include <CoreFoundation/CFBase.h>
 #include <CoreFoundation/CFDictionary.h>
 #include <CoreFoundation/CFNumber.h>
-#include <CoreFoundation/CFRunLoop.h>
 #include <CoreFoundation/CFString.h>
 
 #include <IOKit/IOTypes.h>
@@ -47,6 +51,20 @@
 #include "IOPMLibPrivate.h"
 #include "IOPowerSourcesPrivate.h"
 
+#include "aes.h"
+#include "agent.h"
+#include "assertions.h"
+#include "commands.h"
+#include "control.h"
+#include "drivers.h"
+#include "eventloop.h"
+#include "history.h"
+#include "profile.h"
+#include "schedule.h"
+#include "trace.h"
+#include "trim.h"
+#include "tuner.h"
+
 /*
  * If the HIBERNATE_SIMULATE_SLEEP is enabled hibernate will sleep for
  * kSimulatedSleepSeconds instead of initiating system sleep. This can be used
@@ -57,24 +75,38 @@
 /* The time to sleep in seconds instead of initiating system sleep. */
 # define kSimulatedSleepSeconds 10
 
-/* The hibernate mode for system sleep. */
-#define kHibernateMode kIOHibernateModeOn
-/* The state of the standby feature during system sleep. */
-#define kStandby 0
-/* The state of the feature wake on local area network during system sleep. */
-#define kWakeOnLAN 0
-/* The time in seconds to wait before initating system sleep. */
-#define kWaitBeforeSystemSleep 2
-/* The time in seconds to wait after the system has powered on. */
-#define kWaitAfterSystemSleep 8
-
 /*
  * The IOPMrootDomain session used to initiate system sleep, receive sleep/wake
  * notifications and acknowledge them.
  */
 io_connect_t session;
-/* The run loop object. */
-CFRunLoopRef loop;
+/* The event loop power notifications are dispatched on. */
+EventLoop loop;
+
+/*
+ * The assertion activity streamed around the sleep/wake cycle. Is only updated
+ * if assertionLogEnabled is set.
+ */
+AssertionLog assertionLog;
+int assertionLogEnabled;
+/* The time system sleep has been requested. */
+CFAbsoluteTime sleepRequestTime;
+/* The time the system has announced that it will sleep. */
+CFAbsoluteTime sleepTime;
+/* The time the system has announced that it has powered on. */
+CFAbsoluteTime poweredOnTime;
+/* The system has announced that it will sleep. */
+int systemSlept;
+/* Initiating system sleep failed. */
+int systemSleepFailed;
+/* The file the power history is appended to after each wake. */
+const char *historyPath = kHistoryDefaultPath;
+/* The seconds spent freeing memory before sleep, 0 disables trimming. */
+double trimBudget;
+/* Hibernate Free Ratio and Free Time are chosen by the tuner. */
+int tuneFreeMemory;
+/* The setting chosen by the tuner for the current cycle, or NULL. */
+const TunerArm *tunerArm;
 
 /* The operating system release is supported. */
 #define kCheckOSReleaseSupported 0
@@ -114,6 +146,54 @@ int CheckOSRelease() {
     }
 }
 
+/*
+ * Sets the power management feature to the specified value if the feature is
+ * available for the power source.
+ */
+void PMSetPreference(CFMutableDictionaryRef preferences,
+                     CFStringRef feature,
+                     SInt32 value,
+                     CFStringRef psType) {
+    if (IOPMFeatureIsAvailable(feature, psType)) {
+        CFNumberRef number = CFNumberCreate(kCFAllocatorDefault,
+                                            kCFNumberSInt32Type,
+                                            &value);
+        CFDictionarySetValue(preferences, feature, number);
+        CFRelease(number);
+    }
+}
+
+/*
+ * Gets the value of a power management feature of the active power source.
+ * Returns 0 on success and -1 if the feature is not set.
+ */
+int PMGetPreference(CFStringRef feature, SInt32 *value) {
+    int rc = -1;
+
+    CFTypeRef psInformation = IOPSCopyPowerSourcesInfo();
+    if (!psInformation) {
+        return -1;
+    }
+    CFStringRef psType = IOPSGetProvidingPowerSourceType(psInformation);
+    CFDictionaryRef preferences = IOPMCopyPMPreferences();
+    if (psType && preferences) {
+        CFDictionaryRef preferencesPS =
+                CFDictionaryGetValue(preferences, psType);
+        CFTypeRef number = preferencesPS
+                ? CFDictionaryGetValue(preferencesPS, feature)
+                : NULL;
+        if (number && CFGetTypeID(number) == CFNumberGetTypeID() &&
+            CFNumberGetValue(number, kCFNumberSInt32Type, value)) {
+            rc = 0;
+        }
+    }
+    if (preferences) {
+        CFRelease(preferences);
+    }
+    CFRelease(psInformation);
+    return rc;
+}
+
 /* The power management preferences have been adapted to enable hibernation. */
 #define kPMAlterPreferencesSuccess 0
 /* Getting or setting the power management preferences failed. */
@@ -123,9 +203,14 @@ int CheckOSRelease() {
 /* Getting or setting the active power management preferences failed. */
 #define kPMAlterPreferencesErrorActivePreferences 3
 
-int PMAlterPreferences(CFDictionaryRef *originalPMPreferences) {
-    CFStringRef feature = NULL;
-    CFNumberRef value = NULL;
+/*
+ * Adapts the power management preferences of the active power source to the
+ * hibernate mode, standby state and suppressed wake sources of the profile and
+ * to the setting of the tuner, if any. All changes are applied at once and are
+ * reverted at once by PMRestorePreferences.
+ */
+int PMAlterPreferences(CFDictionaryRef *originalPMPreferences,
+                       const HibernateProfile *profile) {
     IOReturn rc;
 
     // Get power source type
@@ -174,40 +259,40 @@ int PMAlterPreferences(CFDictionaryRef *originalPMPreferences) {
                          mutableActivePMPreferencesPS);
 
     // Set hibernate mode
-    feature = CFSTR(kIOHibernateModeKey);
-    if (IOPMFeatureIsAvailable(feature, psType)) {
-        SInt32 hibernateMode = kHibernateMode;
-        value = CFNumberCreate(kCFAllocatorDefault,
-                               kCFNumberSInt32Type,
-                               &hibernateMode);
-        CFDictionarySetValue(mutableActivePMPreferencesPS, feature, value);
-        CFRelease(value);
-    }
-    CFRelease(feature);
+    PMSetPreference(mutableActivePMPreferencesPS,
+                    CFSTR(kIOHibernateModeKey),
+                    profile->hibernateMode,
+                    psType);
 
     // Set standby
-    feature = CFSTR(kIOPMDeepSleepEnabledKey);
-    if (IOPMFeatureIsAvailable(feature, psType)) {
-        SInt32 standby = kStandby;
-        value = CFNumberCreate(kCFAllocatorDefault,
-                               kCFNumberSInt32Type,
-                               &standby);
-        CFDictionarySetValue(mutableActivePMPreferencesPS, feature, value);
-        CFRelease(value);
+    PMSetPreference(mutableActivePMPreferencesPS,
+                    CFSTR(kIOPMDeepSleepEnabledKey),
+                    profile->standby,
+                    psType);
+
+    // Set how many pages the kernel frees before writing the image
+    if (tunerArm) {
+        PMSetPreference(mutableActivePMPreferencesPS,
+                        CFSTR(kIOHibernateFreeRatioKey),
+                        tunerArm->freeRatio,
+                        psType);
+        PMSetPreference(mutableActivePMPreferencesPS,
+                        CFSTR(kIOHibernateFreeTimeKey),
+                        tunerArm->freeTime,
+                        psType);
     }
-    CFRelease(feature);
 
-    // Set wake on local area network
-    feature = CFSTR(kIOPMWakeOnLANKey);
-    if (IOPMFeatureIsAvailable(feature, psType)) {
-        SInt32 wakeOnLAN = kWakeOnLAN;
-        value = CFNumberCreate(kCFAllocatorDefault,
-                               kCFNumberSInt32Type,
-                               &wakeOnLAN);
-        CFDictionarySetValue(mutableActivePMPreferencesPS, feature, value);
-        CFRelease(value);
+    // Disable wake sources
+    for (size_t i = 0; i < kWakeSourceCount; i++) {
+        if (profile->suppressedWakeSources & kWakeSources[i].source) {
+            CFStringRef feature =
+                    CFStringCreateWithCString(kCFAllocatorDefault,
+                                              kWakeSources[i].feature,
+                                              kCFStringEncodingUTF8);
+            PMSetPreference(mutableActivePMPreferencesPS, feature, 0, psType);
+            CFRelease(feature);
+        }
     }
-    CFRelease(feature);
 
     CFRelease(mutableActivePMPreferencesPS);
     CFRelease(psType);
@@ -251,90 +336,480 @@ void IOPowerNotificationCallback(void *context,
                                  void *argument) {
     switch (type) {
         case kIOMessageSystemHasPoweredOn:
-            CFRunLoopStop(loop);
+            poweredOnTime = CFAbsoluteTimeGetCurrent();
+            TraceEvent("powered-on", 0);
+            if (assertionLogEnabled) {
+                AssertionLogUpdate(&assertionLog);
+            }
+            EventLoopStop(&loop);
             break;
         case kIOMessageSystemWillSleep:
+            // Capture the activity that delayed sleep entry before allowing
+            // the system to sleep
+            sleepTime = CFAbsoluteTimeGetCurrent();
+            systemSlept = 1;
+            TraceEvent("will-sleep", 0);
+            TraceCaptureUUID();
+            if (assertionLogEnabled) {
+                uint64_t start = TraceNow();
+                AssertionLogUpdate(&assertionLog);
+                TraceSpan("assertion-update", start, assertionLog.count);
+            }
             IOAllowPowerChange(session, (long) argument);
             break;
     }
 }
 
 /*
- * Requests that the system initiate sleep. Is invoked by the CFRunLoop before
- * entering the event processing loop. Requires root privileges.
+ * Requests that the system initiate sleep. The notifications of the sleep/wake
+ * cycle are queued until the event loop runs. Requires root privileges.
  */
-void RLObserverSleepSystem(CFRunLoopObserverRef observer,
-                           CFRunLoopActivity activity,
-                           void *context) {
-    switch (IOPMSleepSystem(session)) {
+void SleepSystem(void) {
+    uint64_t start = TraceNow();
+    if (assertionLogEnabled) {
+        AssertionLogUpdate(&assertionLog);
+        TraceSpan("assertion-update", start, assertionLog.count);
+    }
+    sleepRequestTime = CFAbsoluteTimeGetCurrent();
+
+    start = TraceNow();
+    IOReturn result = IOPMSleepSystem(session);
+    TraceSpan("sleep-request", start, result);
+    switch (result) {
         case kIOReturnSuccess:
             break;
         case kIOReturnNotPrivileged:
             perror("hibernate: must be run as root\n");
         default:
             perror("hibernate: failed to initiate system sleep\n");
-            CFRunLoopStop(CFRunLoopGetCurrent());
+            systemSleepFailed = 1;
             break;
     }
 }
 
-/* The system hibernation has been initiated successfuly. */
-#define kMainSuccess 0
-/* The operating system release could not be determined or is unsupported. */
-#define kMainErrorOSRelease 1
-/* Connection to the IOPMrootDomain failed. */
-#define kMainErrorIOPMrootDomain 2
+/* The long command line options. */
+static const struct option kMainOptions[] = {
+    { "wake-at", required_argument, NULL, 'a' },
+    { "wake-after", required_argument, NULL, 'w' },
+    { "schedule", required_argument, NULL, 's' },
+    { "suppress-wake", required_argument, NULL, 'x' },
+    { "config", required_argument, NULL, 'c' },
+    { "profile", required_argument, NULL, 'p' },
+    { "print-profiles", no_argument, NULL, 'P' },
+    { "history", required_argument, NULL, 'H' },
+    { "trim", required_argument, NULL, 't' },
+    { "tune", no_argument, NULL, 'T' },
+    { "agent", no_argument, NULL, 'g' },
+    { "socket", required_argument, NULL, 'S' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Prints the command line usage to the specified stream. */
+void PrintUsage(FILE *stream) {
+    fprintf(stream,
+            "usage: hibernate [--wake-at date | --wake-after interval]\n"
+            "                 [--config path] [--profile name]\n"
+            "                 [--suppress-wake sources] [--history path]\n"
+            "                 [--trim seconds] [--tune]\n"
+            "       hibernate --schedule \"days HH:MM HH:MM\" | system\n"
+            "                 [--config path] [--profile name]\n"
+            "                 [--suppress-wake sources] [--history path]\n"
+            "                 [--trim seconds] [--tune]\n"
+            "       hibernate --agent [--socket address] [--config path]\n"
+            "                 [--profile name] [--suppress-wake sources]\n"
+            "                 [--history path] [--trim seconds] [--tune]\n"
+            "       hibernate [--config path] --print-profiles\n"
+            "       hibernate aes-benchmark [--pages count] [--buffer pages]\n"
+            "       hibernate history [--history path]\n"
+            "       hibernate drivers [--cycles count] [--top count]\n"
+            "                 [--history path]\n"
+            "       hibernate control [--socket address] command...\n");
+    PrintCommandSynopsis(stream);
+    fprintf(stream,
+            "\n"
+            "  --wake-at date\n"
+            "      wake at \"YYYY-MM-DD HH:MM[:SS]\" or at the next\n"
+            "      \"HH:MM[:SS]\" (local time)\n"
+            "  --wake-after interval\n"
+            "      wake the interval after the system has gone to sleep,\n"
+            "      e.g. \"90\", \"30m\" or \"8h\"\n"
+            "  --schedule spec\n"
+            "      hibernate at the first and wake at the second time on\n"
+            "      \"daily\", \"weekdays\", \"weekends\" or days of\n"
+            "      MTWRFSU, e.g. \"MTWRF 23:00 06:30\"; \"system\" adopts the\n"
+            "      repeating sleep and wake events configured in the system\n"
+            "  --suppress-wake sources\n"
+            "      disable the comma separated wake sources lan, darkwake,\n"
+            "      powernap, acchange and clamshell, \"all\" or \"none\"\n"
+            "      while asleep (default: lan,darkwake,powernap,acchange)\n"
+            "  --config path\n"
+            "      load profiles from the configuration file\n"
+            "      (default: " kProfileDefaultPath ")\n"
+            "  --profile name\n"
+            "      apply the hibernate mode, standby, wake sources and\n"
+            "      waits of the profile (default: " kProfileDefaultName ")\n"
+            "  --print-profiles\n"
+            "      print all profiles in the format of profiles.def\n"
+            "  --history path\n"
+            "      append the device power transitions of each wake to the\n"
+            "      power history (default: " kHistoryDefaultPath ")\n"
+            "  --trim seconds\n"
+            "      ask applications to drop caches and purge the file cache\n"
+            "      before sleep, then wait up to the seconds until the\n"
+            "      Hibernate Free Ratio of free pages is reached\n"
+            "  --tune\n"
+            "      choose Hibernate Free Ratio and Free Time to minimize the\n"
+            "      sleep entry time and record it in " kTunerDefaultPath "\n"
+            "  --agent\n"
+            "      keep running and hibernate when requested over the\n"
+            "      control socket\n"
+            "  --socket address\n"
+            "      the path of the control socket or a TCP port on the\n"
+            "      loopback interface (default: " kControlDefaultSocket ")\n"
+            "\n"
+            "  aes-benchmark\n"
+            "      measure AES-CBC and AES-XTS throughput over --buffer pages\n"
+            "      (default: 8192) and project the time added to sleep and\n"
+            "      wake for an image of --pages pages (default: the pages of\n"
+            "      the last hibernation image)\n"
+            "  history\n"
+            "      print the cycles in the power history\n"
+            "  drivers\n"
+            "      rank the drivers by the p99 of their summed sleep and\n"
+            "      wake latency per cycle over the last --cycles cycles\n"
+            "      (default: 100) of the power history and print the --top\n"
+            "      drivers (default: 10)\n"
+            "  control command...\n"
+            "      send the commands \"set-profile name\", \"hibernate-at\n"
+            "      date\" (a date like --wake-at, \"now\" or \"cancel\") and\n"
+            "      \"query-stats\" to the agent in one request\n");
+    PrintCommandDescriptions(stream);
+}
+
+/*
+ * The number of consecutive sleep/wake failures after which hibernate falls
+ * back to safe sleep.
+ */
+#define kFailureLimit 2
+
+/*
+ * Records the failure reported by power management if the system has been
+ * restarted after a failed sleep/wake cycle. Returns the number of consecutive
+ * failures.
+ */
+uint32_t CheckSleepWakeFailures(void) {
+    HistoryStore store;
+
+    HistoryInit(&store);
+    if (HistoryLoad(&store, historyPath) == kHistoryLoadErrorResources) {
+        TracePrint(stderr, "hibernate: loading power history failed\n");
+        return 0;
+    }
+
+    uint32_t added = 0;
+    if (HistoryCaptureFailure(&store, &added) != kHistoryCaptureSuccess) {
+        TracePrint(stderr,
+                   "hibernate: capturing sleep/wake failure failed\n");
+    }
+    if (added > 0 && HistorySave(&store, historyPath) != 0) {
+        TracePerror("hibernate: saving power history failed\n");
+    }
+    uint32_t failures = store.consecutiveFailures;
+    HistoryFree(&store);
+    return failures;
+}
+
+/* The interval in microseconds at which HID readiness is polled after wake. */
+#define kHIDReadyPollInterval 10000
+/* The maximum number of seconds to wait for HID readiness after wake. */
+#define kHIDReadyTimeout 10
+
+/* Returns the value of kern.hibernatehidready or -1 if it is unavailable. */
+int64_t GetHIDReady(void) {
+    uint32_t value;
+    size_t length = sizeof(value);
+
+    if (sysctlbyname(kIOSysctlHibernateHIDReady,
+                     &value,
+                     &length,
+                     NULL,
+                     0) == -1 || length != sizeof(value)) {
+        return -1;
+    }
+    return value;
+}
+
+/*
+ * Waits the specified seconds after wake. If hidReadyBefore is not -1, polls
+ * kern.hibernatehidready until it differs from hidReadyBefore, for at most
+ * kHIDReadyTimeout seconds. Returns the time the change has been seen, or 0.
+ */
+CFAbsoluteTime WaitAfterWake(int seconds, int64_t hidReadyBefore) {
+    CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+    CFAbsoluteTime hidReadyTime = 0;
+
+    if (hidReadyBefore == -1) {
+        sleep(seconds);
+        return 0;
+    }
+    for (;;) {
+        CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+        if (!hidReadyTime && GetHIDReady() != hidReadyBefore) {
+            hidReadyTime = now;
+        }
+        if (now - start >= seconds &&
+            (hidReadyTime || now - start >= kHIDReadyTimeout)) {
+            return hidReadyTime;
+        }
+        usleep(kHIDReadyPollInterval);
+    }
+}
+
+/*
+ * Measures the time from the physical wake event to the power on notification
+ * and to HID readiness, or 0 if unknown. Returns 0 on success and -1 if the
+ * wake time is unavailable.
+ */
+int MeasureResume(HistoryResume *resume, CFAbsoluteTime hidReadyTime) {
+    CFAbsoluteTime wakeTime;
+    CFTimeInterval hardwareDelta;
+
+    memset(resume, 0, sizeof(*resume));
+    if (!poweredOnTime ||
+        IOPMGetLastWakeTime(&wakeTime, &hardwareDelta) != kIOReturnSuccess ||
+        !wakeTime) {
+        return -1;
+    }
+    if (!IOPMGetUUID(kIOPMSleepWakeUUID,
+                     resume->uuid,
+                     sizeof(resume->uuid))) {
+        resume->uuid[0] = '\0';
+    }
+    resume->wakeTime = wakeTime;
+    resume->hardwareDelta = hardwareDelta;
+    resume->poweredOnLatency = poweredOnTime - wakeTime;
+    resume->hidReadyLatency = hidReadyTime ? hidReadyTime - wakeTime : -1;
+
+    // The booter reports its share of the resume in milliseconds
+    hibernate_statistics_t statistics;
+    size_t length = sizeof(statistics);
+    if (sysctlbyname(kIOSysctlHibernateStatistics,
+                     &statistics,
+                     &length,
+                     NULL,
+                     0) == 0 && length == sizeof(statistics)) {
+        resume->booterDuration = statistics.booterDuration / 1e3;
+        resume->imageReadDuration = statistics.kernelImageReadDuration / 1e3;
+    }
+    return 0;
+}
+
+/*
+ * Appends the cycles powerd has recorded since the last wake and the resume
+ * times, if any, to the power history and resets the consecutive failures.
+ * Failures are reported but do not fail the hibernation.
+ */
+void RecordPowerHistory(const HistoryResume *resume) {
+    HistoryStore store;
+    int rc;
+
+    HistoryInit(&store);
+    rc = HistoryLoad(&store, historyPath);
+    if (rc != kHistoryLoadSuccess) {
+        switch (rc) {
+            case kHistoryLoadErrorFormat:
+                TracePrint(stderr, "hibernate: discarding invalid power "
+                                   "history\n");
+                break;
+            case kHistoryLoadErrorResources:
+                TracePrint(stderr,
+                           "hibernate: loading power history failed\n");
+                return;
+        }
+    }
+
+    uint32_t added = 0;
+    rc = HistoryCapture(&store, &added);
+    if (rc != kHistoryCaptureSuccess) {
+        TracePrint(stderr, "hibernate: capturing power history failed\n");
+    }
+    int changed = added > 0 || store.consecutiveFailures > 0;
+    store.consecutiveFailures = 0;
+    if (resume) {
+        HistoryPrintResume(resume, stdout);
+        if (HistoryAddResume(&store, resume) != 0) {
+            TracePrint(stderr,
+                       "hibernate: recording resume times failed\n");
+        } else {
+            changed = 1;
+        }
+    }
+    if (changed && HistorySave(&store, historyPath) != 0) {
+        TracePerror("hibernate: saving power history failed\n");
+    }
+    HistoryFree(&store);
+}
+
 /*
- * The power management preferences could not be adapted to enable hibernation.
+ * Returns the setting the tuner chooses from the observations in
+ * kTunerDefaultPath, or NULL if they could not be read.
  */
-#define kMainErrorPMAlterPreferences 3
-/* The power manamgment preferences could not be restored after hibernation. */
-#define kMainErrorPMRestorePreferences 4
+const TunerArm *ChooseTunerArm(void) {
+    Tuner tuner;
+    int line;
+
+    TunerInit(&tuner);
+    int rc = TunerLoad(&tuner, kTunerDefaultPath, NULL, &line);
+    if (rc == kTunerLoadErrorSyntax) {
+        TracePrint(stderr,
+                   "hibernate: invalid tuning observation in line %d\n",
+                   line);
+        return NULL;
+    }
+    return &kTunerArms[TunerChoose(&tuner)];
+}
+
+/*
+ * Appends the sleep entry time and image size of the last hibernation with the
+ * setting of the tuner to kTunerDefaultPath. The entry time ends at
+ * kern.sleeptime, which the kernel records after freeing pages and before
+ * writing the image.
+ */
+void RecordTuning(const TunerArm *arm) {
+    struct timeval sleepTimeval;
+    size_t length = sizeof(sleepTimeval);
+    hibernate_statistics_t statistics;
+    size_t statisticsLength = sizeof(statistics);
+
+    if (sysctlbyname("kern.sleeptime",
+                     &sleepTimeval,
+                     &length,
+                     NULL,
+                     0) == -1 ||
+        sysctlbyname(kIOSysctlHibernateStatistics,
+                     &statistics,
+                     &statisticsLength,
+                     NULL,
+                     0) == -1 || statisticsLength != sizeof(statistics)) {
+        TracePrint(stderr,
+                   "hibernate: reading sleep statistics failed\n");
+        return;
+    }
+
+    CFAbsoluteTime kernelSleepTime = sleepTimeval.tv_sec +
+                                     sleepTimeval.tv_usec / 1e6 -
+                                     kCFAbsoluteTimeIntervalSince1970;
+    if (!sleepRequestTime || kernelSleepTime < sleepRequestTime) {
+        return;
+    }
+
+    TunerObservation observation;
+    observation.date = (int64_t) time(NULL);
+    observation.freeRatio = arm->freeRatio;
+    observation.freeTime = arm->freeTime;
+    observation.imageBytes = statistics.imageSize;
+    observation.entrySeconds = kernelSleepTime - sleepRequestTime;
+    TracePrint(stdout,
+               "sleep entry took %.2f s with free ratio %d%% and free time "
+               "%d ms, estimated %.2f s including the image of %llu MB\n",
+               observation.entrySeconds,
+               arm->freeRatio,
+               arm->freeTime,
+               TunerCost(&observation),
+               (unsigned long long) (observation.imageBytes >> 20));
+    if (TunerAppend(kTunerDefaultPath, &observation) != 0) {
+        TracePerror("hibernate: recording tuning observation failed\n");
+    }
+}
 
 /*
  * Initiates hibernation by adapting the power manamgement preferences,
  * initiating system sleep and restoring the previous power management
- * preferences after the system has powered on again.
+ * preferences after the system has powered on again. A wake is scheduled if
+ * wakeDate or wakeInterval is not zero. Returns one of the kMain codes.
  */
-int main (int argc, const char *argv[]) {
+int HibernateCycle(CFAbsoluteTime wakeDate,
+                   CFTimeInterval wakeInterval,
+                   const HibernateProfile *profile) {
     int rc;
 
-    // Check operating system release
-    rc = CheckOSRelease();
-    if (rc != kCheckOSReleaseSupported) {
+    uint64_t start = TraceNow();
+
+    // Fall back to safe sleep after repeated failures, so that another failed
+    // restore costs a wake from memory instead of a cold boot
+    HibernateProfile fallback;
+    uint32_t failures = CheckSleepWakeFailures();
+    if (failures >= kFailureLimit &&
+        !(profile->hibernateMode & kIOHibernateModeSleep)) {
+        fallback = *profile;
+        fallback.hibernateMode |= kIOHibernateModeSleep;
+        profile = &fallback;
+        TracePrint(stderr,
+                   "hibernate: %u consecutive sleep/wake failures, using "
+                   "hibernate mode 0x%x\n",
+                   failures,
+                   profile->hibernateMode);
+    }
+    TraceSpan("check-failures", start, failures);
+
+    sleepRequestTime = 0;
+    sleepTime = 0;
+    systemSlept = 0;
+    systemSleepFailed = 0;
+    poweredOnTime = 0;
+
+    // Schedule wake from hibernation
+    start = TraceNow();
+    ScheduledWake wake = { kWakeNone, 0 };
+    rc = kScheduleWakeSuccess;
+    if (wakeDate) {
+        rc = ScheduleWakeAt(&wake, wakeDate);
+    } else if (wakeInterval) {
+        rc = ScheduleWakeAfter(&wake, wakeInterval);
+    }
+    if (rc != kScheduleWakeSuccess) {
         switch (rc) {
-            case kCheckOSReleaseUnsupported:
-                perror("hibernate: operating system release unsupported\n");
+            case kScheduleWakeErrorNotPrivileged:
+                TracePerror("hibernate: must be run as root\n");
                 break;
-            case kCheckOSReleaseError:
-                perror("hibernate: getting operating system resease failed\n");
+            case kScheduleWakeError:
+                TracePerror("hibernate: scheduling wake failed\n");
                 break;
         }
-        return kMainErrorOSRelease;
+        return kMainErrorScheduleWake;
     }
+    TraceSpan("schedule-wake", start, wake.type);
+
+    // Choose how many pages the kernel frees in this cycle
+    tunerArm = tuneFreeMemory ? ChooseTunerArm() : NULL;
 
     // Adapt power management preferences
+    start = TraceNow();
     CFDictionaryRef originalPMPreferences = NULL;
-    rc = PMAlterPreferences(&originalPMPreferences);
+    rc = PMAlterPreferences(&originalPMPreferences, profile);
     if (rc != kPMAlterPreferencesSuccess) {
         switch (rc) {
             case kPMAlterPreferencesErrorCustomPreferences:
-                perror("hiberate: setting custom power management preferences "
-                       "failed\n");
+                TracePerror("hiberate: setting custom power management "
+                            "preferences failed\n");
                 break;
             case kPMAlterPreferencesErrorPowerSource:
-                perror("hibernate: getting currently active power source type "
-                       "failed\n");
+                TracePerror("hibernate: getting currently active power source "
+                            "type failed\n");
                 break;
             case kPMAlterPreferencesErrorActivePreferences:
-                perror("hibernate: getting active power management preferences "
-                       "failed\n");
+                TracePerror("hibernate: getting active power management "
+                            "preferences failed\n");
                 break;
         }
+        CancelWake(&wake);
         return kMainErrorPMAlterPreferences;
     }
+    TraceSpan("alter-preferences", start, profile->hibernateMode);
 
     // Connect to the IOPMrootDomain
+    start = TraceNow();
     IONotificationPortRef port = NULL;
     io_object_t notifier;
     session = IORegisterForSystemPower(NULL,
@@ -343,42 +818,109 @@ int main (int argc, const char *argv[]) {
                                        &notifier);
     if (!session) {
         CFRelease(originalPMPreferences);
+        CancelWake(&wake);
 
-        perror("hibernate: connecting to the IOPMrootDomain failed\n");
+        TracePerror("hibernate: connecting to the IOPMrootDomain "
+                    "failed\n");
         return kMainErrorIOPMrootDomain;
     }
+    TraceSpan("register-power", start, 0);
 
-    loop = CFRunLoopGetCurrent();
+    // Start streaming assertion activity
+    start = TraceNow();
+    rc = AssertionLogStart(&assertionLog);
+    if (rc == kAssertionLogStartSuccess) {
+        assertionLogEnabled = 1;
+    } else {
+        TracePerror("hibernate: streaming assertion activity failed\n");
+    }
+    TraceSpan("assertion-log-start", start, rc);
 
-    // Add run loop observer to run loop to initiate sleep
-    CFRunLoopObserverRef observer =
-            CFRunLoopObserverCreate(kCFAllocatorDefault,
-                                    kCFRunLoopEntry,
-                                    false,
-                                    0,
-                                    RLObserverSleepSystem,
-                                    NULL);
-    CFRunLoopAddObserver(loop, observer, kCFRunLoopCommonModes);
+    // Receive power notifications on the event loop
+    EventWatcher *watcher = NULL;
+    if (EventLoopInit(&loop) == 0) {
+        watcher = EventLoopAddNotificationPort(&loop, port, NULL, NULL);
+    }
+    if (!watcher) {
+        TracePerror("hibernate: watching power notifications failed\n");
+        EventLoopFree(&loop);
+        IODeregisterForSystemPower(&notifier);
+        IOServiceClose(session);
+        IONotificationPortDestroy(port);
+        PMRestorePreferences(originalPMPreferences);
+        CFRelease(originalPMPreferences);
+        CancelWake(&wake);
+        return kMainErrorIOPMrootDomain;
+    }
+
+    // Remember HID readiness of the last wake to detect the next one
+    int64_t hidReadyBefore = GetHIDReady();
 
-    // Add run loop source to run loop to receive power notifications
-    CFRunLoopSourceRef source = IONotificationPortGetRunLoopSource(port);
-    CFRunLoopAddSource(loop, source, kCFRunLoopCommonModes);
+    sleep(profile->waitBeforeSystemSleep);
 
-    sleep(kWaitBeforeSystemSleep);
+    // Free memory, so that fewer pages are written to the image
+    if (trimBudget > 0) {
+        start = TraceNow();
+        SInt32 freeRatio = kTrimDefaultFreeRatio;
+        PMGetPreference(CFSTR(kIOHibernateFreeRatioKey), &freeRatio);
+        TrimResult trim;
+        rc = TrimMemory(freeRatio, trimBudget, &trim);
+        TraceSpan("trim-memory", start, rc);
+        if (rc == kTrimMemoryError) {
+            TracePerror("hibernate: counting free pages failed\n");
+        } else {
+            int64_t freed = (int64_t) trim.freePagesAfter -
+                            (int64_t) trim.freePagesBefore;
+            TracePrint(stdout,
+                       "trimmed memory in %.1f s: %lld MB freed, %llu%% "
+                       "free (target %d%%)%s\n",
+                       trim.seconds,
+                       (long long) (freed * (int64_t) trim.pageSize >> 20),
+                       (unsigned long long) (trim.freePagesAfter * 100 /
+                                             trim.totalPages),
+                       (int) freeRatio,
+                       trim.purged ? "" : ", file cache not purged");
+        }
+    }
 
 #if HIBERNATE_SIMULATE_SLEEP
     sleep(kSimulatedSleepSeconds);
 #else
-    // Run run loop
-    CFRunLoopRun();
+    // Initiate sleep and dispatch notifications until the system powered on
+    SleepSystem();
+    if (!systemSleepFailed &&
+        EventLoopRun(&loop, -1) == kEventLoopError) {
+        TracePerror("hibernate: waiting for power notifications "
+                    "failed\n");
+    }
 #endif
 
-    sleep(kWaitAfterSystemSleep);
+    // Cancel the scheduled wake if the system did not sleep or woke earlier
+    if (!systemSlept || wake.type == kWakeAbsolute) {
+        CancelWake(&wake);
+    }
 
-    // Clear run loop
-    CFRunLoopRemoveObserver(loop, observer, kCFRunLoopCommonModes);
-    CFRelease(observer);
-    CFRunLoopRemoveSource(loop, source, kCFRunLoopCommonModes);
+    if (assertionLogEnabled) {
+        AssertionLogReport(&assertionLog, sleepRequestTime, sleepTime, stdout);
+    }
+
+    CFAbsoluteTime hidReadyTime =
+            WaitAfterWake(profile->waitAfterSystemSleep,
+                          systemSlept ? hidReadyBefore : -1);
+
+    if (systemSlept) {
+        start = TraceNow();
+        HistoryResume resume;
+        int measured = MeasureResume(&resume, hidReadyTime) == 0;
+        RecordPowerHistory(measured ? &resume : NULL);
+        TraceSpan("record-history", start, measured);
+        if (tunerArm) {
+            RecordTuning(tunerArm);
+        }
+    }
+
+    // Clear event loop
+    EventLoopFree(&loop);
 
     // Disconnect from the IOPMrootDomain
     IODeregisterForSystemPower(&notifier);
@@ -386,17 +928,790 @@ int main (int argc, const char *argv[]) {
     IONotificationPortDestroy(port);
 
     // Restore power management preferences
+    start = TraceNow();
     rc = PMRestorePreferences(originalPMPreferences);
     CFRelease(originalPMPreferences);
+    TraceSpan("restore-preferences", start, rc);
+
     if (rc != kPMRestorePreferencesSuccess) {
         switch(rc) {
             case kPMRestorePreferencesErrorCustomPreferences:
-                perror("hibernate: restoring custom power management "
-                       "preferences failed\n");
+                TracePerror("hibernate: restoring custom power management "
+                            "preferences failed\n");
                 break;
         }
         return kMainErrorPMRestorePreferences;
     }
 
+    if (systemSleepFailed) {
+        return kMainErrorSleepSystem;
+    }
+    return kMainSuccess;
+}
+
+/*
+ * Runs HibernateCycle and writes the trace of the cycle, also if it has
+ * failed. Returns one of the kMain codes.
+ */
+int Hibernate(CFAbsoluteTime wakeDate,
+              CFTimeInterval wakeInterval,
+              const HibernateProfile *profile) {
+    TraceCycleBegin();
+    int rc = HibernateCycle(wakeDate, wakeInterval, profile);
+
+    // Write the trace once the system is awake
+    TraceFlush(stdout);
+    return rc;
+}
+
+/* The weekly schedule has been asked to stop. */
+int scheduleStopped;
+
+/* Stops the weekly schedule on SIGINT and SIGTERM. */
+void ScheduleSignalCallback(EventWatcher *watcher, int events, void *context) {
+    scheduleStopped = 1;
+    EventLoopStop(watcher->loop);
+}
+
+/* Stops the event loop once the next window has started. */
+void ScheduleTimerCallback(EventWatcher *watcher, int events, void *context) {
+    EventLoopStop(watcher->loop);
+}
+
+/*
+ * Hibernates at the start of each window of the weekly schedule until SIGINT or
+ * SIGTERM is received. The repeating power events of the system are replaced
+ * by a repeating wake at the end of each window while the schedule is running.
+ * Returns one of the kMain codes.
+ */
+int RunWeeklySchedule(const WeeklySchedule *schedule,
+                      const HibernateProfile *profile) {
+    int rc;
+
+    // Replace repeating power events
+    CFDictionaryRef originalEvents = NULL;
+    rc = RepeatingEventsAlter(schedule, &originalEvents);
+    if (rc != kRepeatingEventsSuccess) {
+        switch (rc) {
+            case kRepeatingEventsErrorNotPrivileged:
+                TracePerror("hibernate: must be run as root\n");
+                break;
+            case kRepeatingEventsError:
+                TracePerror("hibernate: setting repeating power events "
+                            "failed\n");
+                break;
+        }
+        return kMainErrorSchedule;
+    }
+
+    // Stop on SIGINT and SIGTERM. Signals received during a hibernation are
+    // kept by the loop until the next wait.
+    EventLoop scheduleLoop;
+    int signals[] = { SIGINT, SIGTERM };
+    int watching = EventLoopInit(&scheduleLoop) == 0;
+    for (int i = 0; watching && i < 2; i++) {
+        watching = EventLoopAddSignal(&scheduleLoop,
+                                      signals[i],
+                                      ScheduleSignalCallback,
+                                      NULL) != NULL;
+    }
+    if (!watching) {
+        TracePerror("hibernate: watching signals failed\n");
+        scheduleStopped = 1;
+    }
+
+    while (!scheduleStopped) {
+        CFAbsoluteTime next =
+                WeeklyScheduleNextSleep(schedule, CFAbsoluteTimeGetCurrent());
+
+        // Wait for the next window without waking up in between
+        EventWatcher *timer =
+                EventLoopAddTimer(&scheduleLoop,
+                                  next + kCFAbsoluteTimeIntervalSince1970,
+                                  kEventTimerAbsolute,
+                                  ScheduleTimerCallback,
+                                  NULL);
+        if (!timer) {
+            TracePerror("hibernate: waiting for the next window failed\n");
+            break;
+        }
+        rc = EventLoopRun(&scheduleLoop, -1);
+        EventWatcherCancel(timer);
+        if (rc == kEventLoopError) {
+            TracePerror("hibernate: waiting for the next window failed\n");
+            break;
+        }
+        if (scheduleStopped) {
+            break;
+        }
+
+        // Skip windows that have passed while the system was asleep
+        if (CFAbsoluteTimeGetCurrent() >= WeeklyScheduleWake(schedule, next)) {
+            continue;
+        }
+
+        rc = Hibernate(0, 0, profile);
+        if (rc != kMainSuccess) {
+            TracePrint(stderr,
+                       "hibernate: scheduled hibernation failed (%d)\n",
+                       rc);
+        }
+    }
+
+    EventLoopFree(&scheduleLoop);
+
+    // Restore repeating power events
+    rc = RepeatingEventsRestore(originalEvents);
+    CFRelease(originalEvents);
+    if (rc != kRepeatingEventsSuccess) {
+        TracePerror("hibernate: restoring repeating power events failed\n");
+        return kMainErrorSchedule;
+    }
+
     return kMainSuccess;
 }
+
+/* Hibernates once the date requested with kControlHibernateAt has come. */
+void AgentTimerCallback(EventWatcher *watcher, int events, void *context) {
+    Agent *agent = context;
+    (void) events;
+
+    EventWatcherCancel(watcher);
+    agent->timer = NULL;
+    agent->pendingDate = 0;
+
+    // Requests that arrive meanwhile are executed after wake
+    int rc = Hibernate(0, 0, &agent->profile);
+    if (rc == kMainSuccess) {
+        agent->hibernations++;
+    } else {
+        agent->failures++;
+        TracePrint(stderr,
+                   "hibernate: requested hibernation failed (%d)\n",
+                   rc);
+    }
+}
+
+/* Stops the agent on SIGINT and SIGTERM. */
+void AgentSignalCallback(EventWatcher *watcher, int events, void *context) {
+    (void) events;
+    (void) context;
+    EventLoopStop(watcher->loop);
+}
+
+/*
+ * Serves control requests on the address until SIGINT or SIGTERM is received.
+ * Hibernates with the selected profile at the requested dates. Returns one of
+ * the kMain codes.
+ */
+int RunAgent(const char *address,
+             const ProfileTable *profiles,
+             const HibernateProfile *profile) {
+    EventLoop agentLoop;
+    ControlServer server;
+    Agent agent;
+    int rc = kMainSuccess;
+
+    memset(&agent, 0, sizeof(agent));
+    agent.profiles = profiles;
+    agent.profile = *profile;
+    agent.loop = &agentLoop;
+    agent.hibernate = AgentTimerCallback;
+
+    if (EventLoopInit(&agentLoop) != 0) {
+        TracePerror("hibernate: creating the event loop failed\n");
+        return kMainErrorControl;
+    }
+    if (ControlServerInit(&server,
+                          &agentLoop,
+                          address,
+                          AgentHandleCommand,
+                          &agent) != 0) {
+        TracePerror("hibernate: listening on the control socket failed\n");
+        EventLoopFree(&agentLoop);
+        return kMainErrorControl;
+    }
+
+    // Stop on SIGINT and SIGTERM
+    if (!EventLoopAddSignal(&agentLoop, SIGINT, AgentSignalCallback, NULL) ||
+        !EventLoopAddSignal(&agentLoop, SIGTERM, AgentSignalCallback, NULL)) {
+        TracePerror("hibernate: watching signals failed\n");
+        rc = kMainErrorControl;
+    } else if (EventLoopRun(&agentLoop, -1) == kEventLoopError) {
+        TracePerror("hibernate: waiting for control requests failed\n");
+        rc = kMainErrorControl;
+    }
+
+    ControlServerFree(&server);
+    EventLoopFree(&agentLoop);
+    return rc;
+}
+
+/* The default number of pages encrypted by the AES benchmark. */
+#define kAESBenchmarkPages 8192
+
+/* The long command line options of the aes-benchmark command. */
+static const struct option kAESBenchmarkOptions[] = {
+    { "pages", required_argument, NULL, 'p' },
+    { "buffer", required_argument, NULL, 'b' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Benchmarks the AES implementations and projects the time encryption adds to
+ * an image of the specified or the last image size. Returns one of the kMain
+ * codes.
+ */
+int RunAESBenchmark(int argc, const char *argv[]) {
+    unsigned long long projectedPages = 0;
+    unsigned long bufferPages = kAESBenchmarkPages;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kAESBenchmarkOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'p':
+                if (sscanf(optarg, "%llu", &projectedPages) != 1) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'b':
+                if (sscanf(optarg, "%lu", &bufferPages) != 1 ||
+                    bufferPages == 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Default to the size of the last hibernation image
+    if (projectedPages == 0) {
+        hibernate_statistics_t statistics;
+        size_t length = sizeof(statistics);
+        if (sysctlbyname(kIOSysctlHibernateStatistics,
+                         &statistics,
+                         &length,
+                         NULL,
+                         0) == 0 && length == sizeof(statistics)) {
+            projectedPages = statistics.imagePages;
+        }
+    }
+
+    switch (AESBenchmark(bufferPages, projectedPages, stdout)) {
+        case kAESBenchmarkSuccess:
+            return kMainSuccess;
+        case kAESBenchmarkErrorMismatch:
+            fprintf(stderr, "hibernate: AES results differ between "
+                            "implementations\n");
+            break;
+        case kAESBenchmarkErrorResources:
+            fprintf(stderr, "hibernate: AES benchmark failed\n");
+            break;
+    }
+    return kMainErrorBenchmark;
+}
+
+/* Loads the power history at historyPath. Returns one of the kMain codes. */
+int LoadHistory(HistoryStore *store) {
+    HistoryInit(store);
+    switch (HistoryLoad(store, historyPath)) {
+        case kHistoryLoadSuccess:
+            return kMainSuccess;
+        case kHistoryLoadErrorOpen:
+            perror("hibernate: opening power history failed\n");
+            break;
+        case kHistoryLoadErrorFormat:
+            fprintf(stderr, "hibernate: invalid power history\n");
+            break;
+        case kHistoryLoadErrorResources:
+            fprintf(stderr, "hibernate: loading power history failed\n");
+            break;
+    }
+    return kMainErrorHistory;
+}
+
+/* The long command line options of the history command. */
+static const struct option kHistoryOptions[] = {
+    { "history", required_argument, NULL, 'H' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Prints the power history. Returns one of the kMain codes. */
+int RunHistory(int argc, const char *argv[]) {
+    HistoryStore store;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kHistoryOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'H':
+                historyPath = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    if (LoadHistory(&store) != kMainSuccess) {
+        return kMainErrorHistory;
+    }
+    HistoryPrint(&store, stdout);
+    HistoryFree(&store);
+    return kMainSuccess;
+}
+
+/* The default number of cycles ranked by the drivers command. */
+#define kDriversCycles 100
+/* The default number of drivers printed by the drivers command. */
+#define kDriversTop 10
+
+/* The long command line options of the drivers command. */
+static const struct option kDriversOptions[] = {
+    { "cycles", required_argument, NULL, 'c' },
+    { "top", required_argument, NULL, 't' },
+    { "history", required_argument, NULL, 'H' },
+    { NULL, 0, NULL, 0 }
+};
+
+/*
+ * Prints the drivers with the highest sleep and wake latency in the power
+ * history. Returns one of the kMain codes.
+ */
+int RunDrivers(int argc, const char *argv[]) {
+    unsigned cycles = kDriversCycles;
+    unsigned top = kDriversTop;
+    HistoryStore store;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kDriversOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'c':
+                if (sscanf(optarg, "%u", &cycles) != 1 || cycles == 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 't':
+                if (sscanf(optarg, "%u", &top) != 1 || top == 0) {
+                    PrintUsage(stderr);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'H':
+                historyPath = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    if (LoadHistory(&store) != kMainSuccess) {
+        return kMainErrorHistory;
+    }
+    int rc = DriversReport(&store, cycles, top, stdout);
+    HistoryFree(&store);
+    if (rc != kDriversReportSuccess) {
+        fprintf(stderr, "hibernate: ranking drivers failed\n");
+        return kMainErrorHistory;
+    }
+    return kMainSuccess;
+}
+
+/* The names of the kControlStatus codes. */
+static const char *kControlStatusNames[] = {
+    "ok",
+    "unknown command",
+    "invalid argument",
+    "unknown profile",
+    "failed"
+};
+
+/* The long command line options of the control command. */
+static const struct option kControlOptions[] = {
+    { "socket", required_argument, NULL, 'S' },
+    { NULL, 0, NULL, 0 }
+};
+
+/* Prints a result of a control reply. */
+static void PrintControlResult(const ControlCommand *result) {
+    static const char *kNames[] = {
+        NULL, "set-profile", "hibernate-at", "query-stats"
+    };
+    const char *name = result->opcode < 4 ? kNames[result->opcode] : NULL;
+    const char *status = result->status < 5
+            ? kControlStatusNames[result->status]
+            : "unknown status";
+
+    printf("%s: %s\n", name ? name : "unknown", status);
+
+    ControlStats stats;
+    if (result->opcode == kControlQueryStats &&
+        result->status == kControlStatusSuccess &&
+        ControlStatsDecode(result, &stats) == 0) {
+        char date[32] = "none";
+        if (stats.pendingDate) {
+            struct tm tm;
+            time_t time = (time_t) stats.pendingDate;
+            localtime_r(&time, &tm);
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+        }
+        printf("  profile %s, %u hibernations, %u failed, pending %s, "
+               "%llu commands\n",
+               stats.profile,
+               stats.hibernations,
+               stats.failures,
+               date,
+               (unsigned long long) stats.commands);
+    }
+}
+
+/*
+ * Sends the commands on the command line to the agent in one request and
+ * prints the results. Returns one of the kMain codes.
+ */
+int RunControl(int argc, const char *argv[]) {
+    const char *address = kControlDefaultSocket;
+    static uint8_t bytes[kControlFrameCapacity];
+    ControlFrame request;
+
+    // Parse command line options
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "",
+                                 kControlOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'S':
+                address = optarg;
+                break;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind == argc) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Batch the commands
+    ControlFrameInit(&request, bytes, sizeof(bytes), 0);
+    for (int i = optind; i < argc; i++) {
+        int rc = -1;
+        if (strcmp(argv[i], "set-profile") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            size_t length = strlen(name);
+            if (length < kProfileNameLength) {
+                rc = ControlFrameAdd(&request,
+                                     kControlSetProfile,
+                                     0,
+                                     name,
+                                     (uint16_t) length);
+            }
+        } else if (strcmp(argv[i], "hibernate-at") == 0 && i + 1 < argc) {
+            const char *string = argv[++i];
+            CFAbsoluteTime date;
+            int64_t seconds = -1;
+            if (strcmp(string, "now") == 0) {
+                seconds = time(NULL);
+            } else if (strcmp(string, "cancel") == 0) {
+                seconds = 0;
+            } else if (ParseWakeDate(string, &date) == kParseWakeSuccess) {
+                seconds = (int64_t) (date + kCFAbsoluteTimeIntervalSince1970);
+            }
+            if (seconds != -1) {
+                uint8_t data[sizeof(int64_t)];
+                ControlEncodeInt64(data, seconds);
+                rc = ControlFrameAdd(&request,
+                                     kControlHibernateAt,
+                                     0,
+                                     data,
+                                     sizeof(data));
+            }
+        } else if (strcmp(argv[i], "query-stats") == 0) {
+            rc = ControlFrameAdd(&request, kControlQueryStats, 0, NULL, 0);
+        }
+        if (rc != 0) {
+            fprintf(stderr, "hibernate: invalid control command: %s\n",
+                    argv[i]);
+            return kMainErrorUsage;
+        }
+    }
+    ControlFrameFinish(&request);
+
+    // Send the request and wait for the reply
+    int fd = ControlConnect(address);
+    if (fd == -1) {
+        perror("hibernate: connecting to the agent failed\n");
+        return kMainErrorControl;
+    }
+    size_t length;
+    ControlReader reader;
+    if (ControlWriteFrame(fd, &request) != 0 ||
+        ControlReadFrame(fd, bytes, &length) != 0 ||
+        ControlReaderInit(&reader, bytes, length) != 0 ||
+        reader.count != request.count) {
+        perror("hibernate: control request failed\n");
+        close(fd);
+        return kMainErrorControl;
+    }
+    close(fd);
+
+    int rc = kMainSuccess;
+    ControlCommand result;
+    while (ControlReaderNext(&reader, &result)) {
+        PrintControlResult(&result);
+        if (result.status != kControlStatusSuccess) {
+            rc = kMainErrorControl;
+        }
+    }
+    return rc;
+}
+
+/*
+ * The commands selected by the first argument that use the power management of
+ * the system. The others are found by CommandFind.
+ */
+static const Command kMainCommands[] = {
+    { "aes-benchmark", RunAESBenchmark },
+    { "history", RunHistory },
+    { "drivers", RunDrivers },
+    { "control", RunControl }
+};
+#define kMainCommandCount (sizeof(kMainCommands) / sizeof(kMainCommands[0]))
+
+/*
+ * Hibernates once or, if a weekly schedule is specified, at the start of each
+ * window of the schedule.
+ */
+int main (int argc, const char *argv[]) {
+    int rc;
+
+    // Run commands that do not hibernate the system
+    if (argc > 1 && argv[1][0] != '-') {
+        for (size_t i = 0; i < kMainCommandCount; i++) {
+            if (strcmp(argv[1], kMainCommands[i].name) == 0) {
+                return kMainCommands[i].run(argc - 1, argv + 1);
+            }
+        }
+        const Command *command = CommandFind(argv[1]);
+        if (command != NULL) {
+            return command->run(argc - 1, argv + 1);
+        }
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Parse command line options
+    CFAbsoluteTime wakeDate = 0;
+    CFTimeInterval wakeInterval = 0;
+    WeeklySchedule schedule;
+    int scheduled = 0;
+    const char *configPath = NULL;
+    const char *profileName = kProfileDefaultName;
+    int printProfiles = 0;
+    int agent = 0;
+    const char *socketAddress = kControlDefaultSocket;
+    int suppressedWakeSources = -1;
+    int option;
+    while ((option = getopt_long(argc,
+                                 (char * const *) argv,
+                                 "h",
+                                 kMainOptions,
+                                 NULL)) != -1) {
+        switch (option) {
+            case 'a':
+                rc = ParseWakeDate(optarg, &wakeDate);
+                if (rc != kParseWakeSuccess) {
+                    fprintf(stderr,
+                            rc == kParseWakeErrorPast
+                                ? "hibernate: wake date is in the past: %s\n"
+                                : "hibernate: invalid wake date: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'w':
+                rc = ParseWakeInterval(optarg, &wakeInterval);
+                if (rc != kParseWakeSuccess) {
+                    fprintf(stderr,
+                            "hibernate: invalid wake interval: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 's':
+                if (strcmp(optarg, "system") == 0) {
+                    rc = WeeklyScheduleCopySystem(&schedule);
+                } else {
+                    rc = WeeklyScheduleParse(optarg, &schedule);
+                }
+                if (rc != kWeeklyScheduleSuccess) {
+                    fprintf(stderr,
+                            rc == kWeeklyScheduleErrorSystem
+                                ? "hibernate: no repeating sleep and wake "
+                                  "events configured\n"
+                                : "hibernate: invalid schedule: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                scheduled = 1;
+                break;
+            case 'x':
+                if (ParseWakeSources(optarg, &suppressedWakeSources) != 0) {
+                    fprintf(stderr,
+                            "hibernate: invalid wake sources: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'c':
+                configPath = optarg;
+                break;
+            case 'p':
+                profileName = optarg;
+                break;
+            case 'P':
+                printProfiles = 1;
+                break;
+            case 'H':
+                historyPath = optarg;
+                break;
+            case 't':
+                if (sscanf(optarg, "%lf", &trimBudget) != 1 ||
+                    trimBudget < 0) {
+                    fprintf(stderr,
+                            "hibernate: invalid trim budget: %s\n",
+                            optarg);
+                    return kMainErrorUsage;
+                }
+                break;
+            case 'T':
+                tuneFreeMemory = 1;
+                break;
+            case 'g':
+                agent = 1;
+                break;
+            case 'S':
+                socketAddress = optarg;
+                break;
+            case 'h':
+                PrintUsage(stdout);
+                return kMainSuccess;
+            default:
+                PrintUsage(stderr);
+                return kMainErrorUsage;
+        }
+    }
+    if (optind != argc || (wakeDate && wakeInterval) ||
+        (scheduled && (wakeDate || wakeInterval)) ||
+        (printProfiles && (scheduled || wakeDate || wakeInterval)) ||
+        (agent && (scheduled || wakeDate || wakeInterval || printProfiles))) {
+        PrintUsage(stderr);
+        return kMainErrorUsage;
+    }
+
+    // Load profiles, a missing default configuration file is not an error
+    ProfileTable profiles;
+    ProfileTableInit(&profiles);
+    int errorLine;
+    rc = ProfileTableLoad(&profiles,
+                          configPath ? configPath : kProfileDefaultPath,
+                          &errorLine);
+    if (rc != kProfileLoadSuccess && (rc != kProfileLoadErrorOpen ||
+                                      configPath)) {
+        switch (rc) {
+            case kProfileLoadErrorOpen:
+                perror("hibernate: opening configuration file failed\n");
+                break;
+            case kProfileLoadErrorSyntax:
+                fprintf(stderr,
+                        "hibernate: invalid configuration in line %d\n",
+                        errorLine);
+                break;
+            case kProfileLoadErrorCapacity:
+                fprintf(stderr,
+                        "hibernate: too many profiles in line %d\n",
+                        errorLine);
+                break;
+        }
+        return kMainErrorConfig;
+    }
+
+    if (printProfiles) {
+        ProfileTablePrint(&profiles, stdout);
+        return kMainSuccess;
+    }
+
+    // Select profile, --suppress-wake overrides the wake sources of the profile
+    const HibernateProfile *found = ProfileTableFind(&profiles, profileName);
+    if (!found) {
+        fprintf(stderr, "hibernate: unknown profile: %s\n", profileName);
+        return kMainErrorConfig;
+    }
+    HibernateProfile profile = *found;
+    if (suppressedWakeSources != -1) {
+        profile.suppressedWakeSources = suppressedWakeSources;
+    }
+
+    // Check operating system release
+    rc = CheckOSRelease();
+    if (rc != kCheckOSReleaseSupported) {
+        switch (rc) {
+            case kCheckOSReleaseUnsupported:
+                perror("hibernate: operating system release unsupported\n");
+                break;
+            case kCheckOSReleaseError:
+                perror("hibernate: getting operating system resease failed\n");
+                break;
+        }
+        return kMainErrorOSRelease;
+    }
+
+    // Allocate the trace buffer of the thread that hibernates once, before
+    // anything is recorded
+    if (TraceThreadInit() != 0) {
+        fprintf(stderr, "hibernate: allocating trace buffer failed\n");
+    }
+
+    if (scheduled) {
+        return RunWeeklySchedule(&schedule, &profile);
+    }
+    if (agent) {
+        return RunAgent(socketAddress, &profiles, &profile);
+    }
+    return Hibernate(wakeDate, wakeInterval, &profile);
+}
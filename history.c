@@ -0,0 +1,848 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "history.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include <CoreFoundation/CFArray.h>
+#include <CoreFoundation/CFDictionary.h>
+#include <CoreFoundation/CFNumber.h>
+#include <CoreFoundation/CFString.h>
+
+#include <IOKit/IOReturn.h>
+#include <IOKit/pwr_mgt/IOPMLib.h>
+
+#include "IOPMLibPrivate.h"
+
+/* The signature of a history file, "HBHS". */
+#define kHistoryFileMagic 0x48424853
+/*
+ * The version of the history file format. Version 1 has no failures, version 2
+ * no resume times.
+ */
+#define kHistoryFileVersion 3
+
+/*
+ * The header of a history file. It is followed by the strings, the symbols,
+ * the cycles, the event columns, the failures and the resume times in the order
+ * of HistoryStore.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t stringsSize;
+    uint32_t symbolCount;
+    uint32_t cycleCount;
+    uint32_t eventCount;
+    /* Added in version 2. */
+    uint32_t failureCount;
+    uint32_t consecutiveFailures;
+    /* Added in version 3. */
+    uint32_t resumeCount;
+} HistoryFileHeader;
+
+/* The size of the header of each version, indexed by version - 1. */
+static const size_t kHistoryFileHeaderSizes[] = {
+    6 * sizeof(uint32_t),
+    8 * sizeof(uint32_t),
+    sizeof(HistoryFileHeader)
+};
+
+/* The bytes of one event in all columns. */
+#define kHistoryEventSize (4 * sizeof(uint32_t) + 2 * sizeof(uint8_t))
+
+void HistoryInit(HistoryStore *store) {
+    memset(store, 0, sizeof(*store));
+}
+
+void HistoryFree(HistoryStore *store) {
+    free(store->strings);
+    free(store->symbols);
+    free(store->slots);
+    free(store->cycles);
+    free(store->device);
+    free(store->interested);
+    free(store->offsetUS);
+    free(store->elapsedUS);
+    free(store->oldState);
+    free(store->newState);
+    free(store->failures);
+    free(store->resumes);
+    HistoryInit(store);
+}
+
+/*
+ * Grows an array to hold at least needed elements, doubling its capacity.
+ * Returns 0 on success and -1 otherwise.
+ */
+static int Reserve(void **array,
+                   uint32_t *capacity,
+                   uint64_t needed,
+                   size_t size) {
+    if (needed <= *capacity) {
+        return 0;
+    }
+    uint64_t grown = *capacity ? *capacity : 64;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    if (grown > UINT32_MAX) {
+        return -1;
+    }
+    void *resized = realloc(*array, grown * size);
+    if (!resized) {
+        return -1;
+    }
+    *array = resized;
+    *capacity = (uint32_t) grown;
+    return 0;
+}
+
+/* Grows all event columns to hold at least needed events. */
+static int ReserveEvents(HistoryStore *store, uint64_t needed) {
+    void **columns[] = {
+        (void **) &store->device,
+        (void **) &store->interested,
+        (void **) &store->offsetUS,
+        (void **) &store->elapsedUS
+    };
+    uint32_t capacity = 0;
+
+    for (int i = 0; i < 4; i++) {
+        capacity = store->eventCapacity;
+        if (Reserve(columns[i], &capacity, needed, sizeof(uint32_t)) != 0) {
+            return -1;
+        }
+    }
+    capacity = store->eventCapacity;
+    if (Reserve((void **) &store->oldState, &capacity, needed, 1) != 0) {
+        return -1;
+    }
+    capacity = store->eventCapacity;
+    if (Reserve((void **) &store->newState, &capacity, needed, 1) != 0) {
+        return -1;
+    }
+    store->eventCapacity = capacity;
+    return 0;
+}
+
+/* Returns the FNV-1a hash of a string. */
+static uint32_t Hash(const char *string) {
+    uint32_t hash = 2166136261u;
+
+    while (*string) {
+        hash = (hash ^ (uint8_t) *string++) * 16777619u;
+    }
+    return hash;
+}
+
+/* Rebuilds the hash table with the specified power of two slots. */
+static int Rehash(HistoryStore *store, uint32_t slotCount) {
+    uint32_t *slots = calloc(slotCount, sizeof(uint32_t));
+    if (!slots) {
+        return -1;
+    }
+
+    uint32_t mask = slotCount - 1;
+    for (uint32_t symbol = 0; symbol < store->symbolCount; symbol++) {
+        uint32_t i = Hash(store->strings + store->symbols[symbol]) & mask;
+        while (slots[i]) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = symbol + 1;
+    }
+
+    free(store->slots);
+    store->slots = slots;
+    store->slotCount = slotCount;
+    return 0;
+}
+
+uint32_t HistoryIntern(HistoryStore *store, const char *string) {
+    // Keep the hash table at most half full
+    if ((uint64_t) (store->symbolCount + 1) * 2 > store->slotCount &&
+        Rehash(store, store->slotCount ? store->slotCount * 2 : 256) != 0) {
+        return kHistorySymbolNone;
+    }
+
+    uint32_t mask = store->slotCount - 1;
+    uint32_t i = Hash(string) & mask;
+    while (store->slots[i]) {
+        uint32_t symbol = store->slots[i] - 1;
+        if (strcmp(store->strings + store->symbols[symbol], string) == 0) {
+            return symbol;
+        }
+        i = (i + 1) & mask;
+    }
+
+    size_t length = strlen(string) + 1;
+    if (Reserve((void **) &store->strings,
+                &store->stringsCapacity,
+                (uint64_t) store->stringsSize + length,
+                1) != 0 ||
+        Reserve((void **) &store->symbols,
+                &store->symbolCapacity,
+                (uint64_t) store->symbolCount + 1,
+                sizeof(uint32_t)) != 0) {
+        return kHistorySymbolNone;
+    }
+    memcpy(store->strings + store->stringsSize, string, length);
+    store->symbols[store->symbolCount] = store->stringsSize;
+    store->stringsSize += length;
+    store->slots[i] = store->symbolCount + 1;
+    return store->symbolCount++;
+}
+
+const char *HistorySymbolName(const HistoryStore *store, uint32_t symbol) {
+    return store->strings + store->symbols[symbol];
+}
+
+void HistoryTrim(HistoryStore *store, uint32_t count) {
+    if (store->cycleCount <= count) {
+        return;
+    }
+
+    // The events of the cycles are stored in the order of the cycles
+    uint32_t dropped = store->cycleCount - count;
+    uint32_t firstEvent = count > 0 ? store->cycles[dropped].firstEvent
+                                    : store->eventCount;
+    uint32_t events = store->eventCount - firstEvent;
+
+    memmove(store->cycles,
+            store->cycles + dropped,
+            count * sizeof(HistoryCycle));
+    for (uint32_t i = 0; i < count; i++) {
+        store->cycles[i].firstEvent -= firstEvent;
+    }
+    store->cycleCount = count;
+
+    memmove(store->device, store->device + firstEvent, events * 4);
+    memmove(store->interested, store->interested + firstEvent, events * 4);
+    memmove(store->offsetUS, store->offsetUS + firstEvent, events * 4);
+    memmove(store->elapsedUS, store->elapsedUS + firstEvent, events * 4);
+    memmove(store->oldState, store->oldState + firstEvent, events);
+    memmove(store->newState, store->newState + firstEvent, events);
+    store->eventCount = events;
+}
+
+/* Reads an array of count elements, allocating it. */
+static int ReadArray(FILE *file, void **array, uint32_t count, size_t size) {
+    *array = malloc(count ? count * size : 1);
+    if (!*array) {
+        return kHistoryLoadErrorResources;
+    }
+    if (fread(*array, size, count, file) != count) {
+        return kHistoryLoadErrorFormat;
+    }
+    return kHistoryLoadSuccess;
+}
+
+/* Checks that all offsets and symbols refer to existing entries. */
+static int Validate(const HistoryStore *store) {
+    if (store->stringsSize > 0 &&
+        store->strings[store->stringsSize - 1] != '\0') {
+        return -1;
+    }
+    for (uint32_t i = 0; i < store->symbolCount; i++) {
+        if (store->symbols[i] >= store->stringsSize) {
+            return -1;
+        }
+    }
+    uint64_t nextEvent = 0;
+    for (uint32_t i = 0; i < store->cycleCount; i++) {
+        const HistoryCycle *cycle = &store->cycles[i];
+        if (cycle->firstEvent != nextEvent ||
+            memchr(cycle->uuid, '\0', kHistoryUUIDLength) == NULL) {
+            return -1;
+        }
+        nextEvent += cycle->eventCount;
+    }
+    if (nextEvent != store->eventCount) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < store->eventCount; i++) {
+        if (store->device[i] >= store->symbolCount ||
+            (store->interested[i] >= store->symbolCount &&
+             store->interested[i] != kHistorySymbolNone)) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < store->failureCount; i++) {
+        const HistoryFailure *failure = &store->failures[i];
+        if (memchr(failure->uuid, '\0', kHistoryUUIDLength) == NULL ||
+            (failure->driver >= store->symbolCount &&
+             failure->driver != kHistorySymbolNone)) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < store->resumeCount; i++) {
+        if (memchr(store->resumes[i].uuid, '\0', kHistoryUUIDLength) == NULL) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int HistoryLoad(HistoryStore *store, const char *path) {
+    HistoryFileHeader header;
+    struct stat status;
+    int rc;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return kHistoryLoadErrorOpen;
+    }
+    if (fstat(fileno(file), &status) == -1) {
+        fclose(file);
+        return kHistoryLoadErrorOpen;
+    }
+
+    // Check the sizes against the file before allocating anything
+    memset(&header, 0, sizeof(header));
+    size_t headerSize = kHistoryFileHeaderSizes[0];
+    if (fread(&header, headerSize, 1, file) == 1 &&
+        header.version > 1 && header.version <= kHistoryFileVersion) {
+        size_t size = kHistoryFileHeaderSizes[header.version - 1];
+        if (fread((uint8_t *) &header + headerSize,
+                  size - headerSize,
+                  1,
+                  file) != 1) {
+            header.magic = 0;
+        }
+        headerSize = size;
+    }
+    uint64_t expected = headerSize +
+                        (uint64_t) header.stringsSize +
+                        (uint64_t) header.symbolCount * sizeof(uint32_t) +
+                        (uint64_t) header.cycleCount * sizeof(HistoryCycle) +
+                        (uint64_t) header.eventCount * kHistoryEventSize +
+                        (uint64_t) header.failureCount *
+                        sizeof(HistoryFailure) +
+                        (uint64_t) header.resumeCount * sizeof(HistoryResume);
+    if (header.magic != kHistoryFileMagic ||
+        header.version < 1 || header.version > kHistoryFileVersion ||
+        expected != (uint64_t) status.st_size) {
+        fclose(file);
+        return kHistoryLoadErrorFormat;
+    }
+
+    store->stringsSize = store->stringsCapacity = header.stringsSize;
+    store->symbolCount = store->symbolCapacity = header.symbolCount;
+    store->cycleCount = store->cycleCapacity = header.cycleCount;
+    store->eventCount = store->eventCapacity = header.eventCount;
+    store->failureCount = store->failureCapacity = header.failureCount;
+    store->consecutiveFailures = header.consecutiveFailures;
+    store->resumeCount = store->resumeCapacity = header.resumeCount;
+    uint32_t events = header.eventCount;
+    if ((rc = ReadArray(file,
+                        (void **) &store->strings,
+                        header.stringsSize,
+                        1)) != kHistoryLoadSuccess ||
+        (rc = ReadArray(file,
+                        (void **) &store->symbols,
+                        header.symbolCount,
+                        sizeof(uint32_t))) != kHistoryLoadSuccess ||
+        (rc = ReadArray(file,
+                        (void **) &store->cycles,
+                        header.cycleCount,
+                        sizeof(HistoryCycle))) != kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->device, events, 4)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->interested, events, 4)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->offsetUS, events, 4)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->elapsedUS, events, 4)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->oldState, events, 1)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file, (void **) &store->newState, events, 1)) !=
+                kHistoryLoadSuccess ||
+        (rc = ReadArray(file,
+                        (void **) &store->failures,
+                        header.failureCount,
+                        sizeof(HistoryFailure))) != kHistoryLoadSuccess ||
+        (rc = ReadArray(file,
+                        (void **) &store->resumes,
+                        header.resumeCount,
+                        sizeof(HistoryResume))) != kHistoryLoadSuccess) {
+        fclose(file);
+        HistoryFree(store);
+        return rc;
+    }
+    fclose(file);
+
+    if (Validate(store) != 0) {
+        HistoryFree(store);
+        return kHistoryLoadErrorFormat;
+    }
+
+    // Size the hash table for the symbols at most half full
+    uint32_t slotCount = 256;
+    while (slotCount < 2 * (uint64_t) store->symbolCount + 2) {
+        slotCount *= 2;
+    }
+    if (Rehash(store, slotCount) != 0) {
+        HistoryFree(store);
+        return kHistoryLoadErrorResources;
+    }
+    return kHistoryLoadSuccess;
+}
+
+int HistorySave(const HistoryStore *store, const char *path) {
+    HistoryFileHeader header = {
+        kHistoryFileMagic,
+        kHistoryFileVersion,
+        store->stringsSize,
+        store->symbolCount,
+        store->cycleCount,
+        store->eventCount,
+        store->failureCount,
+        store->consecutiveFailures,
+        store->resumeCount
+    };
+    char temporary[1024];
+
+    if ((size_t) snprintf(temporary,
+                          sizeof(temporary),
+                          "%s.tmp",
+                          path) >= sizeof(temporary)) {
+        return -1;
+    }
+    FILE *file = fopen(temporary, "w");
+    if (!file) {
+        return -1;
+    }
+
+    uint32_t events = store->eventCount;
+    int failed =
+            fwrite(&header, sizeof(header), 1, file) != 1 ||
+            fwrite(store->strings, 1, store->stringsSize, file) !=
+                    store->stringsSize ||
+            fwrite(store->symbols, 4, store->symbolCount, file) !=
+                    store->symbolCount ||
+            fwrite(store->cycles, sizeof(HistoryCycle), store->cycleCount,
+                   file) != store->cycleCount ||
+            fwrite(store->device, 4, events, file) != events ||
+            fwrite(store->interested, 4, events, file) != events ||
+            fwrite(store->offsetUS, 4, events, file) != events ||
+            fwrite(store->elapsedUS, 4, events, file) != events ||
+            fwrite(store->oldState, 1, events, file) != events ||
+            fwrite(store->newState, 1, events, file) != events ||
+            fwrite(store->failures, sizeof(HistoryFailure), store->failureCount,
+                   file) != store->failureCount ||
+            fwrite(store->resumes, sizeof(HistoryResume), store->resumeCount,
+                   file) != store->resumeCount;
+    if (fclose(file) != 0) {
+        failed = 1;
+    }
+    if (failed || rename(temporary, path) == -1) {
+        unlink(temporary);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Copies the string to the buffer. Strings that do not fit into the buffer are
+ * truncated.
+ */
+static void CopyCString(CFTypeRef string, char *buffer, CFIndex size) {
+    CFIndex used = 0;
+
+    if (string && CFGetTypeID(string) == CFStringGetTypeID()) {
+        CFIndex length = CFStringGetLength((CFStringRef) string);
+        CFStringGetBytes((CFStringRef) string,
+                         CFRangeMake(0, length),
+                         kCFStringEncodingUTF8,
+                         '?',
+                         false,
+                         (UInt8 *) buffer,
+                         size - 1,
+                         &used);
+    }
+    buffer[used] = '\0';
+}
+
+/* Returns a CFAbsoluteTime stored as CFNumber or CFDate, or 0. */
+static CFAbsoluteTime GetTime(CFTypeRef value) {
+    CFAbsoluteTime time = 0;
+
+    if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef) value, kCFNumberDoubleType, &time);
+    } else if (value && CFGetTypeID(value) == CFDateGetTypeID()) {
+        time = CFDateGetAbsoluteTime((CFDateRef) value);
+    }
+    return time;
+}
+
+/* Returns a CFNumber clamped to [0, maximum], or 0. */
+static uint32_t GetNumber(CFTypeRef value, uint32_t maximum) {
+    long long number = 0;
+
+    if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef) value, kCFNumberLongLongType, &number);
+    }
+    if (number < 0) {
+        return 0;
+    }
+    return number > maximum ? maximum : (uint32_t) number;
+}
+
+/* Returns whether a cycle with the UUID is in the store. */
+static int HasCycle(const HistoryStore *store, const char *uuid) {
+    // Recent cycles are the most likely to be reported again
+    for (uint32_t i = store->cycleCount; i > 0; i--) {
+        if (strcmp(store->cycles[i - 1].uuid, uuid) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Appends a cycle and its transitions returned by IOPMCopyPowerHistoryDetailed.
+ * Returns 0 on success and -1 if memory is exhausted.
+ */
+static int AppendCycle(HistoryStore *store,
+                       const char *uuid,
+                       CFDictionaryRef detailed) {
+    CFTypeRef value;
+    char name[128];
+
+    CFIndex count = 0;
+    CFArrayRef events =
+            CFDictionaryGetValue(detailed,
+                                 CFSTR(kIOPMPowerHistoryEventArrayKey));
+    if (events && CFGetTypeID(events) == CFArrayGetTypeID()) {
+        count = CFArrayGetCount(events);
+    }
+
+    if (Reserve((void **) &store->cycles,
+                &store->cycleCapacity,
+                (uint64_t) store->cycleCount + 1,
+                sizeof(HistoryCycle)) != 0 ||
+        ReserveEvents(store, (uint64_t) store->eventCount + count) != 0) {
+        return -1;
+    }
+
+    HistoryCycle *cycle = &store->cycles[store->cycleCount];
+    strlcpy(cycle->uuid, uuid, sizeof(cycle->uuid));
+    value = CFDictionaryGetValue(detailed,
+                                 CFSTR(kIOPMPowerHistoryTimestampKey));
+    cycle->start = GetTime(value);
+    value = CFDictionaryGetValue(detailed,
+                                 CFSTR(kIOPMPowerHistoryTimestampCompletedKey));
+    cycle->end = GetTime(value);
+    cycle->firstEvent = store->eventCount;
+    cycle->eventCount = 0;
+
+    for (CFIndex i = 0; i < count; i++) {
+        CFDictionaryRef event = CFArrayGetValueAtIndex(events, i);
+        if (!event || CFGetTypeID(event) != CFDictionaryGetTypeID()) {
+            continue;
+        }
+        uint32_t e = store->eventCount;
+
+        value = CFDictionaryGetValue(event,
+                                     CFSTR(kIOPMPowerHistoryDeviceNameKey));
+        CopyCString(value, name, sizeof(name));
+        store->device[e] = HistoryIntern(store, name);
+
+        value = CFDictionaryGetValue(
+                event, CFSTR(kIOPMPowerHistoryInterestedDeviceNameKey));
+        CopyCString(value, name, sizeof(name));
+        store->interested[e] = kHistorySymbolNone;
+        if (name[0]) {
+            store->interested[e] = HistoryIntern(store, name);
+        }
+
+        if (store->device[e] == kHistorySymbolNone ||
+            (name[0] && store->interested[e] == kHistorySymbolNone)) {
+            // Drop the events of the incomplete cycle
+            store->eventCount = cycle->firstEvent;
+            return -1;
+        }
+
+        value = CFDictionaryGetValue(event,
+                                     CFSTR(kIOPMPowerHistoryTimestampKey));
+        double offset = GetTime(value) - cycle->start;
+        if (offset <= 0) {
+            store->offsetUS[e] = 0;
+        } else if (offset >= UINT32_MAX / 1e6) {
+            store->offsetUS[e] = UINT32_MAX;
+        } else {
+            store->offsetUS[e] = (uint32_t) (offset * 1e6);
+        }
+
+        value = CFDictionaryGetValue(event,
+                                     CFSTR(kIOPMPowerHistoryElapsedTimeUSKey));
+        store->elapsedUS[e] = GetNumber(value, UINT32_MAX);
+        value = CFDictionaryGetValue(event,
+                                     CFSTR(kIOPMPowerHistoryOldStateKey));
+        store->oldState[e] = GetNumber(value, UINT8_MAX);
+        value = CFDictionaryGetValue(event,
+                                     CFSTR(kIOPMPowerHistoryNewStateKey));
+        store->newState[e] = GetNumber(value, UINT8_MAX);
+
+        store->eventCount++;
+        cycle->eventCount++;
+    }
+    store->cycleCount++;
+    return 0;
+}
+
+int HistoryCapture(HistoryStore *store, uint32_t *added) {
+    CFArrayRef history = NULL;
+    int rc = kHistoryCaptureSuccess;
+
+    *added = 0;
+    if (IOPMCopyPowerHistory(&history) != kIOReturnSuccess || !history) {
+        return kHistoryCaptureErrorCopy;
+    }
+
+    CFIndex count = CFArrayGetCount(history);
+    for (CFIndex i = 0; i < count && rc == kHistoryCaptureSuccess; i++) {
+        CFDictionaryRef entry = CFArrayGetValueAtIndex(history, i);
+        if (!entry || CFGetTypeID(entry) != CFDictionaryGetTypeID()) {
+            continue;
+        }
+        CFStringRef uuidString =
+                CFDictionaryGetValue(entry, CFSTR(kIOPMPowerHistoryUUIDKey));
+        char uuid[kHistoryUUIDLength];
+        CopyCString(uuidString, uuid, sizeof(uuid));
+        if (uuid[0] == '\0' || HasCycle(store, uuid)) {
+            continue;
+        }
+
+        // Cycles whose details have already been discarded are skipped
+        CFDictionaryRef detailed = NULL;
+        if (IOPMCopyPowerHistoryDetailed(uuidString,
+                                         &detailed) != kIOReturnSuccess ||
+            !detailed) {
+            continue;
+        }
+        if (AppendCycle(store, uuid, detailed) == 0) {
+            (*added)++;
+        } else {
+            rc = kHistoryCaptureErrorResources;
+        }
+        CFRelease(detailed);
+    }
+    CFRelease(history);
+
+    HistoryTrim(store, kHistoryCapacity);
+    return rc;
+}
+
+const HistoryFailure *HistoryFindFailure(const HistoryStore *store,
+                                         const char *uuid) {
+    for (uint32_t i = store->failureCount; i > 0; i--) {
+        if (strcmp(store->failures[i - 1].uuid, uuid) == 0) {
+            return &store->failures[i - 1];
+        }
+    }
+    return NULL;
+}
+
+int HistoryCaptureFailure(HistoryStore *store, uint32_t *added) {
+    CFTypeRef value;
+    char buffer[128];
+
+    *added = 0;
+    CFDictionaryRef failure = IOPMCopySleepWakeFailure();
+    if (!failure) {
+        return kHistoryCaptureSuccess;
+    }
+
+    value = CFDictionaryGetValue(failure, CFSTR(kIOPMSleepWakeFailureUUIDKey));
+    CopyCString(value, buffer, kHistoryUUIDLength);
+    if (buffer[0] == '\0' || HistoryFindFailure(store, buffer)) {
+        CFRelease(failure);
+        return kHistoryCaptureSuccess;
+    }
+
+    // Drop the oldest failure once the store is full
+    if (store->failureCount == kHistoryFailureCapacity) {
+        memmove(store->failures,
+                store->failures + 1,
+                (kHistoryFailureCapacity - 1) * sizeof(HistoryFailure));
+        store->failureCount--;
+    }
+    if (Reserve((void **) &store->failures,
+                &store->failureCapacity,
+                (uint64_t) store->failureCount + 1,
+                sizeof(HistoryFailure)) != 0) {
+        CFRelease(failure);
+        return kHistoryCaptureErrorResources;
+    }
+    HistoryFailure *entry = &store->failures[store->failureCount];
+    memset(entry, 0, sizeof(*entry));
+    strlcpy(entry->uuid, buffer, sizeof(entry->uuid));
+
+    value = CFDictionaryGetValue(failure, CFSTR(kIOPMSleepWakeFailureDateKey));
+    entry->date = GetTime(value);
+    value = CFDictionaryGetValue(failure, CFSTR(kIOPMSleepWakeFailureCodeKey));
+    if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef) value,
+                         kCFNumberSInt64Type,
+                         &entry->statusCode);
+    }
+    value = CFDictionaryGetValue(failure, CFSTR(kIOPMSleepWakeFailureKey));
+    entry->phase = GetNumber(value, UINT8_MAX);
+    value = CFDictionaryGetValue(failure,
+                                 CFSTR(kIOPMSleepWakeFailureLoginKey));
+    entry->loginPhase = GetNumber(value, UINT8_MAX);
+
+    value = CFDictionaryGetValue(failure,
+                                 CFSTR(kIOPMSleepWakeFailureDriverTreeKey));
+    CopyCString(value, buffer, sizeof(buffer));
+    entry->driver = kHistorySymbolNone;
+    if (buffer[0]) {
+        entry->driver = HistoryIntern(store, buffer);
+    }
+    CFRelease(failure);
+
+    store->failureCount++;
+    store->consecutiveFailures++;
+    *added = 1;
+    return kHistoryCaptureSuccess;
+}
+
+int HistoryAddResume(HistoryStore *store, const HistoryResume *resume) {
+    if (store->resumeCount == kHistoryCapacity) {
+        memmove(store->resumes,
+                store->resumes + 1,
+                (kHistoryCapacity - 1) * sizeof(HistoryResume));
+        store->resumeCount--;
+    }
+    if (Reserve((void **) &store->resumes,
+                &store->resumeCapacity,
+                (uint64_t) store->resumeCount + 1,
+                sizeof(HistoryResume)) != 0) {
+        return -1;
+    }
+    store->resumes[store->resumeCount++] = *resume;
+    return 0;
+}
+
+/* Formats a CFAbsoluteTime as local date and time. */
+static void FormatDate(CFAbsoluteTime date, char *buffer, size_t size) {
+    struct tm tm;
+    time_t time = (time_t) (date + kCFAbsoluteTimeIntervalSince1970);
+
+    localtime_r(&time, &tm);
+    strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &tm);
+}
+
+void HistoryPrintResume(const HistoryResume *resume, FILE *stream) {
+    char date[32];
+    char hidReady[16] = "-";
+
+    FormatDate(resume->wakeTime, date, sizeof(date));
+    if (resume->hidReadyLatency >= 0) {
+        snprintf(hidReady,
+                 sizeof(hidReady),
+                 "%.3f s",
+                 resume->hidReadyLatency);
+    }
+    fprintf(stream,
+            "resume %s  %s  powered on %.3f s  HID ready %s  "
+            "(booter %.3f s, image read %.3f s, hardware delta %.3f s)\n",
+            resume->uuid,
+            date,
+            resume->poweredOnLatency,
+            hidReady,
+            resume->booterDuration,
+            resume->imageReadDuration,
+            resume->hardwareDelta);
+}
+
+void HistoryPrint(const HistoryStore *store, FILE *stream) {
+    char date[32];
+
+    for (uint32_t i = 0; i < store->cycleCount; i++) {
+        const HistoryCycle *cycle = &store->cycles[i];
+        uint64_t elapsed = 0;
+        for (uint32_t e = cycle->firstEvent;
+             e < cycle->firstEvent + cycle->eventCount;
+             e++) {
+            elapsed += store->elapsedUS[e];
+        }
+
+        FormatDate(cycle->start, date, sizeof(date));
+        fprintf(stream,
+                "%s  %s  %8.3f s  %5u transitions  %10.3f ms%s\n",
+                cycle->uuid,
+                date,
+                cycle->end > cycle->start ? cycle->end - cycle->start : 0,
+                cycle->eventCount,
+                elapsed / 1e3,
+                HistoryFindFailure(store, cycle->uuid) ? "  failed" : "");
+    }
+
+    for (uint32_t i = 0; i < store->failureCount; i++) {
+        const HistoryFailure *failure = &store->failures[i];
+        FormatDate(failure->date, date, sizeof(date));
+        fprintf(stream,
+                "failure %s  %s  phase 0x%02x  loginwindow 0x%02x  "
+                "status 0x%016llx  %s\n",
+                failure->uuid,
+                date,
+                failure->phase,
+                failure->loginPhase,
+                (unsigned long long) failure->statusCode,
+                failure->driver == kHistorySymbolNone
+                        ? "-"
+                        : HistorySymbolName(store, failure->driver));
+    }
+
+    for (uint32_t i = 0; i < store->resumeCount; i++) {
+        HistoryPrintResume(&store->resumes[i], stream);
+    }
+
+    uint64_t size = sizeof(HistoryFileHeader) +
+                    (uint64_t) store->stringsSize +
+                    (uint64_t) store->symbolCount * sizeof(uint32_t) +
+                    (uint64_t) store->cycleCount * sizeof(HistoryCycle) +
+                    (uint64_t) store->eventCount * kHistoryEventSize +
+                    (uint64_t) store->failureCount * sizeof(HistoryFailure) +
+                    (uint64_t) store->resumeCount * sizeof(HistoryResume);
+    fprintf(stream,
+            "%u cycles, %u transitions, %u devices, %u failures "
+            "(%u consecutive), %llu bytes\n",
+            store->cycleCount,
+            store->eventCount,
+            store->symbolCount,
+            store->failureCount,
+            store->consecutiveFailures,
+            (unsigned long long) size);
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_HISTORY_H
+#define HIBERNATE_HISTORY_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <CoreFoundation/CFDate.h>
+
+/* The default file the power history is stored in. */
+#define kHistoryDefaultPath "/var/db/hibernate.history"
+/* The number of cycles kept, older cycles are dropped. */
+#define kHistoryCapacity 4096
+/* The maximum length of a cycle UUID including the terminating zero. */
+#define kHistoryUUIDLength 40
+/* The number of sleep/wake failures kept, older failures are dropped. */
+#define kHistoryFailureCapacity 256
+/* The symbol of events without an interested device. */
+#define kHistorySymbolNone UINT32_MAX
+
+/* A sleep or wake cycle, a cluster of power events reported by powerd. */
+typedef struct {
+    char uuid[kHistoryUUIDLength];
+    CFAbsoluteTime start;
+    CFAbsoluteTime end;
+    /* The events of the cycle in the event columns. */
+    uint32_t firstEvent;
+    uint32_t eventCount;
+} HistoryCycle;
+
+/*
+ * A failed sleep/wake cycle reported by IOPMCopySleepWakeFailure after the
+ * system has been restarted.
+ */
+typedef struct {
+    /* The UUID of the failed cycle, as in the power history. */
+    char uuid[kHistoryUUIDLength];
+    /* The date the failed sleep has been initiated. */
+    CFAbsoluteTime date;
+    /* The 8-byte failure descriptor of power management. */
+    uint64_t statusCode;
+    /* The symbol of the PCI driver tree the failure occurred in, if any. */
+    uint32_t driver;
+    /* The phase power management and loginwindow have been in. */
+    uint8_t phase;
+    uint8_t loginPhase;
+} HistoryFailure;
+
+/* The resume times of a cycle, measured by hibernate after the wake. */
+typedef struct {
+    char uuid[kHistoryUUIDLength];
+    /* The time of the physical wake event. */
+    CFAbsoluteTime wakeTime;
+    /* The seconds the wake time has been adjusted by with hardware timers. */
+    float hardwareDelta;
+    /* The seconds from the physical wake to kIOMessageSystemHasPoweredOn. */
+    float poweredOnLatency;
+    /* The seconds from the physical wake to HID readiness, or -1. */
+    float hidReadyLatency;
+    /* The booter and image read seconds of the hibernate statistics. */
+    float booterDuration;
+    float imageReadDuration;
+} HistoryResume;
+
+/*
+ * The device power transitions of many cycles. IOPMCopyPowerHistoryDetailed
+ * returns a dictionary with a dozen CF objects per transition. The store keeps
+ * each field in a column of plain integers instead, and device names in a
+ * symbol table, so that a transition takes 18 bytes and a device name is stored
+ * only once for all cycles.
+ */
+typedef struct {
+    /* The interned strings, each terminated by a zero. */
+    char *strings;
+    uint32_t stringsSize;
+    uint32_t stringsCapacity;
+    /* The offset of each symbol in strings. */
+    uint32_t *symbols;
+    uint32_t symbolCount;
+    uint32_t symbolCapacity;
+    /* Open addressing hash table of symbol + 1, 0 marks an empty slot. */
+    uint32_t *slots;
+    uint32_t slotCount;
+
+    HistoryCycle *cycles;
+    uint32_t cycleCount;
+    uint32_t cycleCapacity;
+
+    /* The event columns, all of eventCount entries. */
+    uint32_t *device;
+    uint32_t *interested;
+    /* The time from the start of the cycle to the transition. */
+    uint32_t *offsetUS;
+    /* The time the transition took to complete. */
+    uint32_t *elapsedUS;
+    uint8_t *oldState;
+    uint8_t *newState;
+    uint32_t eventCount;
+    uint32_t eventCapacity;
+
+    HistoryFailure *failures;
+    uint32_t failureCount;
+    uint32_t failureCapacity;
+    /* The number of failures since the last successful wake. */
+    uint32_t consecutiveFailures;
+
+    HistoryResume *resumes;
+    uint32_t resumeCount;
+    uint32_t resumeCapacity;
+} HistoryStore;
+
+/* Initializes an empty store. */
+void HistoryInit(HistoryStore *store);
+
+/* Frees the memory of a store. */
+void HistoryFree(HistoryStore *store);
+
+/*
+ * Returns the symbol of a string, adding it to the symbol table if necessary,
+ * or kHistorySymbolNone if memory is exhausted.
+ */
+uint32_t HistoryIntern(HistoryStore *store, const char *string);
+
+/* Returns the string of a symbol. */
+const char *HistorySymbolName(const HistoryStore *store, uint32_t symbol);
+
+/* Drops the oldest cycles and their events until count cycles are left. */
+void HistoryTrim(HistoryStore *store, uint32_t count);
+
+/* The history has been loaded successfully. */
+#define kHistoryLoadSuccess 0
+/* The file could not be opened or read. */
+#define kHistoryLoadErrorOpen 1
+/* The file is not a history file of this version or it is truncated. */
+#define kHistoryLoadErrorFormat 2
+/* The history could not be allocated. */
+#define kHistoryLoadErrorResources 3
+
+/*
+ * Replaces the contents of an empty store with the history stored in a file.
+ * The file is written in the byte order of the machine, it is not meant to be
+ * copied to other machines.
+ */
+int HistoryLoad(HistoryStore *store, const char *path);
+
+/*
+ * Writes the history to a temporary file that replaces the file at the path.
+ * Returns 0 on success and -1 otherwise.
+ */
+int HistorySave(const HistoryStore *store, const char *path);
+
+/* The power history has been captured. */
+#define kHistoryCaptureSuccess 0
+/* powerd did not return the power history. */
+#define kHistoryCaptureErrorCopy 1
+/* Memory is exhausted. */
+#define kHistoryCaptureErrorResources 2
+
+/*
+ * Appends the cycles reported by IOPMCopyPowerHistory that are not in the store
+ * yet, with the transitions of IOPMCopyPowerHistoryDetailed, and trims the
+ * store to kHistoryCapacity cycles. The number of new cycles is returned in
+ * added.
+ */
+int HistoryCapture(HistoryStore *store, uint32_t *added);
+
+/*
+ * Appends the failure reported by IOPMCopySleepWakeFailure if it is not in the
+ * store yet, and counts it as consecutive failure. The failure is the same for
+ * the whole boot, so it is added once after the system has been restarted. Sets
+ * added to 1 if the failure is new and to 0 otherwise.
+ */
+int HistoryCaptureFailure(HistoryStore *store, uint32_t *added);
+
+/* Returns the failure of the cycle with the UUID or NULL. */
+const HistoryFailure *HistoryFindFailure(const HistoryStore *store,
+                                         const char *uuid);
+
+/*
+ * Appends the resume times of a cycle and drops the oldest ones beyond
+ * kHistoryCapacity. Returns 0 on success and -1 if memory is exhausted.
+ */
+int HistoryAddResume(HistoryStore *store, const HistoryResume *resume);
+
+/*
+ * Prints the resume times of a cycle, the part until the booter has read the
+ * image is spent in firmware and booter, the rest in the operating system.
+ */
+void HistoryPrintResume(const HistoryResume *resume, FILE *stream);
+
+/*
+ * Prints a summary of each cycle, the failures, the resume times and the size
+ * of the store.
+ */
+void HistoryPrint(const HistoryStore *store, FILE *stream);
+
+#endif /* HIBERNATE_HISTORY_H */
@@ -0,0 +1,376 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "image.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int ImageInit(HibernateImage *image, const uint8_t *base, size_t size) {
+    image->base = base;
+    image->size = size;
+    image->mapped = 0;
+
+    if (size < kImagePageSize) {
+        return kImageOpenErrorFormat;
+    }
+    uint32_t signature = ImageGetHeader(image)->signature;
+    if (signature != kIOHibernateHeaderSignature &&
+        signature != kIOHibernateHeaderInvalidSignature) {
+        return kImageOpenErrorFormat;
+    }
+    return kImageOpenSuccess;
+}
+
+int ImageOpen(HibernateImage *image, const char *path) {
+    struct stat status;
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return kImageOpenErrorFile;
+    }
+    if (fstat(fd, &status) == -1) {
+        close(fd);
+        return kImageOpenErrorFile;
+    }
+    if (status.st_size < kImagePageSize) {
+        close(fd);
+        return kImageOpenErrorFormat;
+    }
+
+    void *base = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return kImageOpenErrorFile;
+    }
+
+    int rc = ImageInit(image, base, status.st_size);
+    if (rc != kImageOpenSuccess) {
+        munmap(base, status.st_size);
+        return rc;
+    }
+    image->mapped = 1;
+    return kImageOpenSuccess;
+}
+
+void ImageClose(HibernateImage *image) {
+    if (image->mapped) {
+        munmap((void *) image->base, image->size);
+        image->mapped = 0;
+    }
+}
+
+const IOHibernateImageHeader *ImageGetHeader(const HibernateImage *image) {
+    return (const IOHibernateImageHeader *) image->base;
+}
+
+int ImageGetPreview(const HibernateImage *image,
+                    const hibernate_preview_t **preview,
+                    const uint8_t **pixels) {
+    const IOHibernateImageHeader *header = ImageGetHeader(image);
+
+    if (header->previewSize == 0) {
+        return kImagePreviewErrorMissing;
+    }
+
+    // Locate the preview buffer behind the restore code and the page list,
+    // all sizes are widened to 64 bits so that they cannot overflow
+    uint64_t offset = (uint64_t) kImagePageSize *
+                      (1 + (uint64_t) header->restore1PageCount);
+    if (header->previewPageListSize > header->previewSize ||
+        header->previewPageListSize % sizeof(uint32_t) != 0 ||
+        offset + header->previewSize > image->size) {
+        return kImagePreviewErrorFormat;
+    }
+    offset += header->previewPageListSize;
+    uint64_t size = header->previewSize - header->previewPageListSize;
+    if (size < sizeof(hibernate_preview_t)) {
+        return kImagePreviewErrorFormat;
+    }
+
+    // Check that all images are within the preview buffer
+    const hibernate_preview_t *buffer =
+            (const hibernate_preview_t *) (image->base + offset);
+    if (buffer->imageCount > kIOPreviewImageCount ||
+        (buffer->depth != 16 && buffer->depth != 32)) {
+        return kImagePreviewErrorFormat;
+    }
+    uint64_t pixelCount = (uint64_t) buffer->width * buffer->height;
+    if (buffer->imageCount > 0 &&
+        pixelCount > (size - sizeof(hibernate_preview_t)) /
+                     (buffer->imageCount * (buffer->depth / 8))) {
+        return kImagePreviewErrorFormat;
+    }
+
+    *preview = buffer;
+    *pixels = image->base + offset + sizeof(hibernate_preview_t);
+    return kImagePreviewSuccess;
+}
+
+uint32_t ImageSumPage(const uint8_t *page, uint32_t number) {
+    uint32_t word;
+
+    memcpy(&word,
+           page + (number & (kImagePageSize / 4 - 1)) * sizeof(word),
+           sizeof(word));
+    return word;
+}
+
+/* Returns the offset of the page list, behind the preview buffer. */
+static uint64_t GetPageListOffset(const IOHibernateImageHeader *header) {
+    return (uint64_t) kImagePageSize *
+           (1 + (uint64_t) header->restore1PageCount) + header->previewSize;
+}
+
+int ImageGetPageList(const HibernateImage *image,
+                     const hibernate_page_list_t **list) {
+    const IOHibernateImageHeader *header = ImageGetHeader(image);
+
+    uint64_t offset = GetPageListOffset(header);
+    uint64_t size = header->bitmapSize;
+    if (offset % sizeof(uint32_t) != 0 || offset + size > image->size ||
+        size < sizeof(hibernate_page_list_t)) {
+        return kImagePageListErrorFormat;
+    }
+
+    // Walk the banks, each one must fit into the rest of the list
+    const hibernate_page_list_t *pageList =
+            (const hibernate_page_list_t *) (image->base + offset);
+    if (pageList->list_size > size) {
+        return kImagePageListErrorFormat;
+    }
+    uint64_t position = sizeof(hibernate_page_list_t);
+    for (uint32_t i = 0; i < pageList->bank_count; i++) {
+        if (position + sizeof(hibernate_bitmap_t) > pageList->list_size) {
+            return kImagePageListErrorFormat;
+        }
+        const hibernate_bitmap_t *bank =
+                (const hibernate_bitmap_t *) ((const uint8_t *) pageList +
+                                              position);
+        if (bank->last_page < bank->first_page ||
+            bank->bitmapwords <
+                    ((uint64_t) bank->last_page - bank->first_page + 32) / 32) {
+            return kImagePageListErrorFormat;
+        }
+        position += sizeof(hibernate_bitmap_t) +
+                    (uint64_t) bank->bitmapwords * sizeof(uint32_t);
+        if (position > pageList->list_size) {
+            return kImagePageListErrorFormat;
+        }
+    }
+
+    *list = pageList;
+    return kImagePageListSuccess;
+}
+
+int ImagePageListTest(const hibernate_page_list_t *list, uint32_t page) {
+    const hibernate_bitmap_t *bank = list->bank_bitmap;
+
+    for (uint32_t i = 0; i < list->bank_count; i++) {
+        if (page >= bank->first_page && page <= bank->last_page) {
+            uint32_t index = page - bank->first_page;
+            return (bank->bitmap[index >> 5] & (0x80000000 >> (index & 31)))
+                   != 0;
+        }
+        bank = (const hibernate_bitmap_t *) &bank->bitmap[bank->bitmapwords];
+    }
+    return 0;
+}
+
+int ImagePagesInit(ImagePageIterator *iterator, const HibernateImage *image) {
+    const IOHibernateImageHeader *header = ImageGetHeader(image);
+
+    iterator->image = image;
+    iterator->offset = GetPageListOffset(header) + header->bitmapSize;
+    iterator->image1End = header->image1Size;
+    iterator->end = header->imageSize;
+    iterator->runPage = 0;
+    iterator->runRemaining = 0;
+    if (iterator->offset > iterator->image1End ||
+        iterator->image1End > iterator->end ||
+        iterator->end > image->size) {
+        return kImagePagesErrorFormat;
+    }
+    return kImagePagesSuccess;
+}
+
+/* Reads a uint32_t that must end before the limit. */
+static int ReadWord(ImagePageIterator *iterator,
+                    uint64_t limit,
+                    uint32_t *value) {
+    if (iterator->offset + sizeof(uint32_t) > limit) {
+        return -1;
+    }
+    memcpy(value, iterator->image->base + iterator->offset, sizeof(*value));
+    iterator->offset += sizeof(uint32_t);
+    return 0;
+}
+
+int ImagePagesNext(ImagePageIterator *iterator, ImagePage *page) {
+    // Runs do not cross from image1 into image2
+    int image2 = iterator->offset >= iterator->image1End;
+    uint64_t limit = image2 ? iterator->end : iterator->image1End;
+
+    // Start the next run, empty runs are skipped
+    while (iterator->runRemaining == 0) {
+        if (iterator->offset == limit) {
+            if (image2) {
+                return kImagePagesEnd;
+            }
+            image2 = 1;
+            limit = iterator->end;
+            continue;
+        }
+        uint32_t run[2];
+        if (ReadWord(iterator, limit, &run[0]) != 0 ||
+            ReadWord(iterator, limit, &run[1]) != 0 ||
+            (uint64_t) run[0] + run[1] > (uint64_t) UINT32_MAX + 1) {
+            return kImagePagesErrorFormat;
+        }
+        iterator->runPage = run[0];
+        iterator->runRemaining = run[1];
+    }
+
+    uint32_t tag;
+    if (ReadWord(iterator, limit, &tag) != 0 ||
+        (tag & ~kImageTagLengthMask) != kImageTagSignature) {
+        return kImagePagesErrorFormat;
+    }
+    uint32_t length = tag & kImageTagLengthMask;
+    uint64_t padded = (length + 3) & ~3ULL;
+    if (length == 0 || length > kImagePageSize ||
+        iterator->offset + padded > limit) {
+        return kImagePagesErrorFormat;
+    }
+
+    page->number = iterator->runPage++;
+    page->length = length;
+    page->offset = iterator->offset;
+    page->image2 = image2;
+    iterator->runRemaining--;
+    iterator->offset += padded;
+    return kImagePagesSuccess;
+}
+
+int ImageHandoffInit(ImageHandoffIterator *iterator,
+                     const HibernateImage *image) {
+    const IOHibernateImageHeader *header = ImageGetHeader(image);
+    ImagePageIterator pages;
+    ImagePage page;
+    uint32_t found = 0;
+    int rc;
+
+    iterator->image = image;
+    iterator->pageCount = header->handoffPageCount;
+    iterator->position = 0;
+    if (header->handoffPageCount == 0) {
+        return kImageHandoffErrorMissing;
+    }
+    if (header->handoffPageCount > kImageHandoffMaxPages) {
+        return kImageHandoffErrorFormat;
+    }
+
+    // Look for the handoff pages in image1, each one must be stored once
+    uint64_t first = header->handoffPages;
+    memset(iterator->pageOffsets, 0, sizeof(iterator->pageOffsets));
+    if (ImagePagesInit(&pages, image) != kImagePagesSuccess) {
+        return kImageHandoffErrorFormat;
+    }
+    while ((rc = ImagePagesNext(&pages, &page)) == kImagePagesSuccess &&
+           !page.image2) {
+        if (page.number < first ||
+            page.number - first >= iterator->pageCount) {
+            continue;
+        }
+        uint32_t index = (uint32_t) (page.number - first);
+        if (page.length != kImagePageSize || iterator->pageOffsets[index]) {
+            return kImageHandoffErrorFormat;
+        }
+        iterator->pageOffsets[index] = page.offset;
+        found++;
+    }
+    if ((rc != kImagePagesSuccess && rc != kImagePagesEnd) ||
+        found != iterator->pageCount) {
+        return kImageHandoffErrorFormat;
+    }
+    return kImageHandoffSuccess;
+}
+
+int ImageHandoffRead(const ImageHandoffIterator *iterator,
+                     uint64_t position,
+                     void *buffer,
+                     size_t length) {
+    uint8_t *bytes = buffer;
+
+    if (position > (uint64_t) iterator->pageCount * kImagePageSize ||
+        length > (uint64_t) iterator->pageCount * kImagePageSize - position) {
+        return -1;
+    }
+    while (length > 0) {
+        uint64_t index = position / kImagePageSize;
+        uint64_t inPage = position % kImagePageSize;
+        size_t chunk = kImagePageSize - inPage;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(bytes,
+               iterator->image->base + iterator->pageOffsets[index] + inPage,
+               chunk);
+        bytes += chunk;
+        position += chunk;
+        length -= chunk;
+    }
+    return 0;
+}
+
+int ImageHandoffNext(ImageHandoffIterator *iterator,
+                     ImageHandoffEntry *entry) {
+    IOHibernateHandoff handoff;
+
+    if (ImageHandoffRead(iterator,
+                         iterator->position,
+                         &handoff,
+                         sizeof(handoff)) != 0) {
+        return kImageHandoffErrorFormat;
+    }
+    if (handoff.type == kIOHibernateHandoffTypeEnd) {
+        return kImageHandoffEnd;
+    }
+
+    uint64_t position = iterator->position + sizeof(handoff);
+    if ((uint64_t) handoff.bytecount >
+        (uint64_t) iterator->pageCount * kImagePageSize - position) {
+        return kImageHandoffErrorFormat;
+    }
+    entry->type = handoff.type;
+    entry->bytecount = handoff.bytecount;
+    entry->position = position;
+    iterator->position = position + handoff.bytecount;
+    return kImageHandoffSuccess;
+}
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_IMAGE_H
+#define HIBERNATE_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "IOHibernatePrivate.h"
+
+/* The size of a page in a hibernation image. */
+#define kImagePageSize 4096
+
+/*
+ * A hibernation image in memory, e.g. /var/vm/sleepimage mapped by ImageOpen.
+ * The offline tools read uncompressed and unencrypted images with the sections
+ * in the order the kernel writes them:
+ *
+ *   IOHibernateImageHeader    padded to one page
+ *   restore code              restore1PageCount pages
+ *   preview page list         previewPageListSize bytes
+ *   preview buffer            previewSize - previewPageListSize bytes
+ *   page list                 bitmapSize bytes
+ *   image1 page runs          up to image1Size bytes from the start
+ *   image2 page runs          up to imageSize bytes from the start
+ *
+ * The preview buffer starts with a hibernate_preview_t followed by imageCount
+ * images of width * height pixels with depth bits each, the desktop at
+ * kIOPreviewImageIndexDesktop and the lock screen at
+ * kIOPreviewImageIndexLockScreen.
+ *
+ * The page list is a hibernate_page_list_t of bank_count hibernate_bitmap_t,
+ * each followed by its bitmapwords words. A set bit marks a physical page that
+ * is not saved. Bit 31 of the first word is the first page of the bank.
+ *
+ * The booter restores image1, the pages needed to run the kernel, and the
+ * kernel restores image2. Each run starts with two uint32_t, the first physical
+ * page and the number of pages, followed by each page as a uint32_t tag of
+ * kImageTagSignature and the stored size, and the stored data padded to 4
+ * bytes. Uncompressed images store each page with a size of kImagePageSize.
+ *
+ * restore1Sum, image1Sum and image2Sum are the sums of ImageSumPage over the
+ * restore code, numbered from restore1CodePhysPage, and the pages of image1
+ * and image2. The handoff chain of the booter is a list of IOHibernateHandoff
+ * in handoffPageCount pages of image1 starting at the physical page
+ * handoffPages, which ends with kIOHibernateHandoffTypeEnd.
+ */
+typedef struct {
+    const uint8_t *base;
+    size_t size;
+    /* The image has been mapped by ImageOpen. */
+    int mapped;
+} HibernateImage;
+
+/* The image has been opened successfully. */
+#define kImageOpenSuccess 0
+/* The file could not be opened or mapped. */
+#define kImageOpenErrorFile 1
+/*
+ * The image is smaller than a page or the header signature is neither
+ * kIOHibernateHeaderSignature nor kIOHibernateHeaderInvalidSignature, which
+ * the kernel writes after the image has been restored.
+ */
+#define kImageOpenErrorFormat 2
+
+/* Validates the header of an image in memory. The memory is not copied. */
+int ImageInit(HibernateImage *image, const uint8_t *base, size_t size);
+
+/* Maps the image file read-only and validates the header. */
+int ImageOpen(HibernateImage *image, const char *path);
+
+/* Unmaps an image opened by ImageOpen. */
+void ImageClose(HibernateImage *image);
+
+/* Returns the header of the image. */
+const IOHibernateImageHeader *ImageGetHeader(const HibernateImage *image);
+
+/* The preview has been found. */
+#define kImagePreviewSuccess 0
+/* The image does not contain a preview. */
+#define kImagePreviewErrorMissing 1
+/*
+ * The preview sizes are inconsistent with each other or with the image, or
+ * the size of the preview page list is not a multiple of 4 bytes.
+ */
+#define kImagePreviewErrorFormat 2
+
+/*
+ * Returns the preview header and the pixels of the first preview image. The
+ * pixels of the following images start at the end of the previous one. All
+ * images are guaranteed to be within the image.
+ */
+int ImageGetPreview(const HibernateImage *image,
+                    const hibernate_preview_t **preview,
+                    const uint8_t **pixels);
+
+/* The signature in the upper bits of the tag in front of each page. */
+#define kImageTagSignature 0x53000000
+/* The bits of the tag that hold the stored size of a page. */
+#define kImageTagLengthMask 0x00001fff
+
+/*
+ * Returns the checksum of a page like the kernel computes it, one word of the
+ * page selected by the physical page number.
+ */
+uint32_t ImageSumPage(const uint8_t *page, uint32_t number);
+
+/* The page list has been found. */
+#define kImagePageListSuccess 0
+/*
+ * The page list is not aligned to 4 bytes or exceeds bitmapSize or the
+ * image.
+ */
+#define kImagePageListErrorFormat 1
+
+/*
+ * Returns the page list of the image. All banks are guaranteed to be within
+ * bitmapSize and the image.
+ */
+int ImageGetPageList(const HibernateImage *image,
+                     const hibernate_page_list_t **list);
+
+/*
+ * Returns 1 if the page is marked as not saved in the page list and 0 if it is
+ * saved or outside of all banks.
+ */
+int ImagePageListTest(const hibernate_page_list_t *list, uint32_t page);
+
+/* A page stored in an image. */
+typedef struct {
+    /* The physical page number. */
+    uint32_t number;
+    /* The stored size of the page. */
+    uint32_t length;
+    /* The offset of the stored data in the image. */
+    uint64_t offset;
+    /* The page is part of image2. */
+    int image2;
+} ImagePage;
+
+/* Iterates the pages of an image in the order they are restored. */
+typedef struct {
+    const HibernateImage *image;
+    /* The offset of the next run or tag. */
+    uint64_t offset;
+    uint64_t image1End;
+    uint64_t end;
+    /* The physical page number and the remaining pages of the current run. */
+    uint32_t runPage;
+    uint32_t runRemaining;
+} ImagePageIterator;
+
+/* A page has been returned. */
+#define kImagePagesSuccess 0
+/* All pages have been returned. */
+#define kImagePagesEnd 1
+/*
+ * The sizes of the header are inconsistent with the image or a run or tag is
+ * invalid.
+ */
+#define kImagePagesErrorFormat 2
+
+/* Starts iterating the pages behind the page list. */
+int ImagePagesInit(ImagePageIterator *iterator, const HibernateImage *image);
+
+/*
+ * Returns the next page. Each page is checked to be within its part of the
+ * image before it is returned.
+ */
+int ImagePagesNext(ImagePageIterator *iterator, ImagePage *page);
+
+/* The maximum number of pages of the handoff chain. */
+#define kImageHandoffMaxPages 16
+
+/* An entry of the handoff chain. */
+typedef struct {
+    uint32_t type;
+    uint32_t bytecount;
+    /* The position of the data in the chain, for ImageHandoffRead. */
+    uint64_t position;
+} ImageHandoffEntry;
+
+/*
+ * Iterates the handoff chain. The pages of the chain are not contiguous in the
+ * image, so the chain is read through the offsets of its pages.
+ */
+typedef struct {
+    const HibernateImage *image;
+    uint64_t pageOffsets[kImageHandoffMaxPages];
+    uint32_t pageCount;
+    /* The position of the next entry in the chain. */
+    uint64_t position;
+} ImageHandoffIterator;
+
+/* An entry has been returned or the handoff pages have been found. */
+#define kImageHandoffSuccess 0
+/* The chain has ended with kIOHibernateHandoffTypeEnd. */
+#define kImageHandoffEnd 1
+/* The image has no handoff pages. */
+#define kImageHandoffErrorMissing 2
+/*
+ * A handoff page is not stored uncompressed in image1, there are more than
+ * kImageHandoffMaxPages, or an entry exceeds the pages.
+ */
+#define kImageHandoffErrorFormat 3
+
+/* Finds the handoff pages in image1. */
+int ImageHandoffInit(ImageHandoffIterator *iterator,
+                     const HibernateImage *image);
+
+/* Returns the next entry of the chain. */
+int ImageHandoffNext(ImageHandoffIterator *iterator, ImageHandoffEntry *entry);
+
+/*
+ * Copies bytes of the chain starting at a position. Returns 0 on success and
+ * -1 if they exceed the handoff pages.
+ */
+int ImageHandoffRead(const ImageHandoffIterator *iterator,
+                     uint64_t position,
+                     void *buffer,
+                     size_t length);
+
+#endif /* HIBERNATE_IMAGE_H */
@@ -0,0 +1,609 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* glibc only declares O_DIRECT for GNU sources. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "polled.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "IOHibernatePrivate.h"
+
+/* The largest queue depth and block size of a run. */
+#define kPolledMaxQueueDepth 256
+#define kPolledMaxBlockSize (64 << 20)
+/* The size of a sector, which direct I/O offsets and sizes are multiples of. */
+#define kPolledSectorSize 512
+/* The alignment of the buffers for direct I/O. */
+#define kPolledBufferAlignment 4096
+/* The way the cache is bypassed. */
+#if defined(__APPLE__)
+#define kPolledDirectName "F_NOCACHE"
+#else
+#define kPolledDirectName "O_DIRECT"
+#endif
+/* The size of the writes that extend the file before the first run. */
+#define kPolledPrepareSize (1 << 20)
+
+/* The parameters of a run and what it achieved. */
+typedef struct {
+    uint32_t queueDepth;
+    uint32_t blockSize;
+    uint32_t alignment;
+    uint32_t extentCount;
+    uint64_t writes;
+    double seconds;
+    double latencySum;
+    double latencyMax;
+    /* The errno of the first write or flush that failed, 0 if none did. */
+    int error;
+} PolledRun;
+
+/* A write at a device offset. */
+typedef struct {
+    uint64_t offset;
+    uint32_t length;
+} PolledWrite;
+
+/* The writes of a run, taken in order by the workers. */
+typedef struct {
+    int fd;
+    const PolledWrite *writes;
+    size_t count;
+    size_t next;
+    int failed;
+} PolledQueue;
+
+/* A thread that keeps one write in flight. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    PolledQueue *queue;
+    const uint8_t *buffer;
+    uint64_t writes;
+    double latencySum;
+    double latencyMax;
+    int error;
+} PolledWorker;
+
+static double Now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Returns the next number of a splitmix64 sequence. */
+static uint64_t NextRandom(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint64_t RoundUp(uint64_t value, uint64_t size) {
+    return (value + size - 1) / size * size;
+}
+
+/* Writes a whole buffer at an offset. Returns 0 on success. */
+static int WriteAll(int fd,
+                    const uint8_t *buffer,
+                    size_t length,
+                    off_t offset) {
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t n = pwrite(fd, buffer + done, length - done, offset + done);
+        if (n == -1) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+/* Flushes the writes to the medium, like the kernel at the end of the image. */
+static int Flush(int fd) {
+#if defined(__APPLE__)
+    // fsync only hands the writes to the drive
+    if (fcntl(fd, F_FULLFSYNC) == 0) {
+        return 0;
+    }
+#endif
+    return fsync(fd);
+}
+
+static void *PolledWorkerRun(void *argument) {
+    PolledWorker *worker = argument;
+    PolledQueue *queue = worker->queue;
+
+    while (!__atomic_load_n(&queue->failed, __ATOMIC_RELAXED)) {
+        size_t i = __atomic_fetch_add(&queue->next, 1, __ATOMIC_RELAXED);
+        if (i >= queue->count) {
+            break;
+        }
+        double start = Now();
+        if (WriteAll(queue->fd,
+                     worker->buffer,
+                     queue->writes[i].length,
+                     (off_t) queue->writes[i].offset) != 0) {
+            worker->error = errno;
+            __atomic_store_n(&queue->failed, 1, __ATOMIC_RELAXED);
+            break;
+        }
+        double latency = Now() - start;
+        worker->writes++;
+        worker->latencySum += latency;
+        if (latency > worker->latencyMax) {
+            worker->latencyMax = latency;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the length of the extents of a run, a multiple of the block size of
+ * the file system, and sets the number of extents actually needed.
+ */
+static uint64_t ExtentLength(uint64_t size,
+                             uint32_t extentCount,
+                             uint32_t fileBlockSize,
+                             uint32_t *count) {
+    uint64_t length = RoundUp((size + extentCount - 1) / extentCount,
+                              fileBlockSize);
+
+    *count = (uint32_t) ((size + length - 1) / length);
+    return length;
+}
+
+/* Returns the offset after the last byte a run writes. */
+static uint64_t RunEnd(const PolledRun *run,
+                       uint64_t size,
+                       uint32_t fileBlockSize) {
+    uint32_t count;
+    uint64_t length = ExtentLength(size,
+                                   run->extentCount,
+                                   fileBlockSize,
+                                   &count);
+    return run->alignment + count * length;
+}
+
+/*
+ * Plans the writes of a run: the extents of the file map are shuffled across
+ * the device and written in order in writes of at most the block size.
+ * Returns the writes or NULL if memory could not be allocated.
+ */
+static PolledWrite *PlanWrites(const PolledRun *run,
+                               uint64_t size,
+                               uint32_t fileBlockSize,
+                               size_t *writeCount) {
+    uint32_t count;
+    uint64_t length = ExtentLength(size,
+                                   run->extentCount,
+                                   fileBlockSize,
+                                   &count);
+
+    IOPolledFileExtent *extents = malloc(count * sizeof(*extents));
+    uint32_t *slots = malloc(count * sizeof(*slots));
+    size_t capacity = count + size / run->blockSize + 1;
+    PolledWrite *writes = malloc(capacity * sizeof(*writes));
+    if (!extents || !slots || !writes) {
+        free(writes);
+        writes = NULL;
+        goto out;
+    }
+
+    // The same runs place the extents the same way
+    uint64_t state = run->extentCount;
+    for (uint32_t i = 0; i < count; i++) {
+        slots[i] = i;
+    }
+    for (uint32_t i = count; i > 1; i--) {
+        uint32_t j = NextRandom(&state) % i;
+        uint32_t slot = slots[i - 1];
+        slots[i - 1] = slots[j];
+        slots[j] = slot;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        extents[i].start = slots[i] * length;
+        extents[i].length = size - i * length < length ? size - i * length
+                                                       : length;
+    }
+
+    *writeCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint64_t done = 0; done < extents[i].length; ) {
+            PolledWrite *write = &writes[(*writeCount)++];
+            write->offset = run->alignment + extents[i].start + done;
+            write->length = extents[i].length - done < run->blockSize ?
+                            (uint32_t) (extents[i].length - done) :
+                            run->blockSize;
+            done += write->length;
+        }
+    }
+
+out:
+    free(slots);
+    free(extents);
+    return writes;
+}
+
+/* Writes a run on queueDepth threads. Returns 0 unless memory ran out. */
+static int Run(int fd,
+               uint64_t size,
+               uint32_t fileBlockSize,
+               const uint8_t *buffer,
+               PolledRun *run) {
+    PolledQueue queue = { .fd = fd };
+    size_t count;
+
+    PolledWrite *writes = PlanWrites(run, size, fileBlockSize, &count);
+    PolledWorker *workers = calloc(run->queueDepth, sizeof(*workers));
+    if (!writes || !workers) {
+        free(workers);
+        free(writes);
+        return -1;
+    }
+    queue.writes = writes;
+    queue.count = count;
+
+    // Each worker writes from its own block of the buffer
+    double start = Now();
+    for (uint32_t i = 0; i < run->queueDepth; i++) {
+        workers[i].queue = &queue;
+        workers[i].buffer = buffer + (size_t) i * run->blockSize;
+        workers[i].started = pthread_create(&workers[i].thread,
+                                            NULL,
+                                            PolledWorkerRun,
+                                            &workers[i]) == 0;
+    }
+    for (uint32_t i = 0; i < run->queueDepth; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        } else {
+            PolledWorkerRun(&workers[i]);
+        }
+        run->writes += workers[i].writes;
+        run->latencySum += workers[i].latencySum;
+        if (workers[i].latencyMax > run->latencyMax) {
+            run->latencyMax = workers[i].latencyMax;
+        }
+        if (workers[i].error && !run->error) {
+            run->error = workers[i].error;
+        }
+    }
+    if (!run->error && Flush(fd) != 0) {
+        run->error = errno;
+    }
+    run->seconds = Now() - start;
+
+    free(workers);
+    free(writes);
+    return 0;
+}
+
+/* Returns 1 if each value is between minimum and maximum and a multiple. */
+static int ValuesValid(const uint32_t *values,
+                       unsigned count,
+                       uint32_t minimum,
+                       uint32_t maximum,
+                       uint32_t multiple) {
+    if (count < 1 || count > kPolledMaxValues) {
+        return 0;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (values[i] < minimum || values[i] > maximum ||
+            values[i] % multiple != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Sets the parameters of a run to the values at the indexes. */
+static void SetRun(PolledRun *run,
+                   const uint32_t * const *values,
+                   const unsigned *index) {
+    run->queueDepth = values[0][index[0]];
+    run->blockSize = values[1][index[1]];
+    run->alignment = values[2][index[2]];
+    run->extentCount = values[3][index[3]];
+}
+
+/*
+ * Lists the runs: the baseline, then each other value of a parameter, or all
+ * combinations. Returns the runs or NULL if memory could not be allocated.
+ */
+static PolledRun *ListRuns(const PolledOptions *options, size_t *count) {
+    const uint32_t *values[4] = {
+        options->queueDepths, options->blockSizes,
+        options->alignments, options->extentCounts
+    };
+    unsigned counts[4] = {
+        options->queueDepthCount, options->blockSizeCount,
+        options->alignmentCount, options->extentCountCount
+    };
+    size_t capacity = options->all ? (size_t) counts[0] * counts[1] *
+                                     counts[2] * counts[3]
+                                   : counts[0] + counts[1] + counts[2] +
+                                     counts[3] - 3;
+    PolledRun *runs = calloc(capacity, sizeof(*runs));
+    if (!runs) {
+        return NULL;
+    }
+
+    *count = 0;
+    if (options->all) {
+        for (size_t i = 0; i < capacity; i++) {
+            unsigned index[4];
+            size_t rest = i;
+            for (int j = 3; j >= 0; j--) {
+                index[j] = rest % counts[j];
+                rest /= counts[j];
+            }
+            SetRun(&runs[(*count)++], values, index);
+        }
+        return runs;
+    }
+
+    unsigned index[4] = { 0, 0, 0, 0 };
+    SetRun(&runs[(*count)++], values, index);
+    for (int j = 0; j < 4; j++) {
+        for (unsigned k = 1; k < counts[j]; k++) {
+            index[j] = k;
+            SetRun(&runs[(*count)++], values, index);
+        }
+        index[j] = 0;
+    }
+    return runs;
+}
+
+void PolledOptionsInit(PolledOptions *options) {
+    static const uint32_t kQueueDepths[] = { 2, 1, 4, 8, 16, 32 };
+    static const uint32_t kBlockSizes[] = {
+        128 << 10, 16 << 10, 64 << 10, 256 << 10, 1 << 20
+    };
+    static const uint32_t kAlignments[] = { 0, 512, 2048 };
+    static const uint32_t kExtentCounts[] = { 1, 16, 256, 4096 };
+
+    memset(options, 0, sizeof(*options));
+    options->size = kPolledDefaultSize;
+    memcpy(options->queueDepths, kQueueDepths, sizeof(kQueueDepths));
+    options->queueDepthCount = sizeof(kQueueDepths) / sizeof(*kQueueDepths);
+    memcpy(options->blockSizes, kBlockSizes, sizeof(kBlockSizes));
+    options->blockSizeCount = sizeof(kBlockSizes) / sizeof(*kBlockSizes);
+    memcpy(options->alignments, kAlignments, sizeof(kAlignments));
+    options->alignmentCount = sizeof(kAlignments) / sizeof(*kAlignments);
+    memcpy(options->extentCounts, kExtentCounts, sizeof(kExtentCounts));
+    options->extentCountCount = sizeof(kExtentCounts) /
+                                sizeof(*kExtentCounts);
+}
+
+/*
+ * Opens or creates the file and bypasses the cache if possible. Returns the
+ * descriptor or -1, and the status of the file.
+ */
+static int OpenFile(const char *path, int *direct, struct stat *status) {
+    int fd;
+
+#if defined(__APPLE__)
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    *direct = fd != -1 && fcntl(fd, F_NOCACHE, 1) == 0;
+#elif defined(O_DIRECT)
+    // Some file systems like tmpfs do not support direct I/O
+    fd = open(path, O_RDWR | O_CREAT | O_DIRECT, 0644);
+    *direct = fd != -1;
+    if (fd == -1 && errno == EINVAL) {
+        fd = open(path, O_RDWR | O_CREAT, 0644);
+    }
+#else
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    *direct = 0;
+#endif
+    if (fd == -1) {
+        return -1;
+    }
+
+    // Never write to a device or anything else but a regular file
+    if (fstat(fd, status) == -1) {
+        close(fd);
+        return -1;
+    }
+    if (!S_ISREG(status->st_mode)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Extends the file to its size by writing zeros, so that the runs overwrite
+ * allocated blocks like the kernel does. Returns 0 on success.
+ */
+static int PrepareFile(int fd, uint64_t size, uint8_t *buffer) {
+    struct stat status;
+
+    if (fstat(fd, &status) == -1) {
+        return -1;
+    }
+    memset(buffer, 0, kPolledPrepareSize);
+    uint64_t offset = (uint64_t) status.st_size / kPolledBufferAlignment *
+                      kPolledBufferAlignment;
+    while (offset < size) {
+        uint64_t length = size - offset < kPolledPrepareSize ?
+                          RoundUp(size - offset, kPolledBufferAlignment) :
+                          kPolledPrepareSize;
+        if (WriteAll(fd, buffer, length, (off_t) offset) != 0) {
+            return -1;
+        }
+        offset += length;
+    }
+    return Flush(fd);
+}
+
+int PolledBenchmark(const char *path,
+                    const PolledOptions *options,
+                    uint64_t projectedBytes,
+                    FILE *stream) {
+    struct stat status;
+    int direct;
+
+    if (options->size < kPolledSectorSize ||
+        !ValuesValid(options->queueDepths,
+                     options->queueDepthCount,
+                     1,
+                     kPolledMaxQueueDepth,
+                     1) ||
+        !ValuesValid(options->blockSizes,
+                     options->blockSizeCount,
+                     kPolledSectorSize,
+                     kPolledMaxBlockSize,
+                     kPolledSectorSize) ||
+        !ValuesValid(options->alignments,
+                     options->alignmentCount,
+                     0,
+                     kPolledMaxBlockSize,
+                     1) ||
+        !ValuesValid(options->extentCounts,
+                     options->extentCountCount,
+                     1,
+                     UINT32_MAX,
+                     1)) {
+        return kPolledBenchmarkErrorOptions;
+    }
+
+    size_t runCount;
+    PolledRun *runs = ListRuns(options, &runCount);
+    if (!runs) {
+        return kPolledBenchmarkErrorResources;
+    }
+    int fd = OpenFile(path, &direct, &status);
+    if (fd == -1) {
+        free(runs);
+        return kPolledBenchmarkErrorFile;
+    }
+
+    // Extents are multiples of the block size of the file system
+    uint32_t fileBlockSize = status.st_blksize > kPolledSectorSize ?
+                             (uint32_t) status.st_blksize : kPolledSectorSize;
+    uint64_t size = RoundUp(options->size, kPolledSectorSize);
+    uint64_t fileSize = 0;
+    size_t bufferSize = kPolledPrepareSize;
+    for (size_t i = 0; i < runCount; i++) {
+        uint64_t end = RunEnd(&runs[i], size, fileBlockSize);
+        if (end > fileSize) {
+            fileSize = end;
+        }
+        if ((size_t) runs[i].queueDepth * runs[i].blockSize > bufferSize) {
+            bufferSize = (size_t) runs[i].queueDepth * runs[i].blockSize;
+        }
+    }
+
+    void *buffer = NULL;
+    int rc = kPolledBenchmarkSuccess;
+    if (posix_memalign(&buffer, kPolledBufferAlignment, bufferSize) != 0) {
+        buffer = NULL;
+        rc = kPolledBenchmarkErrorResources;
+        goto out;
+    }
+    fprintf(stream,
+            "preparing %.1f MB in %s\n",
+            fileSize / 1048576.0,
+            path);
+    if (PrepareFile(fd, fileSize, buffer) != 0) {
+        rc = kPolledBenchmarkErrorFile;
+        goto out;
+    }
+
+    // Random data, in case the drive compresses or deduplicates
+    uint64_t state = 1;
+    for (size_t i = 0; i + sizeof(uint64_t) <= bufferSize; i += 8) {
+        uint64_t value = NextRandom(&state);
+        memcpy((uint8_t *) buffer + i, &value, sizeof(value));
+    }
+
+    fprintf(stream,
+            "writing %.1f MB per run %s\n\n"
+            "%5s %8s %6s %7s %9s %8s %8s\n",
+            size / 1048576.0,
+            direct ? "with " kPolledDirectName
+                   : "through the cache (direct I/O is not supported)",
+            "depth",
+            "block KB",
+            "base",
+            "extents",
+            "MB/s",
+            "mean ms",
+            "max ms");
+    for (size_t i = 0; i < runCount; i++) {
+        PolledRun *run = &runs[i];
+        if (Run(fd, size, fileBlockSize, buffer, run) != 0) {
+            rc = kPolledBenchmarkErrorResources;
+            goto out;
+        }
+        fprintf(stream,
+                "%5u %8.1f %6u %7u",
+                run->queueDepth,
+                run->blockSize / 1024.0,
+                run->alignment,
+                run->extentCount);
+        if (run->error) {
+            fprintf(stream, "  failed: %s\n", strerror(run->error));
+            continue;
+        }
+        fprintf(stream,
+                " %9.1f %8.2f %8.2f\n",
+                run->seconds > 0 ? size / run->seconds / 1e6 : 0,
+                run->writes > 0 ? run->latencySum / run->writes * 1e3 : 0,
+                run->latencyMax * 1e3);
+    }
+
+    // The first run is the baseline unless all combinations are swept
+    if (projectedBytes > 0 && !options->all && !runs[0].error &&
+        runs[0].seconds > 0) {
+        double rate = size / runs[0].seconds;
+        fprintf(stream,
+                "\nwriting an image of %.1f MB at the baseline takes %.1f s\n",
+                projectedBytes / 1048576.0,
+                projectedBytes / rate);
+    }
+
+out:
+    free(buffer);
+    free(runs);
+    close(fd);
+    return rc;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_POLLED_H
+#define HIBERNATE_POLLED_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The maximum number of values of a parameter that are swept. */
+#define kPolledMaxValues 16
+/* The default number of bytes written by each run, 1 GB. */
+#define kPolledDefaultSize (1ULL << 30)
+/*
+ * The parameters of the polled writes of the kernel and the baseline of the
+ * sweep. The kernel writes from two halves of its I/O buffer alternately, so
+ * at most two writes are in flight.
+ */
+#define kPolledBaselineQueueDepth 2
+#define kPolledBaselineBlockSize (128 << 10)
+
+/*
+ * The values of each parameter to sweep. The first value is the baseline, and
+ * each parameter is swept with the others at their baselines unless all is set.
+ */
+typedef struct {
+    /* The bytes written by each run. */
+    uint64_t size;
+    /* The writes in flight at a time. */
+    uint32_t queueDepths[kPolledMaxValues];
+    unsigned queueDepthCount;
+    /* The bytes of each write, a multiple of 512. */
+    uint32_t blockSizes[kPolledMaxValues];
+    unsigned blockSizeCount;
+    /* The deviceBase of the writes, a multiple of 512 for direct I/O. */
+    uint32_t alignments[kPolledMaxValues];
+    unsigned alignmentCount;
+    /* The number of extents of the file, in shuffled order on the device. */
+    uint32_t extentCounts[kPolledMaxValues];
+    unsigned extentCountCount;
+    /* Runs every combination of the values. */
+    int all;
+} PolledOptions;
+
+/* The benchmark has completed, runs that failed have been reported. */
+#define kPolledBenchmarkSuccess 0
+/* The file could not be opened or prepared, errno is set. */
+#define kPolledBenchmarkErrorFile 1
+/* A value is out of range. */
+#define kPolledBenchmarkErrorOptions 2
+/* Memory could not be allocated. */
+#define kPolledBenchmarkErrorResources 3
+
+/*
+ * Initializes the options to sweep queue depths of 2, 1, 4, 8, 16 and 32,
+ * blocks of 128 KB, 16 KB, 64 KB, 256 KB and 1 MB, a deviceBase of 0, 512 and
+ * 2048 and 1, 16, 256 and 4096 extents.
+ */
+void PolledOptionsInit(PolledOptions *options);
+
+/*
+ * Writes to a regular file on the device under test the way the kernel writes
+ * the image to the polled file: the file is described by IOPolledFileExtent
+ * extents and written in order, each extent at deviceBase plus its start, in
+ * writes of at most the block size that do not cross extents. The file is
+ * opened with O_DIRECT or F_NOCACHE so that writes bypass the cache, and every
+ * run ends with a flush of the device. The throughput and write latency of
+ * each run is printed. If projectedBytes is not zero, the time writing that
+ * many bytes would take at the baseline is printed as well.
+ */
+int PolledBenchmark(const char *path,
+                    const PolledOptions *options,
+                    uint64_t projectedBytes,
+                    FILE *stream);
+
+#endif /* HIBERNATE_POLLED_H */
@@ -0,0 +1,378 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "prefetch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* A saved page in image order. */
+typedef struct {
+    uint32_t number;
+    uint32_t image2 : 1;
+    uint32_t touched : 1;
+    uint32_t recommended : 1;
+    /* The bytes the page takes in the image, including its tag. */
+    uint32_t size : 29;
+    /*
+     * The offset of the end of the page in image2, and that offset once the
+     * recommended pages have been moved into image1.
+     */
+    uint64_t end;
+    uint64_t movedEnd;
+} PrefetchPage;
+
+/* A page number and the index of the page in image order. */
+typedef struct {
+    uint32_t number;
+    uint32_t index;
+} PrefetchIndex;
+
+/* The marker of an access to a page that is not in the image. */
+#define kPrefetchMissing UINT32_MAX
+
+/* A growing array of 32 bit values. */
+typedef struct {
+    uint32_t *values;
+    size_t count;
+    size_t capacity;
+} PrefetchArray;
+
+/* Appends a value. Returns 0 on success and -1 otherwise. */
+static int ArrayAppend(PrefetchArray *array, uint32_t value) {
+    if (array->count == array->capacity) {
+        size_t capacity = array->capacity ? array->capacity * 2 : 1024;
+        uint32_t *values = realloc(array->values,
+                                   capacity * sizeof(*values));
+        if (!values) {
+            return -1;
+        }
+        array->values = values;
+        array->capacity = capacity;
+    }
+    array->values[array->count++] = value;
+    return 0;
+}
+
+static int CompareIndex(const void *a, const void *b) {
+    const PrefetchIndex *left = a;
+    const PrefetchIndex *right = b;
+
+    if (left->number != right->number) {
+        return left->number < right->number ? -1 : 1;
+    }
+    return left->index < right->index ? -1 : left->index > right->index;
+}
+
+/* Returns the index of the page in image order or kPrefetchMissing. */
+static uint32_t FindPage(const PrefetchIndex *lookup,
+                         size_t count,
+                         uint32_t number) {
+    size_t low = 0;
+    size_t high = count;
+
+    // Find the first entry, duplicate pages are restored in image order
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (lookup[middle].number < number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low < count && lookup[low].number == number) {
+        return lookup[low].index;
+    }
+    return kPrefetchMissing;
+}
+
+/*
+ * Reads the page numbers of the trace into accesses as indexes of pages.
+ * Returns 0 on success and -1 if the trace could not be read or is invalid.
+ */
+static int ReadTrace(const char *path,
+                     const PrefetchIndex *lookup,
+                     size_t count,
+                     PrefetchArray *accesses) {
+    char buffer[128];
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    int rc = 0;
+    while (rc == 0 && fgets(buffer, sizeof(buffer), file)) {
+        char *text = buffer + strspn(buffer, " \t");
+        if (*text == '#' || *text == '\n' || *text == '\0') {
+            continue;
+        }
+        char *end;
+        unsigned long long number = strtoull(text, &end, 0);
+        end += strspn(end, " \t\r\n");
+        if (end == text || *end != '\0' || number > UINT32_MAX) {
+            rc = -1;
+            break;
+        }
+        rc = ArrayAppend(accesses,
+                         FindPage(lookup, count, (uint32_t) number));
+    }
+    if (ferror(file)) {
+        rc = -1;
+    }
+    fclose(file);
+    return rc;
+}
+
+/* Replays the accesses against the image order, with or without moving. */
+static void Simulate(const PrefetchPage *pages,
+                     const PrefetchArray *accesses,
+                     uint64_t image1Bytes,
+                     double readRate,
+                     int moved,
+                     PrefetchWake *wake) {
+    wake->image1Seconds = image1Bytes / readRate;
+    wake->stalls = 0;
+
+    // The trace starts once the kernel runs and takes no time itself
+    double now = wake->image1Seconds;
+    for (size_t i = 0; i < accesses->count; i++) {
+        if (accesses->values[i] == kPrefetchMissing) {
+            continue;
+        }
+        const PrefetchPage *page = &pages[accesses->values[i]];
+        if (!page->image2 || (moved && page->recommended)) {
+            continue;
+        }
+        double ready = wake->image1Seconds +
+                       (moved ? page->movedEnd : page->end) / readRate;
+        if (ready > now) {
+            now = ready;
+            wake->stalls++;
+        }
+    }
+    wake->readySeconds = now;
+}
+
+int PrefetchAnalyze(const HibernateImage *image,
+                    const char *tracePath,
+                    double readRate,
+                    uint64_t budget,
+                    FILE *recommendation,
+                    PrefetchReport *report) {
+    const hibernate_page_list_t *list;
+    ImagePageIterator iterator;
+    ImagePage page;
+    PrefetchPage *pages = NULL;
+    PrefetchIndex *lookup = NULL;
+    PrefetchArray accesses = { NULL, 0, 0 };
+    PrefetchArray touched = { NULL, 0, 0 };
+    size_t count = 0;
+    size_t capacity = 0;
+    int rc;
+
+    memset(report, 0, sizeof(*report));
+    report->readRate = readRate;
+    if (ImageGetPageList(image, &list) != kImagePageListSuccess ||
+        ImagePagesInit(&iterator, image) != kImagePagesSuccess) {
+        return kPrefetchAnalyzeErrorFormat;
+    }
+    uint64_t image1End = iterator.image1End;
+    report->image1Bytes = image1End;
+    report->image2Bytes = iterator.end - image1End;
+
+    // Collect the saved pages in the order they are restored
+    while ((rc = ImagePagesNext(&iterator, &page)) == kImagePagesSuccess) {
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            PrefetchPage *grown = realloc(pages, capacity * sizeof(*pages));
+            if (!grown) {
+                rc = kPrefetchAnalyzeErrorResources;
+                goto out;
+            }
+            pages = grown;
+        }
+        PrefetchPage *entry = &pages[count++];
+        uint32_t size = sizeof(uint32_t) + ((page.length + 3) & ~3U);
+        entry->number = page.number;
+        entry->image2 = page.image2;
+        entry->touched = 0;
+        entry->recommended = 0;
+        entry->size = size;
+        entry->end = page.image2 ? page.offset + size - sizeof(uint32_t) -
+                                   image1End
+                                 : 0;
+        if (page.image2) {
+            report->image2Pages++;
+        } else {
+            report->image1Pages++;
+        }
+        if (ImagePageListTest(list, page.number)) {
+            report->unsavedPages++;
+        }
+    }
+    if (rc != kImagePagesEnd || count >= kPrefetchMissing) {
+        rc = kPrefetchAnalyzeErrorFormat;
+        goto out;
+    }
+
+    // Sort the pages by number to look up the accesses
+    lookup = malloc((count ? count : 1) * sizeof(*lookup));
+    if (!lookup) {
+        rc = kPrefetchAnalyzeErrorResources;
+        goto out;
+    }
+    for (size_t i = 0; i < count; i++) {
+        lookup[i].number = pages[i].number;
+        lookup[i].index = (uint32_t) i;
+    }
+    qsort(lookup, count, sizeof(*lookup), CompareIndex);
+
+    if (ReadTrace(tracePath, lookup, count, &accesses) != 0) {
+        rc = kPrefetchAnalyzeErrorTrace;
+        goto out;
+    }
+
+    // Classify the accesses and remember the order of first access
+    for (size_t i = 0; i < accesses.count; i++) {
+        uint32_t index = accesses.values[i];
+        report->accesses++;
+        if (index == kPrefetchMissing) {
+            report->missingAccesses++;
+        } else if (!pages[index].image2) {
+            report->image1Accesses++;
+        } else {
+            report->image2Accesses++;
+            if (!pages[index].touched) {
+                pages[index].touched = 1;
+                if (ArrayAppend(&touched, index) != 0) {
+                    rc = kPrefetchAnalyzeErrorResources;
+                    goto out;
+                }
+            }
+        }
+    }
+    report->image2Touched = (uint32_t) touched.count;
+
+    // Every page is ready once the last accessed page of image2 has been read,
+    // so only moving the accessed pages read last ends the wait earlier. The
+    // untouched pages between them no longer have to be read before
+    for (size_t i = count; i > 0; i--) {
+        PrefetchPage *entry = &pages[i - 1];
+        if (!entry->touched) {
+            continue;
+        }
+        if (report->recommendedBytes + entry->size > budget) {
+            break;
+        }
+        entry->recommended = 1;
+        report->recommendedPages++;
+        report->recommendedBytes += entry->size;
+    }
+    if (recommendation) {
+        for (size_t i = 0; i < touched.count; i++) {
+            const PrefetchPage *entry = &pages[touched.values[i]];
+            if (entry->recommended) {
+                fprintf(recommendation, "0x%x\n", entry->number);
+            }
+        }
+    }
+
+    // The pages behind a moved page are read that much earlier
+    uint64_t moved = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (pages[i].image2) {
+            if (pages[i].recommended) {
+                moved += pages[i].size;
+            }
+            pages[i].movedEnd = pages[i].end - moved;
+        }
+    }
+
+    Simulate(pages,
+             &accesses,
+             report->image1Bytes,
+             readRate,
+             0,
+             &report->current);
+    Simulate(pages,
+             &accesses,
+             report->image1Bytes + report->recommendedBytes,
+             readRate,
+             1,
+             &report->recommended);
+    rc = kPrefetchAnalyzeSuccess;
+
+out:
+    free(pages);
+    free(lookup);
+    free(accesses.values);
+    free(touched.values);
+    return rc;
+}
+
+void PrefetchPrint(const PrefetchReport *report, FILE *stream) {
+    double rate = report->readRate;
+
+    fprintf(stream,
+            "image1: %u pages, %.1f MB, %.3f s\n"
+            "image2: %u pages, %.1f MB, %.3f s\n",
+            report->image1Pages,
+            report->image1Bytes / 1e6,
+            report->image1Bytes / rate,
+            report->image2Pages,
+            report->image2Bytes / 1e6,
+            report->image2Bytes / rate);
+    if (report->unsavedPages > 0) {
+        fprintf(stream,
+                "%u saved pages are marked as not saved in the page list\n",
+                report->unsavedPages);
+    }
+    fprintf(stream,
+            "trace: %llu accesses, %llu in image1, %llu in image2 "
+            "(%u pages), %llu not in the image\n",
+            (unsigned long long) report->accesses,
+            (unsigned long long) report->image1Accesses,
+            (unsigned long long) report->image2Accesses,
+            report->image2Touched,
+            (unsigned long long) report->missingAccesses);
+    fprintf(stream,
+            "current order:   ready after %.3f s, %.3f s waiting for "
+            "image2, %llu stalls\n",
+            report->current.readySeconds,
+            report->current.readySeconds - report->current.image1Seconds,
+            (unsigned long long) report->current.stalls);
+    fprintf(stream,
+            "recommended:     ready after %.3f s, %.3f s waiting for "
+            "image2, %llu stalls\n"
+            "                 %u pages (%.1f MB) moved into image1, "
+            "%.3f s saved\n",
+            report->recommended.readySeconds,
+            report->recommended.readySeconds -
+                    report->recommended.image1Seconds,
+            (unsigned long long) report->recommended.stalls,
+            report->recommendedPages,
+            report->recommendedBytes / 1e6,
+            report->current.readySeconds - report->recommended.readySeconds);
+}
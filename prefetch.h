@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_PREFETCH_H
+#define HIBERNATE_PREFETCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "image.h"
+
+/*
+ * The bytes per second the image is read at on wake if the statistics of the
+ * last wake are unavailable.
+ */
+#define kPrefetchDefaultReadRate 1000e6
+/* The default number of bytes that may be moved into image1. */
+#define kPrefetchDefaultBudget (64ULL << 20)
+
+/*
+ * The result of simulating a wake. The booter reads image1 at the read rate,
+ * then the kernel reads image2 in image order at the same rate. The accesses
+ * of the trace are replayed in order once image1 has been read, and an access
+ * to a page of image2 waits until the page has been read.
+ */
+typedef struct {
+    /* The seconds until image1 has been read. */
+    double image1Seconds;
+    /* The seconds until all pages of the trace have been read. */
+    double readySeconds;
+    /* The accesses that had to wait for the image2 read. */
+    uint64_t stalls;
+} PrefetchWake;
+
+/* The result of analyzing an image with an access trace. */
+typedef struct {
+    /* The pages in each part and the size of each part in the image. */
+    uint32_t image1Pages;
+    uint32_t image2Pages;
+    uint64_t image1Bytes;
+    uint64_t image2Bytes;
+    /* Saved pages that are marked as not saved in the page list. */
+    uint32_t unsavedPages;
+    /* The accesses of the trace, in image1, in image2 and not in the image. */
+    uint64_t accesses;
+    uint64_t image1Accesses;
+    uint64_t image2Accesses;
+    uint64_t missingAccesses;
+    /* The distinct pages of image2 accessed. */
+    uint32_t image2Touched;
+    /* The pages of image2 recommended for image1 and their size. */
+    uint32_t recommendedPages;
+    uint64_t recommendedBytes;
+    /* The bytes per second the simulation reads at. */
+    double readRate;
+    /* The wake with the current order and with the recommended pages moved. */
+    PrefetchWake current;
+    PrefetchWake recommended;
+} PrefetchReport;
+
+/* The image has been analyzed successfully. */
+#define kPrefetchAnalyzeSuccess 0
+/* The trace could not be read. */
+#define kPrefetchAnalyzeErrorTrace 1
+/* The page runs or the page list of the image are invalid. */
+#define kPrefetchAnalyzeErrorFormat 2
+/* Memory could not be allocated. */
+#define kPrefetchAnalyzeErrorResources 3
+
+/*
+ * Replays the access trace against the restore order of the image and
+ * recommends the pages of image2 that should be in image1: the accessed pages
+ * read last, up to budget bytes, because the last of them decides when the
+ * trace is ready. The trace has one physical page number per line, decimal or
+ * hexadecimal with 0x, and comments starting with #. If recommendation is not
+ * NULL, the recommended pages are written to it in the same format, in the
+ * order of their first access.
+ */
+int PrefetchAnalyze(const HibernateImage *image,
+                    const char *tracePath,
+                    double readRate,
+                    uint64_t budget,
+                    FILE *recommendation,
+                    PrefetchReport *report);
+
+/* Prints the report. */
+void PrefetchPrint(const PrefetchReport *report, FILE *stream);
+
+#endif /* HIBERNATE_PREFETCH_H */
@@ -0,0 +1,543 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "preview.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The channels of a pixel, which are filtered together by the vector unit. */
+typedef float Float4 __attribute__((vector_size(16)));
+
+/* The input pixels that contribute to an output pixel. */
+typedef struct {
+    uint32_t first;
+    uint32_t count;
+} FilterSpan;
+
+/* The filter weights for resizing one dimension. */
+typedef struct {
+    FilterSpan *spans;
+    /* taps weights per output pixel. */
+    float *weights;
+    uint32_t taps;
+} FilterTable;
+
+static double FilterBox(double x) {
+    return x >= -0.5 && x < 0.5 ? 1 : 0;
+}
+
+static double FilterLanczos(double x) {
+    if (x == 0) {
+        return 1;
+    }
+    if (x <= -3 || x >= 3) {
+        return 0;
+    }
+    double px = M_PI * x;
+    return 3 * sin(px) * sin(px / 3) / (px * px);
+}
+
+/*
+ * Computes the weights for resizing inSize to outSize pixels. Returns 0 on
+ * success and -1 if the table could not be allocated.
+ */
+static int FilterTableInit(FilterTable *table,
+                           uint32_t inSize,
+                           uint32_t outSize,
+                           int filter) {
+    double (*kernel)(double) = FilterBox;
+    double radius = 0.5;
+    if (filter == kPreviewFilterLanczos) {
+        kernel = FilterLanczos;
+        radius = 3;
+    }
+
+    // Stretch the filter when downscaling, so that it covers all input pixels
+    double scale = (double) inSize / outSize;
+    double stretch = scale > 1 ? scale : 1;
+    double support = radius * stretch;
+
+    table->taps = (uint32_t) ceil(2 * support) + 1;
+    table->spans = (FilterSpan *) malloc(outSize * sizeof(FilterSpan));
+    table->weights = (float *) malloc((size_t) outSize * table->taps *
+                                      sizeof(float));
+    if (!table->spans || !table->weights) {
+        free(table->spans);
+        free(table->weights);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < outSize; i++) {
+        FilterSpan *span = &table->spans[i];
+        float *weights = &table->weights[(size_t) i * table->taps];
+        double center = (i + 0.5) * scale - 0.5;
+        double first = ceil(center - support);
+        double last = floor(center + support);
+        if (first < 0) {
+            first = 0;
+        }
+        if (last > inSize - 1) {
+            last = inSize - 1;
+        }
+        if (last - first + 1 > table->taps) {
+            last = first + table->taps - 1;
+        }
+
+        double sum = 0;
+        span->first = (uint32_t) first;
+        span->count = 0;
+        for (double x = first; x <= last; x++) {
+            double weight = kernel((x - center) / stretch);
+            weights[span->count++] = (float) weight;
+            sum += weight;
+        }
+
+        if (sum == 0) {
+            // Fall back to the nearest pixel
+            double nearest = floor(center + 0.5);
+            span->first = nearest < 0 ? 0 : nearest > inSize - 1
+                          ? inSize - 1 : (uint32_t) nearest;
+            span->count = 1;
+            weights[0] = 1;
+        } else {
+            for (uint32_t j = 0; j < span->count; j++) {
+                weights[j] = (float) (weights[j] / sum);
+            }
+        }
+    }
+    return 0;
+}
+
+static void FilterTableRelease(FilterTable *table) {
+    free(table->spans);
+    free(table->weights);
+}
+
+/* The horizontal pass writes rows of the intermediate image. */
+#define kResizePassHorizontal 0
+/* The vertical pass writes rows of the output image. */
+#define kResizePassVertical 1
+
+/* A stripe of rows resized by one thread. */
+typedef struct {
+    pthread_t thread;
+    int started;
+    int pass;
+    uint32_t firstRow;
+    uint32_t lastRow;
+    const PreviewBitmap *bitmap;
+    const FilterTable *horizontal;
+    const FilterTable *vertical;
+    /* The bitmap resized horizontally, bitmap height rows of width pixels. */
+    Float4 *intermediate;
+    uint32_t *output;
+    uint32_t width;
+    int failed;
+} ResizeStripe;
+
+/* Converts a row of the bitmap to floating point channels. */
+static void LoadRow(const PreviewBitmap *bitmap, uint32_t y, Float4 *row) {
+    const uint8_t *line = bitmap->pixels + (size_t) y * bitmap->rowBytes;
+
+    if (bitmap->depth == 32) {
+        for (uint32_t x = 0; x < bitmap->width; x++) {
+            const uint8_t *pixel = line + x * 4;
+            Float4 value = { pixel[0], pixel[1], pixel[2], 0 };
+            row[x] = value;
+        }
+    } else {
+        for (uint32_t x = 0; x < bitmap->width; x++) {
+            uint16_t pixel = (uint16_t) (line[x * 2] | (line[x * 2 + 1] << 8));
+            Float4 value = {
+                (pixel & 0x1f) << 3,
+                ((pixel >> 5) & 0x1f) << 3,
+                ((pixel >> 10) & 0x1f) << 3,
+                0
+            };
+            row[x] = value;
+        }
+    }
+}
+
+/* Rounds and clamps a channel. */
+static inline uint32_t StoreChannel(float value) {
+    value += 0.5f;
+    return value <= 0 ? 0 : value >= 255 ? 255 : (uint32_t) value;
+}
+
+static void ResizeHorizontal(ResizeStripe *stripe, Float4 *row) {
+    const FilterTable *table = stripe->horizontal;
+
+    for (uint32_t y = stripe->firstRow; y < stripe->lastRow; y++) {
+        LoadRow(stripe->bitmap, y, row);
+
+        Float4 *out = stripe->intermediate + (size_t) y * stripe->width;
+        for (uint32_t x = 0; x < stripe->width; x++) {
+            const FilterSpan *span = &table->spans[x];
+            const float *weights = &table->weights[(size_t) x * table->taps];
+            const Float4 *in = row + span->first;
+            Float4 sum = { 0, 0, 0, 0 };
+            for (uint32_t i = 0; i < span->count; i++) {
+                sum += weights[i] * in[i];
+            }
+            out[x] = sum;
+        }
+    }
+}
+
+static void ResizeVertical(ResizeStripe *stripe, Float4 *row) {
+    const FilterTable *table = stripe->vertical;
+
+    for (uint32_t y = stripe->firstRow; y < stripe->lastRow; y++) {
+        const FilterSpan *span = &table->spans[y];
+        const float *weights = &table->weights[(size_t) y * table->taps];
+
+        // Accumulate whole rows, so that the inner loop runs over contiguous
+        // pixels
+        for (uint32_t x = 0; x < stripe->width; x++) {
+            row[x] = (Float4) { 0, 0, 0, 0 };
+        }
+        for (uint32_t i = 0; i < span->count; i++) {
+            const Float4 *in = stripe->intermediate +
+                               (size_t) (span->first + i) * stripe->width;
+            float weight = weights[i];
+            for (uint32_t x = 0; x < stripe->width; x++) {
+                row[x] += weight * in[x];
+            }
+        }
+
+        uint32_t *out = stripe->output + (size_t) y * stripe->width;
+        for (uint32_t x = 0; x < stripe->width; x++) {
+            out[x] = StoreChannel(row[x][0]) |
+                     (StoreChannel(row[x][1]) << 8) |
+                     (StoreChannel(row[x][2]) << 16);
+        }
+    }
+}
+
+static void *ResizeStripeRun(void *context) {
+    ResizeStripe *stripe = (ResizeStripe *) context;
+    uint32_t length = stripe->pass == kResizePassHorizontal
+                      ? stripe->bitmap->width : stripe->width;
+
+    Float4 *row = (Float4 *) malloc(length * sizeof(Float4));
+    if (!row) {
+        stripe->failed = 1;
+        return NULL;
+    }
+    if (stripe->pass == kResizePassHorizontal) {
+        ResizeHorizontal(stripe, row);
+    } else {
+        ResizeVertical(stripe, row);
+    }
+    free(row);
+    return NULL;
+}
+
+/*
+ * Runs a pass over rows stripes, the first one on the calling thread. Stripes
+ * whose thread cannot be created run on the calling thread as well. Returns 0
+ * on success and -1 if a stripe failed.
+ */
+static int ResizeRunPass(ResizeStripe *stripes,
+                         unsigned count,
+                         int pass,
+                         uint32_t rows) {
+    int rc = 0;
+
+    for (unsigned i = 0; i < count; i++) {
+        stripes[i].pass = pass;
+        stripes[i].firstRow = (uint32_t) ((uint64_t) rows * i / count);
+        stripes[i].lastRow = (uint32_t) ((uint64_t) rows * (i + 1) / count);
+        stripes[i].started = 0;
+        stripes[i].failed = 0;
+    }
+    for (unsigned i = 1; i < count; i++) {
+        stripes[i].started = pthread_create(&stripes[i].thread,
+                                            NULL,
+                                            ResizeStripeRun,
+                                            &stripes[i]) == 0;
+    }
+    for (unsigned i = 0; i < count; i++) {
+        if (stripes[i].started) {
+            pthread_join(stripes[i].thread, NULL);
+        } else {
+            ResizeStripeRun(&stripes[i]);
+        }
+        if (stripes[i].failed) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
+
+/* The maximum number of stripes per pass. */
+#define kResizeStripeCount 64
+
+int PreviewResize(const PreviewBitmap *bitmap,
+                  uint32_t width,
+                  uint32_t height,
+                  int filter,
+                  unsigned threads,
+                  uint32_t **pixels) {
+    FilterTable horizontal;
+    FilterTable vertical;
+    ResizeStripe stripes[kResizeStripeCount];
+    int rc = kPreviewResizeSuccess;
+
+    if (width == 0 || height == 0 || bitmap->width == 0 ||
+        bitmap->height == 0) {
+        return kPreviewResizeErrorSize;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > kResizeStripeCount) {
+        threads = kResizeStripeCount;
+    }
+
+    if (FilterTableInit(&horizontal, bitmap->width, width, filter) != 0) {
+        return kPreviewResizeErrorResources;
+    }
+    if (FilterTableInit(&vertical, bitmap->height, height, filter) != 0) {
+        FilterTableRelease(&horizontal);
+        return kPreviewResizeErrorResources;
+    }
+    Float4 *intermediate = (Float4 *) malloc((size_t) width *
+                                             bitmap->height *
+                                             sizeof(Float4));
+    uint32_t *output = (uint32_t *) malloc((size_t) width * height *
+                                           sizeof(uint32_t));
+
+    if (!intermediate || !output) {
+        rc = kPreviewResizeErrorResources;
+    } else {
+        for (unsigned i = 0; i < threads; i++) {
+            stripes[i].bitmap = bitmap;
+            stripes[i].horizontal = &horizontal;
+            stripes[i].vertical = &vertical;
+            stripes[i].intermediate = intermediate;
+            stripes[i].output = output;
+            stripes[i].width = width;
+        }
+        if (ResizeRunPass(stripes,
+                          threads,
+                          kResizePassHorizontal,
+                          bitmap->height) != 0 ||
+            ResizeRunPass(stripes,
+                          threads,
+                          kResizePassVertical,
+                          height) != 0) {
+            rc = kPreviewResizeErrorResources;
+        }
+    }
+
+    free(intermediate);
+    FilterTableRelease(&horizontal);
+    FilterTableRelease(&vertical);
+    if (rc != kPreviewResizeSuccess) {
+        free(output);
+        return rc;
+    }
+    *pixels = output;
+    return kPreviewResizeSuccess;
+}
+
+/* The largest block of uncompressed data in a deflate stream. */
+#define kDeflateBlockSize 65535
+/* The largest prime below 65536 used by the Adler-32 checksum. */
+#define kAdlerBase 65521
+
+/* A PNG file that is written chunk by chunk. */
+typedef struct {
+    FILE *file;
+    uint32_t crcTable[256];
+    uint32_t crc;
+    uint32_t adlerA;
+    uint32_t adlerB;
+    /* The bytes left in the current and all following deflate blocks. */
+    uint32_t blockLeft;
+    uint64_t dataLeft;
+    int failed;
+} PNGWriter;
+
+static void PNGWriteBytes(PNGWriter *writer, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint32_t crc = writer->crc;
+
+    for (size_t i = 0; i < size; i++) {
+        crc = writer->crcTable[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    }
+    writer->crc = crc;
+    if (fwrite(data, 1, size, writer->file) != size) {
+        writer->failed = 1;
+    }
+}
+
+static void PNGWriteUInt32(PNGWriter *writer, uint32_t value) {
+    uint8_t bytes[4] = {
+        (uint8_t) (value >> 24),
+        (uint8_t) (value >> 16),
+        (uint8_t) (value >> 8),
+        (uint8_t) value
+    };
+    PNGWriteBytes(writer, bytes, sizeof(bytes));
+}
+
+static void PNGBeginChunk(PNGWriter *writer,
+                          uint32_t length,
+                          const char *type) {
+    PNGWriteUInt32(writer, length);
+    writer->crc = 0xffffffff;
+    PNGWriteBytes(writer, type, 4);
+}
+
+static void PNGEndChunk(PNGWriter *writer) {
+    PNGWriteUInt32(writer, writer->crc ^ 0xffffffff);
+}
+
+/* Writes image data as stored deflate blocks and updates the checksum. */
+static void PNGWriteData(PNGWriter *writer, const uint8_t *data, size_t size) {
+    while (size > 0) {
+        if (writer->blockLeft == 0) {
+            uint32_t length = writer->dataLeft > kDeflateBlockSize
+                              ? kDeflateBlockSize
+                              : (uint32_t) writer->dataLeft;
+            uint8_t header[5] = {
+                writer->dataLeft == length,
+                (uint8_t) length,
+                (uint8_t) (length >> 8),
+                (uint8_t) ~length,
+                (uint8_t) (~length >> 8)
+            };
+            PNGWriteBytes(writer, header, sizeof(header));
+            writer->blockLeft = length;
+        }
+
+        size_t count = size < writer->blockLeft ? size : writer->blockLeft;
+        PNGWriteBytes(writer, data, count);
+
+        // Reduce the checksum before the sums can overflow
+        for (size_t i = 0; i < count; i += 4096) {
+            size_t end = i + 4096 < count ? i + 4096 : count;
+            for (size_t j = i; j < end; j++) {
+                writer->adlerA += data[j];
+                writer->adlerB += writer->adlerA;
+            }
+            writer->adlerA %= kAdlerBase;
+            writer->adlerB %= kAdlerBase;
+        }
+
+        writer->blockLeft -= count;
+        writer->dataLeft -= count;
+        data += count;
+        size -= count;
+    }
+}
+
+int PreviewWritePNG(const char *path,
+                    const uint32_t *pixels,
+                    uint32_t width,
+                    uint32_t height) {
+    static const uint8_t signature[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+    PNGWriter writer;
+
+    // Each row starts with the filter type followed by RGB pixels
+    uint64_t rowSize = 1 + (uint64_t) width * 3;
+    uint64_t dataSize = rowSize * height;
+    uint64_t blocks = (dataSize + kDeflateBlockSize - 1) / kDeflateBlockSize;
+    uint64_t streamSize = 2 + dataSize + 5 * blocks + 4;
+    if (width == 0 || height == 0 || streamSize > 0x7fffffff) {
+        return -1;
+    }
+
+    uint8_t *row = (uint8_t *) malloc(rowSize);
+    if (!row) {
+        return -1;
+    }
+    writer.file = fopen(path, "wb");
+    if (!writer.file) {
+        free(row);
+        return -1;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+        }
+        writer.crcTable[i] = crc;
+    }
+    writer.adlerA = 1;
+    writer.adlerB = 0;
+    writer.blockLeft = 0;
+    writer.dataLeft = dataSize;
+    writer.failed = 0;
+
+    PNGWriteBytes(&writer, signature, sizeof(signature));
+
+    // 8 bit RGB, no interlacing
+    uint8_t header[13] = {
+        (uint8_t) (width >> 24), (uint8_t) (width >> 16),
+        (uint8_t) (width >> 8), (uint8_t) width,
+        (uint8_t) (height >> 24), (uint8_t) (height >> 16),
+        (uint8_t) (height >> 8), (uint8_t) height,
+        8, 2, 0, 0, 0
+    };
+    PNGBeginChunk(&writer, sizeof(header), "IHDR");
+    PNGWriteBytes(&writer, header, sizeof(header));
+    PNGEndChunk(&writer);
+
+    // zlib stream of stored blocks
+    static const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+    PNGBeginChunk(&writer, (uint32_t) streamSize, "IDAT");
+    PNGWriteBytes(&writer, zlibHeader, sizeof(zlibHeader));
+    for (uint32_t y = 0; y < height; y++) {
+        const uint32_t *in = pixels + (size_t) y * width;
+        row[0] = 0;
+        for (uint32_t x = 0; x < width; x++) {
+            row[1 + x * 3] = (uint8_t) (in[x] >> 16);
+            row[2 + x * 3] = (uint8_t) (in[x] >> 8);
+            row[3 + x * 3] = (uint8_t) in[x];
+        }
+        PNGWriteData(&writer, row, rowSize);
+    }
+    PNGWriteUInt32(&writer, (writer.adlerB << 16) | writer.adlerA);
+    PNGEndChunk(&writer);
+
+    PNGBeginChunk(&writer, 0, "IEND");
+    PNGEndChunk(&writer);
+
+    free(row);
+    if (fclose(writer.file) != 0 || writer.failed) {
+        return -1;
+    }
+    return 0;
+}
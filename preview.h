@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_PREVIEW_H
+#define HIBERNATE_PREVIEW_H
+
+#include <stdint.h>
+
+/*
+ * An image of x1r5g5b5 pixels for a depth of 16 or x8r8g8b8 pixels for a
+ * depth of 32, the formats of the preview images in a hibernation image.
+ */
+typedef struct {
+    const uint8_t *pixels;
+    uint32_t rowBytes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+} PreviewBitmap;
+
+/* Averages the input pixels covered by each output pixel. */
+#define kPreviewFilterBox 0
+/* A three-lobed Lanczos filter, sharper but slower than the box filter. */
+#define kPreviewFilterLanczos 1
+
+/* The bitmap has been resized successfully. */
+#define kPreviewResizeSuccess 0
+/* The sizes are zero. */
+#define kPreviewResizeErrorSize 1
+/* The buffers or threads could not be created. */
+#define kPreviewResizeErrorResources 2
+
+/*
+ * Resizes the bitmap to width x height x8r8g8b8 pixels, which are allocated and
+ * returned in pixels and must be freed. The image is filtered horizontally and
+ * then vertically, each pass split into stripes of rows that are processed by
+ * up to threads threads.
+ */
+int PreviewResize(const PreviewBitmap *bitmap,
+                  uint32_t width,
+                  uint32_t height,
+                  int filter,
+                  unsigned threads,
+                  uint32_t **pixels);
+
+/*
+ * Writes x8r8g8b8 pixels to a PNG file. The image data is stored without
+ * compression, so that no compression library is needed. Returns 0 on success
+ * and -1 otherwise.
+ */
+int PreviewWritePNG(const char *path,
+                    const uint32_t *pixels,
+                    uint32_t width,
+                    uint32_t height);
+
+#endif /* HIBERNATE_PREVIEW_H */
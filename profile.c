@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "profile.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__APPLE__)
+#include "IOPMLibPrivate.h"
+#else
+/* The power management features of IOPMLibPrivate.h. */
+#define kIOPMWakeOnLANKey "Wake On LAN"
+#define kIOPMDarkWakeBackgroundTaskKey "DarkWakeBackgroundTasks"
+#define kIOPMPowerNapSupportedKey "PowerNap"
+#define kIOPMWakeOnACChangeKey "Wake On AC Change"
+#define kIOPMWakeOnClamshellKey "Wake On Clamshell Open"
+#endif
+
+const WakeSource kWakeSources[] = {
+    { kWakeSourceLAN, "lan", kIOPMWakeOnLANKey },
+    { kWakeSourceDarkWake, "darkwake", kIOPMDarkWakeBackgroundTaskKey },
+    { kWakeSourcePowerNap, "powernap", kIOPMPowerNapSupportedKey },
+    { kWakeSourceACChange, "acchange", kIOPMWakeOnACChangeKey },
+    { kWakeSourceClamshell, "clamshell", kIOPMWakeOnClamshellKey }
+};
+const size_t kWakeSourceCount = sizeof(kWakeSources) / sizeof(kWakeSources[0]);
+
+/* The built-in profiles. */
+static const HibernateProfile kBuiltinProfiles[] = {
+#define HIBERNATE_PROFILE(name, mode, standby, suppressed, before, after) \
+    { name, mode, standby, suppressed, before, after },
+#include "profiles.def"
+#undef HIBERNATE_PROFILE
+};
+
+int ParseWakeSources(const char *string, int *sources) {
+    char buffer[128];
+    char *list = buffer;
+    char *name;
+
+    if (strlen(string) >= sizeof(buffer)) {
+        return -1;
+    }
+    strcpy(buffer, string);
+
+    *sources = 0;
+    while ((name = strsep(&list, ",")) != NULL) {
+        if (strcmp(name, "all") == 0) {
+            *sources |= kWakeSourcesAll;
+        } else if (strcmp(name, "none") != 0) {
+            size_t i = 0;
+            while (i < kWakeSourceCount &&
+                   strcmp(name, kWakeSources[i].name) != 0) {
+                i++;
+            }
+            if (i == kWakeSourceCount) {
+                return -1;
+            }
+            *sources |= kWakeSources[i].source;
+        }
+    }
+    return 0;
+}
+
+void ProfileTableInit(ProfileTable *table) {
+    table->count = sizeof(kBuiltinProfiles) / sizeof(kBuiltinProfiles[0]);
+    memcpy(table->profiles, kBuiltinProfiles, sizeof(kBuiltinProfiles));
+}
+
+const HibernateProfile *ProfileTableFind(const ProfileTable *table,
+                                         const char *name) {
+    for (size_t i = 0; i < table->count; i++) {
+        if (strcmp(table->profiles[i].name, name) == 0) {
+            return &table->profiles[i];
+        }
+    }
+    return NULL;
+}
+
+/* Removes leading and trailing white space in place. */
+static char *Trim(char *string) {
+    while (isspace((unsigned char) *string)) {
+        string++;
+    }
+    char *end = string + strlen(string);
+    while (end > string && isspace((unsigned char) end[-1])) {
+        end--;
+    }
+    *end = '\0';
+    return string;
+}
+
+/* Parses a non-negative integer. Returns 0 on success and -1 otherwise. */
+static int ParseInt(const char *string, int *value) {
+    char *end;
+    long number = strtol(string, &end, 0);
+
+    if (end == string || *end != '\0' || number < 0 || number > INT_MAX) {
+        return -1;
+    }
+    *value = (int) number;
+    return 0;
+}
+
+/* Sets a profile setting. Returns 0 on success and -1 otherwise. */
+static int SetProfileValue(HibernateProfile *profile,
+                           const char *key,
+                           const char *value) {
+    if (strcmp(key, "hibernatemode") == 0) {
+        return ParseInt(value, &profile->hibernateMode);
+    }
+    if (strcmp(key, "standby") == 0) {
+        return ParseInt(value, &profile->standby);
+    }
+    if (strcmp(key, "suppress-wake") == 0) {
+        return ParseWakeSources(value, &profile->suppressedWakeSources);
+    }
+    if (strcmp(key, "wait-before") == 0) {
+        return ParseInt(value, &profile->waitBeforeSystemSleep);
+    }
+    if (strcmp(key, "wait-after") == 0) {
+        return ParseInt(value, &profile->waitAfterSystemSleep);
+    }
+    return -1;
+}
+
+int ProfileTableLoad(ProfileTable *table, const char *path, int *errorLine) {
+    HibernateProfile *profile = NULL;
+    char buffer[256];
+    int rc = kProfileLoadSuccess;
+    int line = 0;
+
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return kProfileLoadErrorOpen;
+    }
+
+    while (rc == kProfileLoadSuccess && fgets(buffer, sizeof(buffer), file)) {
+        line++;
+
+        // Strip comments
+        char *comment = strchr(buffer, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        char *text = Trim(buffer);
+        size_t length = strlen(text);
+        if (length == 0) {
+            continue;
+        }
+
+        if (text[0] == '[' && text[length - 1] == ']') {
+            // Start a new profile or replace an existing one
+            text[length - 1] = '\0';
+            char *name = Trim(text + 1);
+            if (*name == '\0' || strlen(name) >= kProfileNameLength) {
+                rc = kProfileLoadErrorSyntax;
+                break;
+            }
+
+            profile = (HibernateProfile *) ProfileTableFind(table, name);
+            if (!profile) {
+                if (table->count == kProfileCapacity) {
+                    rc = kProfileLoadErrorCapacity;
+                    break;
+                }
+                const HibernateProfile *base =
+                        ProfileTableFind(table, kProfileDefaultName);
+                profile = &table->profiles[table->count++];
+                *profile = base ? *base : kBuiltinProfiles[0];
+                snprintf(profile->name, sizeof(profile->name), "%s", name);
+            }
+            continue;
+        }
+
+        // Set a value of the current profile
+        char *separator = strchr(text, '=');
+        if (!profile || !separator) {
+            rc = kProfileLoadErrorSyntax;
+            break;
+        }
+        *separator = '\0';
+        if (SetProfileValue(profile,
+                            Trim(text),
+                            Trim(separator + 1)) != 0) {
+            rc = kProfileLoadErrorSyntax;
+        }
+    }
+    fclose(file);
+
+    *errorLine = line;
+    return rc;
+}
+
+/*
+ * Prints a string as a C string literal. Quotes, backslashes and characters
+ * that are not printable are escaped, the latter with three octal digits so
+ * that a following digit does not continue the escape.
+ */
+static void PrintStringLiteral(const char *string, FILE *stream) {
+    fputc('"', stream);
+    for (const unsigned char *c = (const unsigned char *) string; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(stream, "\\%c", *c);
+        } else if (!isprint(*c)) {
+            fprintf(stream, "\\%03o", *c);
+        } else {
+            fputc(*c, stream);
+        }
+    }
+    fputc('"', stream);
+}
+
+void ProfileTablePrint(const ProfileTable *table, FILE *stream) {
+    for (size_t i = 0; i < table->count; i++) {
+        const HibernateProfile *profile = &table->profiles[i];
+        fprintf(stream, "HIBERNATE_PROFILE(");
+        PrintStringLiteral(profile->name, stream);
+        fprintf(stream,
+                ", 0x%x, %d, 0x%x, %d, %d)\n",
+                profile->hibernateMode,
+                profile->standby,
+                profile->suppressedWakeSources,
+                profile->waitBeforeSystemSleep,
+                profile->waitAfterSystemSleep);
+    }
+}
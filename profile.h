@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_PROFILE_H
+#define HIBERNATE_PROFILE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Wake sources that can be disabled during system sleep. Every wake from
+ * hibernation restores the complete image, which is why background wakes are
+ * disabled by default.
+ */
+#define kWakeSourceLAN (1 << 0)
+#define kWakeSourceDarkWake (1 << 1)
+#define kWakeSourcePowerNap (1 << 2)
+#define kWakeSourceACChange (1 << 3)
+#define kWakeSourceClamshell (1 << 4)
+#define kWakeSourcesAll (kWakeSourceLAN | kWakeSourceDarkWake | \
+                         kWakeSourcePowerNap | kWakeSourceACChange | \
+                         kWakeSourceClamshell)
+#define kWakeSourcesDefault (kWakeSourceLAN | kWakeSourceDarkWake | \
+                             kWakeSourcePowerNap | kWakeSourceACChange)
+
+/* A wake source and the power management feature that controls it. */
+typedef struct {
+    int source;
+    const char *name;
+    const char *feature;
+} WakeSource;
+
+/* The wake sources indexed by bit. */
+extern const WakeSource kWakeSources[];
+/* The number of wake sources. */
+extern const size_t kWakeSourceCount;
+
+/*
+ * Parses a comma separated list of wake source names, "all" or "none". Returns
+ * 0 on success and -1 if the list contains an unknown name.
+ */
+int ParseWakeSources(const char *string, int *sources);
+
+/* The maximum length of a profile name including the terminating zero. */
+#define kProfileNameLength 32
+/* The maximum number of profiles including the built-in profiles. */
+#define kProfileCapacity 32
+/* The default configuration file. */
+#define kProfileDefaultPath "/etc/hibernate.conf"
+/* The profile used if no profile is specified. */
+#define kProfileDefaultName "default"
+
+/* The settings applied while the system hibernates. */
+typedef struct {
+    char name[kProfileNameLength];
+    /* The hibernate mode for system sleep. */
+    int hibernateMode;
+    /* The state of the standby feature during system sleep. */
+    int standby;
+    /* The wake sources that are disabled during system sleep. */
+    int suppressedWakeSources;
+    /* The time in seconds to wait before initating system sleep. */
+    int waitBeforeSystemSleep;
+    /* The time in seconds to wait after the system has powered on. */
+    int waitAfterSystemSleep;
+} HibernateProfile;
+
+/*
+ * The known profiles. Initialized with the built-in profiles compiled from
+ * profiles.def and extended by configuration files.
+ */
+typedef struct {
+    HibernateProfile profiles[kProfileCapacity];
+    size_t count;
+} ProfileTable;
+
+/* Initializes the table with the built-in profiles. */
+void ProfileTableInit(ProfileTable *table);
+
+/* The configuration file has been loaded successfully. */
+#define kProfileLoadSuccess 0
+/* The configuration file could not be opened. */
+#define kProfileLoadErrorOpen 1
+/* The configuration file contains a syntax error or an invalid value. */
+#define kProfileLoadErrorSyntax 2
+/* The configuration file defines too many profiles. */
+#define kProfileLoadErrorCapacity 3
+
+/*
+ * Loads the profiles defined in a configuration file into the table. Profiles
+ * with the name of an existing profile start out as a copy of that profile and
+ * replace it. New profiles start out as a copy of the default profile. The line
+ * of a syntax error is returned in errorLine.
+ */
+int ProfileTableLoad(ProfileTable *table, const char *path, int *errorLine);
+
+/* Returns the profile with the specified name or NULL. */
+const HibernateProfile *ProfileTableFind(const ProfileTable *table,
+                                         const char *name);
+
+/*
+ * Prints the profiles in the format of profiles.def, so that the profiles of a
+ * configuration file can be compiled into hibernate.
+ */
+void ProfileTablePrint(const ProfileTable *table, FILE *stream);
+
+#endif /* HIBERNATE_PROFILE_H */
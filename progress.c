@@ -0,0 +1,619 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "progress.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "IOHibernatePrivate.h"
+
+DECLARE_IOHIBERNATEPROGRESSALPHA
+
+/* The width of the progress indicator in unscaled pixels. */
+#define kProgressStripWidth (kIOHibernateProgressCount * \
+                             (kIOHibernateProgressWidth + \
+                              kIOHibernateProgressSpacing))
+
+/* Converts a kernel gray value to a x8r8g8b8 pixel. */
+#define GRAY(value) (((value) << 16) | ((value) << 8) | (value))
+
+void ProgressThemeInit(ProgressTheme *theme) {
+    theme->doneColor = GRAY(kIOHibernateProgressLightGray);
+    theme->activeColor = GRAY(kIOHibernateProgressMidGray);
+    theme->scale = 1;
+}
+
+/*
+ * Divides a blended channel by 255 and rounds to the nearest integer. Exact for
+ * all values up to 255 * 255.
+ */
+static inline uint32_t Div255(uint32_t value) {
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+static void BlendScalar(uint32_t *out,
+                        const uint32_t *in,
+                        const uint8_t *alpha,
+                        uint32_t color,
+                        size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t a = alpha[i];
+        uint32_t pixel = in[i];
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            result |= Div255((255 - a) * ((pixel >> shift) & 0xff) +
+                             a * ((color >> shift) & 0xff)) << shift;
+        }
+        out[i] = result;
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/* Replicates the alpha of 4 pixels to the 4 channels of each pixel. */
+static inline __m128i ExpandAlpha(const uint8_t *alpha) {
+    uint32_t packed;
+    memcpy(&packed, alpha, sizeof(packed));
+    __m128i expanded = _mm_cvtsi32_si128((int) packed);
+    expanded = _mm_unpacklo_epi8(expanded, expanded);
+    return _mm_unpacklo_epi16(expanded, expanded);
+}
+
+/* Blends 2 pixels with channels widened to 16 bits. */
+static inline __m128i Blend2(__m128i in, __m128i alpha, __m128i color) {
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), alpha);
+    __m128i value = _mm_add_epi16(_mm_mullo_epi16(in, inverse),
+                                  _mm_mullo_epi16(color, alpha));
+    value = _mm_add_epi16(value, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(value, _mm_srli_epi16(value, 8)), 8);
+}
+
+/*
+ * Blends 4 pixels. Is inlined into the AVX2 version as well, where it is
+ * compiled to VEX encoded instructions.
+ */
+static inline void BlendQuad(uint32_t *out,
+                             const uint32_t *in,
+                             const uint8_t *alpha,
+                             __m128i color16) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i pixels = _mm_loadu_si128((const __m128i *) in);
+    __m128i alpha8 = ExpandAlpha(alpha);
+    __m128i low = Blend2(_mm_unpacklo_epi8(pixels, zero),
+                         _mm_unpacklo_epi8(alpha8, zero),
+                         color16);
+    __m128i high = Blend2(_mm_unpackhi_epi8(pixels, zero),
+                          _mm_unpackhi_epi8(alpha8, zero),
+                          color16);
+    _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(low, high));
+}
+
+static void BlendSSE2(uint32_t *out,
+                      const uint32_t *in,
+                      const uint8_t *alpha,
+                      uint32_t color,
+                      size_t count) {
+    __m128i color16 = _mm_unpacklo_epi8(_mm_set1_epi32((int) color),
+                                        _mm_setzero_si128());
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        BlendQuad(out + i, in + i, alpha + i, color16);
+    }
+    BlendScalar(out + i, in + i, alpha + i, color, count - i);
+}
+
+/* Blends 4 pixels with channels widened to 16 bits. */
+__attribute__((target("avx2")))
+static inline __m256i Blend4(__m256i in, __m256i alpha, __m256i color) {
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), alpha);
+    __m256i value = _mm256_add_epi16(_mm256_mullo_epi16(in, inverse),
+                                     _mm256_mullo_epi16(color, alpha));
+    value = _mm256_add_epi16(value, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(value,
+                                              _mm256_srli_epi16(value, 8)),
+                             8);
+}
+
+__attribute__((target("avx2")))
+static void BlendAVX2(uint32_t *out,
+                      const uint32_t *in,
+                      const uint8_t *alpha,
+                      uint32_t color,
+                      size_t count) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i color16 = _mm256_unpacklo_epi8(_mm256_set1_epi32((int) color),
+                                           zero);
+    size_t i = 0;
+
+    // The unpack and pack instructions operate on each 128 bit lane, so the
+    // expanded alpha has to follow the same layout as the pixels
+    for (; i + 8 <= count; i += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i *) (in + i));
+        __m256i alpha8 =
+                _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(ExpandAlpha(alpha + i)),
+                        ExpandAlpha(alpha + i + 4),
+                        1);
+        __m256i low = Blend4(_mm256_unpacklo_epi8(pixels, zero),
+                             _mm256_unpacklo_epi8(alpha8, zero),
+                             color16);
+        __m256i high = Blend4(_mm256_unpackhi_epi8(pixels, zero),
+                              _mm256_unpackhi_epi8(alpha8, zero),
+                              color16);
+        _mm256_storeu_si256((__m256i *) (out + i),
+                            _mm256_packus_epi16(low, high));
+    }
+
+    // Blend the remaining pixels in this function, calling the SSE2 version
+    // would mix VEX and legacy SSE encodings
+    for (; i + 4 <= count; i += 4) {
+        BlendQuad(out + i,
+                  in + i,
+                  alpha + i,
+                  _mm256_castsi256_si128(color16));
+    }
+    BlendScalar(out + i, in + i, alpha + i, color, count - i);
+}
+
+#endif /* __x86_64__ || __i386__ */
+
+#if defined(__ARM_NEON)
+
+static void BlendNEON(uint32_t *out,
+                      const uint32_t *in,
+                      const uint8_t *alpha,
+                      uint32_t color,
+                      size_t count) {
+    uint8x8_t color8 = vreinterpret_u8_u32(vdup_n_u32(color));
+    uint16x8_t half = vdupq_n_u16(128);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        uint32_t expanded[4] = {
+            alpha[i] * 0x01010101u,
+            alpha[i + 1] * 0x01010101u,
+            alpha[i + 2] * 0x01010101u,
+            alpha[i + 3] * 0x01010101u
+        };
+        uint8x16_t pixels = vld1q_u8((const uint8_t *) (in + i));
+        uint8x16_t alpha8 = vreinterpretq_u8_u32(vld1q_u32(expanded));
+        uint8x16_t inverse = vmvnq_u8(alpha8);
+
+        uint16x8_t low = vmull_u8(vget_low_u8(pixels), vget_low_u8(inverse));
+        low = vmlal_u8(low, color8, vget_low_u8(alpha8));
+        low = vaddq_u16(low, half);
+        uint16x8_t high = vmull_u8(vget_high_u8(pixels),
+                                   vget_high_u8(inverse));
+        high = vmlal_u8(high, color8, vget_high_u8(alpha8));
+        high = vaddq_u16(high, half);
+
+        vst1q_u8((uint8_t *) (out + i),
+                 vcombine_u8(vshrn_n_u16(vsraq_n_u16(low, low, 8), 8),
+                             vshrn_n_u16(vsraq_n_u16(high, high, 8), 8)));
+    }
+    BlendScalar(out + i, in + i, alpha + i, color, count - i);
+}
+
+#endif /* __ARM_NEON */
+
+const char *ProgressBlendName(int implementation) {
+    static const char *names[kProgressBlendCount] = {
+        "scalar", "sse2", "avx2", "neon"
+    };
+    if (implementation < 0 || implementation >= kProgressBlendCount) {
+        return "unknown";
+    }
+    return names[implementation];
+}
+
+ProgressBlendFunction ProgressBlendGet(int implementation) {
+    switch (implementation) {
+        case kProgressBlendScalar:
+            return BlendScalar;
+#if defined(__x86_64__) || defined(__i386__)
+        case kProgressBlendSSE2:
+            return BlendSSE2;
+        case kProgressBlendAVX2:
+            return __builtin_cpu_supports("avx2") ? BlendAVX2 : NULL;
+#endif
+#if defined(__ARM_NEON)
+        case kProgressBlendNEON:
+            return BlendNEON;
+#endif
+    }
+    return NULL;
+}
+
+ProgressBlendFunction ProgressBlendGetBest(void) {
+    for (int i = kProgressBlendCount - 1; i > kProgressBlendScalar; i--) {
+        ProgressBlendFunction blend = ProgressBlendGet(i);
+        if (blend) {
+            return blend;
+        }
+    }
+    return BlendScalar;
+}
+
+/* Converts a x1r5g5b5 pixel to x8r8g8b8. */
+static inline uint32_t Expand555(uint16_t pixel) {
+    return ((uint32_t) (pixel & 0x7c00) << 9) |
+           ((uint32_t) (pixel & 0x03e0) << 6) |
+           ((uint32_t) (pixel & 0x001f) << 3);
+}
+
+/* Converts a x8r8g8b8 pixel to x1r5g5b5 by truncation like the kernel. */
+static inline uint16_t Pack555(uint32_t pixel) {
+    return (uint16_t) (((pixel >> 9) & 0x7c00) |
+                       ((pixel >> 6) & 0x03e0) |
+                       ((pixel >> 3) & 0x001f));
+}
+
+int ProgressSaveUnderCapture(ProgressSaveUnder *saveUnder,
+                             const ProgressFramebuffer *framebuffer,
+                             const ProgressTheme *theme) {
+    uint32_t scale = theme->scale;
+
+    if (framebuffer->depth != 16 && framebuffer->depth != 32) {
+        return kProgressCaptureErrorDepth;
+    }
+    if (scale < 1 || scale > kProgressScaleMax ||
+        framebuffer->width < kProgressStripWidth * scale ||
+        framebuffer->height < (kIOHibernateProgressOriginY +
+                               kIOHibernateProgressHeight) * scale) {
+        return kProgressCaptureErrorSize;
+    }
+
+    saveUnder->width = kProgressStripWidth * scale;
+    saveUnder->height = kIOHibernateProgressHeight * scale;
+    saveUnder->x = (framebuffer->width - saveUnder->width) / 2;
+    saveUnder->y = framebuffer->height - (kIOHibernateProgressOriginY +
+                                          kIOHibernateProgressHeight) * scale;
+    saveUnder->pixels = (uint32_t *) malloc(saveUnder->width *
+                                            saveUnder->height *
+                                            sizeof(uint32_t));
+    if (!saveUnder->pixels) {
+        return kProgressCaptureErrorMemory;
+    }
+
+    for (uint32_t y = 0; y < saveUnder->height; y++) {
+        const uint8_t *line = framebuffer->base +
+                              (saveUnder->y + y) * framebuffer->rowBytes;
+        uint32_t *pixels = saveUnder->pixels + y * saveUnder->width;
+        if (framebuffer->depth == 32) {
+            memcpy(pixels,
+                   line + saveUnder->x * sizeof(uint32_t),
+                   saveUnder->width * sizeof(uint32_t));
+        } else {
+            const uint16_t *in = (const uint16_t *) line + saveUnder->x;
+            for (uint32_t x = 0; x < saveUnder->width; x++) {
+                pixels[x] = Expand555(in[x]);
+            }
+        }
+    }
+    return kProgressCaptureSuccess;
+}
+
+void ProgressSaveUnderRelease(ProgressSaveUnder *saveUnder) {
+    free(saveUnder->pixels);
+    saveUnder->pixels = NULL;
+}
+
+/*
+ * Blends one row of the progress indicator starting at the pixel offset and
+ * stores it in the framebuffer.
+ */
+static void RenderSpan(ProgressFramebuffer *framebuffer,
+                       const ProgressSaveUnder *saveUnder,
+                       uint32_t y,
+                       uint32_t offset,
+                       uint32_t count,
+                       const uint8_t *alpha,
+                       uint32_t color,
+                       ProgressBlendFunction blend) {
+    uint8_t *line = framebuffer->base +
+                    (saveUnder->y + y) * framebuffer->rowBytes;
+    const uint32_t *in = saveUnder->pixels + y * saveUnder->width + offset;
+
+    if (framebuffer->depth == 32) {
+        blend((uint32_t *) line + saveUnder->x + offset,
+              in,
+              alpha + offset,
+              color,
+              count);
+    } else {
+        uint32_t pixels[kProgressStripWidth * kProgressScaleMax];
+        uint16_t *out = (uint16_t *) line + saveUnder->x + offset;
+        blend(pixels, in, alpha + offset, color, count);
+        for (uint32_t x = 0; x < count; x++) {
+            out[x] = Pack555(pixels[x]);
+        }
+    }
+}
+
+void ProgressRender(ProgressFramebuffer *framebuffer,
+                    const ProgressSaveUnder *saveUnder,
+                    const ProgressTheme *theme,
+                    int firstBlob,
+                    int select,
+                    ProgressBlendFunction blend) {
+    uint32_t scale = theme->scale;
+    uint32_t pitch = (kIOHibernateProgressWidth +
+                      kIOHibernateProgressSpacing) * scale;
+    uint8_t alpha[kProgressStripWidth * kProgressScaleMax];
+
+    if (firstBlob < 0) {
+        firstBlob = 0;
+    }
+    if (select >= kIOHibernateProgressCount) {
+        select = kIOHibernateProgressCount - 1;
+    }
+    if (firstBlob > select) {
+        return;
+    }
+
+    for (uint32_t y = 0; y < saveUnder->height; y++) {
+        // Scale the glyph row and repeat it for every step, the spacing
+        // between steps is transparent
+        const uint8_t *glyph = gIOHibernateProgressAlpha[y / scale];
+        for (uint32_t x = 0; x < pitch; x++) {
+            alpha[x] = x < kIOHibernateProgressWidth * scale
+                       ? glyph[x / scale] : 0;
+        }
+        for (int blob = 1; blob <= select; blob++) {
+            memcpy(alpha + blob * pitch, alpha, pitch);
+        }
+
+        // Finished steps share a color and are blended in a single span
+        if (firstBlob < select) {
+            RenderSpan(framebuffer,
+                       saveUnder,
+                       y,
+                       firstBlob * pitch,
+                       (select - firstBlob) * pitch,
+                       alpha,
+                       theme->doneColor,
+                       blend);
+        }
+        RenderSpan(framebuffer,
+                   saveUnder,
+                   y,
+                   select * pitch,
+                   kIOHibernateProgressWidth * scale,
+                   alpha,
+                   theme->activeColor,
+                   blend);
+    }
+}
+
+/* The displays used by the benchmark. */
+static const struct {
+    const char *name;
+    uint32_t width;
+    uint32_t height;
+    uint32_t scale;
+} kBenchmarkDisplays[] = {
+    { "5K", 5120, 2880, 2 },
+    { "6K", 6016, 3384, 2 }
+};
+
+/* The padding added to each framebuffer row, like a hardware pitch. */
+#define kBenchmarkRowPadding 48
+
+/* Returns the monotonic time in seconds. */
+static double BenchmarkTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/* Copies the pixels covered by the progress indicator as stored. */
+static void CopyStrip(uint8_t *pixels,
+                      const ProgressFramebuffer *framebuffer,
+                      const ProgressSaveUnder *saveUnder) {
+    size_t rowSize = saveUnder->width * (framebuffer->depth / 8);
+
+    for (uint32_t y = 0; y < saveUnder->height; y++) {
+        memcpy(pixels + y * rowSize,
+               framebuffer->base +
+               (saveUnder->y + y) * framebuffer->rowBytes +
+               saveUnder->x * (framebuffer->depth / 8),
+               rowSize);
+    }
+}
+
+/* Restores the pixels covered by the progress indicator. */
+static void RestoreStrip(ProgressFramebuffer *framebuffer,
+                         const ProgressSaveUnder *saveUnder) {
+    for (uint32_t y = 0; y < saveUnder->height; y++) {
+        uint8_t *line = framebuffer->base +
+                        (saveUnder->y + y) * framebuffer->rowBytes;
+        const uint32_t *pixels = saveUnder->pixels + y * saveUnder->width;
+        if (framebuffer->depth == 32) {
+            memcpy(line + saveUnder->x * sizeof(uint32_t),
+                   pixels,
+                   saveUnder->width * sizeof(uint32_t));
+        } else {
+            uint16_t *out = (uint16_t *) line + saveUnder->x;
+            for (uint32_t x = 0; x < saveUnder->width; x++) {
+                out[x] = Pack555(pixels[x]);
+            }
+        }
+    }
+}
+
+/*
+ * Draws every step of the indicator with each supported implementation,
+ * compares the result with the scalar reference and prints the time per frame.
+ * A frame consists of all kIOHibernateProgressCount steps.
+ */
+static int BenchmarkDisplay(ProgressFramebuffer *framebuffer,
+                            const ProgressTheme *theme,
+                            const char *name,
+                            unsigned iterations,
+                            FILE *stream) {
+    ProgressSaveUnder saveUnder;
+    int rc = kProgressBenchmarkSuccess;
+
+    if (ProgressSaveUnderCapture(&saveUnder,
+                                 framebuffer,
+                                 theme) != kProgressCaptureSuccess) {
+        return kProgressBenchmarkErrorMemory;
+    }
+    size_t stripSize = saveUnder.width * saveUnder.height *
+                       (framebuffer->depth / 8);
+    uint8_t *reference = (uint8_t *) malloc(stripSize *
+                                            kIOHibernateProgressCount);
+    uint8_t *strip = (uint8_t *) malloc(stripSize);
+    if (!reference || !strip) {
+        free(reference);
+        free(strip);
+        ProgressSaveUnderRelease(&saveUnder);
+        return kProgressBenchmarkErrorMemory;
+    }
+
+    for (int select = 0; select < kIOHibernateProgressCount; select++) {
+        ProgressRender(framebuffer, &saveUnder, theme, 0, select, BlendScalar);
+        CopyStrip(reference + select * stripSize, framebuffer, &saveUnder);
+    }
+
+    for (int i = 0; i < kProgressBlendCount; i++) {
+        ProgressBlendFunction blend = ProgressBlendGet(i);
+        if (!blend) {
+            continue;
+        }
+
+        // Validate against the scalar reference. Steps after select are not
+        // drawn, so each pass starts from the captured pixels
+        int match = 1;
+        RestoreStrip(framebuffer, &saveUnder);
+        for (int select = 0; select < kIOHibernateProgressCount; select++) {
+            ProgressRender(framebuffer, &saveUnder, theme, 0, select, blend);
+            CopyStrip(strip, framebuffer, &saveUnder);
+            if (memcmp(strip, reference + select * stripSize, stripSize) != 0) {
+                match = 0;
+            }
+        }
+        if (!match) {
+            rc = kProgressBenchmarkErrorMismatch;
+        }
+
+        double start = BenchmarkTime();
+        for (unsigned j = 0; j < iterations; j++) {
+            for (int select = 0; select < kIOHibernateProgressCount;
+                 select++) {
+                ProgressRender(framebuffer,
+                               &saveUnder,
+                               theme,
+                               0,
+                               select,
+                               blend);
+            }
+        }
+        double elapsed = BenchmarkTime() - start;
+
+        fprintf(stream,
+                "%-8s %-6u %-8s %12.2f %s\n",
+                name,
+                framebuffer->depth,
+                ProgressBlendName(i),
+                elapsed * 1e6 / iterations,
+                match ? "" : "MISMATCH");
+    }
+
+    free(reference);
+    free(strip);
+    ProgressSaveUnderRelease(&saveUnder);
+    return rc;
+}
+
+int ProgressBenchmark(unsigned iterations, FILE *stream) {
+    size_t count = sizeof(kBenchmarkDisplays) / sizeof(kBenchmarkDisplays[0]);
+    int rc = kProgressBenchmarkSuccess;
+
+    fprintf(stream,
+            "%-8s %-6s %-8s %12s\n",
+            "display",
+            "depth",
+            "blend",
+            "us/frame");
+    for (size_t i = 0; i < count * 2 && rc != kProgressBenchmarkErrorMemory;
+         i++) {
+        ProgressTheme theme;
+        ProgressThemeInit(&theme);
+        theme.scale = kBenchmarkDisplays[i / 2].scale;
+
+        // Each display at a depth of 32 and 16, which packs the blended
+        // pixels after the blend loop
+        ProgressFramebuffer framebuffer;
+        framebuffer.width = kBenchmarkDisplays[i / 2].width;
+        framebuffer.height = kBenchmarkDisplays[i / 2].height;
+        framebuffer.depth = i % 2 ? 16 : 32;
+        framebuffer.rowBytes = framebuffer.width * (framebuffer.depth / 8) +
+                               kBenchmarkRowPadding;
+        framebuffer.base = (uint8_t *) malloc(framebuffer.rowBytes *
+                                              framebuffer.height);
+        if (!framebuffer.base) {
+            return kProgressBenchmarkErrorMemory;
+        }
+
+        // Fill with a gradient, so that the channels of the partially
+        // covered pixels differ
+        for (uint32_t y = 0; y < framebuffer.height; y++) {
+            uint8_t *line = framebuffer.base + y * framebuffer.rowBytes;
+            for (uint32_t x = 0; x < framebuffer.width; x++) {
+                uint32_t pixel = ((x * 255 / framebuffer.width) << 16) |
+                                 ((y * 255 / framebuffer.height) << 8) |
+                                 ((x + y) & 0xff);
+                if (framebuffer.depth == 32) {
+                    ((uint32_t *) line)[x] = pixel;
+                } else {
+                    ((uint16_t *) line)[x] = Pack555(pixel);
+                }
+            }
+        }
+
+        int result = BenchmarkDisplay(&framebuffer,
+                                      &theme,
+                                      kBenchmarkDisplays[i / 2].name,
+                                      iterations,
+                                      stream);
+        if (result != kProgressBenchmarkSuccess) {
+            rc = result;
+        }
+        free(framebuffer.base);
+    }
+    return rc;
+}
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_PROGRESS_H
+#define HIBERNATE_PROGRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A framebuffer in the layout described by hibernate_graphics_t. Pixels are
+ * x1r5g5b5 for a depth of 16 and x8r8g8b8 for a depth of 32. Rows may be
+ * padded, i.e. rowBytes may be larger than width times the pixel size, but
+ * must be a multiple of the pixel size.
+ */
+typedef struct {
+    uint8_t *base;
+    uint32_t rowBytes;
+    uint32_t width;
+    uint32_t height;
+    uint32_t depth;
+} ProgressFramebuffer;
+
+/*
+ * The colors of the progress indicator in x8r8g8b8 and the factor by which the
+ * glyphs are scaled, e.g. 2 for Retina displays. The kernel draws finished
+ * steps in kIOHibernateProgressLightGray and the current step in
+ * kIOHibernateProgressMidGray at a scale of 1.
+ */
+typedef struct {
+    uint32_t doneColor;
+    uint32_t activeColor;
+    uint32_t scale;
+} ProgressTheme;
+
+/* The largest supported theme scale. */
+#define kProgressScaleMax 8
+
+/* Initializes the theme with the colors and scale used by the kernel. */
+void ProgressThemeInit(ProgressTheme *theme);
+
+/*
+ * Composites color over count x8r8g8b8 pixels of in with the per pixel alpha
+ * and stores the result in out. Every channel is computed as
+ * ((255 - alpha) * in + alpha * color) / 255 rounded to the nearest integer.
+ * in and out may be the same buffer.
+ */
+typedef void (*ProgressBlendFunction)(uint32_t *out,
+                                      const uint32_t *in,
+                                      const uint8_t *alpha,
+                                      uint32_t color,
+                                      size_t count);
+
+/* The portable blend loop all other implementations are checked against. */
+#define kProgressBlendScalar 0
+/* 4 pixels per iteration using SSE2. */
+#define kProgressBlendSSE2 1
+/* 8 pixels per iteration using AVX2. */
+#define kProgressBlendAVX2 2
+/* 4 pixels per iteration using NEON. */
+#define kProgressBlendNEON 3
+/* The number of blend implementations. */
+#define kProgressBlendCount 4
+
+/* Returns the name of the blend implementation. */
+const char *ProgressBlendName(int implementation);
+
+/*
+ * Returns the blend implementation or NULL if it has not been compiled in or is
+ * not supported by the processor.
+ */
+ProgressBlendFunction ProgressBlendGet(int implementation);
+
+/* Returns the fastest blend implementation supported by the processor. */
+ProgressBlendFunction ProgressBlendGetBest(void);
+
+/*
+ * The pixels underneath the progress indicator, captured before the indicator
+ * is drawn for the first time. The pixels are stored as x8r8g8b8 regardless of
+ * the framebuffer depth, like progressSaveUnder in hibernate_graphics_t stores
+ * the pixels underneath the edges of the glyphs.
+ */
+typedef struct {
+    uint32_t *pixels;
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+    uint32_t height;
+} ProgressSaveUnder;
+
+/* The pixels have been captured successfully. */
+#define kProgressCaptureSuccess 0
+/* The framebuffer depth is neither 16 nor 32. */
+#define kProgressCaptureErrorDepth 1
+/*
+ * The scale is out of range or the scaled progress indicator does not fit into
+ * the framebuffer.
+ */
+#define kProgressCaptureErrorSize 2
+/* The save-under buffer could not be allocated. */
+#define kProgressCaptureErrorMemory 3
+
+/*
+ * Captures the pixels underneath the progress indicator. The indicator is
+ * placed like the kernel places it, centered horizontally and
+ * kIOHibernateProgressOriginY above the bottom, both multiplied by the theme
+ * scale. The buffer must be released with ProgressSaveUnderRelease.
+ */
+int ProgressSaveUnderCapture(ProgressSaveUnder *saveUnder,
+                             const ProgressFramebuffer *framebuffer,
+                             const ProgressTheme *theme);
+
+/* Releases the buffer allocated by ProgressSaveUnderCapture. */
+void ProgressSaveUnderRelease(ProgressSaveUnder *saveUnder);
+
+/*
+ * Draws the steps firstBlob to select of the progress indicator over the
+ * captured pixels, like ProgressUpdate in the hibernation restore code. Steps
+ * before select are drawn in doneColor and step select in activeColor.
+ */
+void ProgressRender(ProgressFramebuffer *framebuffer,
+                    const ProgressSaveUnder *saveUnder,
+                    const ProgressTheme *theme,
+                    int firstBlob,
+                    int select,
+                    ProgressBlendFunction blend);
+
+/* The benchmark has completed and all implementations match the reference. */
+#define kProgressBenchmarkSuccess 0
+/* An implementation produced pixels different from the scalar reference. */
+#define kProgressBenchmarkErrorMismatch 1
+/* The framebuffers could not be allocated. */
+#define kProgressBenchmarkErrorMemory 2
+
+/*
+ * Draws all steps of the progress indicator on 5K and 6K framebuffers of a
+ * depth of 32 and 16 with every supported blend implementation, checks the
+ * pixels against the scalar reference and prints the time per frame.
+ */
+int ProgressBenchmark(unsigned iterations, FILE *stream);
+
+#endif /* HIBERNATE_PROGRESS_H */
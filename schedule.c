@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "schedule.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CoreFoundation/CFNumber.h>
+#include <CoreFoundation/CFString.h>
+
+#include <IOKit/IOReturn.h>
+#include <IOKit/pwr_mgt/IOPMLib.h>
+
+#include "IOPMLibPrivate.h"
+
+/* The name hibernate schedules power events with. */
+#define kScheduleAppName "hibernate"
+
+/* Schedules or cancels a power event of the specified type. */
+static IOReturn SchedulePowerEvent(int schedule,
+                                   CFAbsoluteTime date,
+                                   CFStringRef type) {
+    IOReturn rc;
+
+    CFDateRef eventDate = CFDateCreate(kCFAllocatorDefault, date);
+    if (schedule) {
+        rc = IOPMSchedulePowerEvent(eventDate, CFSTR(kScheduleAppName), type);
+    } else {
+        rc = IOPMCancelScheduledPowerEvent(eventDate,
+                                           CFSTR(kScheduleAppName),
+                                           type);
+    }
+    CFRelease(eventDate);
+
+    return rc;
+}
+
+/* Maps the result of scheduling a power event to a kScheduleWake code. */
+static int ScheduleWakeResult(IOReturn rc) {
+    switch (rc) {
+        case kIOReturnSuccess:
+            return kScheduleWakeSuccess;
+        case kIOReturnNotPrivileged:
+            return kScheduleWakeErrorNotPrivileged;
+        default:
+            return kScheduleWakeError;
+    }
+}
+
+int ScheduleWakeAt(ScheduledWake *wake, CFAbsoluteTime date) {
+    IOReturn rc = SchedulePowerEvent(1, date, CFSTR(kIOPMAutoWake));
+
+    if (rc == kIOReturnSuccess) {
+        wake->type = kWakeAbsolute;
+        wake->date = date;
+    }
+    return ScheduleWakeResult(rc);
+}
+
+int ScheduleWakeAfter(ScheduledWake *wake, CFTimeInterval interval) {
+    // The date is interpreted relative to the time the system has completed
+    // going to sleep, which excludes the time spent writing the image
+    CFAbsoluteTime date = CFAbsoluteTimeGetCurrent() + interval;
+    IOReturn rc = SchedulePowerEvent(1,
+                                     date,
+                                     CFSTR(kIOPMAutoWakeRelativeSeconds));
+
+    if (rc == kIOReturnSuccess) {
+        wake->type = kWakeRelative;
+        wake->date = date;
+    }
+    return ScheduleWakeResult(rc);
+}
+
+void CancelWake(ScheduledWake *wake) {
+    switch (wake->type) {
+        case kWakeAbsolute:
+            // Wakes in the past have already fired or been discarded
+            if (wake->date > CFAbsoluteTimeGetCurrent()) {
+                SchedulePowerEvent(0, wake->date, CFSTR(kIOPMAutoWake));
+            }
+            break;
+        case kWakeRelative:
+            SchedulePowerEvent(0,
+                               wake->date,
+                               CFSTR(kIOPMAutoWakeRelativeSeconds));
+            break;
+    }
+    wake->type = kWakeNone;
+}
+
+/*
+ * Returns the integer stored for the key in the dictionary or -1 if there is
+ * no such number.
+ */
+static int GetInt(CFDictionaryRef dictionary, const char *key) {
+    CFStringRef name = CFStringCreateWithCString(kCFAllocatorDefault,
+                                                 key,
+                                                 kCFStringEncodingUTF8);
+    CFTypeRef value = CFDictionaryGetValue(dictionary, name);
+    CFRelease(name);
+
+    int number = -1;
+    if (value && CFGetTypeID(value) == CFNumberGetTypeID()) {
+        CFNumberGetValue((CFNumberRef) value, kCFNumberIntType, &number);
+    }
+    return number;
+}
+
+/* Returns the repeating event of the specified kind or NULL. */
+static CFDictionaryRef GetRepeatingEvent(CFDictionaryRef events,
+                                         CFStringRef kind) {
+    CFTypeRef event = CFDictionaryGetValue(events, kind);
+
+    if (!event || CFGetTypeID(event) != CFDictionaryGetTypeID()) {
+        return NULL;
+    }
+    return (CFDictionaryRef) event;
+}
+
+int WeeklyScheduleCopySystem(WeeklySchedule *schedule) {
+    int rc = kWeeklyScheduleErrorSystem;
+
+    CFDictionaryRef events = IOPMCopyRepeatingPowerEvents();
+    if (!events) {
+        return rc;
+    }
+
+    // Adopt the repeating sleep and the subsequent repeating wake
+    CFDictionaryRef off = GetRepeatingEvent(events,
+                                            CFSTR(kIOPMRepeatingPowerOffKey));
+    CFDictionaryRef on = GetRepeatingEvent(events,
+                                           CFSTR(kIOPMRepeatingPowerOnKey));
+    if (off && on) {
+        CFTypeRef type = CFDictionaryGetValue(off,
+                                              CFSTR(kIOPMPowerEventTypeKey));
+        memset(schedule, 0, sizeof(*schedule));
+        schedule->sleepDays = GetInt(off, kIOPMDaysOfWeekKey);
+        schedule->sleepMinute = GetInt(off, kIOPMPowerEventTimeKey);
+        schedule->wakeMinute = GetInt(on, kIOPMPowerEventTimeKey);
+
+        if (type && CFEqual(type, CFSTR(kIOPMAutoSleep)) &&
+            schedule->sleepDays > 0 &&
+            schedule->sleepMinute >= 0 &&
+            schedule->sleepMinute < kMinutesPerDay &&
+            schedule->wakeMinute >= 0 &&
+            schedule->wakeMinute < kMinutesPerDay &&
+            schedule->sleepMinute != schedule->wakeMinute) {
+            schedule->sleepDays &= kAllDays;
+            WeeklyScheduleCompile(schedule);
+            rc = kWeeklyScheduleSuccess;
+        }
+    }
+    CFRelease(events);
+
+    return rc;
+}
+
+/* Creates a CFNumber for an int. */
+static CFNumberRef CreateInt(int value) {
+    return CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &value);
+}
+
+int RepeatingEventsAlter(const WeeklySchedule *schedule,
+                         CFDictionaryRef *originalEvents) {
+    IOReturn rc;
+
+    CFDictionaryRef events = IOPMCopyRepeatingPowerEvents();
+    if (!events) {
+        return kRepeatingEventsError;
+    }
+
+    // Create repeating wake at the end of each window
+    CFMutableDictionaryRef wake =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      0,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(wake,
+                         CFSTR(kIOPMPowerEventTypeKey),
+                         CFSTR(kIOPMAutoWake));
+    CFNumberRef value = CreateInt(schedule->wakeDays);
+    CFDictionarySetValue(wake, CFSTR(kIOPMDaysOfWeekKey), value);
+    CFRelease(value);
+    value = CreateInt(schedule->wakeMinute);
+    CFDictionarySetValue(wake, CFSTR(kIOPMPowerEventTimeKey), value);
+    CFRelease(value);
+
+    CFMutableDictionaryRef alteredEvents =
+            CFDictionaryCreateMutable(kCFAllocatorDefault,
+                                      0,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+    CFDictionarySetValue(alteredEvents,
+                         CFSTR(kIOPMRepeatingPowerOnKey),
+                         wake);
+    CFRelease(wake);
+
+    // Remove repeating sleep, which would bypass hibernation, and install the
+    // repeating wake
+    rc = IOPMCancelAllRepeatingPowerEvents();
+    if (rc == kIOReturnSuccess) {
+        rc = IOPMScheduleRepeatingPowerEvent(alteredEvents);
+        if (rc != kIOReturnSuccess) {
+            RepeatingEventsRestore(events);
+        }
+    }
+    CFRelease(alteredEvents);
+
+    switch (rc) {
+        case kIOReturnSuccess:
+            *originalEvents = events;
+            return kRepeatingEventsSuccess;
+        case kIOReturnNotPrivileged:
+            CFRelease(events);
+            return kRepeatingEventsErrorNotPrivileged;
+        default:
+            CFRelease(events);
+            return kRepeatingEventsError;
+    }
+}
+
+int RepeatingEventsRestore(CFDictionaryRef originalEvents) {
+    if (IOPMCancelAllRepeatingPowerEvents() != kIOReturnSuccess) {
+        return kRepeatingEventsError;
+    }
+    if (CFDictionaryGetCount(originalEvents) > 0 &&
+        IOPMScheduleRepeatingPowerEvent(originalEvents) != kIOReturnSuccess) {
+        return kRepeatingEventsError;
+    }
+    return kRepeatingEventsSuccess;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_SCHEDULE_H
+#define HIBERNATE_SCHEDULE_H
+
+#include <CoreFoundation/CFBase.h>
+#include <CoreFoundation/CFDictionary.h>
+
+#include "calendar.h"
+
+/* No wake has been scheduled. */
+#define kWakeNone 0
+/* The wake has been scheduled for an absolute date. */
+#define kWakeAbsolute 1
+/* The wake has been scheduled relative to the time the system sleeps. */
+#define kWakeRelative 2
+
+/* A wake from system sleep scheduled with the power management. */
+typedef struct {
+    int type;
+    /*
+     * The date passed to the power management. For relative wakes this is the
+     * interval added to the time the wake has been scheduled.
+     */
+    CFAbsoluteTime date;
+} ScheduledWake;
+
+/* The wake has been scheduled successfully. */
+#define kScheduleWakeSuccess 0
+/* Scheduling the wake requires root privileges. */
+#define kScheduleWakeErrorNotPrivileged 1
+/* The power management refused to schedule the wake. */
+#define kScheduleWakeError 2
+
+/* Schedules a wake from system sleep at the specified date. */
+int ScheduleWakeAt(ScheduledWake *wake, CFAbsoluteTime date);
+
+/*
+ * Schedules a wake from system sleep the specified interval after the system
+ * has completed going to sleep.
+ */
+int ScheduleWakeAfter(ScheduledWake *wake, CFTimeInterval interval);
+
+/*
+ * Cancels a previously scheduled wake. Wakes that are no longer pending are
+ * ignored.
+ */
+void CancelWake(ScheduledWake *wake);
+
+/*
+ * Adopts the repeating sleep and wake events configured in the system, e.g. in
+ * the Energy Saver preferences.
+ */
+int WeeklyScheduleCopySystem(WeeklySchedule *schedule);
+
+/* The repeating power events have been replaced successfully. */
+#define kRepeatingEventsSuccess 0
+/* Modifying repeating power events requires root privileges. */
+#define kRepeatingEventsErrorNotPrivileged 1
+/* Getting or setting the repeating power events failed. */
+#define kRepeatingEventsError 2
+
+/*
+ * Replaces the repeating power events of the system by a repeating wake at the
+ * end of each window. Repeating sleep events are removed as they would put the
+ * system to sleep without hibernation. The previous events are returned and
+ * must be passed to RepeatingEventsRestore.
+ */
+int RepeatingEventsAlter(const WeeklySchedule *schedule,
+                         CFDictionaryRef *originalEvents);
+
+/* Restores the repeating power events replaced by RepeatingEventsAlter. */
+int RepeatingEventsRestore(CFDictionaryRef originalEvents);
+
+#endif /* HIBERNATE_SCHEDULE_H */
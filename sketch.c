@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sketch.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void SketchInit(Sketch *sketch) {
+    memset(sketch, 0, sizeof(*sketch));
+    sketch->min = INFINITY;
+    sketch->max = -INFINITY;
+}
+
+/*
+ * The scale function of the t-digest. It maps a quantile to k between
+ * -compression / 4 and compression / 4. A centroid spans at most one unit of
+ * k, which limits the size of centroids near the tails.
+ */
+static double ScaleK(double q) {
+    return kSketchCompression / (2 * M_PI) * asin(2 * q - 1);
+}
+
+/* The inverse of ScaleK. */
+static double ScaleQ(double k) {
+    if (k >= kSketchCompression / 4.0) {
+        return 1;
+    }
+    return (sin(k * 2 * M_PI / kSketchCompression) + 1) / 2;
+}
+
+static int CompareCentroids(const void *a, const void *b) {
+    double x = ((const SketchCentroid *) a)->mean;
+    double y = ((const SketchCentroid *) b)->mean;
+    return (x > y) - (x < y);
+}
+
+/* Merges the buffered values into the centroids. */
+static void SketchMerge(Sketch *sketch) {
+    SketchCentroid merged[kSketchCapacity + kSketchBufferSize];
+    uint32_t count = sketch->count;
+    double total = 0;
+
+    if (sketch->buffered == 0) {
+        return;
+    }
+    memcpy(merged, sketch->centroids, count * sizeof(SketchCentroid));
+    for (uint32_t i = 0; i < sketch->buffered; i++) {
+        merged[count].mean = sketch->buffer[i];
+        merged[count].weight = 1;
+        count++;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        total += merged[i].weight;
+    }
+    qsort(merged, count, sizeof(SketchCentroid), CompareCentroids);
+
+    // Each centroid grows until it would span more than one unit of k
+    SketchCentroid *out = sketch->centroids;
+    uint32_t n = 0;
+    double weightBefore = 0;
+    double weightLimit = total * ScaleQ(ScaleK(0) + 1);
+    out[0] = merged[0];
+    for (uint32_t i = 1; i < count; i++) {
+        double weight = out[n].weight + merged[i].weight;
+        if (weightBefore + weight <= weightLimit ||
+            n + 1 == kSketchCapacity) {
+            out[n].mean += (merged[i].mean - out[n].mean) *
+                           merged[i].weight / weight;
+            out[n].weight = weight;
+        } else {
+            weightBefore += out[n].weight;
+            weightLimit = total * ScaleQ(ScaleK(weightBefore / total) + 1);
+            out[++n] = merged[i];
+        }
+    }
+    sketch->count = n + 1;
+    sketch->buffered = 0;
+}
+
+void SketchAdd(Sketch *sketch, double value) {
+    if (sketch->buffered == kSketchBufferSize) {
+        SketchMerge(sketch);
+    }
+    sketch->buffer[sketch->buffered++] = value;
+    sketch->total++;
+    sketch->sum += value;
+    if (value < sketch->min) {
+        sketch->min = value;
+    }
+    if (value > sketch->max) {
+        sketch->max = value;
+    }
+}
+
+double SketchQuantile(Sketch *sketch, double q) {
+    SketchMerge(sketch);
+    if (sketch->count == 0) {
+        return 0;
+    }
+
+    // Interpolate between the centers of the centroids, and between the
+    // extremes and the first and last center
+    const SketchCentroid *c = sketch->centroids;
+    uint32_t n = sketch->count;
+    double index = q * sketch->total;
+    if (index <= c[0].weight / 2) {
+        return sketch->min + (c[0].mean - sketch->min) *
+                             index / (c[0].weight / 2);
+    }
+    double cumulative = c[0].weight / 2;
+    for (uint32_t i = 0; i + 1 < n; i++) {
+        double step = (c[i].weight + c[i + 1].weight) / 2;
+        if (cumulative + step > index) {
+            return c[i].mean + (c[i + 1].mean - c[i].mean) *
+                               (index - cumulative) / step;
+        }
+        cumulative += step;
+    }
+    double rest = c[n - 1].weight / 2;
+    if (rest <= 0 || index >= cumulative + rest) {
+        return sketch->max;
+    }
+    return c[n - 1].mean + (sketch->max - c[n - 1].mean) *
+                           (index - cumulative) / rest;
+}
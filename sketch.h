@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_SKETCH_H
+#define HIBERNATE_SKETCH_H
+
+#include <stdint.h>
+
+/*
+ * The compression of a sketch. A sketch keeps at most kSketchCompression + 1
+ * centroids, the error of a quantile q is about q * (1 - q) / compression. The
+ * centroids around p99 hold less than 0.5% of the values each, so that a value
+ * shared by most cycles is not blurred into the rare outliers after it.
+ */
+#define kSketchCompression 200
+/* The number of centroids a sketch can hold. */
+#define kSketchCapacity (kSketchCompression + 2)
+/* The number of values buffered before they are merged into the centroids. */
+#define kSketchBufferSize 64
+
+/* A cluster of values represented by their mean. */
+typedef struct {
+    double mean;
+    double weight;
+} SketchCentroid;
+
+/*
+ * A merging t-digest, a summary of a stream of values of constant size that
+ * answers quantile queries. Centroids are small near the minimum and the
+ * maximum, so that tail quantiles like p99 are accurate.
+ */
+typedef struct {
+    SketchCentroid centroids[kSketchCapacity];
+    uint32_t count;
+    double buffer[kSketchBufferSize];
+    uint32_t buffered;
+    /* The number of values added. */
+    uint64_t total;
+    double min;
+    double max;
+    double sum;
+} Sketch;
+
+/* Initializes an empty sketch. */
+void SketchInit(Sketch *sketch);
+
+/* Adds a value to the sketch. */
+void SketchAdd(Sketch *sketch, double value);
+
+/*
+ * Returns the estimated value of quantile q between 0 and 1, or 0 if the sketch
+ * is empty. Merges buffered values, which is why the sketch is not const.
+ */
+double SketchQuantile(Sketch *sketch, double q);
+
+#endif /* HIBERNATE_SKETCH_H */
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "../delta.h"
+#include "../generate.h"
+#include "../image.h"
+
+#include "check.h"
+
+/* Generates and opens a small synthetic image. */
+static void OpenGeneratedImage(HibernateImage *image,
+                               char *path,
+                               uint64_t seed) {
+    GenerateOptions options;
+    GenerateResult result;
+
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    close(fd);
+    GenerateOptionsInit(&options);
+    options.size = 2 << 20;
+    options.previewWidth = 32;
+    options.previewHeight = 20;
+    options.seed = seed;
+    options.threads = 1;
+    CHECK(GenerateImage(path, &options, &result) == kGenerateImageSuccess);
+    CHECK(ImageOpen(image, path) == kImageOpenSuccess);
+}
+
+/* Checks that only the block sizes the buffers can hold are accepted. */
+static void TestBlockSize(void) {
+    char path[] = "/tmp/hibernate-delta.XXXXXX";
+    const uint32_t invalid[] = { 0, 256, 3000, kDeltaMaxBlockSize * 2 };
+    DeltaDevice device;
+
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    close(fd);
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        errno = 0;
+        CHECK(DeltaDeviceOpen(&device, path, invalid[i]) == -1);
+        CHECK(errno == EINVAL);
+    }
+    CHECK(DeltaDeviceOpen(&device, path, kDeltaMaxBlockSize) == 0);
+    DeltaDeviceClose(&device);
+    unlink(path);
+}
+
+/* Writes and verifies a delta in blocks of the largest size. */
+static void TestLargestBlockSize(void) {
+    char previousPath[] = "/tmp/hibernate-delta.XXXXXX";
+    char nextPath[] = "/tmp/hibernate-delta.XXXXXX";
+    char devicePath[] = "/tmp/hibernate-delta.XXXXXX";
+    HibernateImage previous, next;
+    DeltaDevice device;
+    DeltaResult result;
+
+    OpenGeneratedImage(&previous, previousPath, 1);
+    OpenGeneratedImage(&next, nextPath, 2);
+    int fd = mkstemp(devicePath);
+    CHECK(fd != -1);
+    close(fd);
+    CHECK(DeltaDeviceOpen(&device, devicePath, kDeltaMaxBlockSize) == 0);
+    CHECK(DeltaWriteFull(&device, &previous, &result) == kDeltaSuccess);
+    CHECK(DeltaWrite(&device, &previous, &next, &result) == kDeltaSuccess);
+    CHECK(DeltaVerify(&device, &previous, &next) == kDeltaSuccess);
+
+    DeltaDeviceClose(&device);
+    ImageClose(&next);
+    ImageClose(&previous);
+    unlink(devicePath);
+    unlink(nextPath);
+    unlink(previousPath);
+}
+
+int main(void) {
+    TestBlockSize();
+    TestLargestBlockSize();
+    return 0;
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include "../commands.h"
+#include "../entropy.h"
+#include "../generate.h"
+#include "../image.h"
+
+#include "check.h"
+
+/* The pages inside the encrypted range overwritten with text. */
+#define kTextPage 40
+#define kTextPages 3
+/* The pages at the end of the image left out of the encrypted range. */
+#define kUncoveredPages 2
+
+/* The regions reported by EntropyVerify. */
+typedef struct {
+    EntropyRegion regions[8];
+    int count;
+} Regions;
+
+static void AddRegion(const EntropyRegion *region, void *context) {
+    Regions *regions = context;
+
+    CHECK(regions->count < 8);
+    regions->regions[regions->count++] = *region;
+}
+
+/* Writes a value at an offset of the file. */
+static void WriteAt(const char *path,
+                    const void *value,
+                    size_t size,
+                    off_t offset) {
+    int fd = open(path, O_WRONLY);
+    CHECK(fd != -1);
+    CHECK(pwrite(fd, value, size, offset) == (ssize_t) size);
+    CHECK(close(fd) == 0);
+}
+
+/* Sets the encrypted range in the header of the image. */
+static void SetEncryptedRange(const char *path, uint64_t start, uint64_t end) {
+    WriteAt(path,
+            &start,
+            sizeof(start),
+            offsetof(IOHibernateImageHeader, encryptStart));
+    WriteAt(path,
+            &end,
+            sizeof(end),
+            offsetof(IOHibernateImageHeader, encryptEnd));
+}
+
+/* Verifies the image like the verify-encryption command. */
+static int VerifyImage(const char *path,
+                       Regions *regions,
+                       EntropySummary *summary) {
+    memset(regions, 0, sizeof(*regions));
+    return EntropyVerify(path,
+                         kEntropyThresholdDefault,
+                         2,
+                         AddRegion,
+                         regions,
+                         summary);
+}
+
+/* Returns the exit status of the verify-encryption command. */
+static int RunVerifyEncryption(const char *path) {
+    char command[128];
+
+    snprintf(command,
+             sizeof(command),
+             "./hibernate verify-encryption %s >/dev/null 2>&1",
+             path);
+    int status = system(command);
+    CHECK(status != -1 && WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+/*
+ * Checks the regions found in a generated image of random pages, once it has
+ * been patched to claim encryption.
+ */
+static void TestEncryptedRange(void) {
+    char path[] = "/tmp/hibernate-entropy.XXXXXX";
+    GenerateOptions options;
+    GenerateResult result;
+    EntropySummary summary;
+    Regions regions;
+
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    close(fd);
+    GenerateOptionsInit(&options);
+    options.size = 2 << 20;
+    options.zeroRatio = 0;
+    options.duplicateRatio = 0;
+    options.textRatio = 0;
+    options.previewWidth = 32;
+    options.previewHeight = 20;
+    options.seed = 1;
+    options.threads = 1;
+    CHECK(GenerateImage(path, &options, &result) == kGenerateImageSuccess);
+    uint64_t pages = result.imageSize / kImagePageSize;
+
+    // Generated images are not encrypted
+    CHECK(VerifyImage(path, &regions, &summary) ==
+          kEntropyVerifyErrorNotEncrypted);
+    CHECK(RunVerifyEncryption(path) == kMainErrorVerify);
+
+    // The restore code of real images is plaintext, the generated one random
+    uint8_t text[kImagePageSize];
+    for (size_t i = 0; i < sizeof(text); i++) {
+        text[i] = "hibernate "[i % 10];
+    }
+    for (int i = 0; i < kGenerateRestorePages; i++) {
+        WriteAt(path, text, sizeof(text), (off_t) (1 + i) * kImagePageSize);
+    }
+
+    // Find the end of the restore code and the preview, then cover the random
+    // pages after them
+    SetEncryptedRange(path, 0, result.imageSize);
+    CHECK(VerifyImage(path, &regions, &summary) == kEntropyVerifySuccess);
+    uint64_t first = (summary.plaintextEnd + kImagePageSize - 1) /
+                     kImagePageSize;
+    SetEncryptedRange(path, first * kImagePageSize, result.imageSize);
+    CHECK(VerifyImage(path, &regions, &summary) == kEntropyVerifySuccess);
+    CHECK(regions.count == 0);
+    CHECK(summary.pages == pages);
+    CHECK(summary.encryptedPages == pages - first);
+    CHECK(RunVerifyEncryption(path) == kMainSuccess);
+
+    // Text inside the range and pages after its end are reported
+    CHECK(first < kTextPage && kTextPage + kTextPages < pages);
+    for (int i = 0; i < kTextPages; i++) {
+        WriteAt(path,
+                text,
+                sizeof(text),
+                (off_t) (kTextPage + i) * kImagePageSize);
+    }
+    SetEncryptedRange(path,
+                      first * kImagePageSize,
+                      (pages - kUncoveredPages) * kImagePageSize);
+    CHECK(VerifyImage(path, &regions, &summary) == kEntropyVerifySuccess);
+    CHECK(regions.count == 3);
+    CHECK(regions.regions[0].kind == kEntropyRegionUncovered);
+    CHECK(regions.regions[0].firstPage == pages - kUncoveredPages);
+    CHECK(regions.regions[0].pageCount == kUncoveredPages);
+    CHECK(regions.regions[1].kind == kEntropyRegionPlaintext);
+    CHECK(regions.regions[1].firstPage == kTextPage);
+    CHECK(regions.regions[1].pageCount == kTextPages);
+    CHECK(regions.regions[1].maxEntropy < 4);
+    CHECK(regions.regions[2].kind == kEntropyRegionCipherOutside);
+    CHECK(regions.regions[2].firstPage == pages - kUncoveredPages);
+    CHECK(regions.regions[2].pageCount == kUncoveredPages);
+    CHECK(summary.uncoveredPages == kUncoveredPages);
+    CHECK(summary.plaintextPages == kTextPages);
+    CHECK(summary.cipherOutsidePages == kUncoveredPages);
+    CHECK(RunVerifyEncryption(path) == kMainErrorVerify);
+
+    unlink(path);
+}
+
+int main(void) {
+    TestEncryptedRange();
+    return 0;
+}
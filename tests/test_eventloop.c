@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../eventloop.h"
+
+#include "check.h"
+
+/* The order in which callbacks have been invoked. */
+typedef struct {
+    int order[8];
+    int count;
+} Record;
+
+/* The record shared by the callbacks of a test. */
+static Record record;
+
+/* Records the number in the context of the watcher. */
+static void RecordCallback(EventWatcher *watcher, int events, void *context) {
+    (void) watcher;
+    CHECK(events & kEventTimer);
+    CHECK(record.count < 8);
+    record.order[record.count++] = (int) (intptr_t) context;
+}
+
+/* Returns the wall clock date in seconds since 1970. */
+static double Now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Checks that timers expire in the order of their dates. */
+static void TestTimerOrder(void) {
+    EventLoop loop;
+
+    record.count = 0;
+    CHECK(EventLoopInit(&loop) == 0);
+    CHECK(EventLoopAddTimer(&loop, 0.06, 0, RecordCallback, (void *) 4));
+    CHECK(EventLoopAddTimer(&loop, 0.02, 0, RecordCallback, (void *) 1));
+    CHECK(EventLoopAddTimer(&loop,
+                            Now() + 0.04,
+                            kEventTimerAbsolute,
+                            RecordCallback,
+                            (void *) 3));
+    CHECK(EventLoopAddTimer(&loop, 0.03, 0, RecordCallback, (void *) 2));
+
+    // Expired one-shot timers do not keep the loop running
+    CHECK(EventLoopRun(&loop, 2) == kEventLoopIdle);
+    CHECK(record.count == 4);
+    for (int i = 0; i < 4; i++) {
+        CHECK(record.order[i] == i + 1);
+    }
+    EventLoopFree(&loop);
+}
+
+/* Cancels the repeating timer on its third expiration. */
+static void CancelSelfCallback(EventWatcher *watcher,
+                               int events,
+                               void *context) {
+    int *count = context;
+    (void) events;
+
+    if (++*count == 3) {
+        EventWatcherCancel(watcher);
+    }
+}
+
+/* Cancels the other watcher of a batch, which must not be invoked anymore. */
+static void CancelOtherCallback(EventWatcher *watcher,
+                                int events,
+                                void *context) {
+    EventWatcher **other = context;
+    (void) events;
+
+    record.order[record.count++] = watcher == other[0] ? 0 : 1;
+    EventWatcherCancel(watcher == other[0] ? other[1] : other[0]);
+    EventWatcherCancel(watcher);
+}
+
+/* Checks that callbacks can cancel their own and other watchers. */
+static void TestCancelInCallback(void) {
+    EventLoop loop;
+    int count = 0;
+
+    CHECK(EventLoopInit(&loop) == 0);
+    CHECK(EventLoopAddTimer(&loop,
+                            0.005,
+                            kEventTimerRepeat,
+                            CancelSelfCallback,
+                            &count));
+    CHECK(EventLoopRun(&loop, 2) == kEventLoopIdle);
+    CHECK(count == 3);
+
+    // Both timers expire before the loop runs, so they are in one batch
+    EventWatcher *watchers[2];
+    record.count = 0;
+    watchers[0] = EventLoopAddTimer(&loop,
+                                    0.001,
+                                    0,
+                                    CancelOtherCallback,
+                                    watchers);
+    watchers[1] = EventLoopAddTimer(&loop,
+                                    0.001,
+                                    0,
+                                    CancelOtherCallback,
+                                    watchers);
+    CHECK(watchers[0] && watchers[1]);
+    usleep(20000);
+    CHECK(EventLoopRun(&loop, 2) == kEventLoopIdle);
+    CHECK(record.count == 1);
+    EventLoopFree(&loop);
+}
+
+/* Stops the loop once the signal has been received. */
+static void SignalCallback(EventWatcher *watcher, int events, void *context) {
+    int *received = context;
+
+    CHECK(events & kEventSignal);
+    CHECK(watcher->signal == SIGUSR1);
+    ++*received;
+    EventLoopStop(watcher->loop);
+}
+
+/* Checks that a watched signal is delivered to the loop, not the process. */
+static void TestSignal(void) {
+    EventLoop loop;
+    int received = 0;
+    sigset_t mask;
+
+    CHECK(EventLoopInit(&loop) == 0);
+    EventWatcher *watcher =
+            EventLoopAddSignal(&loop, SIGUSR1, SignalCallback, &received);
+    CHECK(watcher != NULL);
+    CHECK(raise(SIGUSR1) == 0);
+    CHECK(EventLoopRun(&loop, 2) == kEventLoopStopped);
+    CHECK(received == 1);
+
+    // The previous disposition is restored
+    EventWatcherCancel(watcher);
+    CHECK(sigprocmask(SIG_BLOCK, NULL, &mask) == 0);
+    CHECK(!sigismember(&mask, SIGUSR1));
+    EventLoopFree(&loop);
+}
+
+int main(void) {
+    TestTimerOrder();
+    TestCancelInCallback();
+    TestSignal();
+    return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+
+#include "../generate.h"
+#include "../image.h"
+#include "../prefetch.h"
+
+#include "check.h"
+
+/* Every how many pages of image2 the trace accesses one. */
+#define kTraceStride 8
+
+/* Generates and opens a small synthetic image. */
+static void OpenGeneratedImage(HibernateImage *image, char *path) {
+    GenerateOptions options;
+    GenerateResult result;
+
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    close(fd);
+    GenerateOptionsInit(&options);
+    options.size = 2 << 20;
+    options.previewWidth = 32;
+    options.previewHeight = 20;
+    options.seed = 1;
+    options.threads = 1;
+    CHECK(GenerateImage(path, &options, &result) == kGenerateImageSuccess);
+    CHECK(ImageOpen(image, path) == kImageOpenSuccess);
+}
+
+/*
+ * Writes a trace that accesses every kTraceStride-th page of image2 and the
+ * last one, in reverse order, to path.
+ */
+static void WriteTrace(const HibernateImage *image, char *path) {
+    ImagePageIterator iterator;
+    ImagePage page;
+    uint32_t last = 0;
+    uint32_t index = 0;
+
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    FILE *file = fdopen(fd, "w");
+    CHECK(file != NULL);
+
+    fprintf(file, "# every %dth page of image2\n", kTraceStride);
+    CHECK(ImagePagesInit(&iterator, image) == kImagePagesSuccess);
+    while (ImagePagesNext(&iterator, &page) == kImagePagesSuccess) {
+        if (page.image2) {
+            if (index++ % kTraceStride == 0) {
+                fprintf(file, "0x%x\n", page.number);
+            }
+            last = page.number;
+        }
+    }
+    CHECK(index > 16 * kTraceStride);
+    fprintf(file, "%u\n", last);
+    CHECK(fclose(file) == 0);
+}
+
+/* Checks that a budget for a part of the trace ends the wait earlier. */
+static void TestPartialBudget(void) {
+    char imagePath[] = "/tmp/hibernate-prefetch.XXXXXX";
+    char tracePath[] = "/tmp/hibernate-prefetch.XXXXXX";
+    HibernateImage image;
+    PrefetchReport full, none, partial;
+
+    OpenGeneratedImage(&image, imagePath);
+    WriteTrace(&image, tracePath);
+
+    CHECK(PrefetchAnalyze(&image, tracePath, 1e9, 1ULL << 40, NULL, &full) ==
+          kPrefetchAnalyzeSuccess);
+    CHECK(full.recommendedPages == full.image2Touched);
+    CHECK(full.recommended.stalls == 0);
+    CHECK(full.recommended.readySeconds < full.current.readySeconds);
+
+    CHECK(PrefetchAnalyze(&image, tracePath, 1e9, 0, NULL, &none) ==
+          kPrefetchAnalyzeSuccess);
+    CHECK(none.recommendedPages == 0);
+    CHECK(none.recommended.readySeconds == none.current.readySeconds);
+
+    // A quarter of the budget the trace needs still saves reading the pages
+    // between the last ones
+    uint64_t budget = full.recommendedBytes / 4;
+    FILE *recommendation = tmpfile();
+    CHECK(recommendation != NULL);
+    CHECK(PrefetchAnalyze(&image,
+                          tracePath,
+                          1e9,
+                          budget,
+                          recommendation,
+                          &partial) == kPrefetchAnalyzeSuccess);
+    CHECK(partial.recommendedPages > 0);
+    CHECK(partial.recommendedPages < partial.image2Touched);
+    CHECK(partial.recommendedBytes <= budget);
+    CHECK(partial.recommended.readySeconds < partial.current.readySeconds);
+    CHECK(partial.recommended.readySeconds > full.recommended.readySeconds);
+
+    // The recommendation lists one page per line
+    char line[32];
+    uint32_t lines = 0;
+    rewind(recommendation);
+    while (fgets(line, sizeof(line), recommendation)) {
+        CHECK(line[0] == '0' && line[1] == 'x');
+        lines++;
+    }
+    CHECK(lines == partial.recommendedPages);
+    fclose(recommendation);
+
+    ImageClose(&image);
+    unlink(tracePath);
+    unlink(imagePath);
+}
+
+int main(void) {
+    TestPartialBudget();
+    return 0;
+}
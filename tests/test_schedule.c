@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "../calendar.h"
+
+#include "check.h"
+
+/* Returns the CFAbsoluteTime of a date in UTC. */
+static CFAbsoluteTime Date(int year, int month, int day, int hour, int min) {
+    struct tm tm = {
+        .tm_year = year - 1900,
+        .tm_mon = month - 1,
+        .tm_mday = day,
+        .tm_hour = hour,
+        .tm_min = min,
+        .tm_isdst = -1
+    };
+    return (CFAbsoluteTime) mktime(&tm) - kCFAbsoluteTimeIntervalSince1970;
+}
+
+static void TestParseWakeInterval(void) {
+    static const char *const kInvalid[] = {
+        "nan", "inf", "-inf", "1e400", "1e306h", "30x", "30m ", "30mm", "-5",
+        "0", "", "h"
+    };
+    CFTimeInterval interval;
+
+    CHECK(ParseWakeInterval("90", &interval) == kParseWakeSuccess);
+    CHECK(interval == 90);
+    CHECK(ParseWakeInterval("1.5s", &interval) == kParseWakeSuccess);
+    CHECK(interval == 1.5);
+    CHECK(ParseWakeInterval("30m", &interval) == kParseWakeSuccess);
+    CHECK(interval == 1800);
+    CHECK(ParseWakeInterval("8h", &interval) == kParseWakeSuccess);
+    CHECK(interval == 8 * 3600);
+
+    for (size_t i = 0; i < sizeof(kInvalid) / sizeof(kInvalid[0]); i++) {
+        interval = -1;
+        CHECK(ParseWakeInterval(kInvalid[i], &interval) ==
+              kParseWakeErrorFormat);
+        CHECK(interval == -1);
+    }
+}
+
+static void TestParseWakeDate(void) {
+    CFAbsoluteTime date;
+
+    CHECK(ParseWakeDate("2099-01-02 03:04", &date) == kParseWakeSuccess);
+    CHECK(date == Date(2099, 1, 2, 3, 4));
+    CHECK(ParseWakeDate("2099-01-02 03:04:05", &date) == kParseWakeSuccess);
+    CHECK(date == Date(2099, 1, 2, 3, 4) + 5);
+    CHECK(ParseWakeDate("2001-01-01 00:00", &date) == kParseWakeErrorPast);
+
+    // A time of day refers to its next occurrence within a day
+    CHECK(ParseWakeDate("00:00", &date) == kParseWakeSuccess);
+    time_t now = time(NULL);
+    CHECK(date + kCFAbsoluteTimeIntervalSince1970 > now);
+    CHECK(date + kCFAbsoluteTimeIntervalSince1970 <= now + 24 * 3600);
+
+    CHECK(ParseWakeDate("25:00", &date) == kParseWakeErrorFormat);
+    CHECK(ParseWakeDate("12:00 pm", &date) == kParseWakeErrorFormat);
+    CHECK(ParseWakeDate("", &date) == kParseWakeErrorFormat);
+}
+
+static void TestWeeklyScheduleParse(void) {
+    WeeklySchedule schedule;
+
+    CHECK(WeeklyScheduleParse("daily 23:00 07:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.sleepDays == kAllDays);
+    CHECK(schedule.sleepMinute == 23 * 60);
+    CHECK(schedule.wakeMinute == 7 * 60);
+
+    CHECK(WeeklyScheduleParse("weekdays 23:00 06:30", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.sleepDays == 0x1f);
+    CHECK(WeeklyScheduleParse("weekends 1:00 9:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.sleepDays == 0x60);
+    CHECK(WeeklyScheduleParse("MTWRFSU 12:00 13:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.sleepDays == kAllDays);
+    CHECK(WeeklyScheduleParse("U 12:00 13:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.sleepDays == kIOPMSunday);
+
+    CHECK(WeeklyScheduleParse("MX 12:00 13:00", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+    CHECK(WeeklyScheduleParse("daily 12:00 12:00", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+    CHECK(WeeklyScheduleParse("daily 24:00 12:00", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+    CHECK(WeeklyScheduleParse("daily 12:00 13:60", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+    CHECK(WeeklyScheduleParse("daily 12:00 13:00 x", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+    CHECK(WeeklyScheduleParse("daily 12:00", &schedule) ==
+          kWeeklyScheduleErrorFormat);
+}
+
+static void TestWeeklyScheduleCompile(void) {
+    WeeklySchedule schedule;
+
+    // Windows past midnight end on the following days
+    CHECK(WeeklyScheduleParse("weekdays 23:00 06:30", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.wakeDays == 0x3e);
+    CHECK(schedule.daysToNextSleep[0] == 1);
+    CHECK(schedule.daysToNextSleep[4] == 3);
+    CHECK(schedule.daysToNextSleep[5] == 2);
+    CHECK(schedule.daysToNextSleep[6] == 1);
+
+    // Sunday wraps to Monday
+    CHECK(WeeklyScheduleParse("U 22:00 07:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.wakeDays == kIOPMMonday);
+    CHECK(schedule.daysToNextSleep[6] == 7);
+    CHECK(schedule.daysToNextSleep[0] == 6);
+
+    CHECK(WeeklyScheduleParse("M 01:00 05:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(schedule.wakeDays == kIOPMMonday);
+}
+
+static void TestWeeklyScheduleNextSleep(void) {
+    WeeklySchedule schedule;
+
+    // 2017-01-30 is a Monday
+    CHECK(WeeklyScheduleParse("weekdays 23:00 06:30", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 1, 30, 22, 0)) ==
+          Date(2017, 1, 30, 23, 0));
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 1, 30, 23, 0)) ==
+          Date(2017, 1, 31, 23, 0));
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 2, 3, 23, 30)) ==
+          Date(2017, 2, 6, 23, 0));
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 2, 4, 12, 0)) ==
+          Date(2017, 2, 6, 23, 0));
+
+    // Week wrap from Sunday to the next Sunday
+    CHECK(WeeklyScheduleParse("U 22:00 07:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 2, 5, 21, 0)) ==
+          Date(2017, 2, 5, 22, 0));
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 2, 5, 23, 0)) ==
+          Date(2017, 2, 12, 22, 0));
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 1, 30, 0, 0)) ==
+          Date(2017, 2, 5, 22, 0));
+
+    // Across the end of the year
+    CHECK(WeeklyScheduleParse("M 01:00 05:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleNextSleep(&schedule, Date(2017, 12, 26, 0, 0)) ==
+          Date(2018, 1, 1, 1, 0));
+}
+
+static void TestWeeklyScheduleWake(void) {
+    WeeklySchedule schedule;
+
+    CHECK(WeeklyScheduleParse("weekdays 23:00 06:30", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleWake(&schedule, Date(2017, 2, 3, 23, 0)) ==
+          Date(2017, 2, 4, 6, 30));
+
+    CHECK(WeeklyScheduleParse("U 22:00 07:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleWake(&schedule, Date(2017, 12, 31, 22, 0)) ==
+          Date(2018, 1, 1, 7, 0));
+
+    CHECK(WeeklyScheduleParse("M 01:00 05:00", &schedule) ==
+          kWeeklyScheduleSuccess);
+    CHECK(WeeklyScheduleWake(&schedule, Date(2017, 1, 30, 1, 0)) ==
+          Date(2017, 1, 30, 5, 0));
+}
+
+int main(void) {
+    // Evaluate schedules independently of the time zone of the system
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    TestParseWakeInterval();
+    TestParseWakeDate();
+    TestWeeklyScheduleParse();
+    TestWeeklyScheduleCompile();
+    TestWeeklyScheduleNextSleep();
+    TestWeeklyScheduleWake();
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../sketch.h"
+
+#include "check.h"
+
+/* The number of values of each distribution. */
+#define kValueCount 100000
+
+/* The quantiles compared with the exact ones. */
+static const double kQuantiles[] = {
+    0.001, 0.01, 0.1, 0.25, 0.5, 0.75, 0.9, 0.99, 0.999
+};
+
+/* Returns a uniform random number in [0, 1) of a xorshift generator. */
+static double Random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return (*state >> 11) / 9007199254740992.0;
+}
+
+static int CompareValues(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Adds the values to a sketch and checks that the rank of each estimated
+ * quantile in the values is within the error bound of the sketch. Sorts the
+ * values.
+ */
+static void CheckQuantiles(double *values, size_t count) {
+    Sketch sketch;
+
+    SketchInit(&sketch);
+    for (size_t i = 0; i < count; i++) {
+        SketchAdd(&sketch, values[i]);
+    }
+    qsort(values, count, sizeof(*values), CompareValues);
+
+    for (size_t i = 0; i < sizeof(kQuantiles) / sizeof(kQuantiles[0]); i++) {
+        double q = kQuantiles[i];
+        double estimate = SketchQuantile(&sketch, q);
+        double error = 0.0005 + 2 * q * (1 - q) / kSketchCompression;
+
+        // A value that occurs several times covers a range of ranks
+        size_t below = 0;
+        while (below < count && values[below] < estimate) {
+            below++;
+        }
+        size_t through = below;
+        while (through < count && values[through] <= estimate) {
+            through++;
+        }
+        CHECK((double) below / count <= q + error);
+        CHECK((double) through / count >= q - error);
+    }
+    CHECK(SketchQuantile(&sketch, 0) == values[0]);
+    CHECK(SketchQuantile(&sketch, 1) == values[count - 1]);
+}
+
+static void TestUniform(double *values) {
+    uint64_t state = 1;
+
+    for (size_t i = 0; i < kValueCount; i++) {
+        values[i] = 1000 * Random(&state);
+    }
+    CheckQuantiles(values, kValueCount);
+}
+
+static void TestExponential(double *values) {
+    uint64_t state = 2;
+
+    for (size_t i = 0; i < kValueCount; i++) {
+        values[i] = -100 * log(1 - Random(&state));
+    }
+    CheckQuantiles(values, kValueCount);
+}
+
+/* Checks a point mass with rare outliers, e.g. a driver that usually idles. */
+static void TestBimodal(double *values) {
+    uint64_t state = 3;
+    Sketch sketch;
+
+    SketchInit(&sketch);
+    for (size_t i = 0; i < kValueCount; i++) {
+        values[i] = Random(&state) < 0.995 ? 10 : 10000;
+        SketchAdd(&sketch, values[i]);
+    }
+    CHECK(SketchQuantile(&sketch, 0.5) == 10);
+    CHECK(SketchQuantile(&sketch, 0.99) == 10);
+    CHECK(SketchQuantile(&sketch, 0.999) == 10000);
+    CheckQuantiles(values, kValueCount);
+}
+
+/* Checks a sketch that has seen fewer values than it can hold. */
+static void TestFewValues(void) {
+    Sketch sketch;
+
+    SketchInit(&sketch);
+    CHECK(SketchQuantile(&sketch, 0.5) == 0);
+    SketchAdd(&sketch, 7);
+    CHECK(SketchQuantile(&sketch, 0.5) == 7);
+    CHECK(SketchQuantile(&sketch, 0.99) == 7);
+}
+
+int main(void) {
+    double *values = malloc(kValueCount * sizeof(*values));
+    CHECK(values != NULL);
+
+    TestUniform(values);
+    TestExponential(values);
+    TestBimodal(values);
+    TestFewValues();
+    free(values);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../trim.h"
+
+#include "check.h"
+
+/* Checks that trimming ends once the free ratio has been reached. */
+static void TestRatioReached(void) {
+    TrimResult result;
+
+    CHECK(TrimMemory(0, 10, &result) == kTrimMemorySuccess);
+    CHECK(result.seconds < 1);
+    CHECK(result.pageSize > 0);
+    CHECK(result.totalPages > 0);
+    CHECK(result.freePagesAfter <= result.totalPages);
+}
+
+/*
+ * Checks that an unreachable free ratio ends trimming once the budget has
+ * passed, with the purge stopped.
+ */
+static void TestBudget(void) {
+    TrimResult result;
+
+    for (int i = 0; i < 2; i++) {
+        CHECK(TrimMemory(101, 0.3, &result) == kTrimMemoryTimedOut);
+        CHECK(result.seconds >= 0.3);
+        CHECK(result.seconds < 0.3 + kTrimPollInterval / 1000.0);
+    }
+}
+
+int main(void) {
+    TestRatioReached();
+    TestBudget();
+    return 0;
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <unistd.h>
+
+#include "../tuner.h"
+
+#include "check.h"
+
+/* The arm with the lowest cost in the simulated cycles. */
+#define kBestArm 13
+
+/* Returns the simulated sleep entry time of an arm in the cycle. */
+static double SimulatedCost(int arm, int cycle) {
+    int distance = arm < kBestArm ? kBestArm - arm : arm - kBestArm;
+    return 10.0 + 2.0 * distance + (cycle % 3) * 0.1;
+}
+
+/* Writes a trace that tries every arm once, then the extra lines, to path. */
+static void WriteTrace(char *path, const char *extra) {
+    int fd = mkstemp(path);
+    CHECK(fd != -1);
+    FILE *file = fdopen(fd, "w");
+    CHECK(file != NULL);
+
+    fprintf(file, "# date free-ratio free-time image-bytes entry-seconds\n");
+    for (int i = 0; i < kTunerArmCount; i++) {
+        fprintf(file,
+                "%d %d %d 0 %.3f\n",
+                1000 + i,
+                kTunerArms[i].freeRatio,
+                kTunerArms[i].freeTime,
+                SimulatedCost(i, 0));
+    }
+    fputs(extra, file);
+    CHECK(fclose(file) == 0);
+}
+
+/* Replays a recorded trace and checks the setting chosen after each cycle. */
+static void TestReplay(void) {
+    char path[] = "/tmp/hibernate-tuner.XXXXXX";
+    WriteTrace(path, "\n1100 20 2000 0 1.000\n");
+
+    Tuner tuner;
+    int line;
+    FILE *replay = tmpfile();
+    CHECK(replay != NULL);
+    TunerInit(&tuner);
+    CHECK(TunerLoad(&tuner, path, replay, &line) == kTunerLoadSuccess);
+    unlink(path);
+    CHECK(tuner.total == kTunerArmCount);
+    CHECK(tuner.ignored == 1);
+
+    // Untried arms come first, in order, then the cheapest
+    char buffer[256];
+    int cycle = 0;
+    rewind(replay);
+    while (fgets(buffer, sizeof(buffer), replay)) {
+        const char *choice = strstr(buffer, "-> ");
+        int freeRatio, freeTime;
+        CHECK(choice != NULL);
+        CHECK(sscanf(choice,
+                     "-> ratio %d%% time %d ms",
+                     &freeRatio,
+                     &freeTime) == 2);
+
+        int expected = cycle + 1 < kTunerArmCount ? cycle + 1 : kBestArm;
+        CHECK(freeRatio == kTunerArms[expected].freeRatio);
+        CHECK(freeTime == kTunerArms[expected].freeTime);
+        cycle++;
+    }
+    fclose(replay);
+    CHECK(cycle == kTunerArmCount + 1);
+    CHECK(TunerChoose(&tuner) == kBestArm);
+}
+
+/* Checks that the line of an invalid observation is reported. */
+static void TestSyntaxError(void) {
+    char path[] = "/tmp/hibernate-tuner.XXXXXX";
+    WriteTrace(path, "1100 70 1000 0 -1\n");
+
+    Tuner tuner;
+    int line;
+    TunerInit(&tuner);
+    CHECK(TunerLoad(&tuner, path, NULL, &line) == kTunerLoadErrorSyntax);
+    unlink(path);
+    CHECK(line == kTunerArmCount + 2);
+
+    CHECK(TunerLoad(&tuner, path, NULL, &line) == kTunerLoadErrorOpen);
+}
+
+/* Runs the tuner on simulated cycles and checks that it settles. */
+static void TestConvergence(void) {
+    uint32_t recent[kTunerArmCount] = { 0 };
+    Tuner tuner;
+
+    TunerInit(&tuner);
+    for (int cycle = 0; cycle < 400; cycle++) {
+        int arm = TunerChoose(&tuner);
+        CHECK(arm >= 0 && arm < kTunerArmCount);
+        if (cycle >= 300) {
+            recent[arm]++;
+        }
+
+        TunerObservation observation;
+        observation.date = cycle;
+        observation.freeRatio = kTunerArms[arm].freeRatio;
+        observation.freeTime = kTunerArms[arm].freeTime;
+        observation.imageBytes = 0;
+        observation.entrySeconds = SimulatedCost(arm, cycle);
+        TunerObserve(&tuner, &observation);
+    }
+
+    // Every arm has been tried and the best one is used most of the time
+    for (int i = 0; i < kTunerArmCount; i++) {
+        CHECK(tuner.arms[i].count > 0);
+        CHECK(i == kBestArm ||
+              tuner.arms[i].count < tuner.arms[kBestArm].count);
+    }
+    CHECK(recent[kBestArm] >= 75);
+}
+
+int main(void) {
+    TestReplay();
+    TestSyntaxError();
+    TestConvergence();
+    return 0;
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "trace.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mach/mach_time.h>
+
+#include <CoreFoundation/CFDate.h>
+
+#include "IOPMLibPrivate.h"
+
+/* The buffer of the calling thread. */
+static __thread TraceBuffer *tBuffer;
+/* The list of all buffers, pushed with compare and swap. */
+static TraceBuffer *gBuffers;
+/* The number of buffers created. */
+static uint32_t gThreads;
+
+/*
+ * The conversion from mach_continuous_time to CFAbsoluteTime, measured once
+ * when the first buffer is created.
+ */
+static double gSecondsPerTick;
+static uint64_t gReferenceTicks;
+static CFAbsoluteTime gReferenceTime;
+static pthread_once_t gClockOnce = PTHREAD_ONCE_INIT;
+
+static void ClockInit(void) {
+    mach_timebase_info_data_t timebase;
+
+    mach_timebase_info(&timebase);
+    gSecondsPerTick = (double) timebase.numer / timebase.denom / 1e9;
+    gReferenceTicks = mach_continuous_time();
+    gReferenceTime = CFAbsoluteTimeGetCurrent();
+}
+
+int TraceThreadInit(void) {
+    if (tBuffer) {
+        return 0;
+    }
+    pthread_once(&gClockOnce, ClockInit);
+
+    TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+    if (!buffer) {
+        return -1;
+    }
+    buffer->thread = __atomic_fetch_add(&gThreads, 1, __ATOMIC_RELAXED);
+    buffer->next = __atomic_load_n(&gBuffers, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&gBuffers,
+                                        &buffer->next,
+                                        buffer,
+                                        1,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+    tBuffer = buffer;
+    return 0;
+}
+
+uint64_t TraceNow(void) {
+    return mach_continuous_time();
+}
+
+/* Appends a record to the buffer of the calling thread. */
+static void TraceAppend(const char *name,
+                        uint64_t start,
+                        uint64_t end,
+                        int64_t value) {
+    TraceBuffer *buffer = tBuffer;
+
+    if (!buffer) {
+        return;
+    }
+    if (buffer->count == kTraceCapacity) {
+        buffer->dropped++;
+        return;
+    }
+    TraceRecord *record = &buffer->records[buffer->count];
+    record->start = start;
+    record->end = end;
+    record->name = name;
+    record->value = value;
+    __atomic_store_n(&buffer->count, buffer->count + 1, __ATOMIC_RELEASE);
+}
+
+void TraceSpan(const char *name, uint64_t start, int64_t value) {
+    TraceAppend(name, start, mach_continuous_time(), value);
+}
+
+void TraceEvent(const char *name, int64_t value) {
+    uint64_t now = mach_continuous_time();
+    TraceAppend(name, now, now, value);
+}
+
+/* The number of messages TracePrint can buffer during a cycle. */
+#define kTraceMessageCapacity 32
+/* The maximum length of a buffered message including the terminating zero. */
+#define kTraceMessageLength 256
+
+/* A message of TracePrint waiting for the UUID of the cycle. */
+typedef struct {
+    FILE *stream;
+    char text[kTraceMessageLength];
+} TraceMessage;
+
+/*
+ * The UUID lines are tagged with, captured once per cycle, and the messages
+ * buffered since TraceCycleBegin.
+ */
+static char gUUID[100] = "-";
+static int gCycle;
+static TraceMessage gMessages[kTraceMessageCapacity];
+static uint32_t gMessageCount;
+static pthread_mutex_t gMessageLock = PTHREAD_MUTEX_INITIALIZER;
+
+void TraceCycleBegin(void) {
+    pthread_mutex_lock(&gMessageLock);
+    snprintf(gUUID, sizeof(gUUID), "-");
+    gCycle = 1;
+    pthread_mutex_unlock(&gMessageLock);
+}
+
+void TraceCaptureUUID(void) {
+    char uuid[sizeof(gUUID)];
+
+    if (!IOPMGetUUID(kIOPMSleepWakeUUID, uuid, sizeof(uuid))) {
+        return;
+    }
+    pthread_mutex_lock(&gMessageLock);
+    memcpy(gUUID, uuid, sizeof(gUUID));
+    pthread_mutex_unlock(&gMessageLock);
+}
+
+void TracePrint(FILE *stream, const char *format, ...) {
+    va_list arguments;
+
+    pthread_mutex_lock(&gMessageLock);
+    va_start(arguments, format);
+    if (gCycle && gMessageCount < kTraceMessageCapacity) {
+        // Keep the message until the UUID of the cycle is known
+        TraceMessage *message = &gMessages[gMessageCount++];
+        message->stream = stream;
+        vsnprintf(message->text, sizeof(message->text), format, arguments);
+    } else {
+        fprintf(stream, "%s ", gUUID);
+        vfprintf(stream, format, arguments);
+    }
+    va_end(arguments);
+    pthread_mutex_unlock(&gMessageLock);
+}
+
+void TracePerror(const char *message) {
+    const char *description = strerror(errno);
+
+    TracePrint(stderr,
+               "%.*s: %s\n",
+               (int) strcspn(message, "\n"),
+               message,
+               description);
+}
+
+void TraceFlush(FILE *stream) {
+    char uuid[sizeof(gUUID)];
+
+    // Print the messages of the cycle, which has ended
+    pthread_mutex_lock(&gMessageLock);
+    memcpy(uuid, gUUID, sizeof(uuid));
+    for (uint32_t i = 0; i < gMessageCount; i++) {
+        const TraceMessage *message = &gMessages[i];
+        size_t length = strlen(message->text);
+        fprintf(message->stream,
+                "%s %s%s",
+                uuid,
+                message->text,
+                length > 0 && message->text[length - 1] == '\n' ? "" : "\n");
+    }
+    gMessageCount = 0;
+    gCycle = 0;
+    pthread_mutex_unlock(&gMessageLock);
+
+    TraceBuffer *buffer = __atomic_load_n(&gBuffers, __ATOMIC_ACQUIRE);
+    for (; buffer; buffer = buffer->next) {
+        uint32_t count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+        for (uint32_t i = 0; i < count; i++) {
+            const TraceRecord *record = &buffer->records[i];
+            double offset = (double) (int64_t) (record->start -
+                                                gReferenceTicks) *
+                            gSecondsPerTick;
+            double time = gReferenceTime + offset +
+                          kCFAbsoluteTimeIntervalSince1970;
+            time_t seconds = (time_t) floor(time);
+
+            char date[32];
+            struct tm tm;
+            localtime_r(&seconds, &tm);
+            strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm);
+            fprintf(stream,
+                    "%s %s.%03d %u %-24s %12.3f ms %lld\n",
+                    uuid,
+                    date,
+                    (int) ((time - seconds) * 1000),
+                    buffer->thread,
+                    record->name,
+                    (record->end - record->start) * gSecondsPerTick * 1e3,
+                    (long long) record->value);
+        }
+        if (buffer->dropped > 0) {
+            fprintf(stream,
+                    "%s thread %u dropped %u records\n",
+                    uuid,
+                    buffer->thread,
+                    buffer->dropped);
+        }
+        __atomic_store_n(&buffer->count, 0, __ATOMIC_RELAXED);
+        buffer->dropped = 0;
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_TRACE_H
+#define HIBERNATE_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The number of records a thread can buffer until the next flush. */
+#define kTraceCapacity 1024
+
+/*
+ * A span of time, or an event if start and end are equal. Times are in
+ * mach_continuous_time units, which keep counting while the system sleeps.
+ */
+typedef struct {
+    uint64_t start;
+    uint64_t end;
+    /* A string literal, the name is not copied. */
+    const char *name;
+    int64_t value;
+} TraceRecord;
+
+/*
+ * The records of one thread. Only the owning thread appends records, so no
+ * locks are needed. Buffers are never freed and linked into a list that
+ * TraceFlush walks.
+ */
+typedef struct TraceBuffer {
+    TraceRecord records[kTraceCapacity];
+    uint32_t count;
+    /* The number of records dropped because the buffer was full. */
+    uint32_t dropped;
+    /* The index of the thread in the order buffers have been created. */
+    uint32_t thread;
+    struct TraceBuffer *next;
+} TraceBuffer;
+
+/*
+ * Allocates the buffer of the calling thread if it has none. Returns 0 on
+ * success and -1 otherwise. Threads without a buffer do not record anything.
+ * After this, recording neither allocates memory nor makes system calls, so
+ * that it can be used on the path to system sleep.
+ */
+int TraceThreadInit(void);
+
+/* Returns the current time in mach_continuous_time units. */
+uint64_t TraceNow(void);
+
+/* Records a span from start until now. */
+void TraceSpan(const char *name, uint64_t start, int64_t value);
+
+/* Records an event at the current time. */
+void TraceEvent(const char *name, int64_t value);
+
+/*
+ * Starts a sleep/wake cycle. Until the next TraceFlush, the messages of
+ * TracePrint are buffered, because the UUID of the cycle is only known once
+ * the system will sleep.
+ */
+void TraceCycleBegin(void);
+
+/*
+ * Captures the sleep/wake UUID of power management for the current cycle. Call
+ * once the system will sleep, as this asks power management.
+ */
+void TraceCaptureUUID(void);
+
+/*
+ * Prints a message tagged with the sleep/wake UUID of the cycle like the lines
+ * of TraceFlush, so that it can be matched with the cycle. During a cycle the
+ * message is printed by TraceFlush, and truncated to 255 characters. Outside
+ * of a cycle it is tagged with the UUID of the last cycle.
+ */
+void TracePrint(FILE *stream, const char *format, ...)
+        __attribute__((format(printf, 2, 3)));
+
+/*
+ * Prints the message up to its first newline and the description of errno to
+ * stderr like perror, tagged like TracePrint.
+ */
+void TracePerror(const char *message);
+
+/*
+ * Prints the messages of the cycle, then writes the records of all threads to
+ * the stream and empties the buffers, and ends the cycle. Every line is tagged
+ * with the sleep/wake UUID captured by TraceCaptureUUID, which identifies the
+ * cycle in the power history and in the system log, or "-" if the system has
+ * not slept. Records carry the local wall clock time. Must not run while
+ * other threads record.
+ */
+void TraceFlush(FILE *stream);
+
+#endif /* HIBERNATE_TRACE_H */
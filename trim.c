@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "trim.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#include <notify.h>
+#include <sys/sysctl.h>
+#endif
+
+#if defined(__APPLE__)
+/*
+ * The levels of kern.memorypressure_manual_trigger, the values of
+ * NOTE_MEMORYSTATUS_PRESSURE_NORMAL and NOTE_MEMORYSTATUS_PRESSURE_WARN.
+ */
+#define kTrimPressureNormal 0x1
+#define kTrimPressureWarn 0x2
+
+/* The tool that purges the file cache. */
+#define kTrimPurgePath "/usr/sbin/purge"
+#else
+/* Frees the page cache as well as dentries and inodes. */
+#define kTrimDropCachesPath "/proc/sys/vm/drop_caches"
+#endif
+
+extern char **environ;
+
+/* Returns the time of the monotonic clock in seconds. */
+static double Now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int TrimCountPages(uint64_t *freePages, uint64_t *totalPages) {
+#if defined(__APPLE__)
+    vm_statistics64_data_t statistics;
+    mach_msg_type_number_t count = HOST_VM_INFO64_COUNT;
+    uint64_t memorySize;
+    size_t length = sizeof(memorySize);
+
+    if (host_statistics64(mach_host_self(),
+                          HOST_VM_INFO64,
+                          (host_info64_t) &statistics,
+                          &count) != KERN_SUCCESS ||
+        sysctlbyname("hw.memsize", &memorySize, &length, NULL, 0) != 0) {
+        return -1;
+    }
+
+    // Speculative pages are read ahead and are freed first
+    *freePages = statistics.free_count + statistics.speculative_count;
+    *totalPages = memorySize / vm_page_size;
+#else
+    long available = sysconf(_SC_AVPHYS_PAGES);
+    long total = sysconf(_SC_PHYS_PAGES);
+    if (available < 0 || total <= 0) {
+        return -1;
+    }
+    *freePages = (uint64_t) available;
+    *totalPages = (uint64_t) total;
+#endif
+    return 0;
+}
+
+/* Asks applications to drop their caches. */
+static void NotifyApplications(void) {
+#if defined(__APPLE__)
+    notify_post(kTrimNotification);
+
+    // Memory pressure reaches every process that uses dispatch memory
+    // pressure sources, including the caches of the system frameworks
+    int level = kTrimPressureWarn;
+    sysctlbyname("kern.memorypressure_manual_trigger",
+                 NULL,
+                 NULL,
+                 &level,
+                 sizeof(level));
+#endif
+}
+
+/* Ends the simulated memory pressure. */
+static void EndMemoryPressure(void) {
+#if defined(__APPLE__)
+    int level = kTrimPressureNormal;
+    sysctlbyname("kern.memorypressure_manual_trigger",
+                 NULL,
+                 NULL,
+                 &level,
+                 sizeof(level));
+#endif
+}
+
+/*
+ * The purge of an earlier trim that was still running when the budget had
+ * passed, or 0. It is reaped by a later trim.
+ */
+static pid_t gAbandonedPurge;
+
+/*
+ * Starts writing dirty pages and freeing the clean pages of the file cache in
+ * a child process. Returns the process ID or -1.
+ */
+static pid_t PurgeFileCacheStart(void) {
+#if defined(__APPLE__)
+    char *argv[] = { kTrimPurgePath, NULL };
+    pid_t pid;
+
+    if (posix_spawn(&pid, kTrimPurgePath, NULL, NULL, argv, environ) != 0) {
+        return -1;
+    }
+    return pid;
+#else
+    pid_t pid = fork();
+    if (pid == 0) {
+        sync();
+        int fd = open(kTrimDropCachesPath, O_WRONLY);
+        _exit(fd != -1 && write(fd, "3", 1) == 1 ? 0 : 1);
+    }
+    return pid;
+#endif
+}
+
+/*
+ * Returns 1 if the purge has ended and sets purged, if not NULL, to whether it
+ * succeeded. Returns 0 if it is still running.
+ */
+static int PurgeFileCacheEnded(pid_t pid, int *purged) {
+    int status;
+
+    pid_t rc = waitpid(pid, &status, WNOHANG);
+    if (rc == 0) {
+        return 0;
+    }
+    if (purged) {
+        *purged = rc == pid && WIFEXITED(status) &&
+                  WEXITSTATUS(status) == 0;
+    }
+    return 1;
+}
+
+int TrimMemory(int freeRatio, double budget, TrimResult *result) {
+    double start = Now();
+
+    result->pageSize = (uint64_t) sysconf(_SC_PAGESIZE);
+    result->purged = 0;
+    if (TrimCountPages(&result->freePagesBefore, &result->totalPages) != 0) {
+        return kTrimMemoryError;
+    }
+    uint64_t freePages = result->freePagesBefore;
+
+    NotifyApplications();
+
+    // Purge alongside waiting, unless the last purge is still running
+    if (gAbandonedPurge > 0 && PurgeFileCacheEnded(gAbandonedPurge, NULL)) {
+        gAbandonedPurge = 0;
+    }
+    pid_t purge = gAbandonedPurge > 0 ? -1 : PurgeFileCacheStart();
+
+    // Wait for the caches to be released
+    int rc;
+    for (;;) {
+        if (purge > 0 && PurgeFileCacheEnded(purge, &result->purged)) {
+            purge = -1;
+        }
+        if (TrimCountPages(&freePages, &result->totalPages) != 0) {
+            rc = kTrimMemoryError;
+            break;
+        }
+        if (freePages * 100 >= result->totalPages * (uint64_t) freeRatio) {
+            rc = kTrimMemorySuccess;
+            break;
+        }
+        double remaining = budget - (Now() - start);
+        if (remaining <= 0) {
+            rc = kTrimMemoryTimedOut;
+            break;
+        }
+        if (remaining > kTrimPollInterval / 1000.0) {
+            remaining = kTrimPollInterval / 1000.0;
+        }
+        usleep((useconds_t) (remaining * 1e6));
+    }
+    EndMemoryPressure();
+
+    // Stop a purge that has not finished, without waiting for it to exit
+    if (purge > 0) {
+        kill(purge, SIGKILL);
+        if (!PurgeFileCacheEnded(purge, NULL)) {
+            gAbandonedPurge = purge;
+        }
+    }
+
+    result->freePagesAfter = freePages;
+    result->seconds = Now() - start;
+    return rc;
+}
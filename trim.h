@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_TRIM_H
+#define HIBERNATE_TRIM_H
+
+#include <stdint.h>
+
+/*
+ * The Darwin notification posted before the file cache is purged. Processes
+ * that hold caches they can rebuild after wake can register for it with
+ * notify_register_dispatch and drop them.
+ */
+#define kTrimNotification "com.github.bfleischer.hibernate.trim"
+
+/* The free page ratio in percent if the preferences do not set one. */
+#define kTrimDefaultFreeRatio 70
+
+/* The interval in milliseconds in which the free pages are counted. */
+#define kTrimPollInterval 100
+
+/* The outcome of trimming memory. */
+typedef struct {
+    uint64_t pageSize;
+    uint64_t totalPages;
+    uint64_t freePagesBefore;
+    uint64_t freePagesAfter;
+    /* The file cache has been purged. */
+    int purged;
+    double seconds;
+} TrimResult;
+
+/* The free page ratio has been reached. */
+#define kTrimMemorySuccess 0
+/* The time budget has expired before the free page ratio was reached. */
+#define kTrimMemoryTimedOut 1
+/* The number of free pages could not be determined. */
+#define kTrimMemoryError 2
+
+/*
+ * Counts the free and the total pages of physical memory. Returns 0 on success
+ * and -1 otherwise.
+ */
+int TrimCountPages(uint64_t *freePages, uint64_t *totalPages);
+
+/*
+ * Shrinks the memory the hibernation image has to hold. Posts
+ * kTrimNotification and simulates memory pressure on macOS, so that
+ * applications and system frameworks drop their caches, starts purging the
+ * file cache in a child process (drop_caches on Linux) and waits until
+ * freeRatio percent of the pages are free or budget seconds have passed since
+ * the start. A purge that is still running then is killed. Requires root
+ * privileges. Returns one of the kTrimMemory codes.
+ */
+int TrimMemory(int freeRatio, double budget, TrimResult *result);
+
+#endif /* HIBERNATE_TRIM_H */
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "tuner.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+const TunerArm kTunerArms[kTunerArmCount] = {
+    { 70, 1000 }, { 70, 3000 }, { 70, 10000 }, { 70, 30000 },
+    { 0, 1000 }, { 0, 3000 }, { 0, 10000 }, { 0, 30000 },
+    { 30, 1000 }, { 30, 3000 }, { 30, 10000 }, { 30, 30000 },
+    { 50, 1000 }, { 50, 3000 }, { 50, 10000 }, { 50, 30000 },
+    { 90, 1000 }, { 90, 3000 }, { 90, 10000 }, { 90, 30000 }
+};
+
+void TunerInit(Tuner *tuner) {
+    memset(tuner, 0, sizeof(*tuner));
+}
+
+double TunerCost(const TunerObservation *observation) {
+    return observation->entrySeconds +
+           (double) observation->imageBytes / kTunerWriteRate;
+}
+
+/* Returns the index of the arm of a setting or -1 if it is not an arm. */
+static int FindArm(int freeRatio, int freeTime) {
+    for (int i = 0; i < kTunerArmCount; i++) {
+        if (kTunerArms[i].freeRatio == freeRatio &&
+            kTunerArms[i].freeTime == freeTime) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void TunerObserve(Tuner *tuner, const TunerObservation *observation) {
+    int arm = FindArm(observation->freeRatio, observation->freeTime);
+    if (arm < 0) {
+        tuner->ignored++;
+        return;
+    }
+
+    double cost = TunerCost(observation);
+    tuner->arms[arm].count++;
+    tuner->arms[arm].costSum += cost;
+    tuner->total++;
+    tuner->costSum += cost;
+}
+
+int TunerChoose(const Tuner *tuner) {
+    for (int i = 0; i < kTunerArmCount; i++) {
+        if (tuner->arms[i].count == 0) {
+            return i;
+        }
+    }
+
+    // The bonus is scaled by the mean cost of all arms, so that it does not
+    // depend on how fast the disk is
+    double scale = kTunerExploration * tuner->costSum / tuner->total;
+    double logTotal = log((double) tuner->total);
+    int best = 0;
+    double bestScore = INFINITY;
+    for (int i = 0; i < kTunerArmCount; i++) {
+        const TunerArmStatistics *arm = &tuner->arms[i];
+        double score = arm->costSum / arm->count -
+                       scale * sqrt(2.0 * logTotal / arm->count);
+        if (score < bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+int TunerLoad(Tuner *tuner, const char *path, FILE *replay, int *errorLine) {
+    char buffer[256];
+    int rc = kTunerLoadSuccess;
+    int line = 0;
+
+    *errorLine = 0;
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return kTunerLoadErrorOpen;
+    }
+
+    while (fgets(buffer, sizeof(buffer), file)) {
+        line++;
+
+        // Skip comments and empty lines
+        char *text = buffer + strspn(buffer, " \t");
+        if (*text == '#' || *text == '\n' || *text == '\0') {
+            continue;
+        }
+
+        TunerObservation observation;
+        char end;
+        if (sscanf(text,
+                   "%" SCNd64 " %d %d %" SCNu64 " %lf %c",
+                   &observation.date,
+                   &observation.freeRatio,
+                   &observation.freeTime,
+                   &observation.imageBytes,
+                   &observation.entrySeconds,
+                   &end) != 5 ||
+            observation.entrySeconds < 0) {
+            rc = kTunerLoadErrorSyntax;
+            *errorLine = line;
+            break;
+        }
+
+        TunerObserve(tuner, &observation);
+        if (replay) {
+            const TunerArm *next = &kTunerArms[TunerChoose(tuner)];
+            fprintf(replay,
+                    "%" PRId64 "  ratio %2d%%  time %5d ms  %6.2f s  "
+                    "-> ratio %2d%%  time %5d ms\n",
+                    observation.date,
+                    observation.freeRatio,
+                    observation.freeTime,
+                    TunerCost(&observation),
+                    next->freeRatio,
+                    next->freeTime);
+        }
+    }
+    fclose(file);
+    return rc;
+}
+
+int TunerAppend(const char *path, const TunerObservation *observation) {
+    FILE *file = fopen(path, "a");
+    if (!file) {
+        return -1;
+    }
+
+    // Start a new trace with a description of the columns
+    if (ftell(file) == 0) {
+        fprintf(file,
+                "# date free-ratio free-time image-bytes entry-seconds\n");
+    }
+    fprintf(file,
+            "%" PRId64 " %d %d %" PRIu64 " %.3f\n",
+            observation->date,
+            observation->freeRatio,
+            observation->freeTime,
+            observation->imageBytes,
+            observation->entrySeconds);
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+void TunerPrint(const Tuner *tuner, FILE *stream) {
+    fprintf(stream, "free ratio  free time  cycles  mean seconds\n");
+    for (int i = 0; i < kTunerArmCount; i++) {
+        const TunerArmStatistics *arm = &tuner->arms[i];
+        fprintf(stream,
+                "%9d%%  %6d ms  %6u",
+                kTunerArms[i].freeRatio,
+                kTunerArms[i].freeTime,
+                arm->count);
+        if (arm->count > 0) {
+            fprintf(stream, "  %12.2f", arm->costSum / arm->count);
+        }
+        fprintf(stream, "\n");
+    }
+    if (tuner->ignored > 0) {
+        fprintf(stream,
+                "%u cycles with other settings ignored\n",
+                tuner->ignored);
+    }
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2011-2017 Benjamin Fleischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HIBERNATE_TUNER_H
+#define HIBERNATE_TUNER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* The file the observations of the tuner are appended to. */
+#define kTunerDefaultPath "/var/db/hibernate.tuning"
+
+/*
+ * The bytes per second assumed for writing the image. The statistics of the
+ * kernel do not include the write duration, so the tuner charges each byte of
+ * the image at this rate.
+ */
+#define kTunerWriteRate 500e6
+
+/*
+ * The weight of the exploration bonus relative to the mean cost. Larger
+ * values try settings with few observations more often.
+ */
+#define kTunerExploration 0.5
+
+/* The number of settings the tuner chooses from. */
+#define kTunerArmCount 20
+
+/*
+ * A setting of Hibernate Free Ratio, the percentage of free pages the kernel
+ * aims for before writing the image, and Hibernate Free Time, the milliseconds
+ * it may spend freeing pages.
+ */
+typedef struct {
+    int freeRatio;
+    int freeTime;
+} TunerArm;
+
+/* The settings the tuner chooses from, the bounds of the search. */
+extern const TunerArm kTunerArms[kTunerArmCount];
+
+/* The measurements of one hibernation. */
+typedef struct {
+    /* The date in seconds since 1970. */
+    int64_t date;
+    int freeRatio;
+    int freeTime;
+    /* The size of the image written, imageSize of hibernate_statistics_t. */
+    uint64_t imageBytes;
+    /*
+     * The seconds from the sleep request until the kernel started writing the
+     * image, which includes freeing pages.
+     */
+    double entrySeconds;
+} TunerObservation;
+
+/* The observations of a setting. */
+typedef struct {
+    uint32_t count;
+    double costSum;
+} TunerArmStatistics;
+
+/*
+ * An upper confidence bound bandit that minimizes the sleep entry time. The
+ * choice only depends on the observations in the order they were made, so a
+ * recorded trace always replays to the same choices.
+ */
+typedef struct {
+    TunerArmStatistics arms[kTunerArmCount];
+    uint32_t total;
+    double costSum;
+    /* The number of observations of settings that are not arms. */
+    uint32_t ignored;
+} Tuner;
+
+/* Initializes a tuner without observations. */
+void TunerInit(Tuner *tuner);
+
+/*
+ * Returns the estimated sleep entry time of an observation in seconds: the
+ * entry time plus the time to write the image at kTunerWriteRate.
+ */
+double TunerCost(const TunerObservation *observation);
+
+/* Adds an observation to the arm of its setting. */
+void TunerObserve(Tuner *tuner, const TunerObservation *observation);
+
+/*
+ * Returns the index of the arm to use for the next hibernation. Arms without
+ * observations are tried first, in the order of kTunerArms. Then the arm with
+ * the lowest mean cost minus exploration bonus is chosen, the lower index on
+ * ties.
+ */
+int TunerChoose(const Tuner *tuner);
+
+/* The trace has been loaded successfully. */
+#define kTunerLoadSuccess 0
+/* The trace could not be opened. */
+#define kTunerLoadErrorOpen 1
+/* A line of the trace is invalid. */
+#define kTunerLoadErrorSyntax 2
+
+/*
+ * Adds the observations of a trace file to the tuner. If replay is not NULL,
+ * prints each observation and the arm chosen after it to replay. Returns one
+ * of the kTunerLoad codes and the number of the invalid line in errorLine.
+ */
+int TunerLoad(Tuner *tuner, const char *path, FILE *replay, int *errorLine);
+
+/*
+ * Appends an observation to a trace file. Returns 0 on success and -1
+ * otherwise.
+ */
+int TunerAppend(const char *path, const TunerObservation *observation);
+
+/* Prints the observations and the mean cost of each arm. */
+void TunerPrint(const Tuner *tuner, FILE *stream);
+
+#endif /* HIBERNATE_TUNER_H */